@@ -0,0 +1,123 @@
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+
+#include "../HapticCube/deformation.h"
+#include "../HapticCube/objloader.h"
+
+using namespace std;
+
+/* Checks the closed-form deformation gain that the deformation worker and
+   MeshBatch apply against the per-tick falloff it replaces: each servo tick
+   moved ring n by ringFalloff(n + 1) times the root's remaining gap.  Returns
+   the number of failures. */
+
+static const char *kGridFile = "deformationtest_grid.obj";
+static const int kGridSize = 16;
+
+static int gFailures = 0;
+
+static void check(bool ok, const char *what, int slices, int steps, double error)
+{
+	if (ok)
+		return;
+	printf("FAIL %s: %d slices, %d steps, error %g\n", what, slices, steps, error);
+	gFailures++;
+}
+
+/* Flat grid of kGridSize^2 vertices, so that the rings of a region in its
+   middle are all populated. */
+static bool writeGrid()
+{
+	FILE *file = fopen(kGridFile, "w");
+	if (!file)
+		return false;
+	for (int y = 0; y < kGridSize; y++)
+		for (int x = 0; x < kGridSize; x++)
+			fprintf(file, "v %d %d 0\n", x, y);
+	for (int y = 0; y + 1 < kGridSize; y++){
+		for (int x = 0; x + 1 < kGridSize; x++){
+			int v = y * kGridSize + x + 1;
+			fprintf(file, "f %d %d %d\n", v, v + 1, v + kGridSize + 1);
+			fprintf(file, "f %d %d %d\n", v, v + kGridSize + 1, v + kGridSize);
+		}
+	}
+	fclose(file);
+	return true;
+}
+
+/* deformationGain against the gaps of explicit ticks. */
+static void checkGains(int slices, int steps)
+{
+	vector<double> moved(slices, 0.0);
+	double gap = 1.0;
+	for (int t = 0; t < steps; t++){
+		for (int n = 0; n < slices; n++)
+			moved[n] += ringFalloff(n + 1, slices) * gap;
+		gap -= ringFalloff(1, slices) * gap;
+	}
+
+	for (int n = 0; n < slices; n++){
+		double error = fabs(deformationGain(n, slices, steps) - moved[n]);
+		check(error < 1e-9, "gain", slices, steps, error);
+	}
+}
+
+/* DeformationBatch::solve over steps ticks at once against the per-tick loop
+   run on a second copy of the mesh. */
+static void checkSolve(int slices, int steps)
+{
+	OBJLoader batched, ticked;
+	batched.load(kGridFile);
+	ticked.load(kGridFile);
+	int root = (kGridSize / 2) * kGridSize + kGridSize / 2;
+	vec3 target = batched.getVertices()[root] + vec3(0.1f, -0.05f, 0.2f);
+
+	DeformationSession session;
+	session.begin(&batched, root, slices);
+	session.setNumSlices(slices);
+	session.setTarget(target);
+	vector<DeformationSession *> sessions(1, &session);
+	DeformationBatch batch;
+	batch.solve(sessions, steps);
+
+	vector<vector<int> > const &rings = session.getRings();
+	for (int t = 0; t < steps; t++){
+		vec3 direction = target - ticked.getVertices()[root];
+		for (int n = 0; n < slices; n++){
+			float scalar = (float) ringFalloff(n + 1, slices);
+			for (int i = 0; i < rings[n].size(); i++){
+				int v = rings[n][i];
+				ticked.deformPoint(v, ticked.getVertices()[v] + direction * scalar);
+			}
+		}
+	}
+
+	double error = 0.0;
+	for (int v = 0; v < ticked.getVertices().size(); v++){
+		vec3 d = batched.getVertices()[v] - ticked.getVertices()[v];
+		error = (std::max)(error, (double) (fabs(d.x) + fabs(d.y) + fabs(d.z)));
+	}
+	check(error < 1e-4, "solve", slices, steps, error);
+}
+
+int main(int argc, char *argv[])
+{
+	static const int stepCounts[] = { 1, 2, 5, 20, 200 };
+	for (int slices = 1; slices <= 9; slices++)
+		for (int s = 0; s < sizeof(stepCounts) / sizeof(stepCounts[0]); s++)
+			checkGains(slices, stepCounts[s]);
+
+	if (!writeGrid()){
+		printf("Could not write %s\n", kGridFile);
+		return 1;
+	}
+	for (int slices = 1; slices <= 9; slices++)
+		for (int s = 0; s < sizeof(stepCounts) / sizeof(stepCounts[0]); s++)
+			checkSolve(slices, stepCounts[s]);
+	remove(kGridFile);
+
+	if (gFailures == 0)
+		printf("All deformation checks passed\n");
+	return gFailures == 0 ? 0 : 1;
+}
@@ -2,6 +2,11 @@
 #include <math.h>
 #include <assert.h>
 #include <cmath>
+#include <mutex>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <cstring>
 
 #if defined(WIN32)
 #include <windows.h>
@@ -16,12 +21,38 @@
 
 
 #include "objloader.h"
+#include "deformation.h"
+#include "periodicworker.h"
+#include "framescheduler.h"
+#include "perfstats.h"
+#include "bitmapfont.h"
+#include "trace.h"
+#include "threadpool.h"
+#include "assetloader.h"
+#include "seqlock.h"
+#include "spscqueue.h"
+#include "offscreencontext.h"
+#include "frametimings.h"
+#include "scenegraph.h"
+#include "meshbvh.h"
+#include "sweepandprune.h"
+#include "heightfield.h"
+#include "distancefield.h"
+#include "compactmesh.h"
+#include "clustermesh.h"
+#include "sharedscene.h"
+#include "toolcontact.h"
+#include "smoothing.h"
+#include "halfedgemesh.h"
+#include "contactcache.h"
+#include "qualitycontroller.h"
+#include "memoryusage.h"
+#include "snapshotpointer.h"
 
 using namespace std;
 
-/* Haptic device and rendering context handles. */
-static HHD ghHD = HD_INVALID_HANDLE;
-static HHLRC ghHLRC = 0;
+/* Per-device interaction state; see HapticDevice below. */
+struct HapticDevice;
 
 /* Shape id for shape we will render haptically. */
 
@@ -33,43 +64,165 @@ static GLuint gCursorDisplayList = 0;
 /* Struct representing one of the shapes in the scene that can be felt, touched and drawn. */
 struct HapticObject
 {
-    HLuint shapeId;
     GLuint displayList;
-    hduMatrix transform;
+    int node;	// index in gSceneGraph
 	float hap_stiffness;
     float hap_damping;
     float hap_static_friction;
     float hap_dynamic_friction;
 
-	bool touched;
+	bool ready;
+	bool rejected;	// did not fit the memory budget
+	bool downgraded;	// fitted only without its compact copy or full field
 
 	OBJLoader loader;
+	MeshBVH bvh;
+	std::shared_ptr<HeightField> texture;
+	std::shared_ptr<DistanceField> field;
+	CompactMesh compact;
+	std::shared_ptr<HalfEdgeMesh> halfEdges;	// built on the pool for the cut brush
+
+	// Shared scene state.  sharedDirty and sharedDirtyTriangles are guarded
+	// by gMeshMutex; the rest belongs to the publisher.
+	vector<int> sharedDirty;
+	vector<int> sharedDirtyTriangles;
+	int sharedVertexCount;
+	int sharedTriangleCount;
+	int sharedRefreshVertex;
+	int sharedRefreshTriangle;
+	hduMatrix sharedWorld;
 };
 
 vector<HapticObject> hapticObjects(0);
 HapticObject pencilCursor; 
 
+/* Scene meshes are parsed on the thread pool and become visible and touchable
+   one by one as they finish, while the window is already drawing. */
+ThreadPool gThreadPool;
+AssetLoader gAssetLoader(gThreadPool);
+const int kPencilAssetId = -1;
+void pollAssetLoads();
+
+/* Narrow-band signed distance field per scene mesh, built on the pool when the
+   mesh arrives and cached next to it as <mesh>.sdf.  Deformation queues the
+   bricks it disturbs; an idle task recomputes them a few at a time. */
+const float kFieldVoxelSize = 1.0f / 64;
+const int kFieldBandVoxels = 3;
+const int kFieldRefreshChunk = 8;
+bool refreshDistanceFieldsTask(void *userdata);
+
+/* Memory budget for the scene meshes and everything derived from them, set
+   with "--memory-budget <MB>".  A mesh that does not fit is rejected; one
+   that fits without its distance field gets a coarser field, or none, and
+   no compact copy.  A breakdown is printed once the startup loads are in
+   and again at exit. */
+int gMemoryBudgetMB = 1024;
+const int kFieldDowngrades = 2;	// coarser fields tried, each at twice the voxel size
+size_t gSceneMemoryBytes = 0;	// at the last admission or report
+bool gMemoryReported = false;
+MemoryUsage measureObjectMemory(HapticObject const &object, std::set<const void *> &counted);
+MemoryUsage measureSceneMemory(std::set<const void *> &counted);
+void admitMesh(int id);
+void printMemoryReport(const char *when);
+
+/* Quantized copies of the scene meshes, toggled with 'q'.  Nearest-vertex
+   scans run over these instead of the float vertices.  Kept in step with
+   deformation by solveDeformation. */
+bool gCompactMeshes = true;
+int findNearestVertex(int index, vec3 pos);
+
+/* Out-of-core mesh opened with "--stream <file.tvoc>" in place of the
+   default scene; "--convert <in.obj> <out.tvoc>" writes such a file.  Full
+   resolution is paged in around the proxy and coarse proxies elsewhere, with
+   the resident clusters held to "--stream-budget <MB>".  Only the clusters
+   near the proxy go into the haptic shape. */
+ClusterMesh gStreamedMesh;
+const char *gStreamFile = 0;
+int gStreamBudgetMB = 256;
+int gStreamedNode = -1;
+const int kStreamIOThreads = 2;
+const int kStreamClusterTriangles = 4096;
+const float kStreamFocusRadius = 0.3f;
+void initStreamedMesh();
+void updateStreamedMesh();
+
+/* Live scene state for external viewers, published with "--share <name>"
+   into a shared memory ring (see sharedscene.h) by a worker of its own.
+   Each frame carries the transforms and proxies that changed and the vertex
+   and triangle spans that deformation touched.  A slice of every mesh is
+   resent in turn so that a viewer that joins late fills in. */
+SharedSceneWriter gSharedScene;
+PeriodicWorker gSharePublisher;
+const char *gShareName = 0;
+const double kShareRateHz = 60.0;
+const size_t kShareRingBytes = 32 << 20;
+const int kShareNewElements = 65536;	// per mesh and frame, for new meshes
+const int kShareRefreshElements = 2048;
+const int kShareRefreshFrames = 60;	// resend unchanged transforms
+const int kShareSpanGap = 8;
+void initSharedScene();
+void publishSharedScene(double dt, void *userdata);
+void publishSharedMesh(int index);
+
+/* Object placement.  Edited and updated on the client thread; the collision
+   and deformation threads read the published snapshots. */
+SceneGraph gSceneGraph;
+
 hduVector3Dd proxyInitialPosition;
 int proxyTouchedPointIndex;
 
-hduVector3Dd proxyPosition, devicePosition,newProxyPosition;
-
-HLdouble proxyxform[16];
-
 //Display list for model
 GLuint objList;
 
 float stiffnessCoefficient = 1.0;
 
-HDSchedulerHandle gCallbackHandle = 0;
-HDboolean bRenderForce = HD_FALSE;
-HLboolean isAnchoredEditing = false;
 HLboolean toggleCursor = false;
 HLboolean isProxyConstrained = false;
-static HDdouble gSpringStiffness = 0.1;
+static HDdouble gSpringStiffness = 0.1;	// N/mm holding a region's root alone
 static HDdouble gMaxStiffness = 1.0;
+static HDdouble gMaxForce = 3.0;
+static HDdouble gCouplingDamping = 0.0005;
+
+/* Local linearized force model the servo loop renders between deformation
+   solves: force(x) = force + stiffness*(position - x) - damping*velocity.
+   The stiffness is the stylus region's: every ring follows the root, so the
+   more of the mesh the region drags along, the stiffer it holds. */
+struct CouplingModel
+{
+	hduVector3Dd position;
+	hduVector3Dd force;
+	double stiffness;
+	double damping;
+	bool active;
+	unsigned int session;	// stylus session it was solved for
+};
 
-bool buttonDown = false;
+/* Control changes reach a servo callback only through its device's command
+   queue, and are applied at the start of a tick, so the 1 kHz loop never
+   reads state another thread is changing and never takes a lock.  A stylus
+   session's first coupling model is built whole by the client thread and
+   handed over with the command that starts it; after that the servo takes
+   the deformation worker's models, but only those solved for that session. */
+enum ServoMode { SERVO_PROXY, SERVO_TOOL, SERVO_CONTACT_CACHE };
+enum ServoCommandType { SERVO_SET_MODE, SERVO_BEGIN_COUPLING, SERVO_END_COUPLING };
+struct ServoCommand
+{
+	ServoCommandType type;
+	ServoMode mode;	// SERVO_SET_MODE
+	CouplingModel coupling;	// SERVO_BEGIN_COUPLING
+};
+const unsigned int kServoQueueSize = 64;
+void sendServoCommand(HapticDevice &device, ServoCommand const &command);
+void sendServoMode();
+ServoMode currentServoMode();
+void applyServoCommands(HapticDevice &device);
+
+/* The mesh update runs on its own thread so that the size of the deformed
+   region never competes with the 1 kHz force deadline. */
+PeriodicWorker gDeformationWorker;
+double gDeformationRateHz = 200.0;
+const double kServoPeriod = 0.001;
+std::mutex gMeshMutex;
 
 hduMatrix initialProxyTransformation;
 hduMatrix currentProxyxform;
@@ -85,15 +238,17 @@ void exitHandler(void);
 void initGL();
 void initOBJModel();
 void initHL();
+void startWorkers();
 void initScene();
 void drawSceneHaptics();
+void drawDeviceHaptics(HapticDevice &device);
 void drawSceneGraphics();
-void drawCursor();
-void updateWorkspace();
-void createHapticObject();
-void updateDragObjTransform();
-void drawConstrainedSpace();
-int getIndexOfObject(int shapeID);
+void drawCursor(HapticDevice &device);
+void updateWorkspace(HapticDevice &device);
+void createHapticObject(int index);
+void updateDragObjTransform(HapticDevice &device);
+void drawConstrainedSpace(HapticDevice const &device);
+int getIndexOfObject(HapticDevice const &device, HLuint shapeID);
 
 void HLCALLBACK buttonDownClientThreadCallback(HLenum event, HLuint object, HLenum thread, HLcache *cache, void *userdata);
 void HLCALLBACK buttonUpClientThreadCallback(HLenum event, HLuint object, HLenum thread, HLcache *cache, void *userdata);
@@ -102,45 +257,331 @@ void HLCALLBACK hlMotionCB(HLenum event, HLuint object, HLenum thread, HLcache *
 void HLCALLBACK hlTouchCB(HLenum event, HLuint object, HLenum thread, HLcache *cache, void * userdata);
 void HLCALLBACK hlUnTouchCB(HLenum event, HLuint object, HLenum thread, HLcache *cache, void *userdata);
 HDCallbackCode HDCALLBACK anchoredSpringForceCallback(void *pUserData);
-
-long int gCurrentDragObj = -1;
-hduMatrix gStartProxyTransform;
-hduMatrix gInitialObjTransform;
+void solveDeformation(double dt, void *userdata);
+CouplingModel couplingModel(HapticDevice const &device, hduVector3Dd const &position);
+
+/* A dragged object, together with everything below it in gSceneGraph, cannot
+   be pushed into other objects: the drag holds the last pose at which the
+   group touched nothing new.  Objects it already touched when picked up may
+   still be touched, so a bowl resting on the plate can be lifted off it, but
+   not sunk into any deeper than it has been since, as measured by their
+   distance fields; once clear of the group they are like any other. */
+bool gObjectCollisions = true;
+SweepAndPrune gBroadPhase;
+const float kRestingSlack = kFieldVoxelSize;	// depth jitter allowed, model units
+void beginDragCollisions(HapticDevice &device, int dragIndex);
+int findDragContacts(HapticDevice &device, int dragIndex, hduMatrix const &dragWorld, bool pickup);
+float sinkDepth(int moving, int other, hduMatrix const &toOther);
+
+/* Haptic texture, toggled with 'x'.  Each scene object gets a tileable height
+   field baked on the thread pool.  An HL callback effect adds the texture
+   force to the HL contact force in the servo loop, sampling the field at the
+   proxy by triplanar projection in model space, since the meshes carry no
+   texture coordinates.  Each device's collision thread publishes the object
+   its proxy touches. */
+struct TextureContact
+{
+	bool touching;
+	const HeightField *texture;
+	int object;	// hapticObjects index, for its voxmap in gToolScene
+	hduMatrix world;
+	hduMatrix inverseWorld;
+};
+bool gHapticTextures = true;
+double gTextureTile = 0.1;		// model units per height field period
+double gTextureDepth = 0.002;	// relief amplitude in model units
+double gTextureGain = 0.6;		// newtons at full height or unit slope
+const double kMaxTextureForce = 1.5;
+const double kTextureFullDepth = 0.01;	// device penetration in model units for full gain
+const int kTextureSize = 256;
+void publishTextureContact(HapticDevice &device, int index);
+void HLCALLBACK computeTextureForceCB(HDdouble force[3], HLcache *cache, void *userdata);
+
+/* Six-degree-of-freedom tool, toggled with '6' or started with "--tool".
+   The pencil is sampled into a point shell when it loads, and each scene
+   object's distance field serves as its voxmap.  Each device's servo callback
+   places the shell at the device pose and renders the force and torque of
+   the shell points inside the scene, in place of HL's point proxy, with a
+   fixed number of voxmap queries per tick.  The client thread publishes the
+   shell, the scene and each device's workspace transform.  The servo and the
+   contact worker read the shell and scene through gSnapshotReaders, so they
+   never wait on the client thread or free a snapshot. */
+struct ToolFrame
+{
+	hduMatrix toolToDevice;	// pencil model to device coordinates, as drawCursor draws it
+	hduMatrix deviceToWorld;
+	hduMatrix worldToDevice;
+	double deviceUnits;	// millimetres per world unit
+	bool active;
+};
+bool gToolRendering = false;
+QuiescentDomain gSnapshotReaders;
+SnapshotPointer<PointShell> gToolShell(gSnapshotReaders);
+SnapshotPointer<ToolContactScene> gToolScene(gSnapshotReaders);	// also for textures and the contact cache
+double gToolStiffness = 0.5;	// N/mm
+double gToolDamping = 0.002;	// N per mm/s, into the surface only
+const int kToolShellPoints = 768;
+const int kToolClusterPoints = 24;
+const int kToolQueriesPerTick = 1024;
+const int kToolFullContacts = 8;	// points in contact for full stiffness
+const double kMaxToolTorque = 100.0;	// mNm
+void publishToolScene();
+void publishToolFrame(HapticDevice &device);
+void renderToolContact(HapticDevice &device, hduVector3Dd const &velocity);
+
+/* Contact cache, toggled with 'l' or started with "--contact-cache".  HL
+   only sees new geometry once per graphics frame, so a slow frame leaves the
+   proxy pressing on stale triangles.  Instead, a worker samples the scene's
+   voxmaps around each device into a small fixed-size distance patch at
+   kContactRateHz, and the servo callback renders a contact plane from the
+   latest one, blending in geometry that changed over the interval it took
+   to arrive.  HL keeps its shapes, at zero stiffness, for touch and button
+   events only. */
+bool gContactCache = false;
+PeriodicWorker gContactWorker;
+int gContactReader = -1;	// slot in gSnapshotReaders
+const double kContactRateHz = 500.0;
+double gContactStiffness = 0.6;	// N/mm
+double gContactDamping = 0.001;	// N per mm/s, into the surface only
+void extractContactPatches(double dt, void *userdata);
+void renderContactCache(HapticDevice &device, hduVector3Dd const &position, hduVector3Dd const &velocity);
 
 hduMatrix penCursorConfig;
 
 long int gCurrentRotObj = -1;
 
-vec3 touchedPoint;
-int touchedPointIndex;
-
-hduVector3Dd initialProxyPosition, initialDevicePosition, anchor, position, newModelPosition;
-int findNearestPoint(vec3 pointPos, vector<vec3> vertices);
-void drawPoint();
-
-hduVector3Dd constrainedProxyPos;
-hduVector3Dd minPoint;
-hduVector3Dd maxPoint;
-
-vector<vec3> mVerticeBuffer;
+int findNearestPoint(vec3 pointPos, OBJLoader const &loader);
+void drawPoint(HapticDevice const &device);
 
 void generate();
 
 int numSlices = 8;
 const int maxNumSlices = 12;
-set<int> immediateNeighbors[maxNumSlices];
-//set<int> immediateNeighbors;
-int rootTransformIndex;
+
+/* Every active anchored region, applied together by gDeformationBatch.  Each
+   device's stylus edit is one of them; all are guarded by gMeshMutex. */
+vector<DeformationSession *> gDeformationSessions;
+DeformationBatch gDeformationBatch;
+void setAnchoredEditing(HapticDevice &device, bool enable);
+void endStylusSession(HapticDevice &device);
+
+/* Local sqrt(3) refinement of stretched or curved triangles inside the
+   active regions; see OBJLoader::refineRegion. */
+bool gAdaptiveRefinement = true;
+float gRefineStretch = 1.5f;
+float gRefineAngle = 0.35f;
+int gRefineBudget = 64;
+const int kRefineInterval = 10;
+void refineDeformationRegions();
+void noteMovedVertices(int index, vector<int> const &vertices);
+void noteEditedTopology(int index, vector<int> const &vertices, vector<int> const &triangles);
+
+/* Smoothing brushes, cycled with 'b': off, Laplacian, Taubin, cut.  With a
+   brush on, holding the button on an object smooths a disc around the proxy
+   instead of picking the object up; '[' and ']' size the disc.  The brush
+   worker copies the disc out under gMeshMutex, iterates on the copy without
+   it and adds the result back, a few iterations per tick, so the stroke
+   shows up as it converges and never holds the mesh for long.
+
+   The cut brush is a scalpel instead: it cuts the surface away along the
+   path of the proxy through the object's HalfEdgeMesh, with a blade a
+   fraction of the brush radius wide.  Each tick costs time in proportion to
+   the stretch of surface cut, not to the mesh.  The half-edge meshes are
+   built on the thread pool when the cut brush is picked, and an object
+   cannot be cut until its own is done. */
+enum BrushMode { BRUSH_OFF, BRUSH_LAPLACIAN, BRUSH_TAUBIN, BRUSH_CUT };
+struct BrushStroke
+{
+	bool active;
+	int object;
+	vec3 center;	// model space
+};
+BrushMode gBrushMode = BRUSH_OFF;
+PeriodicWorker gBrushWorker;
+const double kBrushRateHz = 60.0;
+float gBrushRadius = 0.1f;	// model units along the surface
+float gBrushStrength = 0.5f;
+const int kBrushVertexSteps = 20000;	// vertex updates per worker tick
+const int kBrushMaxIterations = 8;
+const float kBrushRegather = 0.25f;	// of the radius moved before a new disc
+const float kCutWidth = 0.2f;	// blade radius, of the brush radius
+const int kCutMaxSplits = 256;	// edge splits per tick and device
+void updateBrushStroke(HapticDevice &device);
+void smoothBrushes(double dt, void *userdata);
+void cutAlongStroke(HapticDevice &device, BrushStroke const &stroke);
+bool prepareHalfEdges(HapticObject &object);
+
+/* Redraws only when the scene changed, paced to the target rate.  Normal
+   rebuilds run from the scheduler's idle budget between frames. */
+FrameScheduler gFrameScheduler;
+double gTargetFrameRate = 60.0;
+bool rebuildNormalsTask(void *userdata);
+const int kNormalRebuildChunk = 256;
+
+/* Timing counters for the performance overlay toggled with 'h'. */
+PerfStats gPerfStats;
+BitmapFont gInfoFont;
+bool gShowPerfOverlay = false;
+vector<string> gPerfOverlayLines;
+bool gPerfOverlayStale = true;	// a new sample came in since the overlay was built
+void updatePerfOverlay();
+typedef std::chrono::steady_clock PerfClock;
+
+/* Automatic quality, toggled with 'g'.  Every perf sample window the servo
+   and graphics timings are checked against their budgets.  A servo overrun
+   shrinks the deformation region and slows the deformation worker, which
+   competes with the servo thread for the CPU; a slow graphics frame lowers
+   the redraw rate, and with it the share of the client thread spent
+   drawing, as well as the streamed mesh's full-resolution radius, and pauses
+   refinement.  Each change is printed and shown in the overlay. */
+const int kQualityLevels = 5;
+const double kQualityStep = 0.75;	// of the region, rate and radius per level
+const double kQualityWindow = 0.5;	// seconds
+const int kQualityRecoverWindows = 6;
+const double kQualityRecoverLoad = 0.6;
+const double kServoTickBudgetMs = 0.5;	// leaves the rest of the period to HD
+const double kServoGapBudgetMs = 2.0;
+const double kServoMinRate = 950.0;
+const double kMinDeformationRateHz = 50.0;
+const double kMinFrameRate = 20.0;
+bool gAutoQuality = true;
+QualityController gServoQuality(kQualityLevels, kQualityRecoverWindows, kQualityRecoverLoad);
+QualityController gGraphicsQuality(kQualityLevels, kQualityRecoverWindows, kQualityRecoverLoad);
+void updateQuality();
+void applyServoQuality();
+void applyGraphicsQuality();
+int deformationSlices();
+double graphicsFrameRate();
 
 void DisplayInfo(void);
-void DrawBitmapString(GLfloat x, GLfloat y, void *font, char *format,...);
-double getYVal(void);
+void DrawBitmapString(GLfloat x, GLfloat y, const BitmapFont &font, const char *format,...);
+
+/* One haptic device and everything it is doing.  Each device has its own HL
+   context, servo callback, contact state, drag and stylus session, so several
+   operators can grab, touch and sculpt at once.  The servo callback only
+   reads its own device's seqlocks; the deformation worker merges every
+   device's session into one batched solve.  Devices without an HD handle are
+   stand-ins whose positions the benchmark script sets. */
+struct HapticDevice
+{
+	const char *name;	// HD configuration name, HD_DEFAULT_DEVICE for the default
+	HHD hHD;
+	HHLRC hHLRC;
+	HDSchedulerHandle callbackHandle;
+	HDdouble maxForce;
+	HDdouble maxStiffness;	// N/mm the device renders stably
+	HLuint textureEffect;
+	HLuint streamedShapeId;
+	vector<HLuint> shapeIds;	// per scene object, in this device's context
+
+	// Client thread.
+	hduVector3Dd proxyPosition;
+	hduVector3Dd devicePosition;
+	HLdouble proxyxform[16];
+	hduMatrix scriptedProxyTransform;
+	hduVector3Dd lastDrawnProxyPosition;
+	hduVector3Dd minPoint;	// constrained workspace box
+	hduVector3Dd maxPoint;
+	int dragIndex;	// scene object held, or -1; written under gMeshMutex
+	hduMatrix startProxyTransform;
+	hduMatrix initialObjTransform;
+	vector<char> dragGroup;
+	vector<char> restingContacts;	// touched at pickup and not left since
+	vector<float> restingDepth;	// least sink depth since pickup, or -1
+	bool anchoredEditing;
+	SeqLock<hduMatrix> proxyPose;	// cursor transform for the shared scene
+	hduMatrix sharedPose;	// last one published
+
+	// Stylus edit; the session, its id, renderForce and newProxyPosition are
+	// guarded by gMeshMutex.  renderForce mirrors what was last sent to the
+	// servo.
+	HDboolean renderForce;
+	DeformationSession *session;
+	unsigned int couplingSession;
+	hduVector3Dd initialProxyPosition;
+	hduVector3Dd initialDevicePosition;
+	hduVector3Dd anchor;
+	hduVector3Dd newProxyPosition;
+
+	// Collision thread.
+	int touchedIndex;	// scene object the proxy rests on, or -1
+	int touchedPointIndex;
+	vec3 touchedPoint;
+	SeqLock<TextureContact> textureContact;
+
+	// Servo thread.  Only the servo pops commands; servoMode and
+	// servoCoupling are its own copies of the control state.
+	SpscQueue<ServoCommand, kServoQueueSize> commands;
+	ServoMode servoMode;
+	CouplingModel servoCoupling;
+	std::atomic<bool> forceFault;	// set on a force error, taken by the client thread
+	SeqLock<hduVector3Dd> servoPosition;
+	SeqLock<CouplingModel> coupling;	// written by the deformation worker
+	PerfClock::time_point lastTick;
+	int snapshotReader;	// slot in gSnapshotReaders, or -1
+
+	// Six-degree-of-freedom tool; toolFrame is written by the client thread.
+	int outputDOF;
+	SeqLock<ToolFrame> toolFrame;
+	ToolContact toolContact;
+	SeqLock<ToolContact::Result> toolResult;
+
+	// Contact cache; the sampler belongs to the contact worker, the
+	// renderer to the servo thread.
+	ContactSampler contactSampler;
+	SeqLock<ContactPatch> contactPatch;
+	ContactRenderer contactRenderer;
+
+	// Smoothing brush.  brushIndex belongs to the client thread, which
+	// publishes the stroke; the rest belongs to the brush worker.
+	int brushIndex;	// object being brushed, or -1
+	SeqLock<BrushStroke> brushStroke;
+	SmoothingBrush brush;
+	int brushObject;	// object the disc was gathered on or last cut, or -1
+	vec3 brushCenter;	// where, in its model space
+	int brushVertexCount;
+};
+vector<HapticDevice *> gDevices;
+vector<const char *> gDeviceNames;	// from "--device <name>"; empty for the default device
+HapticDevice *createDevice(const char *name);
+void initDevice(HapticDevice &device);
+
+/* Offscreen benchmark, started with "--benchmark <frames>".  Draws the scene
+   into an offscreen surface without a window or haptic device, moving the
+   camera and a stand-in device per operator along scripted paths, and reports
+   per-frame times. */
+struct BenchmarkOptions
+{
+	int frames;
+	int warmupFrames;
+	int width;
+	int height;
+	const char *meshFile;
+	int copies;
+	const char *dumpPrefix;
+	int dumpEvery;
+	int operators;
+	bool sculpt;
+};
+bool gHeadless = false;
+double gCameraOrbit = 0.0;
+bool parseBenchmarkArgs(int argc, char *argv[], BenchmarkOptions &options);
+int runBenchmark(BenchmarkOptions const &options);
+void initBenchmarkModel(BenchmarkOptions const &options);
+void scriptBenchmarkFrame(int frame, BenchmarkOptions const &options);
 
 /*******************************************************************************
  Initializes GLUT for displaying a simple haptic scene.
 *******************************************************************************/
 int main(int argc, char *argv[])
 {
+    if (argc == 4 && !strcmp(argv[1], "--convert"))
+        return buildClusterMesh(argv[2], argv[3], kStreamClusterTriangles) ? 0 : 1;
+
+    BenchmarkOptions benchmark;
+    if (parseBenchmarkArgs(argc, argv, benchmark))
+        return runBenchmark(benchmark);
+
     glutInit(&argc, argv);
     
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
@@ -172,9 +613,23 @@ int main(int argc, char *argv[])
 *******************************************************************************/
 void glutDisplay()
 {   
+	TRACE_ZONE("glutDisplay");
+	TRACE_THREAD_NAME("GLUT client");
+    PerfClock::time_point start = PerfClock::now();
     drawSceneHaptics();
+    PerfClock::time_point hapticsDone = PerfClock::now();
     drawSceneGraphics();
     glutSwapBuffers();
+
+    PerfClock::time_point end = PerfClock::now();
+    gPerfStats.addHapticFrame(std::chrono::duration<double>(hapticsDone - start).count());
+    gPerfStats.addGraphicsFrame(std::chrono::duration<double>(end - start).count());
+
+    gFrameScheduler.frameDrawn();
+    for (int i = 0; i < gDevices.size(); i++)
+        gDevices[i]->lastDrawnProxyPosition = gDevices[i]->proxyPosition;
+
+    updateQuality();
 }
 
 /*******************************************************************************
@@ -201,36 +656,96 @@ void glutReshape(int width, int height)
     glLoadIdentity();
     gluPerspective(kFovY, aspect, nearDist, farDist);
 
-    // Place the camera down the Z axis looking at the origin.
+    // Place the camera down the Z axis looking at the origin, turned about
+    // the vertical axis by the benchmark's orbit angle.
     glMatrixMode(GL_MODELVIEW);
     glLoadIdentity();            
-    gluLookAt(0, 5, nearDist + 3.0,
+    gluLookAt((nearDist + 3.0) * sin(gCameraOrbit), 5, (nearDist + 3.0) * cos(gCameraOrbit),
               0, 0, 0,
               0, 1, 0);
     
-    updateWorkspace();
+    for (int i = 0; i < gDevices.size(); i++)
+        updateWorkspace(*gDevices[i]);
+    gFrameScheduler.markDirty(FRAME_DIRTY_VIEW);
 }
 
 /*******************************************************************************
- GLUT callback for idle state.  Use this as an opportunity to request a redraw.
- Checks for HLAPI errors that have occurred since the last idle check.
+ GLUT callback for idle state.  Checks for HLAPI errors that have occurred
+ since the last idle check and requests a redraw only when the scene changed.
+ Otherwise the time until the next frame goes to deferred work and sleep.
 *******************************************************************************/
 void glutIdle()
 {
     HLerror error;
 
-    while (HL_ERROR(error = hlGetError()))
+    for (int i = 0; i < gDevices.size(); i++)
     {
-        fprintf(stderr, "HL Error: %s\n", error.errorCode);
-        
-        if (error.errorCode == HL_DEVICE_ERROR)
+        HapticDevice &device = *gDevices[i];
+        if (!device.hHLRC)
+            continue;
+        hlMakeCurrent(device.hHLRC);
+
+        while (HL_ERROR(error = hlGetError()))
         {
-            hduPrintError(stderr, &error.errorInfo,
-                "Error during haptic rendering\n");
+            fprintf(stderr, "HL Error on device %d: %s\n", i, error.errorCode);
+            
+            if (error.errorCode == HL_DEVICE_ERROR)
+            {
+                hduPrintError(stderr, &error.errorInfo,
+                    "Error during haptic rendering\n");
+            }
         }
+
+        // Button events are dispatched here, so they are not held back by the
+        // frame rate.
+        hlCheckEvents();
+
+        hlGetDoublev(HL_PROXY_POSITION, device.proxyPosition);
+        if ((device.proxyPosition - device.lastDrawnProxyPosition).magnitude() > 1e-4)
+            gFrameScheduler.markDirty(FRAME_DIRTY_PROXY);
     }
-    
-    glutPostRedisplay();
+
+    pollAssetLoads();
+
+    // Keep drawing while streamed clusters are in flight, so that they are
+    // picked up as they arrive.
+    if (gStreamedMesh.isOpen() && gStreamedMesh.getPendingCount() > 0)
+        gFrameScheduler.markDirty(FRAME_DIRTY_VERTICES);
+
+    if (gFrameScheduler.shouldRedraw())
+        glutPostRedisplay();
+    else
+        gFrameScheduler.idle(0.002);
+}
+
+/*******************************************************************************
+ Idle task: rebuilds normals around vertices the deformation worker moved.
+*******************************************************************************/
+bool rebuildNormalsTask(void *userdata){
+	TRACE_ZONE("rebuildNormalsTask");
+	bool moreWork = false;
+
+	TRACE_LOCK_GUARD(lock, gMeshMutex);
+	for(int i = 0; i < hapticObjects.size(); i++){
+		if(hapticObjects[i].ready && hapticObjects[i].loader.rebuildNormals(kNormalRebuildChunk))
+			moreWork = true;
+	}
+	return moreWork;
+}
+
+/*******************************************************************************
+ Idle task: recomputes distance field bricks around deformed triangles.
+*******************************************************************************/
+bool refreshDistanceFieldsTask(void *userdata){
+	TRACE_ZONE("refreshDistanceFieldsTask");
+	bool moreWork = false;
+
+	TRACE_LOCK_GUARD(lock, gMeshMutex);
+	for(int i = 0; i < hapticObjects.size(); i++){
+		if(hapticObjects[i].ready && hapticObjects[i].field && hapticObjects[i].field->refresh(kFieldRefreshChunk))
+			moreWork = true;
+	}
+	return moreWork;
 }
 
 /******************************************************************************
@@ -246,52 +761,15 @@ void glutMenu(int ID)
 }
 /******************************************************************************/
 void keyboard(unsigned char key, int x, int y) {
+	TRACE_ZONE("keyboard");
+	gFrameScheduler.markDirty(FRAME_DIRTY_ALL);
+
 	switch (key) {
 	
 	case 'a':
 	case 'A':
-		isAnchoredEditing = !isAnchoredEditing;
-		if(isAnchoredEditing && (gCurrentDragObj !=-1)){
-			
-			initialProxyPosition = proxyPosition;
-			initialDevicePosition = devicePosition;
-            anchor = position;
-
-			int hapticObjectIndex = getIndexOfObject(gCurrentDragObj);
-			mVerticeBuffer = hapticObjects[hapticObjectIndex].loader.getVertices();
-
-			hduMatrix mat = (hapticObjects[hapticObjectIndex].transform).getInverse();
-			mat.multVecMatrix(proxyPosition, newModelPosition);
-			vec3 pos(newModelPosition[0], newModelPosition[1], newModelPosition[2]);
-			rootTransformIndex = findNearestPoint(pos, mVerticeBuffer);
-
-			set<int> traversed;
-			for(int i = 0; i < maxNumSlices; i++){
-				immediateNeighbors[i].clear();
-			}
-	
-			immediateNeighbors[0].insert(rootTransformIndex);
-			traversed.insert(rootTransformIndex);
-
-			for(int n = 1; n < maxNumSlices; n++){
-				for(set<int>::iterator parentIndex = immediateNeighbors[n-1].begin(); 
-					parentIndex != immediateNeighbors[n-1].end(); 
-					parentIndex++){
-					for(set<int>::iterator curIndex = hapticObjects[hapticObjectIndex].loader.net[*parentIndex].begin(); 
-						curIndex != hapticObjects[hapticObjectIndex].loader.net[*parentIndex].end(); 
-						curIndex++){
-							if(traversed.find(*curIndex) == traversed.end()){
-								immediateNeighbors[n].insert(*curIndex);
-								traversed.insert(*curIndex);
-							}
-					}
-				}
-			}
-			bRenderForce = HD_TRUE;
-		}else{
-			bRenderForce = HD_FALSE;
-		}
-
+		for(int i = 0; i < gDevices.size(); i++)
+			setAnchoredEditing(*gDevices[i], !gDevices[i]->anchoredEditing);
 		break;
 	case '+':
 		if(numSlices < maxNumSlices)
@@ -301,22 +779,99 @@ void keyboard(unsigned char key, int x, int y) {
 		if(numSlices > 1)
 			numSlices--;
 		break;
+	case 'r':
+	case 'R':
+		gAdaptiveRefinement = !gAdaptiveRefinement;
+		break;
+	case 'h':
+	case 'H':
+		gShowPerfOverlay = !gShowPerfOverlay;
+		break;
+	case 'c':
+	case 'C':
+		gObjectCollisions = !gObjectCollisions;
+		break;
+	case 'x':
+	case 'X':
+		gHapticTextures = !gHapticTextures;
+		break;
+	case 'q':
+	case 'Q':
+		{
+			TRACE_LOCK_GUARD(lock, gMeshMutex);
+			gCompactMeshes = !gCompactMeshes;
+			std::set<const void *> counted;
+			size_t used = measureSceneMemory(counted).total();
+			size_t budget = gMemoryBudgetMB > 0 ? (size_t) gMemoryBudgetMB << 20 : (size_t) -1;
+			for(int i = 0; i < hapticObjects.size(); i++){
+				HapticObject &object = hapticObjects[i];
+				if(!gCompactMeshes || !object.ready || object.downgraded)
+					continue;
+				// A copy left from before the toggle is stale and replaced.
+				size_t held = object.compact.getMemoryBytes();
+				used -= held;
+				if(used + CompactMesh::estimateBytes(object.loader) > budget){
+					object.compact = CompactMesh();
+					object.downgraded = true;
+					printf("Memory: mesh %d (%s) downgraded to no compact copy\n", i, object.loader.getFileName().c_str());
+					continue;
+				}
+				object.compact.encode(object.loader);
+				used += object.compact.getMemoryBytes();
+			}
+			gSceneMemoryBytes = used;
+		}
+		break;
 	case 't':
 	case 'T':
 		toggleCursor = !toggleCursor;
 		break;
+	case '6':
+		gToolRendering = !gToolRendering;
+		sendServoMode();
+		break;
+	case 'l':
+	case 'L':
+		gContactCache = !gContactCache;
+		sendServoMode();
+		break;
+	case 'g':
+	case 'G':
+		gAutoQuality = !gAutoQuality;
+		if (!gAutoQuality){
+			gServoQuality.reset();
+			gGraphicsQuality.reset();
+			applyServoQuality();
+			applyGraphicsQuality();
+		}
+		break;
+	case 'b':
+	case 'B':
+		gBrushMode = (BrushMode) ((gBrushMode + 1) % 4);
+		if (gBrushMode == BRUSH_CUT){
+			TRACE_LOCK_GUARD(lock, gMeshMutex);
+			for (int i = 0; i < hapticObjects.size(); i++){
+				if (hapticObjects[i].ready)
+					prepareHalfEdges(hapticObjects[i]);
+			}
+		}
+		break;
+	case '[':
+		if(gBrushRadius > 0.02f)
+			gBrushRadius /= 1.25f;
+		break;
+	case ']':
+		if(gBrushRadius < 0.5f)
+			gBrushRadius *= 1.25f;
+		break;
 	case 'e':
 	case 'E':
 		isProxyConstrained = !isProxyConstrained;	
-		if (isProxyConstrained)
+		for(int i = 0; i < gDevices.size() && isProxyConstrained; i++)
 		{
-			constrainedProxyPos= proxyPosition;
-			minPoint[0] = constrainedProxyPos[0] -0.25;
-			minPoint[1] = constrainedProxyPos[1] -0.25;
-			minPoint[2] = constrainedProxyPos[2] -0.25;
-			maxPoint[0] = constrainedProxyPos[0] + 0.25;
-			maxPoint[1] = constrainedProxyPos[1] + 0.25;
-			maxPoint[2] = constrainedProxyPos[2] + 0.25;
+			hduVector3Dd constrainedProxyPos = gDevices[i]->proxyPosition;
+			gDevices[i]->minPoint = constrainedProxyPos - hduVector3Dd(0.25, 0.25, 0.25);
+			gDevices[i]->maxPoint = constrainedProxyPos + hduVector3Dd(0.25, 0.25, 0.25);
 		}
 	}
 }
@@ -324,26 +879,281 @@ void keyboard(unsigned char key, int x, int y) {
  Initializes the scene.  Handles initializing both OpenGL and HL.
 *******************************************************************************/
 void initScene(){
-	initOBJModel();
+	if (gStreamFile)
+		initStreamedMesh();
+	else
+		initOBJModel();
     initGL();
     initHL();
-	createHapticObject();
+
+	gFrameScheduler.setTargetRate(gTargetFrameRate);
+	gFrameScheduler.addIdleTask(rebuildNormalsTask, 0);
+	gFrameScheduler.addIdleTask(refreshDistanceFieldsTask, 0);
+
+	// The workers test gSharedScene.isOpen(), so the segment is created
+	// first; its publisher lists the devices, so it comes after initHL().
+	initSharedScene();
+	startWorkers();
 }
 /*******************************************************************************/
 void initOBJModel(){
-	hapticObjects.push_back(HapticObject());
-	hapticObjects.push_back(HapticObject());
+	static const char *sceneFiles[] = { "Plate.obj", "Bowl.obj" };
+	static const int numSceneFiles = sizeof(sceneFiles) / sizeof(sceneFiles[0]);
+
+	// Loads write straight into these objects, so the vector must not grow
+	// once requests are queued.
+	hapticObjects.resize(numSceneFiles);
+
+	// The bowl rests on the plate and moves with it.  Its local transform
+	// undoes the plate's scale so that it keeps its size.
+	static const double kPlateScale = 1.3;
+	hapticObjects[0].node = gSceneGraph.addNode(-1, hduMatrix::createScale(kPlateScale, kPlateScale, kPlateScale));
+	hapticObjects[1].node = gSceneGraph.addNode(hapticObjects[0].node,
+		hduMatrix::createTranslation(0,0.5,0) * hduMatrix::createScale(1/kPlateScale, 1/kPlateScale, 1/kPlateScale));
+	gSceneGraph.update();
+
+	static const HeightFunction sceneTextures[] = { grainHeight, ridgeHeight };
+
+	for(int i = 0; i < numSceneFiles; i++){
+		hapticObjects[i].ready = false;
+		hapticObjects[i].rejected = false;
+		hapticObjects[i].downgraded = false;
+		gAssetLoader.request(i, &hapticObjects[i].loader, sceneFiles[i]);
+
+		hapticObjects[i].texture.reset(new HeightField());
+		hapticObjects[i].texture->bakeAsync(gThreadPool, kTextureSize, sceneTextures[i], 0);
+	}
+
+	pencilCursor.ready = false;
+	gAssetLoader.request(kPencilAssetId, &pencilCursor.loader, "pencil.obj");
+}
+
+/*******************************************************************************
+ Opens the streamed mesh in place of the default scene.  Its root proxy is
+ read here; everything else arrives on the I/O threads while drawing.
+*******************************************************************************/
+void initStreamedMesh(){
+	gStreamedMesh.setMemoryBudget((size_t) gStreamBudgetMB << 20);
+	if (!gStreamedMesh.open(gStreamFile, kStreamIOThreads)){
+		fprintf(stderr, "Could not open streamed mesh %s\n", gStreamFile);
+		exit(-1);
+	}
+	gStreamedNode = gSceneGraph.addNode(-1, hduMatrix());
+	gSceneGraph.update();
+
+	pencilCursor.ready = false;
+	gAssetLoader.request(kPencilAssetId, &pencilCursor.loader, "pencil.obj");
+}
+
+/*******************************************************************************
+ Chooses the streamed clusters for this frame from the current GL matrices,
+ which must include the mesh's world transform.  The frustum planes come
+ straight from projection * modelview (Gribb and Hartmann), so they are
+ already in model space.
+*******************************************************************************/
+void updateStreamedMesh(){
+	GLdouble modelview[16];
+	GLdouble projection[16];
+	glGetDoublev(GL_MODELVIEW_MATRIX, modelview);
+	glGetDoublev(GL_PROJECTION_MATRIX, projection);
+
+	double clip[16];
+	for (int column = 0; column < 4; column++){
+		for (int row = 0; row < 4; row++){
+			clip[4*column + row] = 0;
+			for (int k = 0; k < 4; k++)
+				clip[4*column + row] += projection[4*k + row] * modelview[4*column + k];
+		}
+	}
+
+	float frustum[6][4];
+	for (int p = 0; p < 6; p++){
+		int row = p / 2;
+		double sign = (p % 2) ? -1.0 : 1.0;
+		for (int k = 0; k < 4; k++)
+			frustum[p][k] = (float) (clip[4*k + 3] + sign * clip[4*k + row]);
+	}
+
+	// Full resolution follows the first device.
+	hduVector3Dd eye, focus;
+	hduMatrix(modelview).getInverse().multVecMatrix(hduVector3Dd(0, 0, 0), eye);
+	gSceneGraph.getInverseWorld(gStreamedNode).multVecMatrix(gDevices[0]->proxyPosition, focus);
+
+	float focusRadius = (float) (kStreamFocusRadius * gGraphicsQuality.getScale(kQualityStep));
+	gStreamedMesh.update(vec3(eye[0], eye[1], eye[2]), frustum, vec3(focus[0], focus[1], focus[2]), focusRadius);
+}
+
+/*******************************************************************************
+ Makes finished loads part of the scene.  Runs on the client thread because
+ shapes and their event callbacks must be created with the HL context current.
+*******************************************************************************/
+void pollAssetLoads(){
+	int id;
+	bool success;
+
+	while (gAssetLoader.poll(id, success)){
+		if (!success)
+			continue;
+
+		if (id == kPencilAssetId){
+			pencilCursor.ready = true;
+
+			std::shared_ptr<PointShell> shell(new PointShell());
+			shell->build(pencilCursor.loader, kToolShellPoints, kToolClusterPoints);
+			gToolShell.publish(shell);
+		}else{
+			TRACE_LOCK_GUARD(lock, gMeshMutex);
+			admitMesh(id);
+		}
+		gFrameScheduler.markDirty(FRAME_DIRTY_ALL);
+	}
 
-	bool loadfile = hapticObjects[0].loader.load("Plate.obj");
-	hapticObjects[0].touched = false;
+	if (!gMemoryReported && gAssetLoader.getPending() == 0){
+		gMemoryReported = true;
+		TRACE_LOCK_GUARD(lock, gMeshMutex);
+		printMemoryReport("after loading");
+	}
+}
+
+/*******************************************************************************
+ Makes a loaded scene mesh ready within the memory budget.  The mesh and its
+ bounding volumes must fit, or it is rejected and its data freed.  Then the
+ finest distance field that fits is built, and the compact copy is kept only
+ if the field was not cut back and the copy fits as well.  Caller holds
+ gMeshMutex.
+*******************************************************************************/
+void admitMesh(int id){
+	HapticObject &object = hapticObjects[id];
+	size_t budget = gMemoryBudgetMB > 0 ? (size_t) gMemoryBudgetMB << 20 : (size_t) -1;
+
+	std::set<const void *> counted;
+	size_t used = measureSceneMemory(counted).total();
+	object.bvh.build(&object.loader);
+	MemoryUsage mesh;
+	object.loader.addMemoryUsage(mesh, counted);
+	mesh.acceleration += object.bvh.getMemoryBytes();
+	used += mesh.total();
+	gSceneMemoryBytes = used;
+
+	std::string const &file = object.loader.getFileName();
+	if (used > budget){
+		printf("Memory: rejected mesh %d (%s), %.1f MB would exceed the %d MB budget\n", id, file.c_str(),
+			mesh.total() / 1048576.0, gMemoryBudgetMB);
+		OBJLoader::evict(file);
+		object.loader = OBJLoader();
+		object.bvh = MeshBVH();
+		object.rejected = true;
+		return;
+	}
 
-	loadfile = hapticObjects[1].loader.load("Bowl.obj");
-	hapticObjects[1].touched = false;
+	if (!gHeadless){
+		createHapticObject(id);
+
+		float voxelSize = kFieldVoxelSize;
+		size_t fieldBytes = DistanceField::estimateBytes(object.loader, voxelSize, kFieldBandVoxels);
+		for (int i = 0; i < kFieldDowngrades && used + fieldBytes > budget; i++){
+			voxelSize *= 2.0f;
+			fieldBytes = DistanceField::estimateBytes(object.loader, voxelSize, kFieldBandVoxels);
+		}
+		if (used + fieldBytes <= budget){
+			object.field.reset(new DistanceField());
+			object.field->buildAsync(gThreadPool, &object.loader, voxelSize, kFieldBandVoxels,
+				file + ".sdf");
+			used += fieldBytes;
+		}
+		object.downgraded = !object.field || voxelSize != kFieldVoxelSize;
+		if (object.downgraded){
+			if (object.field)
+				printf("Memory: mesh %d (%s) downgraded to a distance field of %.3f voxels and no compact copy\n",
+					id, file.c_str(), voxelSize);
+			else
+				printf("Memory: mesh %d (%s) downgraded to no distance field and no compact copy\n", id, file.c_str());
+		}
+	}
+	if (gCompactMeshes && !object.downgraded){
+		size_t compactBytes = CompactMesh::estimateBytes(object.loader);
+		if (used + compactBytes <= budget)
+			object.compact.encode(object.loader);
+		else{
+			object.downgraded = true;
+			printf("Memory: mesh %d (%s) downgraded to no compact copy\n", id, file.c_str());
+		}
+	}
+	gSceneMemoryBytes = used + object.compact.getMemoryBytes();
+	object.ready = true;
+}
 
-	hapticObjects[0].transform = hduMatrix::createScale(1.3,1.3,1.3);
-	hapticObjects[1].transform = hduMatrix::createTranslation(0,0.5,0);
+/*******************************************************************************
+ Heap bytes of one scene object, skipping data already in counted.  Caller
+ holds gMeshMutex.
+*******************************************************************************/
+MemoryUsage measureObjectMemory(HapticObject const &object, std::set<const void *> &counted){
+	MemoryUsage usage;
+	object.loader.addMemoryUsage(usage, counted);
+	usage.acceleration += object.bvh.getMemoryBytes();
+	if (object.field)
+		usage.acceleration += object.field->getMemoryBytes();
+	if (object.halfEdges)
+		usage.adjacency += object.halfEdges->getMemoryBytes();
+	if (object.texture && counted.insert(object.texture.get()).second)
+		usage.caches += object.texture->getMemoryBytes();
+	usage.caches += object.compact.getMemoryBytes() + vectorBytes(object.sharedDirty) +
+		vectorBytes(object.sharedDirtyTriangles);
+	return usage;
+}
 
-	bool loadPencil = pencilCursor.loader.load("pencil.obj");
+/*******************************************************************************
+ Heap bytes of the ready scene objects, the pencil and its point shell, the
+ streamed mesh's resident clusters and the asset cache.  Caller holds
+ gMeshMutex.
+*******************************************************************************/
+MemoryUsage measureSceneMemory(std::set<const void *> &counted){
+	MemoryUsage usage;
+	for (int i = 0; i < hapticObjects.size(); i++){
+		if (hapticObjects[i].ready)
+			usage += measureObjectMemory(hapticObjects[i], counted);
+	}
+	if (pencilCursor.ready)
+		pencilCursor.loader.addMemoryUsage(usage, counted);
+	std::shared_ptr<const PointShell> const &shell = gToolShell.get();
+	if (shell)
+		usage.acceleration += shell->getMemoryBytes();
+	if (gStreamedMesh.isOpen())
+		usage.caches += gStreamedMesh.getResidentBytes();
+	OBJLoader::addCacheMemoryUsage(usage, counted);
+	return usage;
+}
+
+/*******************************************************************************
+ Prints the memory held by each scene mesh, the scene total by kind, and the
+ allocator's counters.  Caller holds gMeshMutex.
+*******************************************************************************/
+void printMemoryReport(const char *when){
+	const double MB = 1048576.0;
+	std::set<const void *> counted;
+	printf("Memory %s:\n", when);
+	for (int i = 0; i < hapticObjects.size(); i++){
+		if (hapticObjects[i].rejected){
+			printf("  mesh %d: rejected\n", i);
+			continue;
+		}
+		if (!hapticObjects[i].ready)
+			continue;
+		MemoryUsage usage = measureObjectMemory(hapticObjects[i], counted);
+		printf("  mesh %d (%s): %.2f MB%s\n", i, hapticObjects[i].loader.getFileName().c_str(), usage.total() / MB,
+			hapticObjects[i].downgraded ? ", downgraded" : "");
+	}
+
+	counted.clear();
+	MemoryUsage scene = measureSceneMemory(counted);
+	gSceneMemoryBytes = scene.total();
+	printf("  scene: %.2f MB of %d MB budget; positions %.2f, attributes %.2f, indices %.2f, adjacency %.2f, "
+		"acceleration %.2f, caches %.2f MB\n", scene.total() / MB, gMemoryBudgetMB, scene.positions / MB,
+		scene.attributes / MB, scene.indices / MB, scene.adjacency / MB, scene.acceleration / MB, scene.caches / MB);
+
+	AllocatorStats heap = getAllocatorStats();
+	printf("  heap: %.2f MB live, %.2f MB peak, %llu allocations, %llu frees\n", heap.liveBytes / MB,
+		heap.peakBytes / MB, heap.allocations, heap.frees);
 }
 /*******************************************************************************
  Sets up general OpenGL rendering properties: lights, depth buffering, etc.
@@ -376,19 +1186,113 @@ void initGL()
     glLightfv(GL_LIGHT0, GL_DIFFUSE, light0_diffuse);
     glLightfv(GL_LIGHT0, GL_POSITION, light0_direction);
     glEnable(GL_LIGHT0);   
+
+    // GLUT fonts need glutInit, which the offscreen benchmark skips.
+    if (!gHeadless)
+        gInfoFont.init(GLUT_BITMAP_HELVETICA_18);
+
+#if defined(WIN32)
+    // Sync swaps to vertical blank so paced frames never tear or run ahead.
+    typedef BOOL (WINAPI *SwapIntervalProc)(int);
+    SwapIntervalProc wglSwapIntervalEXT = (SwapIntervalProc) wglGetProcAddress("wglSwapIntervalEXT");
+    if (wglSwapIntervalEXT)
+        wglSwapIntervalEXT(1);
+#endif
 }
 
 /*******************************************************************************
  Initialize the HDAPI.  This involves initing a device configuration, enabling
  forces, and scheduling a haptic thread callback for servicing the device.
+ Every device named with "--device" gets its own HL context and callback.
 *******************************************************************************/
 void initHL()
+{
+	if (gDeviceNames.empty())
+		gDeviceNames.push_back(HD_DEFAULT_DEVICE);
+
+	for (int i = 0; i < gDeviceNames.size(); i++)
+		initDevice(*createDevice(gDeviceNames[i]));
+}
+
+/*******************************************************************************
+ Starts the deformation, brush and contact workers.  Called once the devices
+ and the shared scene are in place.
+*******************************************************************************/
+void startWorkers()
+{
+	gDeformationWorker.start(gDeformationRateHz, solveDeformation, 0);
+	gBrushWorker.start(kBrushRateHz, smoothBrushes, 0);
+	gContactReader = gSnapshotReaders.addReader();
+	gContactWorker.start(kContactRateHz, extractContactPatches, 0);
+}
+
+/*******************************************************************************
+ Adds a device with no interaction going on.  Nothing is opened; without
+ initDevice it is a stand-in.
+*******************************************************************************/
+HapticDevice *createDevice(const char *name){
+	HapticDevice *device = new HapticDevice();
+	device->name = name;
+	device->hHD = HD_INVALID_HANDLE;
+	device->hHLRC = 0;
+	device->callbackHandle = 0;
+	device->maxForce = gMaxForce;
+	device->maxStiffness = gMaxStiffness;
+	device->textureEffect = 0;
+	device->streamedShapeId = 0;
+	for (int k = 0; k < 16; k++)
+		device->proxyxform[k] = (k % 5 == 0) ? 1.0 : 0.0;
+	device->dragIndex = -1;
+	device->anchoredEditing = false;
+	device->session = 0;
+	device->couplingSession = 0;
+	device->touchedIndex = -1;
+	device->touchedPointIndex = 0;
+	device->renderForce = HD_FALSE;
+	device->servoMode = currentServoMode();
+	device->forceFault = false;
+	device->lastTick = PerfClock::now();
+	device->snapshotReader = -1;
+	device->outputDOF = 3;
+	device->brushIndex = -1;
+	device->brushObject = -1;
+	device->brushVertexCount = 0;
+
+	BrushStroke stroke;
+	stroke.active = false;
+	stroke.object = -1;
+	device->brushStroke.write(stroke);
+
+	ToolFrame frame;
+	frame.active = false;
+	device->toolFrame.write(frame);
+
+	TextureContact contact;
+	contact.touching = false;
+	contact.texture = 0;
+	contact.object = -1;
+	device->textureContact.write(contact);
+
+	CouplingModel model;
+	model.active = false;
+	model.session = 0;
+	device->coupling.write(model);
+	device->servoCoupling = model;
+
+	gDevices.push_back(device);
+	return device;
+}
+
+/*******************************************************************************
+ Opens the device, schedules its servo callback and creates its HL context.
+*******************************************************************************/
+void initDevice(HapticDevice &device)
 {
     HDErrorInfo error;
 
 	/* Start the haptic rendering loop. */
 
-    ghHD = hdInitDevice(HD_DEFAULT_DEVICE);
+    device.hHD = hdInitDevice(device.name);
     if (HD_DEVICE_ERROR(error = hdGetError()))
     {
         hduPrintError(stderr, &error, "Failed to initialize haptic device");
@@ -397,14 +1301,28 @@ void initHL()
         exit(-1);
     }
 	
-	gCallbackHandle = hdScheduleAsynchronous(anchoredSpringForceCallback, 0, HD_DEFAULT_SCHEDULER_PRIORITY);
+	hdGetDoublev(HD_NOMINAL_MAX_FORCE, &device.maxForce);
+	hdGetDoublev(HD_NOMINAL_MAX_STIFFNESS, &device.maxStiffness);
+	hdGetIntegerv(HD_OUTPUT_DOF, &device.outputDOF);
+
+	device.snapshotReader = gSnapshotReaders.addReader();
+	device.callbackHandle = hdScheduleAsynchronous(anchoredSpringForceCallback, &device, HD_DEFAULT_SCHEDULER_PRIORITY);
 	hdEnable(HD_FORCE_OUTPUT);
     
-	ghHLRC = hlCreateContext(ghHD);
-    hlMakeCurrent(ghHLRC);
+	device.hHLRC = hlCreateContext(device.hHD);
+    hlMakeCurrent(device.hHLRC);
 
 	hlEnable(HL_HAPTIC_CAMERA_VIEW);
 
+	hlAddEventCallback(HL_EVENT_1BUTTONUP, HL_OBJECT_ANY, HL_CLIENT_THREAD, buttonUpClientThreadCallback, &device);
+
+	// The texture effect runs for the whole session; it adds nothing while
+	// the proxy is not touching a textured object.
+	device.textureEffect = hlGenEffects(1);
+	hlBeginFrame();
+	hlCallback(HL_EFFECT_COMPUTE_FORCE, (HLcallbackProc) computeTextureForceCB, &device);
+	hlStartEffect(HL_EFFECT_CALLBACK, device.textureEffect);
+	hlEndFrame();
 }
 
 /*******************************************************************************
@@ -413,23 +1331,58 @@ void initHL()
 *******************************************************************************/
 void exitHandler()
 {
-    // Deallocate the sphere shape id we reserved in initHL.
-	for(int i = 0; i < hapticObjects.size(); i++){
-		hlDeleteShapes(hapticObjects[i].shapeId, 1);
-	}
+    for (int i = 0; i < gDevices.size(); i++)
+    {
+        HapticDevice &device = *gDevices[i];
+        if (!device.hHLRC)
+            continue;
+        hlMakeCurrent(device.hHLRC);
+
+        // Deallocate the shape ids reserved in createHapticObject.
+        for (int k = 0; k < device.shapeIds.size(); k++){
+            if (device.shapeIds[k])
+                hlDeleteShapes(device.shapeIds[k], 1);
+        }
+        if (device.streamedShapeId)
+            hlDeleteShapes(device.streamedShapeId, 1);
+
+        if (device.textureEffect)
+        {
+            hlBeginFrame();
+            hlStopEffect(device.textureEffect);
+            hlEndFrame();
+            hlDeleteEffects(device.textureEffect, 1);
+        }
 
-    // Free up the haptic rendering context.
-    hlMakeCurrent(NULL);
-    if (ghHLRC != NULL)
+        // Free up the haptic rendering context.
+        hlMakeCurrent(NULL);
+        hlDeleteContext(device.hHLRC);
+    }
+    gStreamedMesh.close();
+
+    gDeformationWorker.stop();
+    gBrushWorker.stop();
+    gContactWorker.stop();
+    gSharePublisher.stop();
+    gSharedScene.close();
+
+    {
+        TRACE_LOCK_GUARD(lock, gMeshMutex);
+        printMemoryReport("at exit");
+    }
+
+    for (int i = 0; i < gDevices.size(); i++)
     {
-        hlDeleteContext(ghHLRC);
+        if (gDevices[i]->callbackHandle)
+            hdUnschedule(gDevices[i]->callbackHandle);
     }
 
-    hdUnschedule(gCallbackHandle);
-    // Free up the haptic device.
-    if (ghHD != HD_INVALID_HANDLE)
+    TRACE_WRITE("trace.json");
+    // Free up the haptic devices.
+    for (int i = 0; i < gDevices.size(); i++)
     {
-        hdDisableDevice(ghHD);
+        if (gDevices[i]->hHD != HD_INVALID_HANDLE)
+            hdDisableDevice(gDevices[i]->hHD);
     }
 }
 
@@ -437,7 +1390,7 @@ void exitHandler()
  Use the current OpenGL viewing transforms to initialize a transform for the
  haptic device workspace so that it's properly mapped to world coordinates.
 *******************************************************************************/
-void updateWorkspace()
+void updateWorkspace(HapticDevice &device)
 {
     GLdouble modelview[16];
     GLdouble projection[16];
@@ -447,12 +1400,15 @@ void updateWorkspace()
     glGetDoublev(GL_PROJECTION_MATRIX, projection);
     glGetIntegerv(GL_VIEWPORT, viewport);
 
-    hlMatrixMode(HL_TOUCHWORKSPACE);
-    hlLoadIdentity();
-    
     // Fit haptic workspace to view volume.
+    if (device.hHLRC){
+        hlMakeCurrent(device.hHLRC);
+        hlMatrixMode(HL_TOUCHWORKSPACE);
+        hlLoadIdentity();
+    
 	if (!isProxyConstrained) hluFitWorkspace(projection);
-	else hluFitWorkspaceBox( modelview, minPoint, maxPoint);
+	else hluFitWorkspaceBox( modelview, device.minPoint, device.maxPoint);
+    }
 
 	//hluFitWorkspace(projection);
 	
@@ -461,23 +1417,78 @@ void updateWorkspace()
     gCursorScale *= CURSOR_SIZE_PIXELS;
 }
 
+/*******************************************************************************
+ Publishes the voxmaps and placements of the scene objects for the tool
+ contact in the servo callbacks, the texture effect and the contact cache.
+*******************************************************************************/
+void publishToolScene(){
+	std::shared_ptr<const SceneGraph::Snapshot> snapshot = gSceneGraph.getSnapshot();
+	std::shared_ptr<ToolContactScene> scene(new ToolContactScene());
+	for (int i = 0; i < hapticObjects.size(); i++){
+		if (!hapticObjects[i].ready || !hapticObjects[i].field)
+			continue;
+		std::shared_ptr<const DistanceField::Grid> grid = hapticObjects[i].field->getGrid();
+		if (grid)
+			scene->addObject(i, grid, snapshot->world[hapticObjects[i].node], snapshot->inverseWorld[hapticObjects[i].node]);
+	}
+	gToolScene.publish(scene);
+}
+
+/*******************************************************************************
+ Publishes this frame's workspace transform and, for the tool, where the servo
+ callback puts it: the pencil relative to the device, as drawCursor draws
+ it.  Call after updateWorkspace.
+*******************************************************************************/
+void publishToolFrame(HapticDevice &device){
+	ToolFrame frame;
+	GLdouble modelview[16];
+	glGetDoublev(GL_MODELVIEW_MATRIX, modelview);
+	hduMatrix viewTouch, touchWorkspace;
+	hlGetDoublev(HL_VIEWTOUCH_MATRIX, viewTouch);
+	hlGetDoublev(HL_TOUCHWORKSPACE_MATRIX, touchWorkspace);
+	frame.worldToDevice = hduMatrix(modelview) * viewTouch * touchWorkspace;
+	frame.deviceToWorld = frame.worldToDevice.getInverse();
+
+	hduVector3Dd unit;
+	frame.worldToDevice.multDirMatrix(hduVector3Dd(1, 0, 0), unit);
+	frame.deviceUnits = unit.magnitude();
+
+	frame.active = gToolRendering && pencilCursor.ready && gCursorDisplayList != 0;
+	if (frame.active){
+		// The proxy transform drawCursor uses is the device pose carried into
+		// world space without the workspace scale, so undo that scale here.
+		double scale = frame.deviceUnits;
+		frame.toolToDevice = hduMatrix::createScale(gCursorScale, gCursorScale, gCursorScale) * penCursorConfig *
+			hduMatrix::createScale(scale, scale, scale);
+	}
+	device.toolFrame.write(frame);
+}
+
 /*******************************************************************************/
-void createHapticObject(){
-	for(int i = 0; i < hapticObjects.size(); i++){
-		hapticObjects[i].hap_stiffness = 0.8;
-		hapticObjects[i].hap_damping = 0.0;
-		hapticObjects[i].hap_static_friction = 0.5;
-		hapticObjects[i].hap_dynamic_friction = 0.0;
-    
-		hapticObjects[i].shapeId = hlGenShapes(1);
-		hapticObjects[i].displayList = glGenLists(1);
-		hlAddEventCallback(HL_EVENT_1BUTTONDOWN, hapticObjects[i].shapeId, HL_CLIENT_THREAD, buttonDownClientThreadCallback, 0); 
-		hlAddEventCallback(HL_EVENT_MOTION,  hapticObjects[i].shapeId, HL_COLLISION_THREAD, hlMotionCB, 0); 
-		hlAddEventCallback(HL_EVENT_TOUCH, hapticObjects[i].shapeId, HL_COLLISION_THREAD, hlTouchCB, 0); 
-		hlAddEventCallback(HL_EVENT_UNTOUCH, hapticObjects[i].shapeId, HL_COLLISION_THREAD, hlUnTouchCB, 0);
+void createHapticObject(int index){
+	hapticObjects[index].hap_stiffness = 0.8;
+	hapticObjects[index].hap_damping = 0.0;
+	hapticObjects[index].hap_static_friction = 0.5;
+	hapticObjects[index].hap_dynamic_friction = 0.0;
+
+	hapticObjects[index].displayList = glGenLists(1);
+
+	// Shape ids belong to a context, so every device gets its own.
+	for(int i = 0; i < gDevices.size(); i++){
+		HapticDevice &device = *gDevices[i];
+		if(device.shapeIds.size() < hapticObjects.size())
+			device.shapeIds.resize(hapticObjects.size(), 0);
+		if(!device.hHLRC)
+			continue;
+
+		hlMakeCurrent(device.hHLRC);
+		HLuint shapeId = hlGenShapes(1);
+		device.shapeIds[index] = shapeId;
+		hlAddEventCallback(HL_EVENT_1BUTTONDOWN, shapeId, HL_CLIENT_THREAD, buttonDownClientThreadCallback, &device); 
+		hlAddEventCallback(HL_EVENT_MOTION,  shapeId, HL_COLLISION_THREAD, hlMotionCB, &device); 
+		hlAddEventCallback(HL_EVENT_TOUCH, shapeId, HL_COLLISION_THREAD, hlTouchCB, &device); 
+		hlAddEventCallback(HL_EVENT_UNTOUCH, shapeId, HL_COLLISION_THREAD, hlUnTouchCB, &device);
 	}
-	
-	hlAddEventCallback(HL_EVENT_1BUTTONUP, HL_OBJECT_ANY, HL_CLIENT_THREAD, buttonUpClientThreadCallback, 0);
 }
 /*******************************************************************************
  The main routine for displaying the scene.  Gets the latest snapshot of state
@@ -485,80 +1496,144 @@ void createHapticObject(){
 *******************************************************************************/
 void drawSceneGraphics()
 {
+	TRACE_ZONE("drawSceneGraphics");
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);           
 
-    // Draw 3D cursor at haptic device position.
-    drawCursor();
-		
+	// Draw a 3D cursor at each haptic device position.
+	for (int i = 0; i < gDevices.size(); i++){
+		drawCursor(*gDevices[i]);
+	}
+
 	//touchedPoint = hapticObjects[touchedIndex].loader.getVertices()[nearest];
 	
-	int closest = -1;
-
+	TRACE_LOCK_GUARD(lock, gMeshMutex);
 	for(int i = 0; i < hapticObjects.size(); i++){
+		if(!hapticObjects[i].ready)
+			continue;
+
 		glPushMatrix();
-		glMultMatrixd(hapticObjects[i].transform);
+		glMultMatrixd(gSceneGraph.getWorld(hapticObjects[i].node));
 		
 		hapticObjects[i].loader.drawColorObj();
-		
-		vec3 pos(proxyPosition[0], proxyPosition[1], proxyPosition[2]);
-		int closest = findNearestPoint(pos, hapticObjects[i].loader.getVertices());
 
-		//if (nearest > closest) {
-		//	nearest = closest;
-		//}
+		glPopMatrix();
+	}
 
+	if (gStreamedMesh.isOpen()){
+		glPushMatrix();
+		glMultMatrixd(gSceneGraph.getWorld(gStreamedNode));
+		updateStreamedMesh();
+		gStreamedMesh.draw();
 		glPopMatrix();
 	}
 
-	DisplayInfo();
+	if (!gHeadless)
+		DisplayInfo();
 
 	
 }
 
 /*******************************************************************************
- The main routine for rendering scene haptics.
+ The main routine for rendering scene haptics.  Each device renders the scene
+ into its own context.
 *******************************************************************************/
 void drawSceneHaptics()
 {    
+	TRACE_ZONE("drawSceneHaptics");
+	if (gToolRendering || gContactCache || gHapticTextures)
+		publishToolScene();
+
+	for (int i = 0; i < gDevices.size(); i++){
+		if (gDevices[i]->hHLRC)
+			drawDeviceHaptics(*gDevices[i]);
+	}
+}
+
+void drawDeviceHaptics(HapticDevice &device)
+{
+    hlMakeCurrent(device.hHLRC);
+
     // Start haptic frame.  (Must do this before rendering any haptic shapes.)
     hlBeginFrame();
 	hlCheckEvents();
 
-	updateWorkspace();
+	// A force error ended the servo's coupling; stop the edit driving it.
+	if (device.forceFault.exchange(false)){
+		TRACE_LOCK_GUARD(lock, gMeshMutex);
+		device.renderForce = HD_FALSE;
+	}
+
+	updateWorkspace(device);
+	publishToolFrame(device);
+	updateBrushStroke(device);
 
 	HLboolean buttDown;
     hlGetBooleanv(HL_BUTTON1_STATE, &buttDown);
 	if (buttDown){
 	// "Drag" the current drag object, if one is current.
-		if (gCurrentDragObj != -1){
-			updateDragObjTransform();
+		if (device.dragIndex != -1){
+			updateDragObjTransform(device);
 		}
 	}
+	gSceneGraph.update();
 
 	hlTouchModel(HL_CONTACT);
 	hlTouchableFace(HL_FRONT);
 	// Position and orient the object.
 	glPushMatrix();
-	// Set material properties for the shapes to be drawn.
-	if (gCurrentDragObj == -1){ 
+	// Set material properties for the shapes to be drawn.  The tool renders
+	// its own contact, so HL gets no shapes while it is on.
+	if (device.dragIndex == -1 && !gToolRendering){ 
+		TRACE_LOCK_GUARD(lock, gMeshMutex);
 		for(int i = 0; i < hapticObjects.size(); i++){
-			hlBeginShape(HL_SHAPE_FEEDBACK_BUFFER,hapticObjects[i].shapeId );
-			hlMaterialf(HL_FRONT, HL_STIFFNESS, hapticObjects[i].hap_stiffness);
-			hlMaterialf(HL_FRONT, HL_DAMPING, hapticObjects[i].hap_damping);
-			if(hapticObjects[i].touched){
-				hlMaterialf(HL_FRONT, HL_STATIC_FRICTION, hapticObjects[i].loader.getFriction()[touchedPointIndex]);
+			if(!hapticObjects[i].ready || i >= device.shapeIds.size())
+				continue;
+
+			hlBeginShape(HL_SHAPE_FEEDBACK_BUFFER, device.shapeIds[i]);
+			if(gContactCache){
+				// The servo callback renders the contact; HL only tracks it.
+				hlMaterialf(HL_FRONT, HL_STIFFNESS, 0.0);
+				hlMaterialf(HL_FRONT, HL_DAMPING, 0.0);
+				hlMaterialf(HL_FRONT, HL_STATIC_FRICTION, 0.0);
+				hlMaterialf(HL_FRONT, HL_DYNAMIC_FRICTION, 0.0);
+			}else{
+				hlMaterialf(HL_FRONT, HL_STIFFNESS, hapticObjects[i].hap_stiffness);
+				hlMaterialf(HL_FRONT, HL_DAMPING, hapticObjects[i].hap_damping);
+				if(device.touchedIndex == i){
+					hlMaterialf(HL_FRONT, HL_STATIC_FRICTION, hapticObjects[i].loader.getFriction()[device.touchedPointIndex]);
+				}
+				hlMaterialf(HL_FRONT, HL_DYNAMIC_FRICTION, hapticObjects[i].hap_dynamic_friction);
 			}
-			hlMaterialf(HL_FRONT, HL_DYNAMIC_FRICTION, hapticObjects[i].hap_dynamic_friction);
 
 			// Start a new haptic shape.  Use the feedback buffer to capture OpenGL geometry for haptic rendering.
-  
-			glMultMatrixd(hapticObjects[i].transform);
+			// World matrices already include the parent's, so each object
+			// starts from the frame's matrix.
+			glPushMatrix();
+			glMultMatrixd(gSceneGraph.getWorld(hapticObjects[i].node));
 
 			// Use OpenGL commands to create geometry.
 			hapticObjects[i].loader.drawColorObj();
+			glPopMatrix();
 			// End the shape.
 			hlEndShape();
 		}
+
+		// The clusters chosen by the last graphics frame; with none near the
+		// proxy there is nothing to touch.
+		if (gStreamedMesh.isOpen() && gStreamedMesh.getNearTriangleCount() > 0){
+			if (!device.streamedShapeId)
+				device.streamedShapeId = hlGenShapes(1);
+
+			hlHinti(HL_SHAPE_FEEDBACK_BUFFER_VERTICES, 3 * gStreamedMesh.getNearTriangleCount());
+			hlBeginShape(HL_SHAPE_FEEDBACK_BUFFER, device.streamedShapeId);
+			hlMaterialf(HL_FRONT, HL_STIFFNESS, 0.8);
+			hlMaterialf(HL_FRONT, HL_STATIC_FRICTION, 0.5);
+			glPushMatrix();
+			glMultMatrixd(gSceneGraph.getWorld(gStreamedNode));
+			gStreamedMesh.drawNear();
+			glPopMatrix();
+			hlEndShape();
+		}
 	}
 	glPopMatrix();
     // End the haptic frame.
@@ -570,18 +1645,23 @@ void drawSceneHaptics()
  Draws a 3D cursor for the haptic device using the current local transform,
  the workspace to world transform and the screen coordinate scale.
 *******************************************************************************/
-void drawCursor()
+void drawCursor(HapticDevice &device)
 {
     static const double kCursorRadius = 0.5;
     static const double kCursorHeight = 1.5;
     static const int kCursorTess = 15;
    
-	hlGetDoublev(HL_DEVICE_POSITION, devicePosition);
-	hlGetDoublev(HL_PROXY_POSITION, proxyPosition);
-	hlGetDoublev(HL_PROXY_TRANSFORM, proxyxform);
+	// Without a haptic context the benchmark script sets these.
+	HLdouble *proxyxform = device.proxyxform;
+	if (device.hHLRC){
+		hlMakeCurrent(device.hHLRC);
+		hlGetDoublev(HL_DEVICE_POSITION, device.devicePosition);
+		hlGetDoublev(HL_PROXY_POSITION, device.proxyPosition);
+		hlGetDoublev(HL_PROXY_TRANSFORM, proxyxform);
+	}
 	
-	hduVector3Dd devDifference = proxyPosition - proxyInitialPosition;
-	if(bRenderForce){
+	hduVector3Dd devDifference = device.proxyPosition - proxyInitialPosition;
+	if(device.renderForce){
 		proxyxform[12] = devDifference[0];
 		proxyxform[13] = devDifference[1];
 		proxyxform[14] = devDifference[2];
@@ -612,27 +1692,35 @@ void drawCursor()
     
     // Get the proxy transform in world coordinates.
 
-	if( bRenderForce){
-		proxyxform[12] = newProxyPosition[0];
-		proxyxform[13] = newProxyPosition[1];
-		proxyxform[14] = newProxyPosition[2];
+	if( device.renderForce){
+		proxyxform[12] = device.newProxyPosition[0];
+		proxyxform[13] = device.newProxyPosition[1];
+		proxyxform[14] = device.newProxyPosition[2];
 	}
+	if (gSharedScene.isOpen())
+		device.proxyPose.write(hduMatrix(proxyxform));
 
 	
-	if(toggleCursor){
+	// Fall back to the cone until the pencil mesh has loaded.
+	bool drawPencil = !toggleCursor && pencilCursor.ready;
+	if(!drawPencil){
 		glMultMatrixd(proxyxform);
 	}else{
-		hduMatrix proxyxform;
-		hlGetDoublev(HL_PROXY_TRANSFORM, proxyxform);
+		hduMatrix proxyxform = device.scriptedProxyTransform;
+		if (device.hHLRC)
+			hlGetDoublev(HL_PROXY_TRANSFORM, proxyxform);
 		
 		glMultMatrixd(penCursorConfig * proxyxform);
 	}
 
 	glEnable(GL_COLOR_MATERIAL);
-    glColor3f(0.0, 0.5, 1.0);
+	if (&device == gDevices[0])
+		glColor3f(0.0, 0.5, 1.0);
+	else
+		glColor3f(1.0, 0.5, 0.0);
 	// Apply the local cursor scale factor.
 	glScaled(gCursorScale, gCursorScale, gCursorScale);
-	if(toggleCursor){
+	if(!drawPencil){
 		glCallList(gCursorDisplayList);
 	}else{
 		pencilCursor.loader.drawColorObj();
@@ -641,110 +1729,420 @@ void drawCursor()
     glPopAttrib();
 
 	if(isProxyConstrained){
-		drawConstrainedSpace();
+		drawConstrainedSpace(device);
 	}
 }
 
 /******************************************************************************/
 
 void HLCALLBACK buttonDownClientThreadCallback(HLenum event, HLuint object, HLenum thread, HLcache *cache, void *userdata){
-	gCurrentDragObj = object;
-	hlGetDoublev(HL_PROXY_TRANSFORM, gStartProxyTransform);
-	for(int i = 0; i < hapticObjects.size(); i++){
-		if(object == hapticObjects[i].shapeId){
-			gInitialObjTransform =  hapticObjects[i].transform;
-			hapticObjects[i].touched = true;
-		}else{
-			hapticObjects[i].touched = false;
-		}
+	TRACE_ZONE("buttonDown");
+	HapticDevice &device = *(HapticDevice *) userdata;
+	int index = getIndexOfObject(device, object);
+	if(index == -1)
+		return;
+
+	if(gBrushMode != BRUSH_OFF){
+		device.brushIndex = index;
+		return;
+	}
+
+	// An object follows one device at a time.
+	for(int i = 0; i < gDevices.size(); i++){
+		if(gDevices[i] != &device && gDevices[i]->dragIndex == index)
+			return;
 	}
-	buttonDown = true;
+
+	{
+		TRACE_LOCK_GUARD(lock, gMeshMutex);
+		device.dragIndex = index;
+	}
+	hlGetDoublev(HL_PROXY_TRANSFORM, device.startProxyTransform);
+	device.initialObjTransform = gSceneGraph.getWorld(hapticObjects[index].node);
+	device.touchedIndex = index;
+	beginDragCollisions(device, index);
+	gFrameScheduler.markDirty(FRAME_DIRTY_ALL);
 }
 
 void HLCALLBACK buttonUpClientThreadCallback(HLenum event, HLuint object, HLenum thread, HLcache *cache, void *userdata){
-	if (gCurrentDragObj != -1)
-		gCurrentDragObj = -1;
-	buttonDown = false;
-	isAnchoredEditing = false;
-	bRenderForce = false;
+	TRACE_ZONE("buttonUp");
+	HapticDevice &device = *(HapticDevice *) userdata;
+	device.brushIndex = -1;
+	device.anchoredEditing = false;
+
+	ServoCommand command;
+	command.type = SERVO_END_COUPLING;
+	sendServoCommand(device, command);
+
+	// The deformation worker reads the drag under the lock.
+	TRACE_LOCK_GUARD(lock, gMeshMutex);
+	device.dragIndex = -1;
+	device.renderForce = HD_FALSE;
+	endStylusSession(device);
+	gFrameScheduler.markDirty(FRAME_DIRTY_ALL);
 }
 
 
 void HLCALLBACK hlMotionCB(HLenum event, HLuint object, HLenum thread, HLcache *cache, void * userdata){
-	if(gCurrentDragObj != -1){
-		int index = getIndexOfObject(gCurrentDragObj);
-		if(index != -1){
-			hduMatrix mat = (hapticObjects[index].transform).getInverse();
-
-			hduVector3Dd transformedProxyPos;
-			mat.multVecMatrix(proxyPosition, transformedProxyPos);
-			vec3 pos(transformedProxyPos[0], transformedProxyPos[1], transformedProxyPos[2]);
-
-			int nearest = findNearestPoint(pos, hapticObjects[index].loader.getVertices());
-			touchedPoint = hapticObjects[index].loader.getVertices()[nearest];
-			touchedPointIndex = nearest;
-			hapticObjects[index].hap_static_friction = hapticObjects[index].loader.getFriction()[nearest];
-			//printf("Friction:%f\n",hapticObject.surfaceFriction[nearest]);
-		}
+	TRACE_ZONE("hlMotionCB");
+	TRACE_THREAD_NAME("HL collision");
+	gPerfStats.addCollisionCallback();
+	HapticDevice &device = *(HapticDevice *) userdata;
+
+	// Keeps the texture frame in step with an object that is being dragged.
+	int touchedIndex = getIndexOfObject(device, object);
+	if(touchedIndex != -1)
+		publishTextureContact(device, touchedIndex);
+
+	// Skip this event rather than wait out a deformation solve; the next
+	// motion event catches up.  The drag is read under the lock, which the
+	// client thread holds to change it.
+	std::unique_lock<std::mutex> lock(gMeshMutex, std::try_to_lock);
+	if(!lock.owns_lock())
+		return;
+
+	int index = device.dragIndex;
+	if(index != -1){
+		std::shared_ptr<const SceneGraph::Snapshot> scene = gSceneGraph.getSnapshot();
+		hduMatrix const &mat = scene->inverseWorld[hapticObjects[index].node];
+
+		hduVector3Dd proxyPosition, transformedProxyPos;
+		hlCacheGetDoublev(cache, HL_PROXY_POSITION, proxyPosition);
+		mat.multVecMatrix(proxyPosition, transformedProxyPos);
+		vec3 pos(transformedProxyPos[0], transformedProxyPos[1], transformedProxyPos[2]);
+
+		int nearest = findNearestVertex(index, pos);
+		if(nearest == -1)
+			return;
+		device.touchedPoint = hapticObjects[index].loader.getVertices()[nearest];
+		device.touchedPointIndex = nearest;
+		hapticObjects[index].hap_static_friction = hapticObjects[index].loader.getFriction()[nearest];
+		//printf("Friction:%f\n",hapticObject.surfaceFriction[nearest]);
 	}
 }
 
 
 void HLCALLBACK hlTouchCB(HLenum event, HLuint object, HLenum thread, HLcache *cache, void * userdata){
-	int hapticIndex = getIndexOfObject(object);
+	TRACE_ZONE("hlTouchCB");
+	TRACE_THREAD_NAME("HL collision");
+	gPerfStats.addCollisionCallback();
+	HapticDevice &device = *(HapticDevice *) userdata;
+
+	int hapticIndex = getIndexOfObject(device, object);
 	if(hapticIndex != -1){
-		hapticObjects[hapticIndex].touched = true;
+		device.touchedIndex = hapticIndex;
+		publishTextureContact(device, hapticIndex);
 	}
 }
 
 void HLCALLBACK hlUnTouchCB(HLenum event, HLuint object, HLenum thread, HLcache *cache, void *userdata){
-	int hapticIndex = getIndexOfObject(object);
+	TRACE_ZONE("hlUnTouchCB");
+	TRACE_THREAD_NAME("HL collision");
+	gPerfStats.addCollisionCallback();
+	HapticDevice &device = *(HapticDevice *) userdata;
+
+	int hapticIndex = getIndexOfObject(device, object);
 	if(hapticIndex != -1){
-		hapticObjects[hapticIndex].touched = false;
-	}
-}
-
-double getYVal(){
-	switch(numSlices){
-	case 9:
-		return 3.5;
-	case 8:
-		return 4;
-	case 7:
-		return 5;
-	case 6:
-		return 7;
-	case 5:
-		return 9;
-	case 4:
-		return 12;
-	case 3:
-		return 20;
-	case 2:
-		return 40;
-	default:
-		return 3;
-	}
-}
-
-void DrawBitmapString(GLfloat x, GLfloat y, void *font, char *format,...)
+		if(device.touchedIndex == hapticIndex)
+			device.touchedIndex = -1;
+
+		TextureContact contact;
+		contact.touching = false;
+		contact.texture = 0;
+		contact.object = -1;
+		device.textureContact.write(contact);
+	}
+}
+
+/*******************************************************************************
+ Publishes the touched object's height field and placement for the device's
+ texture effect.  That device's collision thread only, so each textureContact
+ has a single writer.
+*******************************************************************************/
+void publishTextureContact(HapticDevice &device, int index){
+	std::shared_ptr<const SceneGraph::Snapshot> scene = gSceneGraph.getSnapshot();
+
+	TextureContact contact;
+	contact.touching = true;
+	contact.texture = hapticObjects[index].texture.get();
+	contact.object = index;
+	contact.world = scene->world[hapticObjects[index].node];
+	contact.inverseWorld = scene->inverseWorld[hapticObjects[index].node];
+	device.textureContact.write(contact);
+}
+
+/*******************************************************************************
+ HL effect callback, run in the servo loop with the force HL has computed so
+ far.  Adds the texture force at the proxy: the relief height pushes along the
+ contact normal and its tangential slope pushes downhill.
+*******************************************************************************/
+void HLCALLBACK computeTextureForceCB(HDdouble force[3], HLcache *cache, void *userdata){
+	if (!gHapticTextures)
+		return;
+
+	TextureContact contact = ((HapticDevice *) userdata)->textureContact.read();
+	if (!contact.touching || !contact.texture || !contact.texture->isReady())
+		return;
+
+	HLboolean touching;
+	hlCacheGetBooleanv(cache, HL_PROXY_IS_TOUCHING, &touching);
+	if (!touching)
+		return;
+
+	TRACE_ZONE("computeTextureForceCB");
+	hduVector3Dd proxy, normal, point, modelNormal;
+	hlCacheGetDoublev(cache, HL_PROXY_POSITION, proxy);
+	hlCacheGetDoublev(cache, HL_PROXY_TOUCH_NORMAL, normal);
+	contact.inverseWorld.multVecMatrix(proxy, point);
+	contact.inverseWorld.multDirMatrix(normal, modelNormal);
+	modelNormal.normalize();
+
+	// Within the distance field's band, the device's depth below the surface
+	// scales the texture like a contact force would, and the field gradient
+	// gives the normal.  Deeper than the band, keep full gain and HL's normal.
+	double pressure = 1.0;
+	const DistanceField::Grid *grid = 0;
+	const ToolContactScene *scene = gToolScene.read();
+	for (int i = 0; scene && i < scene->objects.size(); i++){
+		if (scene->objects[i].id == contact.object)
+			grid = scene->objects[i].voxmap.get();
+	}
+	if (grid){
+		hduVector3Dd device, modelDevice;
+		hlCacheGetDoublev(cache, HL_DEVICE_POSITION, device);
+		contact.inverseWorld.multVecMatrix(device, modelDevice);
+
+		glm::vec3 gradient;
+		float distance = grid->distance(glm::vec3(modelDevice[0], modelDevice[1], modelDevice[2]), &gradient);
+		if (glm::dot(gradient, gradient) > 0.25f){
+			pressure = -distance / kTextureFullDepth;
+			if (pressure < 0.0) pressure = 0.0;
+			if (pressure > 1.0) pressure = 1.0;
+
+			modelNormal = hduVector3Dd(gradient.x, gradient.y, gradient.z);
+			modelNormal.normalize();
+			contact.world.multDirMatrix(modelNormal, normal);
+			normal.normalize();
+		}
+	}
+
+	// Blend the three axis-aligned projections by how squarely the surface
+	// faces each axis.
+	static const int planes[3][2] = { {1, 2}, {0, 2}, {0, 1} };
+	double weights[3], totalWeight = 0.0;
+	for (int k = 0; k < 3; k++){
+		double w = modelNormal[k] * modelNormal[k];
+		weights[k] = w * w;
+		totalWeight += weights[k];
+	}
+
+	double height = 0.0;
+	hduVector3Dd gradient(0, 0, 0);
+	for (int k = 0; k < 3; k++){
+		double w = weights[k] / totalWeight;
+		if (w < 1e-3)
+			continue;
+
+		int a = planes[k][0], b = planes[k][1];
+		float dhdu, dhdv;
+		float h = contact.texture->sample((float) (point[a] / gTextureTile), (float) (point[b] / gTextureTile), dhdu, dhdv);
+		height += w * h;
+		gradient[a] += w * dhdu / gTextureTile;
+		gradient[b] += w * dhdv / gTextureTile;
+	}
+
+	hduVector3Dd slope = gradient * gTextureDepth;
+	slope -= modelNormal * slope.dotProduct(modelNormal);
+	hduVector3Dd worldSlope;
+	contact.world.multDirMatrix(slope, worldSlope);
+
+	hduVector3Dd textureForce = (normal * height - worldSlope) * (gTextureGain * pressure);
+	double magnitude = textureForce.magnitude();
+	if (magnitude > kMaxTextureForce)
+		textureForce *= kMaxTextureForce / magnitude;
+
+	for (int k = 0; k < 3; k++)
+		force[k] += textureForce[k];
+}
+
+void DrawBitmapString(GLfloat x, GLfloat y, const BitmapFont &font, const char *format,...)
 {
-    int len, i;
     va_list args;
     char string[256];
 
 // special C stuff to interpret a dynamic set of arguments specified by "..."
     va_start(args, format);
-    vsprintf(string, format, args);
+    vsnprintf(string, sizeof(string), format, args);
     va_end(args);
 
-    glRasterPos2f(x, y);
-    len = (int) strlen(string);
+    font.drawString(x, y, string);
+}
 
-    for (i = 0; i < len; i++)
-    {
-        glutBitmapCharacter(font, string[i]);
-    }
+/*******************************************************************************
+ Keeps the larger of load and value/budget, and names what it came from.
+*******************************************************************************/
+static void takeWorstLoad(double value, double budget, const char *name, double &load, const char *&reason){
+	if (value / budget > load){
+		load = value / budget;
+		reason = name;
+	}
+}
+
+/*******************************************************************************
+ Takes a perf sample once a window has elapsed and lets the quality
+ controllers react to it.  Servo overruns and force errors step the
+ deformation down; graphics frames longer than the frame period step the
+ redraw rate down.  Either steps back up after a few windows with headroom.
+ Call once per frame from the client thread.
+*******************************************************************************/
+void updateQuality(){
+	if (!gPerfStats.sample(kQualityWindow))
+		return;
+	gPerfOverlayStale = true;
+	if (!gAutoQuality)
+		return;
+
+	const PerfStats::Snapshot &stats = gPerfStats.getSnapshot();
+	double servoLoad = 0.0;
+	const char *servoReason = "";
+	if (stats.servoRate > 0.0){
+		takeWorstLoad(stats.servoWorstTickMs, kServoTickBudgetMs, "servo tick", servoLoad, servoReason);
+		takeWorstLoad(stats.servoWorstIntervalMs, kServoGapBudgetMs, "servo gap", servoLoad, servoReason);
+		takeWorstLoad(kServoMinRate, stats.servoRate, "servo rate", servoLoad, servoReason);
+	}
+	if (stats.deformRate > 0.0)
+		takeWorstLoad(stats.deformSolveMs, 1000.0 / gDeformationWorker.getRate(), "deformation solve", servoLoad, servoReason);
+	if (stats.forceErrors > 0)
+		takeWorstLoad(2.0, 1.0, "force error", servoLoad, servoReason);
+
+	int change = gServoQuality.update(servoLoad);
+	if (change){
+		applyServoQuality();
+		if (change > 0)
+			printf("Quality: %s over budget (%.0f%%), deformation reduced to %d of %d slices at %.0f Hz\n",
+				servoReason, servoLoad * 100.0, deformationSlices(), numSlices, gDeformationWorker.getRate());
+		else
+			printf("Quality: servo loop has headroom, deformation restored to %d of %d slices at %.0f Hz\n",
+				deformationSlices(), numSlices, gDeformationWorker.getRate());
+	}
+
+	double graphicsLoad = 0.0;
+	if (stats.graphicsFrameRate > 0.0)
+		graphicsLoad = stats.graphicsFrameMs / (1000.0 / graphicsFrameRate());
+	change = gGraphicsQuality.update(graphicsLoad);
+	if (change){
+		applyGraphicsQuality();
+		gFrameScheduler.markDirty(FRAME_DIRTY_VIEW);
+		if (change > 0)
+			printf("Quality: graphics frame over budget (%.2f ms), redraw rate reduced to %.0f Hz\n",
+				stats.graphicsFrameMs, graphicsFrameRate());
+		else
+			printf("Quality: graphics has headroom, redraw rate restored to %.0f Hz\n", graphicsFrameRate());
+	}
+}
+
+/*******************************************************************************
+ Sets the deformation rate for the current servo quality level.  The region
+ size follows on the worker's next solve, which asks deformationSlices.
+*******************************************************************************/
+void applyServoQuality(){
+	gDeformationWorker.setRate((std::max)(kMinDeformationRateHz, gDeformationRateHz * gServoQuality.getScale(kQualityStep)));
+}
+
+/*******************************************************************************
+ The redraw rate for the current graphics quality level.  Frames are drawn
+ no faster than this, so a scene too heavy for the target rate takes a
+ smaller share of the client thread, which also runs the HL client callbacks.
+*******************************************************************************/
+double graphicsFrameRate(){
+	return (std::max)(kMinFrameRate, gTargetFrameRate * gGraphicsQuality.getScale(kQualityStep));
+}
+
+void applyGraphicsQuality(){
+	gFrameScheduler.setTargetRate(graphicsFrameRate());
+}
+
+/*******************************************************************************
+ The deformation radius in slices: numSlices, less what the servo quality
+ level takes off.
+*******************************************************************************/
+int deformationSlices(){
+	return (std::max)(1, (int) ceil(numSlices * gServoQuality.getScale(kQualityStep)));
+}
+
+/*******************************************************************************
+ Refreshes the overlay text from the perf counters.  Only runs when a new
+ sample is taken, so the per-frame cost of the overlay is a few glCallLists.
+*******************************************************************************/
+void updatePerfOverlay(){
+	if (!gPerfOverlayStale && !gPerfOverlayLines.empty())
+		return;
+	gPerfOverlayStale = false;
+
+	const PerfStats::Snapshot &stats = gPerfStats.getSnapshot();
+	char line[256];
+
+	gPerfOverlayLines.clear();
+	sprintf(line, "Graphics: %.2f ms/frame, %.1f fps", stats.graphicsFrameMs, stats.graphicsFrameRate);
+	gPerfOverlayLines.push_back(line);
+	sprintf(line, "Haptic frame: %.2f ms", stats.hapticFrameMs);
+	gPerfOverlayLines.push_back(line);
+	sprintf(line, "Servo: %.0f Hz, %.3f ms/tick, worst tick %.3f ms, worst gap %.3f ms",
+		stats.servoRate, stats.servoTickMs, stats.servoWorstTickMs, stats.servoWorstIntervalMs);
+	gPerfOverlayLines.push_back(line);
+	sprintf(line, "Collision callbacks: %.0f /s", stats.collisionRate);
+	gPerfOverlayLines.push_back(line);
+	sprintf(line, "Deformation: %.0f Hz, %.2f ms/solve, %.0f vertices/solve",
+		stats.deformRate, stats.deformSolveMs, stats.verticesPerSolve);
+	gPerfOverlayLines.push_back(line);
+	sprintf(line, "Quality: %s, servo level %d/%d (%d of %d slices at %.0f Hz), graphics level %d/%d (%.0f Hz)",
+		gAutoQuality ? "automatic" : "fixed", gServoQuality.getLevel(), kQualityLevels - 1, deformationSlices(), numSlices,
+		gDeformationWorker.getRate(), gGraphicsQuality.getLevel(), kQualityLevels - 1, graphicsFrameRate());
+	gPerfOverlayLines.push_back(line);
+	if (stats.forceErrors > 0){
+		sprintf(line, "Force output cut by %d servo force errors", stats.forceErrors);
+		gPerfOverlayLines.push_back(line);
+	}
+	{
+		// Refinement on the deformation worker grows the triangle arrays.
+		TRACE_LOCK_GUARD(lock, gMeshMutex);
+		for (int i = 0; i < hapticObjects.size(); i++){
+			if (hapticObjects[i].ready)
+				sprintf(line, "Mesh %d: %d triangles, %d distance field bricks", i, (int)hapticObjects[i].loader.getTriangles().size(),
+					hapticObjects[i].field ? hapticObjects[i].field->getBrickCount() : 0);
+			else if (hapticObjects[i].rejected)
+				sprintf(line, "Mesh %d: rejected, over the memory budget", i);
+			else
+				sprintf(line, "Mesh %d: loading", i);
+			gPerfOverlayLines.push_back(line);
+		}
+	}
+	AllocatorStats heap = getAllocatorStats();
+	sprintf(line, "Memory: scene %.1f of %d MB budget, heap %.1f MB live, %.1f MB peak", gSceneMemoryBytes / 1048576.0,
+		gMemoryBudgetMB, heap.liveBytes / 1048576.0, heap.peakBytes / 1048576.0);
+	gPerfOverlayLines.push_back(line);
+	if (gBrushMode != BRUSH_OFF){
+		static const char *names[] = { "", "Laplacian", "Taubin", "cut" };
+		sprintf(line, "Brush: %s, radius %.3f", names[gBrushMode], gBrushRadius);
+		gPerfOverlayLines.push_back(line);
+	}
+	for (int i = 0; gToolRendering && i < gDevices.size(); i++){
+		ToolContact::Result contact = gDevices[i]->toolResult.read();
+		sprintf(line, "Tool %d: %d points in contact, %d voxmap queries/tick", i, contact.contacts, contact.queries);
+		gPerfOverlayLines.push_back(line);
+	}
+	for (int i = 0; gContactCache && !gToolRendering && i < gDevices.size(); i++){
+		ContactPatch patch = gDevices[i]->contactPatch.read();
+		sprintf(line, "Contact cache %d: %s, spacing %.2f mm, revision %u blended over %.0f ms", i,
+			patch.valid ? "surface in reach" : "clear", patch.spacing, patch.revision, patch.blendSeconds * 1000.0);
+		gPerfOverlayLines.push_back(line);
+	}
+	if (gStreamedMesh.isOpen()){
+		sprintf(line, "Streamed mesh: %d clusters, %.1f / %d MB, %d loading, %d triangles drawn, %d near",
+			gStreamedMesh.getResidentCount(), gStreamedMesh.getResidentBytes() / 1048576.0, gStreamBudgetMB,
+			gStreamedMesh.getPendingCount(), gStreamedMesh.getDrawnTriangleCount(), gStreamedMesh.getNearTriangleCount());
+		gPerfOverlayLines.push_back(line);
+	}
 }
 
 void DisplayInfo(){
@@ -772,9 +2170,22 @@ void DisplayInfo(){
 
     int textRowUp = 0;                                      // lines of text already drawn upwards from the bottom
 
-    DrawBitmapString(0 , 20 , GLUT_BITMAP_HELVETICA_18, "INSTRUCTIONS: ");
-    DrawBitmapString(0 , 40 , GLUT_BITMAP_HELVETICA_18, "Use '+' and '-' keys to increase or decrease the deformation radius.");
-	DrawBitmapString(0 , 60 , GLUT_BITMAP_HELVETICA_18, "Current Radius: %d", numSlices);
+    DrawBitmapString(0 , 20 , gInfoFont, "INSTRUCTIONS: ");
+    DrawBitmapString(0 , 40 , gInfoFont, "Use '+' and '-' keys to increase or decrease the deformation radius.");
+	if (deformationSlices() < numSlices)
+		DrawBitmapString(0 , 60 , gInfoFont, "Current Radius: %d, reduced to %d to keep the servo loop on time", numSlices, deformationSlices());
+	else
+		DrawBitmapString(0 , 60 , gInfoFont, "Current Radius: %d", numSlices);
+	DrawBitmapString(0 , 80 , gInfoFont, "Press 'h' to toggle the performance overlay.");
+
+	if (gShowPerfOverlay){
+		updatePerfOverlay();
+
+		glColor3f(1.0, 1.0, 0.0);
+		for (int i = 0; i < gPerfOverlayLines.size(); i++){
+			gInfoFont.drawString(0, 120 + 20*i, gPerfOverlayLines[i].c_str());
+		}
+	}
 
     glMatrixMode(GL_PROJECTION);
     glPopMatrix();
@@ -787,67 +2198,747 @@ void DisplayInfo(){
     glEnable(GL_TEXTURE_2D);
 }
 
+/*******************************************************************************
+ Servo callback, one per device with the device as pUserData.  All of them run
+ on the HD scheduler thread.
+*******************************************************************************/
 HDCallbackCode HDCALLBACK anchoredSpringForceCallback(void *pUserData){
+	HapticDevice &device = *(HapticDevice *) pUserData;
+	PerfClock::time_point tickStart = PerfClock::now();
+
+	TRACE_ZONE("anchoredSpringForceCallback");
+	TRACE_THREAD_NAME("HD servo");
+	// Nothing read through gSnapshotReaders is held from the last tick.
+	gSnapshotReaders.quiescent(device.snapshotReader);
+
 	hduVector3Dd force(0, 0, 0);
+	hduVector3Dd position, velocity;
 	HDErrorInfo error;
-	hdBeginFrame(hdGetCurrentDevice());
+	hdBeginFrame(device.hHD);
 	hdGetDoublev(HD_CURRENT_POSITION, position); 
+	hdGetDoublev(HD_CURRENT_VELOCITY, velocity);
+	device.servoPosition.write(position);
+	applyServoCommands(device);
 
-	if (bRenderForce && gCurrentDragObj != -1){
-		HapticObject* myObj = &hapticObjects[getIndexOfObject(gCurrentDragObj)];
+	// Only evaluate the coupling model published by solveDeformation; the
+	// mesh itself is never touched at servo rate.
+	if (device.servoCoupling.active){
+		CouplingModel model = device.coupling.read();
+		if (model.active && model.session == device.servoCoupling.session)
+			device.servoCoupling = model;
+		model = device.servoCoupling;
 
-		hduVector3Dd devDifference = devicePosition - initialDevicePosition;
+		force = model.force + (model.position - position)*model.stiffness - velocity*model.damping;
+
+		double magnitude = force.magnitude();
+		if (magnitude > device.maxForce)
+			force *= device.maxForce/magnitude;
 
-		newProxyPosition = initialProxyPosition + devDifference;
-		force = (anchor-position)*gSpringStiffness;
 		hdSetDoublev(HD_CURRENT_FORCE, force);
-		hduMatrix mat = ((*myObj).transform).getInverse();
-		mat.multVecMatrix(newProxyPosition, newModelPosition);
-		
-		vec3 myNormal;
-
-		myNormal.x = newModelPosition[0] - mVerticeBuffer[rootTransformIndex].x;
-		myNormal.y = newModelPosition[1] - mVerticeBuffer[rootTransformIndex].y;
-		myNormal.z = newModelPosition[2] - mVerticeBuffer[rootTransformIndex].z;
-
-		for(int n = 1; n <= numSlices; n++){
-			for(set<int>::iterator cur_b = immediateNeighbors[n-1].begin(); cur_b != immediateNeighbors[n-1].end(); cur_b++){
-				double yVal = getYVal();
-				double scalar = 1/(1+ pow(yVal,(n-double(numSlices)/2.0)));
-				
-				mVerticeBuffer[*cur_b].x += myNormal.x*scalar;
-				mVerticeBuffer[*cur_b].y += myNormal.y*scalar;
-				mVerticeBuffer[*cur_b].z += myNormal.z*scalar;
-				(*myObj).loader.deformPoint(*cur_b, mVerticeBuffer[*cur_b]);
-			}
-		}
+	}else if (device.servoMode == SERVO_TOOL){
+		renderToolContact(device, velocity);
+	}else if (device.servoMode == SERVO_CONTACT_CACHE){
+		renderContactCache(device, position, velocity);
 	}
 
-	hdEndFrame(hdGetCurrentDevice());
+	hdEndFrame(device.hHD);
 	if (HD_DEVICE_ERROR(error = hdGetError())) {
 		if (hduIsForceError(&error)) {
-			bRenderForce = HD_FALSE;
+			device.servoCoupling.active = false;
+			device.forceFault = true;
+			gPerfStats.addForceError();
 		}
 		else if (
 			hduIsSchedulerError(&error)) {
+				gSnapshotReaders.removeReader(device.snapshotReader);
 				return HD_CALLBACK_DONE;
 		}
 	}
+
+	gPerfStats.addServoTick(std::chrono::duration<double>(PerfClock::now() - tickStart).count(),
+		std::chrono::duration<double>(tickStart - device.lastTick).count());
+	device.lastTick = tickStart;
 	
 	return HD_CALLBACK_CONTINUE;
 	
 }
 
-void updateDragObjTransform(){
+/*******************************************************************************
+ Applies the commands queued for the device since the last tick.  Servo
+ thread.  A mode switch or a coupling change drops the contact cache's held
+ plane, which belongs to the stylus it was touched with.
+*******************************************************************************/
+void applyServoCommands(HapticDevice &device){
+	ServoCommand command;
+	while (device.commands.pop(command)){
+		switch (command.type){
+		case SERVO_SET_MODE:
+			if (command.mode != device.servoMode)
+				device.contactRenderer.reset();
+			device.servoMode = command.mode;
+			break;
+		case SERVO_BEGIN_COUPLING:
+			device.servoCoupling = command.coupling;
+			device.contactRenderer.reset();
+			break;
+		case SERVO_END_COUPLING:
+			device.servoCoupling.active = false;
+			device.contactRenderer.reset();
+			break;
+		}
+	}
+}
+
+/*******************************************************************************
+ Queues a command for the device's servo callback.  Client thread.  Stand-in
+ devices have no servo callback, so nothing is queued for them.
+*******************************************************************************/
+void sendServoCommand(HapticDevice &device, ServoCommand const &command){
+	if (device.hHD == HD_INVALID_HANDLE)
+		return;
+	if (!device.commands.push(command))
+		fprintf(stderr, "Servo command queue full on device %s\n", device.name ? device.name : "default");
+}
+
+/*******************************************************************************
+ What the servo callbacks render when no stylus session holds the device.
+*******************************************************************************/
+ServoMode currentServoMode(){
+	if (gToolRendering)
+		return SERVO_TOOL;
+	if (gContactCache)
+		return SERVO_CONTACT_CACHE;
+	return SERVO_PROXY;
+}
+
+/*******************************************************************************
+ Tells every servo callback the current rendering mode.
+*******************************************************************************/
+void sendServoMode(){
+	ServoCommand command;
+	command.type = SERVO_SET_MODE;
+	command.mode = currentServoMode();
+	for (int i = 0; i < gDevices.size(); i++)
+		sendServoCommand(*gDevices[i], command);
+}
+
+/*******************************************************************************
+ Six-degree-of-freedom tool contact for one servo tick.  Places the point
+ shell at the device pose and turns its penetration into the scene into a
+ penalty force and torque.  Both are shared out over the points in contact,
+ so that a flat face is no stiffer than a tip.  Costs at most
+ kToolQueriesPerTick voxmap queries, however many triangles the scene has.
+*******************************************************************************/
+void renderToolContact(HapticDevice &device, hduVector3Dd const &velocity){
+	TRACE_ZONE("renderToolContact");
+	const PointShell *shell = gToolShell.read();
+	const ToolContactScene *scene = gToolScene.read();
+	ToolFrame frame = device.toolFrame.read();
+	if (!shell || !scene || !frame.active)
+		return;
+	if (device.toolContact.getShell() != shell)
+		device.toolContact.setShell(shell);
+
+	hduMatrix pose;
+	hdGetDoublev(HD_CURRENT_TRANSFORM, pose);
+	hduMatrix toolToWorld = frame.toolToDevice * pose * frame.deviceToWorld;
+
+	ToolContact::Result contact;
+	device.toolContact.evaluate(*scene, toolToWorld, kToolQueriesPerTick, contact);
+	device.toolResult.write(contact);
+	if (contact.contacts == 0)
+		return;
+
+	// Penetration is in world units and torque in world units squared; the
+	// workspace transform rotates and scales uniformly.
+	hduVector3Dd force, torque;
+	frame.worldToDevice.multDirMatrix(hduVector3Dd(contact.force.x, contact.force.y, contact.force.z), force);
+	frame.worldToDevice.multDirMatrix(hduVector3Dd(contact.torque.x, contact.torque.y, contact.torque.z), torque);
+	double share = gToolStiffness / (std::max)(contact.contacts, kToolFullContacts);
+	force *= share;
+	torque *= share * frame.deviceUnits;
+
+	hduVector3Dd normal = force;
+	normal.normalize();
+	double approach = velocity.dotProduct(normal);
+	if (approach < 0.0)
+		force -= normal * (approach * gToolDamping);
+
+	double magnitude = force.magnitude();
+	if (magnitude > device.maxForce)
+		force *= device.maxForce/magnitude;
+	magnitude = torque.magnitude();
+	if (magnitude > kMaxToolTorque)
+		torque *= kMaxToolTorque/magnitude;
+
+	hdSetDoublev(HD_CURRENT_FORCE, force);
+	if (device.outputDOF >= 6)
+		hdSetDoublev(HD_CURRENT_TORQUE, torque);
+}
+
+/*******************************************************************************
+ Contact worker job.  Samples the published scene around each device into its
+ contact patch, so that the servo callback has the nearby surface at
+ kContactRateHz whatever the graphics frame rate.
+*******************************************************************************/
+void extractContactPatches(double dt, void *userdata){
+	TRACE_ZONE("extractContactPatches");
+	TRACE_THREAD_NAME("Contact worker");
+	gSnapshotReaders.quiescent(gContactReader);
+	if (!gContactCache)
+		return;
+
+	const ToolContactScene *scene = gToolScene.read();
+	if (!scene)
+		return;
+
+	for (int i = 0; i < gDevices.size(); i++){
+		HapticDevice &device = *gDevices[i];
+		ToolFrame frame = device.toolFrame.read();
+		hduVector3Dd position = device.servoPosition.read();
+
+		ContactPatch patch;
+		device.contactSampler.sample(*scene, frame.deviceToWorld,
+			vec3((float) position[0], (float) position[1], (float) position[2]), dt, patch);
+		device.contactPatch.write(patch);
+	}
+}
+
+/*******************************************************************************
+ Contact cache for one servo tick.  Takes the device's latest contact patch
+ and renders a spring against its contact plane, damped into the surface.
+*******************************************************************************/
+void renderContactCache(HapticDevice &device, hduVector3Dd const &position, hduVector3Dd const &velocity){
+	TRACE_ZONE("renderContactCache");
+	device.contactRenderer.update(device.contactPatch.read());
+
+	float depth;
+	vec3 normal;
+	vec3 p((float) position[0], (float) position[1], (float) position[2]);
+	if (!device.contactRenderer.evaluate(p, kServoPeriod, depth, normal))
+		return;
+
+	hduVector3Dd n(normal.x, normal.y, normal.z);
+	hduVector3Dd force = n * (depth * gContactStiffness);
+	double approach = velocity.dotProduct(n);
+	if (approach < 0.0)
+		force -= n * (approach * gContactDamping);
+
+	double magnitude = force.magnitude();
+	if (magnitude > device.maxForce)
+		force *= device.maxForce/magnitude;
+
+	hdSetDoublev(HD_CURRENT_FORCE, force);
+}
+
+/*******************************************************************************
+ Deformation worker job.  Retargets every device's stylus region at its proxy,
+ applies every active region in one batched pass, so that edits by several
+ devices on one mesh are merged, and then refreshes each device's coupling
+ model rendered by anchoredSpringForceCallback.
+*******************************************************************************/
+void solveDeformation(double dt, void *userdata){
+	TRACE_ZONE("solveDeformation");
+	TRACE_THREAD_NAME("Deformation worker");
+	TRACE_LOCK_GUARD(lock, gMeshMutex);
+
+	std::shared_ptr<const SceneGraph::Snapshot> scene = gSceneGraph.getSnapshot();
+	vector<hduVector3Dd> servoPositions(gDevices.size());
+	vector<char> stylusActive(gDevices.size(), 0);
+	for (int i = 0; i < gDevices.size(); i++){
+		HapticDevice &device = *gDevices[i];
+		servoPositions[i] = device.servoPosition.read();
+		// The client thread changes the drag under gMeshMutex, so it holds
+		// still for this solve; read it once all the same.
+		int dragIndex = device.dragIndex;
+		DeformationSession *session = device.session;
+		if (!device.renderForce || dragIndex == -1 || !session)
+			continue;
+		stylusActive[i] = 1;
+
+		hduVector3Dd devDifference = device.devicePosition - device.initialDevicePosition;
+		device.newProxyPosition = device.initialProxyPosition + devDifference;
+		hduVector3Dd newModelPosition;
+		scene->inverseWorld[hapticObjects[dragIndex].node].multVecMatrix(device.newProxyPosition, newModelPosition);
+
+		session->setTarget(vec3(newModelPosition[0], newModelPosition[1], newModelPosition[2]));
+		session->setNumSlices(deformationSlices());
+	}
+
+	if (gDeformationSessions.empty())
+		return;
+
+	PerfClock::time_point solveStart = PerfClock::now();
+	gDeformationBatch.solve(gDeformationSessions, dt/kServoPeriod);
+	gPerfStats.addDeformSolve(gDeformationBatch.getTouchedCount(), std::chrono::duration<double>(PerfClock::now() - solveStart).count());
+	TRACE_COUNTER("vertices per solve", gDeformationBatch.getTouchedCount());
+	gFrameScheduler.markDirty(FRAME_DIRTY_VERTICES);
+
+	static int solveCount = 0;
+	if (gAdaptiveRefinement && gGraphicsQuality.getLevel() == 0 && ++solveCount % kRefineInterval == 0)
+		refineDeformationRegions();
+
+	// Triangles added by refinement are picked up by the next refresh.
+	for (int i = 0; i < hapticObjects.size(); i++){
+		if (hapticObjects[i].ready)
+			noteMovedVertices(i, gDeformationBatch.getTouchedVertices(&hapticObjects[i].loader));
+	}
+
+	for (int i = 0; i < gDevices.size(); i++){
+		if (!stylusActive[i])
+			continue;
+
+		gDevices[i]->coupling.write(couplingModel(*gDevices[i], servoPositions[i]));
+	}
+}
+
+/*******************************************************************************
+ Coupling model of the device's stylus region about position.  The region
+ holds its root with the spring of a lone root scaled by how much of the mesh
+ follows it, up to what the device renders stably, and the damping keeps its
+ ratio to the stiffness.  Caller holds gMeshMutex.
+*******************************************************************************/
+CouplingModel couplingModel(HapticDevice const &device, hduVector3Dd const &position){
+	double stiffness = gSpringStiffness * device.session->getStiffness();
+	stiffness = (std::min)(stiffness, (std::min)(gMaxStiffness, device.maxStiffness));
+
+	CouplingModel model;
+	model.position = position;
+	model.force = (device.anchor - position)*stiffness;
+	model.stiffness = stiffness;
+	model.damping = gCouplingDamping * sqrt(stiffness/gSpringStiffness);
+	model.active = true;
+	model.session = device.couplingSession;
+	return model;
+}
+
+/*******************************************************************************
+ Brings everything derived from mesh index up to date with vertices moved by
+ an edit: the distance field, the compact copy and the shared scene.  Caller
+ holds gMeshMutex.
+*******************************************************************************/
+void noteMovedVertices(int index, vector<int> const &vertices){
+	HapticObject &object = hapticObjects[index];
+	if (object.field)
+		object.field->markMoved(vertices);
+	if (gCompactMeshes && !object.downgraded && !vertices.empty())
+		object.compact.update(object.loader, vertices);
+	if (gSharedScene.isOpen())
+		object.sharedDirty.insert(object.sharedDirty.end(), vertices.begin(), vertices.end());
+}
+
+/*******************************************************************************
+ As noteMovedVertices, after a topology edit that also rewrote or removed
+ triangles in place.  Caller holds gMeshMutex.
+*******************************************************************************/
+void noteEditedTopology(int index, vector<int> const &vertices, vector<int> const &triangles){
+	HapticObject &object = hapticObjects[index];
+	if (object.field){
+		object.field->markMoved(vertices);
+		object.field->markTriangles(triangles);
+	}
+	if (gCompactMeshes && !object.downgraded)
+		object.compact.updateTopology(object.loader, vertices, triangles);
+	if (gSharedScene.isOpen()){
+		object.sharedDirty.insert(object.sharedDirty.end(), vertices.begin(), vertices.end());
+		object.sharedDirtyTriangles.insert(object.sharedDirtyTriangles.end(), triangles.begin(), triangles.end());
+	}
+}
+
+/*******************************************************************************
+ Publishes the device's brush stroke in the model space of the object it
+ brushes, from the proxy of the last graphics frame.
+*******************************************************************************/
+void updateBrushStroke(HapticDevice &device){
+	BrushStroke stroke;
+	stroke.active = gBrushMode != BRUSH_OFF && device.brushIndex != -1;
+	stroke.object = device.brushIndex;
+	if (stroke.active){
+		hduVector3Dd model;
+		gSceneGraph.getInverseWorld(hapticObjects[device.brushIndex].node).multVecMatrix(device.proxyPosition, model);
+		stroke.center = vec3(model[0], model[1], model[2]);
+	}
+	device.brushStroke.write(stroke);
+}
+
+/*******************************************************************************
+ Brush worker job.  For each device with a stroke, gathers a new disc when the
+ stroke has moved on or the mesh was refined, otherwise re-reads the current
+ one, then smooths the copy with the mesh unlocked.  The number of iterations
+ is fitted to kBrushVertexSteps, so large discs converge over more ticks
+ instead of taking longer per tick.  The cut brush goes to cutAlongStroke.
+*******************************************************************************/
+void smoothBrushes(double dt, void *userdata){
+	TRACE_ZONE("smoothBrushes");
+	TRACE_THREAD_NAME("Brush worker");
+	SmoothingBrush::Mode mode = gBrushMode == BRUSH_TAUBIN ? SmoothingBrush::TAUBIN : SmoothingBrush::LAPLACIAN;
+
+	for (int i = 0; i < gDevices.size(); i++){
+		HapticDevice &device = *gDevices[i];
+		BrushStroke stroke = device.brushStroke.read();
+		if (!stroke.active){
+			device.brushObject = -1;
+			continue;
+		}
+		if (gBrushMode == BRUSH_CUT){
+			cutAlongStroke(device, stroke);
+			continue;
+		}
+
+		OBJLoader &loader = hapticObjects[stroke.object].loader;
+		{
+			TRACE_LOCK_GUARD(lock, gMeshMutex);
+			if (device.brushObject != stroke.object || loader.getVertices().size() != device.brushVertexCount ||
+				glm::distance(stroke.center, device.brushCenter) > gBrushRadius * kBrushRegather){
+				device.brush.gather(loader, findNearestVertex(stroke.object, stroke.center), gBrushRadius);
+				device.brushObject = stroke.object;
+				device.brushCenter = stroke.center;
+				device.brushVertexCount = loader.getVertices().size();
+			}else{
+				device.brush.load(loader);
+			}
+		}
+		if (device.brush.isEmpty())
+			continue;
+
+		int iterations = kBrushVertexSteps / device.brush.getVertexCount();
+		if (iterations < 1) iterations = 1;
+		if (iterations > kBrushMaxIterations) iterations = kBrushMaxIterations;
+		device.brush.iterate(mode, gBrushStrength, iterations);
+
+		TRACE_LOCK_GUARD(lock, gMeshMutex);
+		vector<int> moved;
+		device.brush.apply(loader, moved);
+		if (moved.empty())
+			continue;
+		noteMovedVertices(stroke.object, moved);
+		gFrameScheduler.markDirty(FRAME_DIRTY_VERTICES);
+	}
+}
+
+/*******************************************************************************
+ Cuts the stroke's object from where the device's blade was last tick to where
+ it is now.  Each cut only visits the faces near the blade.  Until the
+ object's half-edge mesh is built the stroke just moves on.  Objects under a
+ deformation session are left alone, since sessions hold on to the vertices
+ and adjacency of their region.
+*******************************************************************************/
+void cutAlongStroke(HapticDevice &device, BrushStroke const &stroke){
+	TRACE_ZONE("cutAlongStroke");
+	HapticObject &object = hapticObjects[stroke.object];
+	vec3 from = device.brushObject == stroke.object ? device.brushCenter : stroke.center;
+	device.brushObject = stroke.object;
+	device.brushCenter = stroke.center;
+	device.brushVertexCount = 0;
+
+	TRACE_LOCK_GUARD(lock, gMeshMutex);
+	for (int k = 0; k < gDeformationSessions.size(); k++){
+		if (gDeformationSessions[k]->getLoader() == &object.loader)
+			return;
+	}
+
+	if (!prepareHalfEdges(object))
+		return;
+
+	int seed = findNearestVertex(stroke.object, stroke.center);
+	object.halfEdges->cut(from, stroke.center, gBrushRadius * kCutWidth, seed, kCutMaxSplits);
+
+	vector<int> vertices, triangles;
+	object.halfEdges->takeChanges(vertices, triangles);
+	if (vertices.empty() && triangles.empty())
+		return;
+	noteEditedTopology(stroke.object, vertices, triangles);
+	gFrameScheduler.markDirty(FRAME_DIRTY_VERTICES);
+}
+
+/*******************************************************************************
+ Starts building the object's half-edge mesh on the thread pool if it has
+ none, or if its topology was edited behind its back, and returns true once
+ it can be cut.  The build copies the triangles first, so the mesh stays
+ unlocked while the twins, linear in the mesh, are found.  Caller holds
+ gMeshMutex.
+*******************************************************************************/
+bool prepareHalfEdges(HapticObject &object){
+	if (!object.halfEdges || object.halfEdges->isStale()){
+		object.halfEdges.reset(new HalfEdgeMesh());
+		object.halfEdges->buildAsync(gThreadPool, &object.loader);
+	}
+	return object.halfEdges->prepare();
+}
+
+/*******************************************************************************
+ Creates the shared scene segment and starts its publisher, if asked for.
+*******************************************************************************/
+void initSharedScene(){
+	if (!gShareName)
+		return;
+	if (!gSharedScene.create(gShareName, kShareRingBytes))
+		return;
+	gSharePublisher.start(kShareRateHz, publishSharedScene, 0);
+}
 
-	int hapticIndex = getIndexOfObject(gCurrentDragObj);
-	if(hapticIndex != -1 && !bRenderForce){
+/*******************************************************************************
+ Publisher job: one shared scene frame.  Transforms come from the scene graph
+ snapshot and proxies from each device's seqlock, so only the mesh spans need
+ gMeshMutex.  When the deformation worker holds it, the spans wait for the
+ next frame rather than hold the worker up.
+*******************************************************************************/
+void publishSharedScene(double dt, void *userdata){
+	TRACE_ZONE("publishSharedScene");
+	TRACE_THREAD_NAME("Scene publisher");
+	static unsigned long long frame = 0;
+	bool refresh = frame % kShareRefreshFrames == 0;
+
+	std::shared_ptr<const SceneGraph::Snapshot> scene = gSceneGraph.getSnapshot();
+	gSharedScene.beginFrame(frame, (int) hapticObjects.size(), (int) gDevices.size());
+
+	for (int i = 0; i < hapticObjects.size(); i++){
+		HapticObject &object = hapticObjects[i];
+		if (object.node < 0 || object.node >= scene->world.size())
+			continue;
+		hduMatrix const &world = scene->world[object.node];
+		if (refresh || memcmp(&world, &object.sharedWorld, sizeof(world)) != 0){
+			gSharedScene.writeMatrix(SHARED_TRANSFORM, i, world);
+			object.sharedWorld = world;
+		}
+	}
+
+	for (int i = 0; i < gDevices.size(); i++){
+		hduMatrix pose = gDevices[i]->proxyPose.read();
+		if (refresh || memcmp(&pose, &gDevices[i]->sharedPose, sizeof(pose)) != 0){
+			gSharedScene.writeMatrix(SHARED_PROXY, i, pose);
+			gDevices[i]->sharedPose = pose;
+		}
+	}
+
+	std::unique_lock<std::mutex> lock(gMeshMutex, std::try_to_lock);
+	if (lock.owns_lock()){
+		for (int i = 0; i < hapticObjects.size(); i++){
+			if (hapticObjects[i].ready)
+				publishSharedMesh(i);
+		}
+	}
+
+	gSharedScene.endFrame();
+	frame++;
+}
+
+/*******************************************************************************
+ Sorted, distinct ids as runs [first, first + count), bridging gaps of up to
+ kShareSpanGap so that a scattered region still goes out in a few records.
+*******************************************************************************/
+static void collectSharedSpans(vector<int> &ids, vector<pair<int, int> > &spans){
+	sort(ids.begin(), ids.end());
+	ids.erase(unique(ids.begin(), ids.end()), ids.end());
+
+	spans.clear();
+	for (int i = 0; i < ids.size(); i++){
+		if (!spans.empty() && ids[i] <= spans.back().first + spans.back().second + kShareSpanGap)
+			spans.back().second = ids[i] - spans.back().first + 1;
+		else
+			spans.push_back(make_pair(ids[i], 1));
+	}
+}
+
+static void writeSharedTriangles(int index, int first, int count, vector<Triangle> const &triangles){
+	vector<unsigned int> indices(3 * count);
+	for (int t = 0; t < count; t++){
+		for (int k = 0; k < 3; k++)
+			indices[3*t + k] = triangles[first + t].vert[k];
+	}
+	gSharedScene.writeSpan(SHARED_TRIANGLES, index, first, count, (int) triangles.size(),
+		indices.empty() ? 0 : &indices[0], 3 * sizeof(unsigned int));
+}
+
+/*******************************************************************************
+ Writes the parts of mesh index that changed since the last frame: moved
+ vertices, vertices and triangles appended since then, triangles a cut
+ rewrote in place, and after refinement the triangles around the vertices,
+ which refinement may have rewritten in place.  Then the next refresh slice.
+ Caller holds gMeshMutex.
+*******************************************************************************/
+void publishSharedMesh(int index){
+	HapticObject &object = hapticObjects[index];
+	vector<vec3> const &vertices = object.loader.getVertices();
+	vector<Triangle> const &triangles = object.loader.getTriangles();
+	int vertexCount = vertices.size(), triangleCount = triangles.size();
+
+	// Vertices are contiguous floats, so spans go out without a copy.
+	vector<int> &dirty = object.sharedDirty;
+	int newVertices = (std::min)(vertexCount - object.sharedVertexCount, kShareNewElements);
+	vector<pair<int, int> > spans;
+	collectSharedSpans(dirty, spans);
+	for (int s = 0; s < spans.size(); s++){
+		int first = spans[s].first, count = (std::min)(spans[s].second, object.sharedVertexCount - first);
+		if (count > 0)
+			gSharedScene.writeSpan(SHARED_VERTICES, index, first, count, vertexCount, &vertices[first], sizeof(vec3));
+	}
+	if (newVertices > 0)
+		gSharedScene.writeSpan(SHARED_VERTICES, index, object.sharedVertexCount, newVertices, vertexCount,
+			&vertices[object.sharedVertexCount], sizeof(vec3));
+
+	vector<int> changed;
+	for (int i = 0; i < object.sharedDirtyTriangles.size(); i++){
+		if (object.sharedDirtyTriangles[i] < object.sharedTriangleCount)
+			changed.push_back(object.sharedDirtyTriangles[i]);
+	}
+	object.sharedDirtyTriangles.clear();
+	if (triangleCount != object.sharedTriangleCount && object.sharedTriangleCount > 0){
+		vector<vector<int> > const &vertexTriangles = object.loader.getVertexTriangles();
+		for (int v = object.sharedVertexCount; v < object.sharedVertexCount + newVertices; v++)
+			dirty.push_back(v);
+		for (int i = 0; i < dirty.size(); i++){
+			vector<int> const &incident = vertexTriangles[dirty[i]];
+			for (int k = 0; k < incident.size(); k++){
+				if (incident[k] < object.sharedTriangleCount)
+					changed.push_back(incident[k]);
+			}
+		}
+	}
+	if (!changed.empty()){
+		collectSharedSpans(changed, spans);
+		for (int s = 0; s < spans.size(); s++)
+			writeSharedTriangles(index, spans[s].first, spans[s].second, triangles);
+	}
+	int newTriangles = (std::min)(triangleCount - object.sharedTriangleCount, kShareNewElements);
+	if (newTriangles > 0)
+		writeSharedTriangles(index, object.sharedTriangleCount, newTriangles, triangles);
+
+	object.sharedVertexCount += newVertices;
+	object.sharedTriangleCount += newTriangles;
+	dirty.clear();
+
+	// Refresh slices, over what has been published.
+	if (object.sharedVertexCount > 0){
+		int first = object.sharedRefreshVertex % object.sharedVertexCount;
+		int count = (std::min)(kShareRefreshElements, object.sharedVertexCount - first);
+		gSharedScene.writeSpan(SHARED_VERTICES, index, first, count, vertexCount, &vertices[first], sizeof(vec3));
+		object.sharedRefreshVertex = first + count;
+	}
+	if (object.sharedTriangleCount > 0){
+		int first = object.sharedRefreshTriangle % object.sharedTriangleCount;
+		int count = (std::min)(kShareRefreshElements, object.sharedTriangleCount - first);
+		writeSharedTriangles(index, first, count, triangles);
+		object.sharedRefreshTriangle = first + count;
+	}
+}
+
+/*******************************************************************************
+ Refines each deformed mesh where its active regions have become stretched or
+ curved, then hands the new vertices to the sessions that cover them.  Only
+ the union of the active regions is visited.  Caller holds gMeshMutex.
+*******************************************************************************/
+void refineDeformationRegions(){
+	TRACE_ZONE("refineDeformationRegions");
+	vector<OBJLoader *> refined;
+
+	for (int k = 0; k < gDeformationSessions.size(); k++){
+		OBJLoader *loader = gDeformationSessions[k]->getLoader();
+		if (find(refined.begin(), refined.end(), loader) != refined.end())
+			continue;
+		refined.push_back(loader);
+
+		vector<int> newVertices;
+		if (loader->refineRegion(gDeformationBatch.getTouchedVertices(loader), gRefineStretch, gRefineAngle, gRefineBudget, newVertices) == 0)
+			continue;
+
+		for (int j = 0; j < gDeformationSessions.size(); j++){
+			if (gDeformationSessions[j]->getLoader() == loader)
+				gDeformationSessions[j]->absorb(newVertices);
+		}
+		gDeformationBatch.invalidate();
+
+		// Every triangle refinement wrote has a new vertex for a corner.
+		for (int j = 0; j < hapticObjects.size(); j++){
+			if (&hapticObjects[j].loader != loader || !hapticObjects[j].halfEdges)
+				continue;
+			vector<int> triangles;
+			for (int v = 0; v < newVertices.size(); v++){
+				vector<int> const &incident = loader->getVertexTriangles()[newVertices[v]];
+				triangles.insert(triangles.end(), incident.begin(), incident.end());
+			}
+			sort(triangles.begin(), triangles.end());
+			triangles.erase(unique(triangles.begin(), triangles.end()), triangles.end());
+			hapticObjects[j].halfEdges->update(triangles);
+		}
+	}
+}
+
+/*******************************************************************************
+ Starts or stops anchored editing of the object the device holds.  Editing
+ anchors a stylus region at the vertex nearest the proxy, and the device is
+ held at the anchor by the coupling model.
+*******************************************************************************/
+void setAnchoredEditing(HapticDevice &device, bool enable){
+	device.anchoredEditing = enable;
+	if(enable && device.dragIndex != -1){
+		TRACE_LOCK_GUARD(lock, gMeshMutex);
+
+		device.initialProxyPosition = device.proxyPosition;
+		device.initialDevicePosition = device.devicePosition;
+		device.anchor = device.servoPosition.read();
+
+		int hapticObjectIndex = device.dragIndex;
+		OBJLoader &loader = hapticObjects[hapticObjectIndex].loader;
+
+		hduVector3Dd newModelPosition;
+		hduMatrix const &mat = gSceneGraph.getInverseWorld(hapticObjects[hapticObjectIndex].node);
+		mat.multVecMatrix(device.proxyPosition, newModelPosition);
+		vec3 pos(newModelPosition[0], newModelPosition[1], newModelPosition[2]);
+
+		int root = findNearestVertex(hapticObjectIndex, pos);
+		if (root == -1)
+			return;
+
+		endStylusSession(device);
+		device.session = new DeformationSession();
+		device.session->begin(&loader, root, maxNumSlices);
+		device.session->setNumSlices(deformationSlices());
+		gDeformationSessions.push_back(device.session);
+
+		// Hold the device at the anchor until the worker publishes its first solve.
+		++device.couplingSession;
+		ServoCommand command;
+		command.type = SERVO_BEGIN_COUPLING;
+		command.coupling = couplingModel(device, device.anchor);
+		sendServoCommand(device, command);
+
+		device.renderForce = HD_TRUE;
+	}else{
+		ServoCommand command;
+		command.type = SERVO_END_COUPLING;
+		sendServoCommand(device, command);
+
+		TRACE_LOCK_GUARD(lock, gMeshMutex);
+		device.renderForce = HD_FALSE;
+		endStylusSession(device);
+	}
+}
+
+/*******************************************************************************
+ Removes the device's stylus region from the active set.  Caller holds
+ gMeshMutex.
+*******************************************************************************/
+void endStylusSession(HapticDevice &device){
+	if (!device.session)
+		return;
+
+	gDeformationSessions.erase(find(gDeformationSessions.begin(), gDeformationSessions.end(), device.session));
+	delete device.session;
+	device.session = 0;
+}
+
+void updateDragObjTransform(HapticDevice &device){
+
+	int hapticIndex = device.dragIndex;
+	if(hapticIndex != -1 && !device.renderForce){
 		hduMatrix proxyxform;
 		hlGetDoublev(HL_PROXY_TRANSFORM, proxyxform);
 
 		// Translation part
 
 		hduVector3Dd proxyPos(proxyxform[3][0], proxyxform[3][1], proxyxform[3][2] );
+		hduMatrix const &gStartProxyTransform = device.startProxyTransform;
 		hduVector3Dd gstartDragProxyPos(gStartProxyTransform[3][0], gStartProxyTransform[3][1], gStartProxyTransform[3][2]);
 		hduVector3Dd dragDeltaTransl = proxyPos - gstartDragProxyPos;
 		hduMatrix deltaMat = hduMatrix::createTranslation(dragDeltaTransl);
@@ -870,15 +2961,160 @@ void updateDragObjTransform(){
 
 		hduMatrix overallDeltaRotation = toCenter*deltaRotationMatrix*fromCenter;
 
-		hapticObjects[hapticIndex].transform = (gInitialObjTransform * deltaMat) * overallDeltaRotation;
+		hduMatrix dragWorld = (device.initialObjTransform * deltaMat) * overallDeltaRotation;
+		if (gObjectCollisions && findDragContacts(device, hapticIndex, dragWorld, false) > 0)
+			return;
+
+		gSceneGraph.setWorld(hapticObjects[hapticIndex].node, dragWorld);
+		gFrameScheduler.markDirty(FRAME_DIRTY_TRANSFORM);
+	}
+}
+
+/*******************************************************************************
+ Collects the group that moves with the dragged object and the objects it is
+ already touching.
+*******************************************************************************/
+void beginDragCollisions(HapticDevice &device, int dragIndex){
+	int dragNode = hapticObjects[dragIndex].node;
+
+	device.dragGroup.assign(hapticObjects.size(), 0);
+	for(int i = 0; i < hapticObjects.size(); i++){
+		for(int node = hapticObjects[i].node; node >= 0; node = gSceneGraph.getParent(node)){
+			if(node == dragNode){
+				device.dragGroup[i] = 1;
+				break;
+			}
+		}
 	}
+
+	findDragContacts(device, dragIndex, gSceneGraph.getWorld(dragNode), true);
 }
 
-int findNearestPoint(vec3 pointPos, vector<vec3> vertices){
-	int closestIndex;
+/*******************************************************************************
+ Counts the objects outside the drag group that the group would intersect with
+ the dragged object placed at dragWorld.  Sweep-and-prune over world bounds
+ picks the candidate pairs; each is confirmed by a BVH triangle test in the
+ static object's model space.  At pickup, marks every object hit as resting
+ and notes how deep the group sinks into it.  Otherwise stops at the first
+ hit; a resting object only counts as hit once the group sinks into it
+ deeper than at any allowed pose so far, and an allowed pose clear of it
+ ends its exemption.  Without a distance field to tell depth by, a resting
+ object stays exempt until the group is clear of it.
+*******************************************************************************/
+int findDragContacts(HapticDevice &device, int dragIndex, hduMatrix const &dragWorld, bool pickup){
+	TRACE_ZONE("findDragContacts");
+	TRACE_LOCK_GUARD(lock, gMeshMutex);
+
+	// Moves a group member from its current world pose to the dragged one.
+	hduMatrix delta = gSceneGraph.getInverseWorld(hapticObjects[dragIndex].node) * dragWorld;
+
+	vector<hduMatrix> poses(hapticObjects.size());
+	vector<SweepAndPrune::Box> boxes(hapticObjects.size());
+	for(int i = 0; i < hapticObjects.size(); i++){
+		HapticObject &object = hapticObjects[i];
+		poses[i] = gSceneGraph.getWorld(object.node);
+		if(device.dragGroup[i])
+			poses[i] = poses[i] * delta;
+
+		if(!object.ready){
+			boxes[i].min = vec3(1, 1, 1);
+			boxes[i].max = vec3(-1, -1, -1);
+			continue;
+		}
+		object.bvh.sync();
+		object.bvh.getWorldBounds(poses[i], boxes[i].min, boxes[i].max);
+	}
+
+	gBroadPhase.update(boxes);
+
+	vector<char> touching(hapticObjects.size(), 0);
+	vector<float> depths(hapticObjects.size(), -1.0f);
+	vector<pair<int, int> > const &pairs = gBroadPhase.getPairs();
+	for(int k = 0; k < pairs.size(); k++){
+		int moving = pairs[k].first, other = pairs[k].second;
+		if(device.dragGroup[moving] == device.dragGroup[other])
+			continue;
+		if(!device.dragGroup[moving])
+			swap(moving, other);
+
+		hduMatrix toOther = poses[moving] * gSceneGraph.getInverseWorld(hapticObjects[other].node);
+		if(!hapticObjects[moving].bvh.intersects(hapticObjects[other].bvh, toOther))
+			continue;
+		if(!pickup && !device.restingContacts[other])
+			return 1;
+		touching[other] = 1;
+		depths[other] = (std::max)(depths[other], sinkDepth(moving, other, toOther));
+	}
+
+	int count = 0;
+	if(pickup){
+		device.restingContacts = touching;
+		device.restingDepth = depths;
+		for(int i = 0; i < touching.size(); i++)
+			count += touching[i];
+		return count;
+	}
+
+	for(int i = 0; i < touching.size(); i++){
+		if(touching[i] && device.restingDepth[i] >= 0.0f && depths[i] > device.restingDepth[i] + kRestingSlack)
+			return 1;
+	}
+
+	// The pose is allowed; the resting contacts follow it.
+	for(int i = 0; i < touching.size(); i++){
+		if(!device.restingContacts[i])
+			continue;
+		if(!touching[i])
+			device.restingContacts[i] = 0;
+		else if(depths[i] >= 0.0f && (device.restingDepth[i] < 0.0f || depths[i] < device.restingDepth[i]))
+			device.restingDepth[i] = depths[i];
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ How deep object moving, placed in other's model space by toOther, sinks into
+ other: the depth of its deepest vertex behind other's distance field, in
+ other's model units.  -1 while other has no field.  Caller holds gMeshMutex.
+*******************************************************************************/
+float sinkDepth(int moving, int other, hduMatrix const &toOther){
+	if(!hapticObjects[other].field)
+		return -1.0f;
+	std::shared_ptr<const DistanceField::Grid> grid = hapticObjects[other].field->getGrid();
+	if(!grid)
+		return -1.0f;
+
+	vector<vec3> const &vertices = hapticObjects[moving].loader.getVertices();
+	float depth = 0.0f;
+	for(int i = 0; i < vertices.size(); i++){
+		hduVector3Dd p;
+		toOther.multVecMatrix(hduVector3Dd(vertices[i].x, vertices[i].y, vertices[i].z), p);
+		depth = (std::max)(depth, -grid->distance(vec3((float) p[0], (float) p[1], (float) p[2]), 0));
+	}
+	return depth;
+}
+
+/*******************************************************************************
+ Vertex of scene object index closest to pos, in model space, or -1 if it has
+ no triangles left.  Vertices that a cut left without a triangle stay where
+ they were and are skipped, so that nothing anchors inside the hole.  Uses
+ the quantized copy when it is enabled.  Caller holds gMeshMutex.
+*******************************************************************************/
+int findNearestVertex(int index, vec3 pos){
+	if (gCompactMeshes && !hapticObjects[index].compact.isEmpty())
+		return hapticObjects[index].compact.findNearestVertex(pos);
+	return findNearestPoint(pos, hapticObjects[index].loader);
+}
+
+int findNearestPoint(vec3 pointPos, OBJLoader const &loader){
+	vector<vec3> const &vertices = loader.getVertices();
+	vector<vector<int> > const &vertexTriangles = loader.getVertexTriangles();
+	int closestIndex = -1;
 	double minDist = -1;
 
 	for(int i = 0; i < vertices.size(); i++){
+		if(vertexTriangles[i].empty())
+			continue;
 		double xDist = vertices[i].x - pointPos.x;
 		double yDist = vertices[i].y - pointPos.y;
 		double zDist = vertices[i].z - pointPos.z;
@@ -894,27 +3130,29 @@ int findNearestPoint(vec3 pointPos, vector<vec3> vertices){
 }
 
 
-void drawPoint(){
+void drawPoint(HapticDevice const &device){
 	glPointSize(10.0f);
 	glBegin(GL_POINTS); 
 	
 	glColor3f(1.0,1.0,0.0);
 
-	glVertex3f(touchedPoint[0], touchedPoint[1], touchedPoint[2]);
+	glVertex3f(device.touchedPoint[0], device.touchedPoint[1], device.touchedPoint[2]);
 	
 	glEnd();
 }
 
-int getIndexOfObject(int shapeID){
-	for(int i = 0; i < hapticObjects.size(); i++){
-		if(hapticObjects[i].shapeId == shapeID){
+int getIndexOfObject(HapticDevice const &device, HLuint shapeID){
+	for(int i = 0; i < device.shapeIds.size(); i++){
+		if(hapticObjects[i].ready && device.shapeIds[i] == shapeID){
 			return i;
 		}
 	}
 	return -1;
 }
 
-void drawConstrainedSpace(){
+void drawConstrainedSpace(HapticDevice const &device){
+	hduVector3Dd const &minPoint = device.minPoint;
+	hduVector3Dd const &maxPoint = device.maxPoint;
 	
 	vec3 Point0(minPoint[0], minPoint[1], minPoint[2]);
 	vec3 Point1(minPoint[0], minPoint[1], maxPoint[2]);
@@ -982,3 +3220,243 @@ void drawConstrainedSpace(){
 	glPopAttrib();
 }
 
+
+/*******************************************************************************
+ Recognizes "--benchmark <frames>" and the options that go with it:
+   --warmup <frames>    untimed frames drawn first (default 10)
+   --size <w>x<h>       surface size (default 1000x1000)
+   --mesh <file.obj>    draw this mesh instead of the scene
+   --copies <n>         instances of --mesh laid out on a grid (default 1)
+   --dump <prefix>      write frames as <prefix>NNNNN.ppm
+   --dump-every <n>     dump every n-th frame (default 1)
+   --operators <n>      stand-in devices moving at once (default 1)
+   --sculpt             each operator also deforms the first mesh
+ Also, with or without --benchmark:
+   --device <name>      use this device; repeat for several (default: the
+                        default device)
+   --stream <file.tvoc> stream this cluster mesh instead of the scene
+   --stream-budget <MB> memory for resident clusters (default 256)
+   --share <name>       publish the scene to shared memory for SceneViewer
+   --tool               start with six-degree-of-freedom tool contact
+ Returns false when the program should start normally.
+*******************************************************************************/
+bool parseBenchmarkArgs(int argc, char *argv[], BenchmarkOptions &options){
+	options.frames = 0;
+	options.warmupFrames = 10;
+	options.width = 1000;
+	options.height = 1000;
+	options.meshFile = 0;
+	options.copies = 1;
+	options.dumpPrefix = 0;
+	options.dumpEvery = 1;
+	options.operators = 1;
+	options.sculpt = false;
+
+	bool benchmark = false;
+	for (int i = 1; i < argc; i++){
+		bool hasValue = i + 1 < argc;
+		if (!strcmp(argv[i], "--benchmark") && hasValue){
+			options.frames = atoi(argv[++i]);
+			benchmark = true;
+		}else if (!strcmp(argv[i], "--warmup") && hasValue){
+			options.warmupFrames = atoi(argv[++i]);
+		}else if (!strcmp(argv[i], "--size") && hasValue){
+			sscanf(argv[++i], "%dx%d", &options.width, &options.height);
+		}else if (!strcmp(argv[i], "--mesh") && hasValue){
+			options.meshFile = argv[++i];
+		}else if (!strcmp(argv[i], "--copies") && hasValue){
+			options.copies = atoi(argv[++i]);
+		}else if (!strcmp(argv[i], "--dump") && hasValue){
+			options.dumpPrefix = argv[++i];
+		}else if (!strcmp(argv[i], "--dump-every") && hasValue){
+			options.dumpEvery = atoi(argv[++i]);
+		}else if (!strcmp(argv[i], "--operators") && hasValue){
+			options.operators = atoi(argv[++i]);
+		}else if (!strcmp(argv[i], "--sculpt")){
+			options.sculpt = true;
+		}else if (!strcmp(argv[i], "--device") && hasValue){
+			gDeviceNames.push_back(argv[++i]);
+		}else if (!strcmp(argv[i], "--share") && hasValue){
+			gShareName = argv[++i];
+		}else if (!strcmp(argv[i], "--tool")){
+			gToolRendering = true;
+		}else if (!strcmp(argv[i], "--contact-cache")){
+			gContactCache = true;
+		}else if (!strcmp(argv[i], "--stream") && hasValue){
+			gStreamFile = argv[++i];
+		}else if (!strcmp(argv[i], "--stream-budget") && hasValue){
+			gStreamBudgetMB = atoi(argv[++i]);
+		}else if (!strcmp(argv[i], "--memory-budget") && hasValue){
+			gMemoryBudgetMB = atoi(argv[++i]);
+		}
+	}
+
+	if (options.frames < 1) options.frames = 1;
+	if (options.warmupFrames < 0) options.warmupFrames = 0;
+	if (options.copies < 1) options.copies = 1;
+	if (options.dumpEvery < 1) options.dumpEvery = 1;
+	if (options.operators < 1) options.operators = 1;
+	return benchmark;
+}
+
+/*******************************************************************************
+ Draws the scene offscreen for the requested number of frames and prints the
+ distribution of frame times.  "draw" is the CPU time spent issuing GL calls;
+ "frame" also waits for the renderer to finish them.  With --sculpt, "solve"
+ is one deformation step over every operator's region.
+*******************************************************************************/
+int runBenchmark(BenchmarkOptions const &options){
+	OffscreenContext context;
+	if (!context.create(options.width, options.height))
+		return 1;
+	gHeadless = true;
+
+	for (int i = 0; i < options.operators; i++)
+		createDevice(HD_DEFAULT_DEVICE);
+
+	if (options.meshFile)
+		initBenchmarkModel(options);
+	else if (gStreamFile)
+		initStreamedMesh();
+	else
+		initOBJModel();
+	initGL();
+
+	// Every mesh has to be in place before the first timed frame.
+	gThreadPool.wait();
+	pollAssetLoads();
+
+	int vertices = 0, triangles = 0;
+	for (int i = 0; i < hapticObjects.size(); i++){
+		if (!hapticObjects[i].ready)
+			continue;
+		vertices += hapticObjects[i].loader.getVertices().size();
+		triangles += hapticObjects[i].loader.getTriangles().size();
+	}
+	size_t compactBytes = 0;
+	for (int i = 0; i < hapticObjects.size(); i++)
+		compactBytes += hapticObjects[i].compact.getMemoryBytes();
+	printf("Renderer: %s\n", (const char *) glGetString(GL_RENDERER));
+	printf("Surface: %dx%d, objects: %d, vertices: %d, triangles: %d\n",
+		context.getWidth(), context.getHeight(), (int) hapticObjects.size(), vertices, triangles);
+	if (compactBytes > 0)
+		printf("Compact meshes: %.1f KB, %.1f bytes/triangle\n", compactBytes / 1024.0, (double) compactBytes / triangles);
+
+	initSharedScene();
+
+	// Every operator grabs the first mesh and starts editing where it is.
+	bool sculpt = options.sculpt && !hapticObjects.empty() && hapticObjects[0].ready;
+	if (sculpt){
+		scriptBenchmarkFrame(0, options);
+		for (int i = 0; i < gDevices.size(); i++){
+			gDevices[i]->dragIndex = 0;
+			setAnchoredEditing(*gDevices[i], true);
+		}
+		printf("Operators: %d sculpting mesh 0\n", (int) gDevices.size());
+	}
+
+	for (int frame = 0; frame < options.warmupFrames; frame++){
+		scriptBenchmarkFrame(frame, options);
+		if (sculpt)
+			solveDeformation(1.0 / gDeformationRateHz, 0);
+		drawSceneGraphics();
+		glFinish();
+	}
+
+	FrameTimings drawTimes, frameTimes, solveTimes;
+	drawTimes.reserve(options.frames);
+	frameTimes.reserve(options.frames);
+	solveTimes.reserve(options.frames);
+
+	for (int frame = 0; frame < options.frames; frame++){
+		scriptBenchmarkFrame(frame, options);
+		if (sculpt){
+			PerfClock::time_point solveStart = PerfClock::now();
+			solveDeformation(1.0 / gDeformationRateHz, 0);
+			solveTimes.add(std::chrono::duration<double>(PerfClock::now() - solveStart).count());
+		}
+
+		PerfClock::time_point start = PerfClock::now();
+		drawSceneGraphics();
+		PerfClock::time_point issued = PerfClock::now();
+		glFinish();
+		PerfClock::time_point end = PerfClock::now();
+
+		drawTimes.add(std::chrono::duration<double>(issued - start).count());
+		frameTimes.add(std::chrono::duration<double>(end - start).count());
+
+		if (options.dumpPrefix && frame % options.dumpEvery == 0){
+			char filename[1024];
+			sprintf(filename, "%s%05d.ppm", options.dumpPrefix, frame);
+			if (!context.writePPM(filename))
+				fprintf(stderr, "Could not write %s\n", filename);
+		}
+	}
+
+	drawTimes.print(stdout, "draw");
+	frameTimes.print(stdout, "frame");
+	if (sculpt)
+		solveTimes.print(stdout, "solve");
+	printf("Mean frame rate: %.1f Hz\n", 1000.0 / frameTimes.summarize().meanMs);
+
+	gSharePublisher.stop();
+	gSharedScene.close();
+	TRACE_WRITE("trace.json");
+	context.release();
+	return 0;
+}
+
+/*******************************************************************************
+ Replaces the scene with copies of one mesh on a square grid, so draw cost can
+ be compared across mesh sizes and instance counts.
+*******************************************************************************/
+void initBenchmarkModel(BenchmarkOptions const &options){
+	int columns = (int) ceil(sqrt((double) options.copies));
+	double spacing = 2.5 / columns;
+
+	hapticObjects.resize(options.copies);
+	for(int i = 0; i < options.copies; i++){
+		double x = ((i % columns) - 0.5 * (columns - 1)) * spacing;
+		double z = ((i / columns) - 0.5 * (columns - 1)) * spacing;
+		hapticObjects[i].node = gSceneGraph.addNode(-1, hduMatrix::createScale(1.0 / columns, 1.0 / columns, 1.0 / columns) *
+			hduMatrix::createTranslation(x, 0, z));
+		hapticObjects[i].ready = false;
+		hapticObjects[i].rejected = false;
+		hapticObjects[i].downgraded = false;
+		gAssetLoader.request(i, &hapticObjects[i].loader, options.meshFile);
+	}
+	gSceneGraph.update();
+
+	pencilCursor.ready = false;
+	gAssetLoader.request(kPencilAssetId, &pencilCursor.loader, "pencil.obj");
+}
+
+/*******************************************************************************
+ Sets the camera and the stand-in devices for one benchmark frame.  Over the
+ run the camera makes one orbit while each proxy sweeps a Lissajous path over
+ the scene with a slow tilt, so the cursor, depth and lighting all change from
+ frame to frame.  Operators run the same path at evenly spread phases.
+*******************************************************************************/
+void scriptBenchmarkFrame(int frame, BenchmarkOptions const &options){
+	static const double kPI = 3.1415926535897932384626433832795;
+
+	gCameraOrbit = 2.0 * kPI * frame / options.frames;
+	glutReshape(options.width, options.height);
+
+	for (int i = 0; i < gDevices.size(); i++){
+		HapticDevice &device = *gDevices[i];
+		double t = (double) frame / options.frames + (double) i / gDevices.size();
+
+		device.proxyPosition = hduVector3Dd(0.8 * sin(6.0 * kPI * t),
+			0.6 + 0.3 * cos(10.0 * kPI * t),
+			0.8 * sin(4.0 * kPI * t));
+		device.devicePosition = device.proxyPosition;
+		device.servoPosition.write(device.devicePosition);
+
+		device.scriptedProxyTransform = hduMatrix::createRotation(hduVector3Dd(1, 0, 0), 0.4 * sin(2.0 * kPI * t)) *
+			hduMatrix::createTranslation(device.proxyPosition);
+		const HDdouble *scripted = device.scriptedProxyTransform;
+		for (int k = 0; k < 16; k++)
+			device.proxyxform[k] = scripted[k];
+	}
+}
@@ -0,0 +1,43 @@
+#include "assetloader.h"
+
+AssetLoader::AssetLoader(ThreadPool &pool) :
+mPool(pool),
+mPending(0)
+{
+}
+
+void AssetLoader::request(int id, OBJLoader *loader, std::string const &filename)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mPending++;
+	}
+
+	mPool.submit([this, id, loader, filename]() {
+		Result result;
+		result.id = id;
+		result.success = loader->load(filename.c_str());
+
+		std::lock_guard<std::mutex> lock(mMutex);
+		mFinished.push_back(result);
+	});
+}
+
+bool AssetLoader::poll(int &id, bool &success)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	if (mFinished.empty())
+		return false;
+
+	id = mFinished.front().id;
+	success = mFinished.front().success;
+	mFinished.pop_front();
+	mPending--;
+	return true;
+}
+
+int AssetLoader::getPending() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mPending;
+}
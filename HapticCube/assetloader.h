@@ -0,0 +1,43 @@
+#ifndef ASSETLOADER_H
+#define ASSETLOADER_H
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include "objloader.h"
+#include "threadpool.h"
+
+	//! Loads OBJ meshes on a thread pool.
+	//!
+	//! Each request parses and preprocesses its file straight into the
+	//! caller's OBJLoader, or shares an earlier load of the same file. The
+	//! loader must not be touched until poll() reports the request as
+	//! finished.
+	class AssetLoader {
+	public:
+		//! Constructor
+		//!
+		explicit AssetLoader(ThreadPool &pool);
+
+		void request(int id, OBJLoader *loader, std::string const &filename);
+
+		//! Returns one finished request, or false if none is waiting.
+		//! Never blocks.
+		bool poll(int &id, bool &success);
+
+		//! Number of requests not yet returned by poll().
+		int getPending() const;
+
+	private:
+		struct Result {
+			int id;
+			bool success;
+		};
+
+		ThreadPool &mPool;
+		mutable std::mutex mMutex;
+		std::deque<Result> mFinished;
+		int mPending;
+	};
+
+#endif
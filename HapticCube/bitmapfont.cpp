@@ -0,0 +1,47 @@
+#include <cstring>
+#include "bitmapfont.h"
+
+static const int kFirstGlyph = 32;
+static const int kNumGlyphs = 96;
+
+BitmapFont::BitmapFont() :
+mListBase(0)
+{
+}
+
+BitmapFont::~BitmapFont()
+{
+	// Lists are owned by the GL context; release() must run while it is
+	// still current.
+}
+
+void BitmapFont::init(void *font)
+{
+	if (mListBase)
+		return;
+
+	mListBase = glGenLists(kNumGlyphs);
+	for (int i = 0; i < kNumGlyphs; i++) {
+		glNewList(mListBase + i, GL_COMPILE);
+		glutBitmapCharacter(font, kFirstGlyph + i);
+		glEndList();
+	}
+}
+
+void BitmapFont::release()
+{
+	if (mListBase)
+		glDeleteLists(mListBase, kNumGlyphs);
+	mListBase = 0;
+}
+
+void BitmapFont::drawString(GLfloat x, GLfloat y, const char *text) const
+{
+	glRasterPos2f(x, y);
+
+	// Each glyph list advances the raster position like glutBitmapCharacter.
+	glPushAttrib(GL_LIST_BIT);
+	glListBase(mListBase - kFirstGlyph);
+	glCallLists((GLsizei) strlen(text), GL_UNSIGNED_BYTE, text);
+	glPopAttrib();
+}
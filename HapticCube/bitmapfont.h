@@ -0,0 +1,34 @@
+#ifndef BITMAPFONT_H
+#define BITMAPFONT_H
+#if defined(WIN32) || defined(linux)
+#include <GL/glut.h>
+#elif defined(__APPLE__)
+#include <GLUT/glut.h>
+#endif
+
+	//! GLUT bitmap font compiled into one display list per printable
+	//! character, so a whole string is drawn with a single glCallLists.
+	class BitmapFont {
+	public:
+		//! Constructor
+		//!
+		BitmapFont();
+
+		//! Destructor
+		//!
+		~BitmapFont();
+
+		//! Builds the glyph lists. Needs a current GL context.
+		void init(void *font);
+		void release();
+
+		void drawString(GLfloat x, GLfloat y, const char *text) const;
+
+	private:
+		BitmapFont(const BitmapFont &);
+		BitmapFont &operator=(const BitmapFont &);
+
+		GLuint mListBase;
+	};
+
+#endif
@@ -0,0 +1,877 @@
+#if defined(WIN32)
+#include <windows.h>
+#endif
+#if defined(WIN32) || defined(linux)
+#include <GL/gl.h>
+#elif defined(__APPLE__)
+#include <OpenGL/gl.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include "clustermesh.h"
+
+static const char kClusterMagic[8] = "TVOCLU1";
+
+// Cells per axis of the vertex-clustering grid that makes a node's proxy,
+// across the node's octree cube.
+static const int kProxyCells = 8;
+
+// A node is opened up into its children's proxies while it spans more than
+// this fraction of its distance from the eye.
+static const float kLodRatio = 0.5f;
+
+// Face records held in memory before they are sorted into the cluster file.
+static const int kSortBatch = 1 << 20;
+
+struct ClusterFileHeader {
+	char magic[8];
+	int nodeCount;
+	int reserved;
+	long long nodeTableOffset;
+};
+
+struct ClusterFileNode {
+	float min[3];
+	float max[3];
+	int firstChild;
+	int childCount;
+	long long proxyOffset;
+	long long meshOffset;
+	int proxyBytes;
+	int meshBytes;
+};
+
+static int seekFile(FILE *file, long long offset)
+{
+#if defined(WIN32)
+	return _fseeki64(file, offset, SEEK_SET);
+#else
+	return fseeko(file, (off_t) offset, SEEK_SET);
+#endif
+}
+
+static long long tellFile(FILE *file)
+{
+#if defined(WIN32)
+	return _ftelli64(file);
+#else
+	return (long long) ftello(file);
+#endif
+}
+
+/*******************************************************************************
+ Conversion
+*******************************************************************************/
+
+namespace {
+
+	struct MeshChunk {
+		std::vector<glm::vec3> positions;
+		std::vector<glm::vec3> normals;
+		std::vector<glm::vec3> colors;
+		std::vector<unsigned int> indices;
+	};
+
+	struct FaceRecord {
+		unsigned int cell;
+		unsigned int v[3];
+		bool operator<(FaceRecord const &other) const { return cell < other.cell; }
+	};
+
+	bool readLine(FILE *file, std::string &line)
+	{
+		char buffer[4096];
+		line.clear();
+		while (fgets(buffer, sizeof(buffer), file)) {
+			line += buffer;
+			if (line[line.size() - 1] == '\n')
+				return true;
+		}
+		return !line.empty();
+	}
+
+	// Calls triangle(a, b, c) for every face of the file, fanning polygons.
+	// Indices are zero-based; negative OBJ indices are resolved.
+	void forEachTriangle(FILE *file, std::function<void(unsigned int, unsigned int, unsigned int)> const &triangle)
+	{
+		rewind(file);
+		std::string line;
+		std::vector<long long> corners;
+		long long vertexCount = 0;
+		while (readLine(file, line)) {
+			if (line.compare(0, 2, "v ") == 0) {
+				vertexCount++;
+				continue;
+			}
+			if (line.compare(0, 2, "f ") != 0)
+				continue;
+
+			corners.clear();
+			const char *s = line.c_str() + 2;
+			while (*s) {
+				while (*s == ' ' || *s == '\t')
+					s++;
+				if (!*s || *s == '\r' || *s == '\n')
+					break;
+				long long index = atoll(s);
+				corners.push_back(index < 0 ? vertexCount + index : index - 1);
+				while (*s && *s != ' ' && *s != '\t')
+					s++;
+			}
+			for (int k = 2; k < corners.size(); k++) {
+				if (corners[0] < 0 || corners[k - 1] < 0 || corners[k] < 0 ||
+					corners[0] >= vertexCount || corners[k - 1] >= vertexCount || corners[k] >= vertexCount)
+					continue;
+				triangle((unsigned int) corners[0], (unsigned int) corners[k - 1], (unsigned int) corners[k]);
+			}
+		}
+	}
+
+	// Vertex clustering: every vertex moves to the average of its cell, and
+	// collapsed triangles go. The cells of every level are aligned to the
+	// same origin and halve in size from parent to child, so clustering the
+	// children's proxies gives the same result as clustering their
+	// triangles, and siblings agree on the cells along their shared border.
+	void simplify(MeshChunk const &chunk, float cellSize, MeshChunk &proxy)
+	{
+		std::unordered_map<long long, int> cells;
+		std::vector<int> remap(chunk.positions.size());
+		std::vector<int> weights;
+		for (int v = 0; v < chunk.positions.size(); v++) {
+			glm::vec3 c = (chunk.positions[v] + glm::vec3(1, 1, 1)) / cellSize;
+			long long key = (((long long) floor(c.z) + (1 << 20)) << 42) |
+				(((long long) floor(c.y) + (1 << 20)) << 21) | ((long long) floor(c.x) + (1 << 20));
+
+			std::unordered_map<long long, int>::iterator it = cells.find(key);
+			if (it == cells.end()) {
+				it = cells.insert(std::make_pair(key, (int) proxy.positions.size())).first;
+				proxy.positions.push_back(glm::vec3(0, 0, 0));
+				proxy.normals.push_back(glm::vec3(0, 0, 0));
+				proxy.colors.push_back(glm::vec3(0, 0, 0));
+				weights.push_back(0);
+			}
+			int p = it->second;
+			remap[v] = p;
+			proxy.positions[p] += chunk.positions[v];
+			proxy.normals[p] += chunk.normals[v];
+			proxy.colors[p] += chunk.colors[v];
+			weights[p]++;
+		}
+
+		for (int p = 0; p < proxy.positions.size(); p++) {
+			proxy.positions[p] /= (float) weights[p];
+			proxy.colors[p] /= (float) weights[p];
+			float length = glm::length(proxy.normals[p]);
+			proxy.normals[p] = length > 0.0f ? proxy.normals[p] / length : glm::vec3(0, 1, 0);
+		}
+
+		for (int i = 0; i + 2 < chunk.indices.size(); i += 3) {
+			int a = remap[chunk.indices[i]], b = remap[chunk.indices[i + 1]], c = remap[chunk.indices[i + 2]];
+			if (a == b || b == c || c == a)
+				continue;
+			proxy.indices.push_back(a);
+			proxy.indices.push_back(b);
+			proxy.indices.push_back(c);
+		}
+	}
+
+	bool writeChunk(FILE *out, MeshChunk const &chunk, long long &offset, int &bytes)
+	{
+		offset = tellFile(out);
+		int counts[2] = { (int) chunk.positions.size(), (int) chunk.indices.size() / 3 };
+		std::vector<unsigned char> colors(3 * chunk.colors.size());
+		for (int v = 0; v < chunk.colors.size(); v++) {
+			for (int k = 0; k < 3; k++)
+				colors[3 * v + k] = (unsigned char) (glm::clamp(chunk.colors[v][k], 0.0f, 1.0f) * 255.0f + 0.5f);
+		}
+
+		bool ok = fwrite(counts, sizeof(counts), 1, out) == 1;
+		if (counts[0] > 0) {
+			ok = ok && fwrite(&chunk.positions[0], sizeof(glm::vec3), counts[0], out) == counts[0];
+			ok = ok && fwrite(&chunk.normals[0], sizeof(glm::vec3), counts[0], out) == counts[0];
+			ok = ok && fwrite(&colors[0], 3, counts[0], out) == counts[0];
+		}
+		if (counts[1] > 0)
+			ok = ok && fwrite(&chunk.indices[0], 3 * sizeof(unsigned int), counts[1], out) == counts[1];
+		bytes = (int) (tellFile(out) - offset);
+		return ok;
+	}
+
+	class ClusterBuilder {
+	public:
+		std::vector<glm::vec3> positions;	// unitized
+		glm::vec3 center;
+		float scale;
+		int grid;
+		std::vector<long long> cellStart;
+		std::vector<long long> summedCounts;	// (grid + 1)^3 summed-volume table
+		FILE *faces;
+		FILE *out;
+		std::vector<ClusterFileNode> nodes;
+
+		long long countCube(int x, int y, int z, int size) const
+		{
+			int n = grid + 1;
+			int x1 = x + size, y1 = y + size, z1 = z + size;
+#define SVT(i, j, k) summedCounts[((long long) (k) * n + (j)) * n + (i)]
+			return SVT(x1, y1, z1) - SVT(x, y1, z1) - SVT(x1, y, z1) - SVT(x1, y1, z)
+				+ SVT(x, y, z1) + SVT(x, y1, z) + SVT(x1, y, z) - SVT(x, y, z);
+#undef SVT
+		}
+
+		bool buildLeaf(int index, int cell, MeshChunk &proxy)
+		{
+			long long count = cellStart[cell + 1] - cellStart[cell];
+			std::vector<FaceRecord> records((size_t) count);
+			if (seekFile(faces, cellStart[cell] * sizeof(FaceRecord)) != 0 ||
+				fread(&records[0], sizeof(FaceRecord), (size_t) count, faces) != count)
+				return false;
+
+			MeshChunk chunk;
+			std::unordered_map<unsigned int, unsigned int> remap;
+			for (int i = 0; i < records.size(); i++) {
+				for (int k = 0; k < 3; k++) {
+					unsigned int v = records[i].v[k];
+					std::unordered_map<unsigned int, unsigned int>::iterator it = remap.find(v);
+					if (it == remap.end()) {
+						it = remap.insert(std::make_pair(v, (unsigned int) chunk.positions.size())).first;
+						chunk.positions.push_back(positions[v]);
+						chunk.normals.push_back(glm::vec3(0, 0, 0));
+
+						// Same coloring as OBJLoader: the direction of the
+						// vertex in the original file.
+						glm::vec3 original = positions[v] / scale + center;
+						float length = glm::length(original);
+						chunk.colors.push_back(length > 0.0f ? glm::abs(original / length) : glm::vec3(1, 1, 1));
+					}
+					chunk.indices.push_back(it->second);
+				}
+			}
+
+			for (int i = 0; i < chunk.indices.size(); i += 3) {
+				glm::vec3 a = chunk.positions[chunk.indices[i]];
+				glm::vec3 normal = glm::cross(chunk.positions[chunk.indices[i + 1]] - a, chunk.positions[chunk.indices[i + 2]] - a);
+				for (int k = 0; k < 3; k++)
+					chunk.normals[chunk.indices[i + k]] += normal;
+			}
+			for (int v = 0; v < chunk.normals.size(); v++) {
+				float length = glm::length(chunk.normals[v]);
+				chunk.normals[v] = length > 0.0f ? chunk.normals[v] / length : glm::vec3(0, 1, 0);
+			}
+
+			glm::vec3 min = chunk.positions[0], max = chunk.positions[0];
+			for (int v = 1; v < chunk.positions.size(); v++) {
+				min = glm::min(min, chunk.positions[v]);
+				max = glm::max(max, chunk.positions[v]);
+			}
+			setBounds(index, min, max);
+
+			simplify(chunk, proxyCellSize(1), proxy);
+			return writeChunk(out, chunk, nodes[index].meshOffset, nodes[index].meshBytes) &&
+				writeChunk(out, proxy, nodes[index].proxyOffset, nodes[index].proxyBytes);
+		}
+
+		bool build(int index, int x, int y, int z, int size, MeshChunk &proxy)
+		{
+			nodes[index].firstChild = -1;
+			nodes[index].childCount = 0;
+			nodes[index].meshOffset = 0;
+			nodes[index].meshBytes = 0;
+
+			if (size == 1)
+				return buildLeaf(index, (z * grid + y) * grid + x, proxy);
+
+			// Children of a node are stored next to each other.
+			int half = size / 2;
+			int cubes[8][3];
+			int count = 0;
+			for (int k = 0; k < 8; k++) {
+				int cx = x + (k & 1) * half, cy = y + ((k >> 1) & 1) * half, cz = z + ((k >> 2) & 1) * half;
+				if (countCube(cx, cy, cz, half) == 0)
+					continue;
+				cubes[count][0] = cx;
+				cubes[count][1] = cy;
+				cubes[count][2] = cz;
+				count++;
+			}
+			int first = nodes.size();
+			nodes[index].firstChild = first;
+			nodes[index].childCount = count;
+			nodes.resize(first + count);
+
+			MeshChunk merged;
+			glm::vec3 min(1e30f, 1e30f, 1e30f), max(-1e30f, -1e30f, -1e30f);
+			for (int c = 0; c < count; c++) {
+				MeshChunk child;
+				if (!build(first + c, cubes[c][0], cubes[c][1], cubes[c][2], half, child))
+					return false;
+
+				unsigned int base = merged.positions.size();
+				merged.positions.insert(merged.positions.end(), child.positions.begin(), child.positions.end());
+				merged.normals.insert(merged.normals.end(), child.normals.begin(), child.normals.end());
+				merged.colors.insert(merged.colors.end(), child.colors.begin(), child.colors.end());
+				for (int i = 0; i < child.indices.size(); i++)
+					merged.indices.push_back(base + child.indices[i]);
+
+				ClusterFileNode const &node = nodes[first + c];
+				min = glm::min(min, glm::vec3(node.min[0], node.min[1], node.min[2]));
+				max = glm::max(max, glm::vec3(node.max[0], node.max[1], node.max[2]));
+			}
+			setBounds(index, min, max);
+
+			simplify(merged, proxyCellSize(size), proxy);
+			return writeChunk(out, proxy, nodes[index].proxyOffset, nodes[index].proxyBytes);
+		}
+
+		// Proxy cell size for a node spanning size grid cells; the grid
+		// spans [-1, 1].
+		float proxyCellSize(int size) const
+		{
+			return 2.0f * size / grid / kProxyCells;
+		}
+
+		void setBounds(int index, glm::vec3 const &min, glm::vec3 const &max)
+		{
+			for (int k = 0; k < 3; k++) {
+				nodes[index].min[k] = min[k];
+				nodes[index].max[k] = max[k];
+			}
+		}
+	};
+
+}
+
+bool buildClusterMesh(const char *objFile, const char *clusterFile, int clusterTriangles)
+{
+	FILE *in = fopen(objFile, "r");
+	if (!in) {
+		fprintf(stderr, "Could not open %s\n", objFile);
+		return false;
+	}
+
+	// Pass 1: positions, unitized as OBJLoader does.
+	ClusterBuilder builder;
+	std::string line;
+	while (readLine(in, line)) {
+		if (line.compare(0, 2, "v ") != 0)
+			continue;
+		glm::vec3 p;
+		if (sscanf(line.c_str() + 2, "%f %f %f", &p.x, &p.y, &p.z) == 3)
+			builder.positions.push_back(p);
+		else
+			builder.positions.push_back(glm::vec3(0, 0, 0));
+	}
+	if (builder.positions.empty()) {
+		fprintf(stderr, "No vertices in %s\n", objFile);
+		fclose(in);
+		return false;
+	}
+
+	glm::vec3 min = builder.positions[0], max = builder.positions[0];
+	for (int v = 1; v < builder.positions.size(); v++) {
+		min = glm::min(min, builder.positions[v]);
+		max = glm::max(max, builder.positions[v]);
+	}
+	glm::vec3 extent = max - min;
+	builder.center = (min + max) * 0.5f;
+	builder.scale = 2.0f / glm::max(glm::max(glm::max(extent.x, extent.y), extent.z), 1e-20f);
+	for (int v = 0; v < builder.positions.size(); v++)
+		builder.positions[v] = (builder.positions[v] - builder.center) * builder.scale;
+
+	// Pass 2: triangles per cell of a grid sized so that cells on the
+	// surface hold about clusterTriangles each.
+	long long triangleCount = 0;
+	forEachTriangle(in, [&](unsigned int a, unsigned int b, unsigned int c) { triangleCount++; });
+	if (triangleCount == 0) {
+		fprintf(stderr, "No faces in %s\n", objFile);
+		fclose(in);
+		return false;
+	}
+
+	int grid = 1;
+	while (grid < 128 && (double) grid * grid * clusterTriangles < triangleCount)
+		grid *= 2;
+	builder.grid = grid;
+
+	std::vector<glm::vec3> const &positions = builder.positions;
+	std::function<unsigned int(unsigned int, unsigned int, unsigned int)> cellOf =
+		[&](unsigned int a, unsigned int b, unsigned int c) -> unsigned int {
+		glm::vec3 centroid = (positions[a] + positions[b] + positions[c]) / 3.0f;
+		glm::vec3 g = (centroid + glm::vec3(1, 1, 1)) * (0.5f * grid);
+		int x = glm::clamp((int) g.x, 0, grid - 1), y = glm::clamp((int) g.y, 0, grid - 1), z = glm::clamp((int) g.z, 0, grid - 1);
+		return (z * grid + y) * grid + x;
+	};
+
+	int cellCount = grid * grid * grid;
+	std::vector<long long> counts(cellCount, 0);
+	forEachTriangle(in, [&](unsigned int a, unsigned int b, unsigned int c) { counts[cellOf(a, b, c)]++; });
+
+	builder.cellStart.assign(cellCount + 1, 0);
+	for (int cell = 0; cell < cellCount; cell++)
+		builder.cellStart[cell + 1] = builder.cellStart[cell] + counts[cell];
+
+	int n = grid + 1;
+	builder.summedCounts.assign((size_t) n * n * n, 0);
+	for (int z = 1; z < n; z++) {
+		for (int y = 1; y < n; y++) {
+			for (int x = 1; x < n; x++) {
+#define SVT(i, j, k) builder.summedCounts[((size_t) (k) * n + (j)) * n + (i)]
+				SVT(x, y, z) = counts[((z - 1) * grid + (y - 1)) * grid + (x - 1)]
+					+ SVT(x - 1, y, z) + SVT(x, y - 1, z) + SVT(x, y, z - 1)
+					- SVT(x - 1, y - 1, z) - SVT(x - 1, y, z - 1) - SVT(x, y - 1, z - 1)
+					+ SVT(x - 1, y - 1, z - 1);
+#undef SVT
+			}
+		}
+	}
+
+	// Pass 3: faces sorted by cell into a scratch file, a batch at a time.
+	std::string facesFile = std::string(clusterFile) + ".faces";
+	builder.faces = fopen(facesFile.c_str(), "w+b");
+	if (!builder.faces) {
+		fprintf(stderr, "Could not create %s\n", facesFile.c_str());
+		fclose(in);
+		return false;
+	}
+
+	bool ok = true;
+	std::vector<long long> written(cellCount, 0);
+	std::vector<FaceRecord> batch;
+	batch.reserve(kSortBatch);
+	std::function<void()> flush = [&]() {
+		std::sort(batch.begin(), batch.end());
+		for (int i = 0; i < batch.size() && ok;) {
+			int j = i;
+			unsigned int cell = batch[i].cell;
+			while (j < batch.size() && batch[j].cell == cell)
+				j++;
+			ok = seekFile(builder.faces, (builder.cellStart[cell] + written[cell]) * sizeof(FaceRecord)) == 0 &&
+				fwrite(&batch[i], sizeof(FaceRecord), j - i, builder.faces) == j - i;
+			written[cell] += j - i;
+			i = j;
+		}
+		batch.clear();
+	};
+	forEachTriangle(in, [&](unsigned int a, unsigned int b, unsigned int c) {
+		FaceRecord record;
+		record.cell = cellOf(a, b, c);
+		record.v[0] = a;
+		record.v[1] = b;
+		record.v[2] = c;
+		batch.push_back(record);
+		if (batch.size() == kSortBatch)
+			flush();
+	});
+	flush();
+	fclose(in);
+
+	// Octree over the grid, written depth first; the node table goes last.
+	builder.out = fopen(clusterFile, "wb");
+	if (!builder.out) {
+		fprintf(stderr, "Could not create %s\n", clusterFile);
+		ok = false;
+	}
+
+	ClusterFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, kClusterMagic, sizeof(header.magic));
+	if (ok)
+		ok = fwrite(&header, sizeof(header), 1, builder.out) == 1;
+
+	if (ok) {
+		MeshChunk rootProxy;
+		builder.nodes.resize(1);
+		ok = builder.build(0, 0, 0, 0, grid, rootProxy);
+	}
+
+	if (ok) {
+		header.nodeCount = builder.nodes.size();
+		header.nodeTableOffset = tellFile(builder.out);
+		ok = fwrite(&builder.nodes[0], sizeof(ClusterFileNode), builder.nodes.size(), builder.out) == builder.nodes.size() &&
+			seekFile(builder.out, 0) == 0 &&
+			fwrite(&header, sizeof(header), 1, builder.out) == 1;
+	}
+
+	if (builder.out && fclose(builder.out) != 0)
+		ok = false;
+	fclose(builder.faces);
+	remove(facesFile.c_str());
+
+	if (!ok)
+		fprintf(stderr, "Could not write %s\n", clusterFile);
+	else
+		printf("%s: %lld triangles in %d nodes, %d^3 grid\n", clusterFile, triangleCount, (int) builder.nodes.size(), grid);
+	return ok;
+}
+
+/*******************************************************************************
+ Streaming
+*******************************************************************************/
+
+size_t ClusterMesh::Payload::getBytes() const
+{
+	return sizeof(Payload) + (positions.size() + normals.size()) * sizeof(glm::vec3) +
+		colors.size() + indices.size() * sizeof(unsigned int);
+}
+
+ClusterMesh::ClusterMesh() :
+mBudget(256 << 20),
+mResidentBytes(0),
+mCancelled(false),
+mFrame(0),
+mFocusRadius(0.0f),
+mDrawnTriangles(0),
+mNearTriangles(0)
+{
+}
+
+ClusterMesh::~ClusterMesh()
+{
+	close();
+}
+
+bool ClusterMesh::open(const char *filename, int ioThreads)
+{
+	close();
+
+	FILE *file = fopen(filename, "rb");
+	if (!file) {
+		fprintf(stderr, "Could not open %s\n", filename);
+		return false;
+	}
+
+	ClusterFileHeader header;
+	bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+		!memcmp(header.magic, kClusterMagic, sizeof(header.magic)) &&
+		header.nodeCount > 0 && seekFile(file, header.nodeTableOffset) == 0;
+
+	std::vector<ClusterFileNode> nodes;
+	if (ok) {
+		nodes.resize(header.nodeCount);
+		ok = fread(&nodes[0], sizeof(ClusterFileNode), nodes.size(), file) == nodes.size();
+	}
+	if (!ok) {
+		fprintf(stderr, "%s is not a cluster mesh\n", filename);
+		fclose(file);
+		return false;
+	}
+
+	mFilename = filename;
+	mNodes.resize(nodes.size());
+	for (int i = 0; i < nodes.size(); i++) {
+		Node &node = mNodes[i];
+		memcpy(node.min, nodes[i].min, sizeof(node.min));
+		memcpy(node.max, nodes[i].max, sizeof(node.max));
+		node.firstChild = nodes[i].firstChild;
+		node.childCount = nodes[i].childCount;
+		node.proxyOffset = nodes[i].proxyOffset;
+		node.proxyBytes = nodes[i].proxyBytes;
+		node.meshOffset = nodes[i].meshOffset;
+		node.meshBytes = nodes[i].meshBytes;
+	}
+
+	// The root proxy is always resident, so there is something to draw
+	// from the first frame.
+	std::shared_ptr<Payload> root(new Payload());
+	ok = readPayload(file, proxyKey(0), *root);
+	fclose(file);
+	if (!ok) {
+		fprintf(stderr, "Could not read %s\n", filename);
+		mNodes.clear();
+		return false;
+	}
+
+	Entry &entry = mResident[proxyKey(0)];
+	entry.payload = root;
+	entry.lru = mLRU.insert(mLRU.begin(), proxyKey(0));
+	entry.frame = mFrame;
+	mResidentBytes = root->getBytes();
+
+	mCancelled = false;
+	mIO.reset(new ThreadPool(ioThreads));
+	return true;
+}
+
+void ClusterMesh::close()
+{
+	// Queued reads see the flag and return at once.
+	mCancelled = true;
+	mIO.reset();
+
+	mNodes.clear();
+	mResident.clear();
+	mLRU.clear();
+	mResidentBytes = 0;
+	mFinished.clear();
+	mPending.clear();
+	mCut.clear();
+	mNear.clear();
+	mDrawnTriangles = 0;
+	mNearTriangles = 0;
+}
+
+bool ClusterMesh::isOpen() const
+{
+	return !mNodes.empty();
+}
+
+void ClusterMesh::setMemoryBudget(size_t bytes)
+{
+	mBudget = bytes;
+}
+
+size_t ClusterMesh::getMemoryBudget() const
+{
+	return mBudget;
+}
+
+void ClusterMesh::update(glm::vec3 const &eye, float const frustum[6][4], glm::vec3 const &focus, float focusRadius)
+{
+	if (!isOpen())
+		return;
+
+	mFrame++;
+	mEye = eye;
+	memcpy(mFrustum, frustum, sizeof(mFrustum));
+	mFocus = focus;
+	mFocusRadius = focusRadius;
+
+	receive();
+
+	mCut.clear();
+	mNear.clear();
+	visit(0, mCut);
+	evict();
+
+	mDrawnTriangles = 0;
+	for (int i = 0; i < mCut.size(); i++)
+		mDrawnTriangles += mCut[i]->indices.size() / 3;
+	mNearTriangles = 0;
+	for (int i = 0; i < mNear.size(); i++)
+		mNearTriangles += mNear[i]->indices.size() / 3;
+}
+
+bool ClusterMesh::visit(int index, std::vector<std::shared_ptr<const Payload> > &cut)
+{
+	Node const &node = mNodes[index];
+	glm::vec3 min(node.min[0], node.min[1], node.min[2]), max(node.max[0], node.max[1], node.max[2]);
+
+	// Entirely behind one plane: nothing to draw.
+	for (int p = 0; p < 6; p++) {
+		glm::vec3 normal(mFrustum[p][0], mFrustum[p][1], mFrustum[p][2]);
+		glm::vec3 corner(normal.x >= 0 ? max.x : min.x, normal.y >= 0 ? max.y : min.y, normal.z >= 0 ? max.z : min.z);
+		if (glm::dot(normal, corner) + mFrustum[p][3] < 0.0f)
+			return true;
+	}
+
+	bool nearFocus = glm::length(glm::max(min, glm::min(mFocus, max)) - mFocus) <= mFocusRadius;
+	if (node.childCount == 0) {
+		if (nearFocus) {
+			std::shared_ptr<const Payload> mesh = acquire(meshKey(index));
+			if (mesh) {
+				cut.push_back(mesh);
+				mNear.push_back(mesh);
+				return true;
+			}
+		}
+	}
+	else {
+		float eyeDistance = glm::length(glm::max(min, glm::min(mEye, max)) - mEye);
+		if (nearFocus || glm::length(max - min) > kLodRatio * eyeDistance) {
+			// Use the children only if all of them can be drawn, but visit
+			// every one so that the missing ones get requested.
+			int cutSize = cut.size(), nearSize = mNear.size();
+			bool complete = true;
+			for (int c = 0; c < node.childCount; c++)
+				complete = visit(node.firstChild + c, cut) && complete;
+			if (complete)
+				return true;
+			cut.resize(cutSize);
+			mNear.resize(nearSize);
+		}
+	}
+
+	std::shared_ptr<const Payload> proxy = acquire(proxyKey(index));
+	if (!proxy)
+		return false;
+	cut.push_back(proxy);
+	return true;
+}
+
+std::shared_ptr<const ClusterMesh::Payload> ClusterMesh::acquire(int key)
+{
+	std::unordered_map<int, Entry>::iterator it = mResident.find(key);
+	if (it == mResident.end()) {
+		request(key);
+		return std::shared_ptr<const Payload>();
+	}
+
+	mLRU.splice(mLRU.begin(), mLRU, it->second.lru);
+	it->second.frame = mFrame;
+	return it->second.payload;
+}
+
+void ClusterMesh::request(int key)
+{
+	if (!mPending.insert(key).second)
+		return;
+
+	mIO->submit([this, key]() {
+		if (mCancelled)
+			return;
+
+		std::shared_ptr<Payload> payload(new Payload());
+		FILE *file = fopen(mFilename.c_str(), "rb");
+		if (!file || !readPayload(file, key, *payload))
+			payload.reset();
+		if (file)
+			fclose(file);
+
+		std::lock_guard<std::mutex> lock(mFinishedMutex);
+		mFinished.push_back(std::make_pair(key, std::shared_ptr<const Payload>(payload)));
+	});
+}
+
+void ClusterMesh::receive()
+{
+	std::vector<std::pair<int, std::shared_ptr<const Payload> > > finished;
+	{
+		std::lock_guard<std::mutex> lock(mFinishedMutex);
+		finished.swap(mFinished);
+	}
+
+	for (int i = 0; i < finished.size(); i++) {
+		int key = finished[i].first;
+		if (!finished[i].second) {
+			// Stays pending, so a cluster that cannot be read is not
+			// requested again every frame.
+			fprintf(stderr, "Could not read cluster %d of %s\n", key / 2, mFilename.c_str());
+			continue;
+		}
+
+		mPending.erase(key);
+		Entry &entry = mResident[key];
+		entry.payload = finished[i].second;
+		entry.lru = mLRU.insert(mLRU.end(), key);
+		entry.frame = 0;
+		mResidentBytes += entry.payload->getBytes();
+	}
+}
+
+void ClusterMesh::evict()
+{
+	// Least recently used first. Whatever this update drew sits at the
+	// front, so stop there even if still over budget.
+	int checked = 0;
+	while (mResidentBytes > mBudget && !mLRU.empty() && checked++ < mResident.size()) {
+		int key = mLRU.back();
+		Entry &entry = mResident[key];
+		if (entry.frame == mFrame)
+			break;
+		if (key == proxyKey(0)) {
+			mLRU.splice(mLRU.begin(), mLRU, entry.lru);
+			continue;
+		}
+
+		mResidentBytes -= entry.payload->getBytes();
+		mLRU.pop_back();
+		mResident.erase(key);
+	}
+}
+
+bool ClusterMesh::readPayload(FILE *file, int key, Payload &payload) const
+{
+	Node const &node = mNodes[key / 2];
+	long long offset = (key & 1) ? node.meshOffset : node.proxyOffset;
+	int bytes = (key & 1) ? node.meshBytes : node.proxyBytes;
+
+	int counts[2];
+	if (bytes < (int) sizeof(counts) || seekFile(file, offset) != 0 || fread(counts, sizeof(counts), 1, file) != 1)
+		return false;
+
+	long long expected = sizeof(counts) + (long long) counts[0] * (2 * sizeof(glm::vec3) + 3) +
+		(long long) counts[1] * 3 * sizeof(unsigned int);
+	if (counts[0] < 0 || counts[1] < 0 || expected != bytes)
+		return false;
+
+	payload.positions.resize(counts[0]);
+	payload.normals.resize(counts[0]);
+	payload.colors.resize(3 * counts[0]);
+	payload.indices.resize(3 * counts[1]);
+	if (counts[0] > 0 &&
+		(fread(&payload.positions[0], sizeof(glm::vec3), counts[0], file) != counts[0] ||
+		fread(&payload.normals[0], sizeof(glm::vec3), counts[0], file) != counts[0] ||
+		fread(&payload.colors[0], 3, counts[0], file) != counts[0]))
+		return false;
+	if (counts[1] > 0 && fread(&payload.indices[0], 3 * sizeof(unsigned int), counts[1], file) != counts[1])
+		return false;
+
+	for (int i = 0; i < payload.indices.size(); i++) {
+		if (payload.indices[i] >= counts[0])
+			return false;
+	}
+	return true;
+}
+
+void ClusterMesh::draw() const
+{
+	glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	for (int i = 0; i < mCut.size(); i++)
+		drawPayload(*mCut[i]);
+	glPopClientAttrib();
+}
+
+int ClusterMesh::drawNear() const
+{
+	glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	for (int i = 0; i < mNear.size(); i++)
+		drawPayload(*mNear[i]);
+	glPopClientAttrib();
+	return mNearTriangles;
+}
+
+void ClusterMesh::drawPayload(Payload const &payload)
+{
+	if (payload.indices.empty())
+		return;
+	glVertexPointer(3, GL_FLOAT, 0, &payload.positions[0]);
+	glNormalPointer(GL_FLOAT, 0, &payload.normals[0]);
+	glColorPointer(3, GL_UNSIGNED_BYTE, 0, &payload.colors[0]);
+	glDrawElements(GL_TRIANGLES, payload.indices.size(), GL_UNSIGNED_INT, &payload.indices[0]);
+}
+
+int ClusterMesh::getNearTriangleCount() const
+{
+	return mNearTriangles;
+}
+
+size_t ClusterMesh::getResidentBytes() const
+{
+	return mResidentBytes;
+}
+
+int ClusterMesh::getResidentCount() const
+{
+	return mResident.size();
+}
+
+int ClusterMesh::getPendingCount() const
+{
+	return mPending.size();
+}
+
+int ClusterMesh::getDrawnTriangleCount() const
+{
+	return mDrawnTriangles;
+}
@@ -0,0 +1,142 @@
+#ifndef CLUSTERMESH_H
+#define CLUSTERMESH_H
+
+#include <atomic>
+#include <cstdio>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+#include "threadpool.h"
+
+//! Converts an OBJ file into a cluster mesh file for ClusterMesh. Only the
+//! vertex positions are held in memory; faces are sorted into clusters
+//! through a temporary file next to clusterFile. clusterTriangles is the
+//! rough number of triangles per full-resolution cluster. Returns false
+//! and prints why if either file cannot be used.
+bool buildClusterMesh(const char *objFile, const char *clusterFile, int clusterTriangles);
+
+	//! Mesh streamed from a cluster mesh file, for meshes that do not fit in
+	//! memory.
+	//!
+	//! The file holds an octree of clusters. Leaves carry the full-resolution
+	//! triangles of their cell, and every node carries a coarse proxy of
+	//! everything below it. Each update() picks a cut through the tree:
+	//! full resolution for leaves near the focus point, proxies elsewhere, and
+	//! nothing outside the view. Missing clusters are read on background I/O
+	//! threads, and an ancestor's proxy stands in until they arrive.
+	//! Resident clusters are kept in an LRU cache trimmed to the memory
+	//! budget.
+	//!
+	//! All coordinates are in the mesh's model space, which is unitized to
+	//! [-1, 1] like OBJLoader meshes. Apart from the I/O threads, every
+	//! method belongs to the thread that calls update().
+	class ClusterMesh {
+	public:
+		//! Constructor
+		//!
+		ClusterMesh();
+
+		//! Destructor. Cancels queued reads and waits for the I/O threads.
+		//!
+		~ClusterMesh();
+
+		//! Reads the node table and the root proxy, and starts ioThreads
+		//! reader threads.
+		bool open(const char *filename, int ioThreads);
+		void close();
+		bool isOpen() const;
+
+		void setMemoryBudget(size_t bytes);
+		size_t getMemoryBudget() const;
+
+		//! Chooses the clusters to draw for a camera at eye with the given
+		//! frustum planes (a, b, c, d with a*x + b*y + c*z + d >= 0 inside),
+		//! loading full resolution within focusRadius of focus.
+		void update(glm::vec3 const &eye, float const frustum[6][4], glm::vec3 const &focus, float focusRadius);
+
+		//! Draws the cut chosen by the last update().
+		void draw() const;
+
+		//! Draws only the full-resolution clusters of the cut, for the
+		//! haptic shape. Returns the number of triangles drawn.
+		int drawNear() const;
+		int getNearTriangleCount() const;
+
+		size_t getResidentBytes() const;
+		int getResidentCount() const;
+		int getPendingCount() const;
+		int getDrawnTriangleCount() const;
+
+	private:
+		ClusterMesh(const ClusterMesh &);
+		ClusterMesh &operator=(const ClusterMesh &);
+
+		struct Node {
+			float min[3];
+			float max[3];
+			int firstChild;
+			int childCount;
+			long long proxyOffset;
+			int proxyBytes;
+			long long meshOffset;	// full resolution, leaves only
+			int meshBytes;
+		};
+
+		struct Payload {
+			std::vector<glm::vec3> positions;
+			std::vector<glm::vec3> normals;
+			std::vector<unsigned char> colors;
+			std::vector<unsigned int> indices;
+			size_t getBytes() const;
+		};
+
+		struct Entry {
+			std::shared_ptr<const Payload> payload;
+			std::list<int>::iterator lru;
+			unsigned int frame;	// last update() that used it
+		};
+
+		// Cache keys: 2 * node for a proxy, 2 * node + 1 for full resolution.
+		static int proxyKey(int node) { return 2 * node; }
+		static int meshKey(int node) { return 2 * node + 1; }
+
+		bool visit(int node, std::vector<std::shared_ptr<const Payload> > &cut);
+		std::shared_ptr<const Payload> acquire(int key);
+		void request(int key);
+		void receive();
+		void evict();
+		bool readPayload(FILE *file, int key, Payload &payload) const;
+		static void drawPayload(Payload const &payload);
+
+		std::string mFilename;
+		std::vector<Node> mNodes;
+		std::unique_ptr<ThreadPool> mIO;
+		size_t mBudget;
+
+		std::unordered_map<int, Entry> mResident;
+		std::list<int> mLRU;	// most recently used first
+		size_t mResidentBytes;
+
+		std::mutex mFinishedMutex;
+		std::vector<std::pair<int, std::shared_ptr<const Payload> > > mFinished;
+		std::set<int> mPending;
+		std::atomic<bool> mCancelled;
+		unsigned int mFrame;
+
+		glm::vec3 mEye;
+		float mFrustum[6][4];
+		glm::vec3 mFocus;
+		float mFocusRadius;
+
+		std::vector<std::shared_ptr<const Payload> > mCut;
+		std::vector<std::shared_ptr<const Payload> > mNear;
+		int mDrawnTriangles;
+		int mNearTriangles;
+	};
+
+#endif
@@ -0,0 +1,360 @@
+#include <cfloat>
+#include <cmath>
+#include "compactmesh.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define COMPACTMESH_SSE2
+#endif
+
+static const int kLanes = 8;
+static const float kMaxQuantized = 32767.0f;
+static const int kMaxMaterials = 256;	// addressable by an 8-bit index
+
+// Room left around the mesh so that deformation rarely forces a requantize.
+static const float kHeadroom = 1.25f;
+
+static short quantize(float x)
+{
+	float q = floor(x + 0.5f);
+	if (q > kMaxQuantized) q = kMaxQuantized;
+	if (q < -kMaxQuantized) q = -kMaxQuantized;
+	return (short) q;
+}
+
+static float signNotZero(float x)
+{
+	return x < 0.0f ? -1.0f : 1.0f;
+}
+
+// Octahedral normal encoding: Cigolle et al., "A Survey of Efficient
+// Representations for Independent Unit Vectors", JCGT 2014.
+static void encodeOctahedral(glm::vec3 n, short out[2])
+{
+	float l1 = fabs(n.x) + fabs(n.y) + fabs(n.z);
+	if (l1 < 1e-20f) {
+		out[0] = out[1] = 0;
+		return;
+	}
+	float x = n.x / l1, y = n.y / l1;
+	if (n.z < 0.0f) {
+		float fx = (1.0f - fabs(y)) * signNotZero(x);
+		float fy = (1.0f - fabs(x)) * signNotZero(y);
+		x = fx;
+		y = fy;
+	}
+	out[0] = quantize(x * kMaxQuantized);
+	out[1] = quantize(y * kMaxQuantized);
+}
+
+static glm::vec3 decodeOctahedral(short const in[2])
+{
+	glm::vec3 n(in[0] / kMaxQuantized, in[1] / kMaxQuantized, 0.0f);
+	n.z = 1.0f - fabs(n.x) - fabs(n.y);
+	if (n.z < 0.0f) {
+		float x = (1.0f - fabs(n.y)) * signNotZero(n.x);
+		float y = (1.0f - fabs(n.x)) * signNotZero(n.y);
+		n.x = x;
+		n.y = y;
+	}
+	return glm::normalize(n);
+}
+
+CompactMesh::CompactMesh() :
+mScale(1.0f),
+mVertexCount(0)
+{
+}
+
+void CompactMesh::encode(OBJLoader const &loader)
+{
+	std::vector<glm::vec3> const &vertices = loader.getVertices();
+	std::vector<Triangle> const &triangles = loader.getTriangles();
+
+	float extent = 0.0f;
+	for (int i = 0; i < vertices.size(); i++) {
+		for (int k = 0; k < 3; k++)
+			extent = glm::max(extent, fabs(vertices[i][k]));
+	}
+	if (extent <= 0.0f)
+		extent = 1.0f;
+	mScale = extent * kHeadroom / kMaxQuantized;
+
+	mVertexCount = vertices.size();
+	int padded = (mVertexCount + kLanes - 1) / kLanes * kLanes;
+	mX.assign(padded, 0);
+	mY.assign(padded, 0);
+	mZ.assign(padded, 0);
+	mNormals.assign(2 * mVertexCount, 0);
+	mColors.assign(3 * mVertexCount, 0);
+	mMaterials.assign(mVertexCount, 0);
+	mUnused.assign(mVertexCount, 0);
+	mMaterialFriction.clear();
+	for (int v = 0; v < mVertexCount; v++)
+		encodeVertex(loader, v);
+
+	mIndices.resize(3 * triangles.size());
+	for (int t = 0; t < triangles.size(); t++) {
+		for (int k = 0; k < 3; k++)
+			mIndices[3 * t + k] = triangles[t].vert[k];
+	}
+}
+
+void CompactMesh::update(OBJLoader const &loader, std::vector<int> const &vertices)
+{
+	if (loader.getVertices().size() != mVertexCount || 3 * loader.getTriangles().size() != mIndices.size()) {
+		encode(loader);
+		return;
+	}
+
+	float limit = kMaxQuantized * mScale;
+	std::vector<glm::vec3> const &positions = loader.getVertices();
+	for (int i = 0; i < vertices.size(); i++) {
+		glm::vec3 const &p = positions[vertices[i]];
+		if (fabs(p.x) > limit || fabs(p.y) > limit || fabs(p.z) > limit) {
+			encode(loader);
+			return;
+		}
+	}
+
+	for (int i = 0; i < vertices.size(); i++)
+		encodeVertex(loader, vertices[i]);
+}
+
+void CompactMesh::updateTopology(OBJLoader const &loader, std::vector<int> const &vertices,
+	std::vector<int> const &triangles)
+{
+	std::vector<glm::vec3> const &positions = loader.getVertices();
+	std::vector<Triangle> const &tris = loader.getTriangles();
+	int vertexCount = positions.size(), triangleCount = tris.size();
+	if (mVertexCount == 0 || vertexCount < mVertexCount || 3 * triangleCount < mIndices.size()) {
+		encode(loader);
+		return;
+	}
+
+	float limit = kMaxQuantized * mScale;
+	for (int v = mVertexCount; v < vertexCount; v++) {
+		glm::vec3 const &p = positions[v];
+		if (fabs(p.x) > limit || fabs(p.y) > limit || fabs(p.z) > limit) {
+			encode(loader);
+			return;
+		}
+	}
+	for (int i = 0; i < vertices.size(); i++) {
+		glm::vec3 const &p = positions[vertices[i]];
+		if (fabs(p.x) > limit || fabs(p.y) > limit || fabs(p.z) > limit) {
+			encode(loader);
+			return;
+		}
+	}
+
+	int firstVertex = mVertexCount;
+	if (vertexCount > mVertexCount) {
+		mVertexCount = vertexCount;
+		int padded = (mVertexCount + kLanes - 1) / kLanes * kLanes;
+		mX.resize(padded, 0);
+		mY.resize(padded, 0);
+		mZ.resize(padded, 0);
+		mNormals.resize(2 * mVertexCount, 0);
+		mColors.resize(3 * mVertexCount, 0);
+		mMaterials.resize(mVertexCount, 0);
+		mUnused.resize(mVertexCount, 0);
+	}
+	for (int v = firstVertex; v < mVertexCount; v++)
+		encodeVertex(loader, v);
+	for (int i = 0; i < vertices.size(); i++)
+		encodeVertex(loader, vertices[i]);
+
+	int firstTriangle = mIndices.size() / 3;
+	mIndices.resize(3 * triangleCount);
+	for (int t = firstTriangle; t < triangleCount; t++) {
+		for (int k = 0; k < 3; k++)
+			mIndices[3 * t + k] = tris[t].vert[k];
+	}
+	for (int i = 0; i < triangles.size(); i++) {
+		int t = triangles[i];
+		for (int k = 0; k < 3; k++)
+			mIndices[3 * t + k] = tris[t].vert[k];
+	}
+}
+
+void CompactMesh::encodeVertex(OBJLoader const &loader, int v)
+{
+	glm::vec3 const &p = loader.getVertices()[v];
+	mX[v] = quantize(p.x / mScale);
+	mY[v] = quantize(p.y / mScale);
+	mZ[v] = quantize(p.z / mScale);
+
+	encodeOctahedral(loader.getNormals()[v], &mNormals[2 * v]);
+
+	glm::vec3 const &color = loader.getColors()[v];
+	for (int k = 0; k < 3; k++)
+		mColors[3 * v + k] = (unsigned char) floor(glm::clamp(color[k], 0.0f, 1.0f) * 255.0f + 0.5f);
+
+	mMaterials[v] = findMaterial(loader.getFriction()[v]);
+	mUnused[v] = loader.getVertexTriangles()[v].empty();
+}
+
+unsigned char CompactMesh::findMaterial(double friction)
+{
+	// Loaded meshes use a handful of friction values; refinement averages
+	// them. Once the table is full, take the closest entry.
+	int closest = -1;
+	double closestError = DBL_MAX;
+	for (int m = 0; m < mMaterialFriction.size(); m++) {
+		double error = fabs(mMaterialFriction[m] - friction);
+		if (error < 1e-4)
+			return m;
+		if (error < closestError) {
+			closest = m;
+			closestError = error;
+		}
+	}
+	if (mMaterialFriction.size() < kMaxMaterials) {
+		mMaterialFriction.push_back((float) friction);
+		return mMaterialFriction.size() - 1;
+	}
+	return closest;
+}
+
+bool CompactMesh::isEmpty() const
+{
+	return mVertexCount == 0;
+}
+
+int CompactMesh::getVertexCount() const
+{
+	return mVertexCount;
+}
+
+int CompactMesh::getTriangleCount() const
+{
+	return mIndices.size() / 3;
+}
+
+std::vector<unsigned int> const &CompactMesh::getIndices() const
+{
+	return mIndices;
+}
+
+void CompactMesh::decodePositions(int first, int count, glm::vec3 *out) const
+{
+	int i = first, end = first + count;
+#if defined(COMPACTMESH_SSE2)
+	__m128 scale = _mm_set1_ps(mScale);
+	float x[kLanes], y[kLanes], z[kLanes];
+	for (; i + kLanes <= end; i += kLanes, out += kLanes) {
+		__m128i qx = _mm_loadu_si128((__m128i const *) &mX[i]);
+		__m128i qy = _mm_loadu_si128((__m128i const *) &mY[i]);
+		__m128i qz = _mm_loadu_si128((__m128i const *) &mZ[i]);
+
+		// Sign-extend each half to 32 bits by unpacking into the high word.
+		_mm_storeu_ps(x, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(qx, qx), 16)), scale));
+		_mm_storeu_ps(x + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(qx, qx), 16)), scale));
+		_mm_storeu_ps(y, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(qy, qy), 16)), scale));
+		_mm_storeu_ps(y + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(qy, qy), 16)), scale));
+		_mm_storeu_ps(z, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(qz, qz), 16)), scale));
+		_mm_storeu_ps(z + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(qz, qz), 16)), scale));
+
+		for (int k = 0; k < kLanes; k++)
+			out[k] = glm::vec3(x[k], y[k], z[k]);
+	}
+#endif
+	for (; i < end; i++, out++)
+		*out = decodePosition(i);
+}
+
+glm::vec3 CompactMesh::decodePosition(int v) const
+{
+	return glm::vec3(mX[v], mY[v], mZ[v]) * mScale;
+}
+
+glm::vec3 CompactMesh::decodeNormal(int v) const
+{
+	return decodeOctahedral(&mNormals[2 * v]);
+}
+
+glm::vec3 CompactMesh::decodeColor(int v) const
+{
+	return glm::vec3(mColors[3 * v], mColors[3 * v + 1], mColors[3 * v + 2]) / 255.0f;
+}
+
+unsigned char CompactMesh::getMaterial(int v) const
+{
+	return mMaterials[v];
+}
+
+float CompactMesh::getFriction(int v) const
+{
+	return mMaterialFriction[mMaterials[v]];
+}
+
+int CompactMesh::findNearestVertex(glm::vec3 const &p) const
+{
+	if (mVertexCount == 0)
+		return -1;
+
+	// Compare in quantized units, so the scan never dequantizes.
+	glm::vec3 q = p / mScale;
+	float best = FLT_MAX;
+	int bestIndex = -1;
+	int i = 0;
+#if defined(COMPACTMESH_SSE2)
+	__m128 px = _mm_set1_ps(q.x), py = _mm_set1_ps(q.y), pz = _mm_set1_ps(q.z);
+	float d2[kLanes];
+	int full = mVertexCount / kLanes * kLanes;
+	for (; i < full; i += kLanes) {
+		__m128i qx = _mm_loadu_si128((__m128i const *) &mX[i]);
+		__m128i qy = _mm_loadu_si128((__m128i const *) &mY[i]);
+		__m128i qz = _mm_loadu_si128((__m128i const *) &mZ[i]);
+
+		__m128 dx = _mm_sub_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(qx, qx), 16)), px);
+		__m128 dy = _mm_sub_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(qy, qy), 16)), py);
+		__m128 dz = _mm_sub_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(qz, qz), 16)), pz);
+		__m128 lo = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+		dx = _mm_sub_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(qx, qx), 16)), px);
+		dy = _mm_sub_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(qy, qy), 16)), py);
+		dz = _mm_sub_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(qz, qz), 16)), pz);
+		__m128 hi = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+		// Only look at the lanes when one of them beats the best so far.
+		__m128 limit = _mm_set1_ps(best);
+		if (!_mm_movemask_ps(_mm_or_ps(_mm_cmplt_ps(lo, limit), _mm_cmplt_ps(hi, limit))))
+			continue;
+
+		_mm_storeu_ps(d2, lo);
+		_mm_storeu_ps(d2 + 4, hi);
+		for (int k = 0; k < kLanes; k++) {
+			if (d2[k] < best && !mUnused[i + k]) {
+				best = d2[k];
+				bestIndex = i + k;
+			}
+		}
+	}
+#endif
+	for (; i < mVertexCount; i++) {
+		glm::vec3 d = glm::vec3(mX[i], mY[i], mZ[i]) - q;
+		float d2 = glm::dot(d, d);
+		if (d2 < best && !mUnused[i]) {
+			best = d2;
+			bestIndex = i;
+		}
+	}
+	return bestIndex;
+}
+
+size_t CompactMesh::getMemoryBytes() const
+{
+	return (mX.size() + mY.size() + mZ.size() + mNormals.size()) * sizeof(short) +
+		mColors.size() + mMaterials.size() + mUnused.size() +
+		mIndices.size() * sizeof(unsigned int) + mMaterialFriction.size() * sizeof(float);
+}
+
+size_t CompactMesh::estimateBytes(OBJLoader const &loader)
+{
+	size_t vertices = loader.getVertices().size();
+	size_t padded = (vertices + kLanes - 1) / kLanes * kLanes;
+	return (3 * padded + 2 * vertices) * sizeof(short) + 5 * vertices +
+		3 * loader.getTriangles().size() * sizeof(unsigned int) + kMaxMaterials * sizeof(float);
+}
@@ -0,0 +1,79 @@
+#ifndef COMPACTMESH_H
+#define COMPACTMESH_H
+
+#include <vector>
+#include "objloader.h"
+
+	//! Quantized copy of an OBJLoader mesh for scans that should stay in
+	//! cache.
+	//!
+	//! Positions are 16-bit fixed point over a cube a little larger than the
+	//! mesh, normals are octahedral 2 x 16-bit, colors are 8-bit RGB and
+	//! friction becomes an 8-bit index into a small material table. The
+	//! triangles are a single index array. That is 14 bytes per vertex and
+	//! 12 per triangle, against several times that in OBJLoader. Positions
+	//! are stored per axis so that they dequantize eight at a time with SSE2.
+	class CompactMesh {
+	public:
+		//! Constructor
+		//!
+		CompactMesh();
+
+		//! Quantizes the whole of loader.
+		void encode(OBJLoader const &loader);
+
+		//! Requantizes the given vertices after loader moved them. Falls
+		//! back to encode() when the mesh grew or a vertex left the cube.
+		void update(OBJLoader const &loader, std::vector<int> const &vertices);
+
+		//! Requantizes the given vertices and copies the given triangles after
+		//! a topology edit rewrote them in place, and takes on any vertices
+		//! and triangles appended since the last call, without a full
+		//! encode() unless a vertex left the cube.
+		void updateTopology(OBJLoader const &loader, std::vector<int> const &vertices,
+			std::vector<int> const &triangles);
+
+		bool isEmpty() const;
+		int getVertexCount() const;
+		int getTriangleCount() const;
+		std::vector<unsigned int> const &getIndices() const;
+
+		//! Positions of vertices [first, first + count).
+		void decodePositions(int first, int count, glm::vec3 *out) const;
+		glm::vec3 decodePosition(int v) const;
+		glm::vec3 decodeNormal(int v) const;
+		glm::vec3 decodeColor(int v) const;
+		unsigned char getMaterial(int v) const;
+		float getFriction(int v) const;
+
+		//! Index of the vertex closest to p among those with a triangle, or
+		//! -1 if there is none. Vertices a cut left behind are skipped.
+		int findNearestVertex(glm::vec3 const &p) const;
+
+		//! Bytes held by the quantized arrays.
+		size_t getMemoryBytes() const;
+
+		//! Bytes encode() of loader would take, without encoding it; the
+		//! material table is taken as full.
+		static size_t estimateBytes(OBJLoader const &loader);
+
+	private:
+		void encodeVertex(OBJLoader const &loader, int v);
+		unsigned char findMaterial(double friction);
+
+		float mScale;	// model units per quantization step
+		int mVertexCount;
+
+		// Padded to a multiple of eight for the SIMD loops.
+		std::vector<short> mX;
+		std::vector<short> mY;
+		std::vector<short> mZ;
+		std::vector<short> mNormals;	// two per vertex
+		std::vector<unsigned char> mColors;	// three per vertex
+		std::vector<unsigned char> mMaterials;
+		std::vector<unsigned char> mUnused;	// per vertex: in no triangle
+		std::vector<unsigned int> mIndices;
+		std::vector<float> mMaterialFriction;
+	};
+
+#endif
@@ -0,0 +1,230 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include "contactcache.h"
+
+// Below this gradient length the patch holds no surface, as on the plateau
+// of a voxmap outside its band.
+static const float kMinGradient = 0.5f;
+
+// Blend times are kept within these, in seconds.
+static const double kMinBlendSeconds = 0.001;
+static const double kMaxBlendSeconds = 0.1;
+
+static glm::vec3 transformPoint(double const m[16], glm::vec3 const &p)
+{
+	return glm::vec3(
+		(float) (m[0] * p.x + m[4] * p.y + m[8] * p.z + m[12]),
+		(float) (m[1] * p.x + m[5] * p.y + m[9] * p.z + m[13]),
+		(float) (m[2] * p.x + m[6] * p.y + m[10] * p.z + m[14]));
+}
+
+static double matrixScale(double const m[16])
+{
+	return sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+}
+
+/*******************************************************************************
+ ContactPatch
+*******************************************************************************/
+
+float ContactPatch::distance(glm::vec3 const &p, glm::vec3 &gradient) const
+{
+	// Clamp onto the lattice and extend from there along the gradient.
+	glm::vec3 g = (p - origin) / spacing;
+	int cell[3];
+	float t[3];
+	for (int k = 0; k < 3; k++) {
+		float c = std::min(std::max(g[k], 0.0f), (float) (kSamples - 1));
+		cell[k] = std::min((int) c, kSamples - 2);
+		t[k] = c - cell[k];
+	}
+
+	const int sy = kSamples, sz = kSamples * kSamples;
+	float const *s = samples + cell[2] * sz + cell[1] * sy + cell[0];
+	float s000 = s[0], s100 = s[1], s010 = s[sy], s110 = s[sy + 1];
+	float s001 = s[sz], s101 = s[sz + 1], s011 = s[sz + sy], s111 = s[sz + sy + 1];
+
+	float x00 = s000 + (s100 - s000) * t[0], x10 = s010 + (s110 - s010) * t[0];
+	float x01 = s001 + (s101 - s001) * t[0], x11 = s011 + (s111 - s011) * t[0];
+	float y0 = x00 + (x10 - x00) * t[1], y1 = x01 + (x11 - x01) * t[1];
+
+	float dx0 = (s100 - s000) + ((s110 - s010) - (s100 - s000)) * t[1];
+	float dx1 = (s101 - s001) + ((s111 - s011) - (s101 - s001)) * t[1];
+	gradient.x = (dx0 + (dx1 - dx0) * t[2]) / spacing;
+	gradient.y = ((x10 - x00) + ((x11 - x01) - (x10 - x00)) * t[2]) / spacing;
+	gradient.z = (y1 - y0) / spacing;
+
+	glm::vec3 clamped = origin + glm::vec3(cell[0] + t[0], cell[1] + t[1], cell[2] + t[2]) * spacing;
+	return y0 + (y1 - y0) * t[2] + glm::dot(gradient, p - clamped);
+}
+
+/*******************************************************************************
+ ContactSampler
+*******************************************************************************/
+
+ContactSampler::ContactSampler() :
+mSequence(0),
+mRevision(0),
+mSinceChange(0.0),
+mBlendSeconds(kMinBlendSeconds)
+{
+}
+
+void ContactSampler::sample(ToolContactScene const &scene, double const deviceToWorld[16], glm::vec3 const &center,
+	double dt, ContactPatch &patch)
+{
+	// A replaced voxmap is new geometry, to be blended in over about as
+	// long as it took to come.
+	mSinceChange += dt;
+	bool changed = scene.objects.size() != mGrids.size();
+	mGrids.resize(scene.objects.size());
+	for (int o = 0; o < scene.objects.size(); o++) {
+		if (mGrids[o] != scene.objects[o].voxmap.get()) {
+			mGrids[o] = scene.objects[o].voxmap.get();
+			changed = true;
+		}
+	}
+	if (changed) {
+		mRevision++;
+		mBlendSeconds = std::min(std::max(mSinceChange, kMinBlendSeconds), kMaxBlendSeconds);
+		mSinceChange = 0.0;
+	}
+	patch.blendSeconds = (float) mBlendSeconds;
+	patch.sequence = ++mSequence;
+	patch.revision = mRevision;
+	patch.valid = false;
+
+	// World units per millimetre, and the finest voxmap in reach.
+	double worldPerDevice = matrixScale(deviceToWorld);
+	glm::vec3 worldCenter = transformPoint(deviceToWorld, center);
+	float spacing = FLT_MAX;
+	for (int o = 0; o < scene.objects.size(); o++) {
+		ToolContactScene::Object const &object = scene.objects[o];
+		float voxel = (float) (object.voxmap->voxelSize * object.scale / worldPerDevice);
+		float reach = (float) (ContactPatch::kSamples * voxel * worldPerDevice);
+		if (glm::distance(worldCenter, object.center) < object.radius + reach)
+			spacing = std::min(spacing, voxel);
+	}
+
+	const int count = ContactPatch::kSamples * ContactPatch::kSamples * ContactPatch::kSamples;
+	std::fill(patch.samples, patch.samples + count, FLT_MAX);
+	if (spacing == FLT_MAX) {
+		patch.origin = center;
+		patch.spacing = 1.0f;
+		return;
+	}
+	patch.spacing = spacing;
+	float half = 0.5f * (ContactPatch::kSamples - 1) * spacing;
+	patch.origin = center - glm::vec3(half, half, half);
+
+	float worldRadius = (float) (half * sqrt(3.0) * worldPerDevice);
+	for (int o = 0; o < scene.objects.size(); o++) {
+		ToolContactScene::Object const &object = scene.objects[o];
+		if (glm::distance(worldCenter, object.center) > object.radius + worldRadius)
+			continue;
+
+		float toDevice = (float) (object.scale / worldPerDevice);	// millimetres per model unit
+		int i = 0;
+		for (int z = 0; z < ContactPatch::kSamples; z++) {
+			for (int y = 0; y < ContactPatch::kSamples; y++) {
+				for (int x = 0; x < ContactPatch::kSamples; x++, i++) {
+					glm::vec3 p = patch.origin + glm::vec3((float) x, (float) y, (float) z) * spacing;
+					glm::vec3 model = transformPoint(object.worldToModel, transformPoint(deviceToWorld, p));
+					float d = object.voxmap->distance(model, 0) * toDevice;
+					patch.samples[i] = std::min(patch.samples[i], d);
+				}
+			}
+		}
+		patch.valid = true;
+	}
+}
+
+/*******************************************************************************
+ ContactRenderer
+*******************************************************************************/
+
+ContactRenderer::ContactRenderer() :
+mBlend(1.0f),
+mTouching(false),
+mOutside(true),
+mPlanePoint(0, 0, 0),
+mPlaneNormal(0, 0, 0),
+mFirstSequence(0)
+{
+	mPrevious.valid = false;
+	mPrevious.sequence = 0;
+	mPrevious.revision = 0;
+	mCurrent.valid = false;
+	mCurrent.sequence = 0;
+	mCurrent.revision = 0;
+	mCurrent.blendSeconds = (float) kMinBlendSeconds;
+}
+
+void ContactRenderer::update(ContactPatch const &patch)
+{
+	if (patch.sequence == mCurrent.sequence || (int) (patch.sequence - mFirstSequence) < 0)
+		return;
+
+	// Only new geometry is blended; a patch that merely moved with the
+	// device describes the same surface.
+	if (patch.revision != mCurrent.revision && mCurrent.valid && patch.valid) {
+		mPrevious = mCurrent;
+		mBlend = 0.0f;
+	}
+	mCurrent = patch;
+}
+
+void ContactRenderer::reset()
+{
+	// The patch being sampled now may predate the reset; it is the one after
+	// the latest seen.
+	mFirstSequence = mCurrent.sequence + 2;
+	mPrevious.valid = false;
+	mCurrent.valid = false;
+	mBlend = 1.0f;
+	mTouching = false;
+	mOutside = true;
+}
+
+bool ContactRenderer::evaluate(glm::vec3 const &p, double dt, float &depth, glm::vec3 &normal)
+{
+	mBlend = std::min(1.0f, mBlend + (float) (dt / mCurrent.blendSeconds));
+
+	glm::vec3 gradient(0, 0, 0);
+	float d = FLT_MAX;
+	if (mCurrent.valid) {
+		d = mCurrent.distance(p, gradient);
+		if (mBlend < 1.0f) {
+			glm::vec3 previousGradient;
+			float previous = mPrevious.distance(p, previousGradient);
+			d = previous + (d - previous) * mBlend;
+			gradient = previousGradient + (gradient - previousGradient) * mBlend;
+		}
+	}
+
+	float length = glm::length(gradient);
+	bool surface = length > kMinGradient;
+	// Once touching, only a surface facing the held plane's way may move it,
+	// so that the far side of a thin shell does not push the device through.
+	bool facing = !mTouching || glm::dot(gradient, mPlaneNormal) > 0.0f;
+	if (surface && d < 0.0f && facing && (mTouching || mOutside)) {
+		mTouching = true;
+		mPlaneNormal = gradient / length;
+		mPlanePoint = p - mPlaneNormal * (d / length);
+	}
+	else if (mTouching) {
+		// Out in front of a surface facing the same way, the surface has
+		// moved off; out of the held plane, the device has left it.
+		bool released = surface && d >= 0.0f && glm::dot(gradient, mPlaneNormal) > 0.0f;
+		if (released || glm::dot(mPlaneNormal, p - mPlanePoint) >= 0.0f)
+			mTouching = false;
+	}
+	mOutside = !mTouching && d >= 0.0f;
+
+	if (!mTouching)
+		return false;
+	depth = glm::dot(mPlaneNormal, mPlanePoint - p);
+	normal = mPlaneNormal;
+	return depth > 0.0f;
+}
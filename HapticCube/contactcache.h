@@ -0,0 +1,98 @@
+#ifndef CONTACTCACHE_H
+#define CONTACTCACHE_H
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "distancefield.h"
+#include "toolcontact.h"
+
+//! Local intermediate representation of the scene around one haptic device
+//! (Adachi et al., "Intermediate Representation for Stiff Virtual Objects",
+//! VRAIS 1995; Mark et al., "Adding Force Feedback to Graphics Systems",
+//! SIGGRAPH 1996).
+//!
+//! A lattice of kSamples^3 signed distances to the union of the scene's
+//! voxmaps, in device coordinates and millimetres. Trilinear interpolation
+//! of it gives back the planes, edges and normals near the device in
+//! constant time, and its size is fixed, so it can be copied to the servo
+//! thread whole. Beyond the lattice the distance is extended linearly.
+struct ContactPatch {
+	static const int kSamples = 8;
+
+	glm::vec3 origin;	// sample (0, 0, 0)
+	float spacing;
+	float samples[kSamples * kSamples * kSamples];	// front side positive
+	bool valid;	// false with no surface in reach
+	unsigned int sequence;	// bumped by every sampling
+	unsigned int revision;	// bumped when the voxmaps behind it changed
+	float blendSeconds;	// how long to blend a new revision in
+
+	//! Signed distance at p, and its gradient.
+	float distance(glm::vec3 const &p, glm::vec3 &gradient) const;
+};
+
+	//! Fills ContactPatches for one device at a fixed rate, off the servo
+	//! thread. Each patch is centered on the device and spaced by the finest
+	//! voxmap in reach. A new revision is declared whenever a voxmap in the
+	//! scene is replaced, with the time since the previous one as its blend
+	//! time, so that geometry that arrives at the graphics frame rate is
+	//! blended in over a frame.
+	class ContactSampler {
+	public:
+		//! Constructor
+		//!
+		ContactSampler();
+
+		//! Samples scene around center, in device coordinates, given the
+		//! device-to-world transform (column-major, uniform scale). dt is the
+		//! time since the previous call.
+		void sample(ToolContactScene const &scene, double const deviceToWorld[16], glm::vec3 const &center, double dt,
+			ContactPatch &patch);
+
+	private:
+		std::vector<const DistanceField::Grid *> mGrids;
+		unsigned int mSequence;
+		unsigned int mRevision;
+		double mSinceChange;
+		double mBlendSeconds;	// of the current revision
+	};
+
+	//! Servo-rate contact against the latest ContactPatch.
+	//!
+	//! The device touches the surface when it crosses into it from outside.
+	//! While it stays in, the contact plane follows the patch, and where the
+	//! patch loses the surface, past the band of the voxmap or through a thin
+	//! shell, the last plane is held until the device is back out of it.
+	//!
+	//! Belongs to the servo thread.
+	class ContactRenderer {
+	public:
+		//! Constructor
+		//!
+		ContactRenderer();
+
+		//! Takes the latest published patch; cheap when it is not new.
+		void update(ContactPatch const &patch);
+
+		//! Advances the blend by dt seconds and evaluates contact at p.
+		//! Returns true in contact, with the penetration depth and the
+		//! outward normal of the contact plane.
+		bool evaluate(glm::vec3 const &p, double dt, float &depth, glm::vec3 &normal);
+
+		//! Drops the held contact and the patches taken so far. A patch the
+		//! worker may already be sampling is skipped as well, so that contact
+		//! resumes only from a patch taken after the reset.
+		void reset();
+
+	private:
+		ContactPatch mPrevious;
+		ContactPatch mCurrent;
+		float mBlend;	// from mPrevious at 0 to mCurrent at 1
+		bool mTouching;
+		bool mOutside;
+		glm::vec3 mPlanePoint;
+		glm::vec3 mPlaneNormal;
+		unsigned int mFirstSequence;	// oldest patch taken since reset()
+	};
+
+#endif
@@ -0,0 +1,295 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <map>
+#include <set>
+#include "deformation.h"
+
+double ringFalloff(int n, int numSlices)
+{
+	double yVal;
+	switch(numSlices){
+	case 9:
+		yVal = 3.5;
+		break;
+	case 8:
+		yVal = 4;
+		break;
+	case 7:
+		yVal = 5;
+		break;
+	case 6:
+		yVal = 7;
+		break;
+	case 5:
+		yVal = 9;
+		break;
+	case 4:
+		yVal = 12;
+		break;
+	case 3:
+		yVal = 20;
+		break;
+	case 2:
+		yVal = 40;
+		break;
+	default:
+		yVal = 3;
+		break;
+	}
+	return 1/(1+ pow(yVal,(n-double(numSlices)/2.0)));
+}
+
+double deformationGain(int ring, int numSlices, double steps)
+{
+	// Each tick moves ring n by s_n times the root's remaining gap, and the
+	// root closes s_1 of that gap, so the gaps form a geometric series.
+	double root = ringFalloff(1, numSlices);
+	return ringFalloff(ring + 1, numSlices) * (1 - pow(1 - root, steps)) / root;
+}
+
+static std::atomic<unsigned int> gNextRevision(1);
+
+/******************************************************************************************************************/
+DeformationSession::DeformationSession() :
+mLoader(0),
+mRevision(0),
+mRootIndex(-1),
+mNumSlices(1)
+{
+}
+
+void DeformationSession::begin(OBJLoader *loader, int rootIndex, int maxSlices)
+{
+	mLoader = loader;
+	mRevision = gNextRevision++;
+	mRootIndex = rootIndex;
+	mTarget = loader->getVertices()[rootIndex];
+
+	mRings.assign(maxSlices, std::vector<int>());
+
+	std::set<int> traversed;
+	mRings[0].push_back(rootIndex);
+	traversed.insert(rootIndex);
+
+	for(int n = 1; n < maxSlices; n++){
+		for(int i = 0; i < mRings[n-1].size(); i++){
+			std::set<int> const &neighbors = loader->getNeighbors(mRings[n-1][i]);
+			for(std::set<int>::const_iterator cur = neighbors.begin(); cur != neighbors.end(); cur++){
+				if(traversed.insert(*cur).second)
+					mRings[n].push_back(*cur);
+			}
+		}
+	}
+}
+
+int DeformationSession::absorb(std::vector<int> const &vertices)
+{
+	std::map<int, int> ringOf;
+	for(int n = 0; n < mRings.size(); n++){
+		for(int i = 0; i < mRings[n].size(); i++)
+			ringOf[mRings[n][i]] = n;
+	}
+
+	int added = 0;
+	for(int i = 0; i < vertices.size(); i++){
+		int ring = -1;
+		std::set<int> const &neighbors = mLoader->getNeighbors(vertices[i]);
+		for(std::set<int>::const_iterator cur = neighbors.begin(); cur != neighbors.end(); cur++){
+			std::map<int, int>::iterator found = ringOf.find(*cur);
+			if(found != ringOf.end() && (ring == -1 || found->second < ring))
+				ring = found->second;
+		}
+
+		if(ring != -1){
+			mRings[ring].push_back(vertices[i]);
+			ringOf[vertices[i]] = ring;
+			added++;
+		}
+	}
+	if(added)
+		mRevision = gNextRevision++;
+	return added;
+}
+
+void DeformationSession::setTarget(vec3 target)
+{
+	mTarget = target;
+}
+
+vec3 DeformationSession::getTarget() const
+{
+	return mTarget;
+}
+
+void DeformationSession::setNumSlices(int n)
+{
+	mNumSlices = std::max(1, std::min(n, (int)mRings.size()));
+}
+
+double DeformationSession::getStiffness() const
+{
+	double root = ringFalloff(1, mNumSlices);
+	double stiffness = 0;
+	for(int n = 0; n < mNumSlices; n++){
+		double ratio = ringFalloff(n + 1, mNumSlices)/root;
+		stiffness += mRings[n].size()*ratio*ratio;
+	}
+	return stiffness;
+}
+
+int DeformationSession::getNumSlices() const
+{
+	return mNumSlices;
+}
+
+OBJLoader *DeformationSession::getLoader() const
+{
+	return mLoader;
+}
+
+int DeformationSession::getRootIndex() const
+{
+	return mRootIndex;
+}
+
+std::vector<std::vector<int> > const &DeformationSession::getRings() const
+{
+	return mRings;
+}
+
+unsigned int DeformationSession::getRevision() const
+{
+	return mRevision;
+}
+
+/******************************************************************************************************************/
+DeformationBatch::DeformationBatch()
+{
+}
+
+void DeformationBatch::invalidate()
+{
+	mPlannedSessions.clear();
+	mPlannedRevisions.clear();
+	mPlannedSlices.clear();
+}
+
+std::vector<int> const &DeformationBatch::getTouchedVertices(OBJLoader const *loader) const
+{
+	static const std::vector<int> none;
+	for(int i = 0; i < mPlans.size(); i++){
+		if(mPlans[i].loader == loader)
+			return mPlans[i].vertices;
+	}
+	return none;
+}
+
+int DeformationBatch::getTouchedCount() const
+{
+	int count = 0;
+	for(int i = 0; i < mPlans.size(); i++)
+		count += mPlans[i].vertices.size();
+	return count;
+}
+
+void DeformationBatch::build(std::vector<DeformationSession *> const &sessions)
+{
+	mPlans.clear();
+	mSessionOffsets.assign(sessions.size() + 1, 0);
+	mPlannedSessions = sessions;
+	mPlannedRevisions.resize(sessions.size());
+	mPlannedSlices.resize(sessions.size());
+
+	for(int k = 0; k < sessions.size(); k++){
+		mPlannedRevisions[k] = sessions[k]->getRevision();
+		mPlannedSlices[k] = sessions[k]->getNumSlices();
+		mSessionOffsets[k + 1] = mSessionOffsets[k] + mPlannedSlices[k];
+	}
+	mDisplacements.assign(mSessionOffsets.back(), vec3(0.0f, 0.0f, 0.0f));
+	mGains.assign(mSessionOffsets.back(), 0.0f);
+
+	// Group (vertex, slot) pairs by mesh, then sort so that every vertex of
+	// the union ends up with one contiguous run of contributing slots.
+	std::vector<OBJLoader *> meshes;
+	std::vector<std::vector<std::pair<int, int> > > pairs;
+	for(int k = 0; k < sessions.size(); k++){
+		OBJLoader *loader = sessions[k]->getLoader();
+		int m = std::find(meshes.begin(), meshes.end(), loader) - meshes.begin();
+		if(m == meshes.size()){
+			meshes.push_back(loader);
+			pairs.push_back(std::vector<std::pair<int, int> >());
+		}
+
+		std::vector<std::vector<int> > const &rings = sessions[k]->getRings();
+		for(int n = 0; n < mPlannedSlices[k]; n++){
+			for(int i = 0; i < rings[n].size(); i++)
+				pairs[m].push_back(std::make_pair(rings[n][i], mSessionOffsets[k] + n));
+		}
+	}
+
+	mPlans.resize(meshes.size());
+	for(int m = 0; m < meshes.size(); m++){
+		MeshPlan &plan = mPlans[m];
+		plan.loader = meshes[m];
+		std::sort(pairs[m].begin(), pairs[m].end());
+
+		for(int i = 0; i < pairs[m].size(); i++){
+			if(plan.vertices.empty() || plan.vertices.back() != pairs[m][i].first){
+				plan.vertices.push_back(pairs[m][i].first);
+				plan.start.push_back(plan.slots.size());
+			}
+			plan.slots.push_back(pairs[m][i].second);
+		}
+		plan.start.push_back(plan.slots.size());
+	}
+}
+
+void DeformationBatch::solve(std::vector<DeformationSession *> const &sessions, double steps)
+{
+	// Compare revisions too: a session deleted and replaced at the same
+	// address has a new region.
+	bool changed = sessions != mPlannedSessions;
+	for(int k = 0; !changed && k < sessions.size(); k++)
+		changed = sessions[k]->getRevision() != mPlannedRevisions[k] ||
+			sessions[k]->getNumSlices() != mPlannedSlices[k];
+	if(changed)
+		build(sessions);
+
+	// The falloff was tuned for one step per servo tick. Apply the requested
+	// number of steps in closed form so the result does not depend on how
+	// often we are called.
+	for(int k = 0; k < sessions.size(); k++){
+		DeformationSession *session = sessions[k];
+		vec3 direction = session->getTarget() - session->getLoader()->getVertices()[session->getRootIndex()];
+
+		for(int n = 0; n < mPlannedSlices[k]; n++){
+			double gain = deformationGain(n, mPlannedSlices[k], steps);
+			mDisplacements[mSessionOffsets[k] + n] = direction*float(gain);
+			mGains[mSessionOffsets[k] + n] = float(gain);
+		}
+	}
+
+	for(int m = 0; m < mPlans.size(); m++){
+		MeshPlan &plan = mPlans[m];
+
+		for(int i = 0; i < plan.vertices.size(); i++){
+			vec3 delta(0.0f, 0.0f, 0.0f);
+			float weight = 0.0f;
+			for(int s = plan.start[i]; s < plan.start[i + 1]; s++){
+				delta += mDisplacements[plan.slots[s]];
+				weight += mGains[plan.slots[s]];
+			}
+
+			// Where regions overlap, blend their pulls instead of stacking
+			// them, otherwise the combined step can overshoot and oscillate.
+			if(weight > 1.0f)
+				delta /= weight;
+
+			// Read through the loader each time: the first deformPoint on a
+			// shared mesh swaps in a private copy of its vertices.
+			int v = plan.vertices[i];
+			plan.loader->deformPoint(v, plan.loader->getVertices()[v] + delta);
+		}
+	}
+}
@@ -0,0 +1,106 @@
+#ifndef DEFORMATION_H
+#define DEFORMATION_H
+
+#include <vector>
+#include "objloader.h"
+
+//! Falloff weight of ring n of an anchored region that is numSlices rings
+//! wide, for one servo-tick step.
+double ringFalloff(int n, int numSlices);
+
+//! Fraction of the root's gap that ring (0 at the root) has moved by after
+//! steps servo ticks of the per-tick falloff, in closed form.
+double deformationGain(int ring, int numSlices, double steps);
+
+	//! One anchored deformation region on a mesh.
+	//!
+	//! The region is the root vertex plus rings of neighbors found by a
+	//! breadth-first walk over the mesh adjacency. Each solve pulls the
+	//! region toward a model-space target with the ring falloff.
+	class DeformationSession {
+	public:
+		//! Constructor
+		//!
+		DeformationSession();
+
+		void begin(OBJLoader *loader, int rootIndex, int maxSlices);
+
+		//! Adds vertices created inside the region by OBJLoader::refineRegion
+		//! to the innermost ring among their neighbors. Vertices with no
+		//! neighbor in the region are ignored. Returns how many were added.
+		int absorb(std::vector<int> const &vertices);
+
+		void setTarget(vec3 target);
+		vec3 getTarget() const;
+
+		void setNumSlices(int n);
+		int getNumSlices() const;
+
+		OBJLoader *getLoader() const;
+		int getRootIndex() const;
+		std::vector<std::vector<int> > const &getRings() const;
+
+		//! Stiffness of the region against moving its root, relative to
+		//! the root alone. Every ring follows the root at its falloff ratio
+		//! s_n / s_1, so with each vertex held by a unit spring the elastic
+		//! energy is that of one spring of sum |ring n| (s_n / s_1)^2.
+		double getStiffness() const;
+
+		//! Changes whenever the region is rebuilt or grows, and is never
+		//! reused, so it tells sessions apart even when a new one is
+		//! allocated where a deleted one was.
+		unsigned int getRevision() const;
+
+	private:
+		OBJLoader *mLoader;
+		unsigned int mRevision;
+		int mRootIndex;
+		int mNumSlices;
+		vec3 mTarget;
+		std::vector<std::vector<int> > mRings;
+	};
+
+	//! Applies every active DeformationSession in one pass per mesh.
+	//!
+	//! Regions that overlap are merged into a deduplicated vertex list once,
+	//! when the set of sessions changes. Each tick then writes every vertex
+	//! of the union exactly once, no matter how many regions cover it.
+	class DeformationBatch {
+	public:
+		//! Constructor
+		//!
+		DeformationBatch();
+
+		//! Advances all sessions by the given number of servo-tick steps.
+		void solve(std::vector<DeformationSession *> const &sessions, double steps);
+
+		//! Forces the merged region to be rebuilt on the next solve.
+		void invalidate();
+
+		//! Vertices written by the last solve on the given mesh.
+		std::vector<int> const &getTouchedVertices(OBJLoader const *loader) const;
+
+		//! Total number of vertices written by each solve.
+		int getTouchedCount() const;
+
+	private:
+		struct MeshPlan {
+			OBJLoader *loader;
+			std::vector<int> vertices;      // union of all regions on the mesh
+			std::vector<int> start;         // vertices[i] sums slots[start[i]..start[i+1])
+			std::vector<int> slots;         // index into mDisplacements
+		};
+
+		void build(std::vector<DeformationSession *> const &sessions);
+
+		std::vector<MeshPlan> mPlans;
+		std::vector<int> mSessionOffsets;
+		std::vector<vec3> mDisplacements;
+		std::vector<float> mGains;
+
+		std::vector<DeformationSession *> mPlannedSessions;
+		std::vector<unsigned int> mPlannedRevisions;
+		std::vector<int> mPlannedSlices;
+	};
+
+#endif
@@ -0,0 +1,546 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "distancefield.h"
+
+static const char kCacheMagic[8] = "TVOSDF1";
+
+// Bricks computed by one pool task.
+static const int kBricksPerTask = 16;
+
+// Closest point to p on triangle abc, as barycentric weights of a, b and c.
+// Real-Time Collision Detection, Ericson, section 5.1.5.
+static glm::vec3 closestBarycentric(glm::vec3 const &p, glm::vec3 const &a, glm::vec3 const &b, glm::vec3 const &c)
+{
+	glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+	float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+	if (d1 <= 0.0f && d2 <= 0.0f)
+		return glm::vec3(1, 0, 0);
+
+	glm::vec3 bp = p - b;
+	float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+	if (d3 >= 0.0f && d4 <= d3)
+		return glm::vec3(0, 1, 0);
+
+	float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+		float v = d1 / (d1 - d3);
+		return glm::vec3(1 - v, v, 0);
+	}
+
+	glm::vec3 cp = p - c;
+	float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+	if (d6 >= 0.0f && d5 <= d6)
+		return glm::vec3(0, 0, 1);
+
+	float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+		float w = d2 / (d2 - d6);
+		return glm::vec3(1 - w, 0, w);
+	}
+
+	float va = d3 * d6 - d5 * d4;
+	if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+		float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+		return glm::vec3(0, 1 - w, w);
+	}
+
+	float denom = 1.0f / (va + vb + vc);
+	float v = vb * denom, w = vc * denom;
+	return glm::vec3(1 - v - w, v, w);
+}
+
+float DistanceField::Grid::distance(glm::vec3 const &p, glm::vec3 *gradient) const
+{
+	if (gradient)
+		*gradient = glm::vec3(0, 0, 0);
+
+	glm::vec3 g = (p - origin) / voxelSize;
+	if (g.x < 0.0f || g.y < 0.0f || g.z < 0.0f)
+		return band;
+
+	int cell[3] = { (int) g.x, (int) g.y, (int) g.z };
+	int b[3], l[3];
+	for (int k = 0; k < 3; k++) {
+		b[k] = cell[k] / kBrickCells;
+		if (b[k] >= dims[k])
+			return band;
+		l[k] = cell[k] - b[k] * kBrickCells;
+	}
+
+	Brick const *brick = bricks[(b[2] * dims[1] + b[1]) * dims[0] + b[0]].get();
+	if (!brick)
+		return band;
+
+	float tx = g.x - cell[0], ty = g.y - cell[1], tz = g.z - cell[2];
+	const int sy = kBrickSamples, sz = kBrickSamples * kBrickSamples;
+	float const *s = brick->samples + l[2] * sz + l[1] * sy + l[0];
+	float s000 = s[0], s100 = s[1], s010 = s[sy], s110 = s[sy + 1];
+	float s001 = s[sz], s101 = s[sz + 1], s011 = s[sz + sy], s111 = s[sz + sy + 1];
+
+	float x00 = s000 + (s100 - s000) * tx, x10 = s010 + (s110 - s010) * tx;
+	float x01 = s001 + (s101 - s001) * tx, x11 = s011 + (s111 - s011) * tx;
+	float y0 = x00 + (x10 - x00) * ty, y1 = x01 + (x11 - x01) * ty;
+
+	if (gradient) {
+		float dx0 = (s100 - s000) + ((s110 - s010) - (s100 - s000)) * ty;
+		float dx1 = (s101 - s001) + ((s111 - s011) - (s101 - s001)) * ty;
+		gradient->x = (dx0 + (dx1 - dx0) * tz) / voxelSize;
+		gradient->y = ((x10 - x00) + ((x11 - x01) - (x10 - x00)) * tz) / voxelSize;
+		gradient->z = (y1 - y0) / voxelSize;
+	}
+	return y0 + (y1 - y0) * tz;
+}
+
+DistanceField::DistanceField() :
+mLoader(0),
+mPendingTasks(0)
+{
+}
+
+void DistanceField::buildAsync(ThreadPool &pool, OBJLoader const *loader, float voxelSize, int bandVoxels,
+	std::string const &cacheFile)
+{
+	mLoader = loader;
+
+	std::vector<glm::vec3> const &vertices = loader->getVertices();
+	int triangleCount = loader->getTriangles().size();
+	mCorners.clear();
+	mCornerNormals.clear();
+	for (int t = 0; t < triangleCount; t++)
+		copyTriangle(t);
+
+	// Deformation may pull the surface out of its load-time bounds, so
+	// leave a brick of room beyond the band on every side.
+	glm::vec3 min = vertices[0], max = vertices[0];
+	for (int i = 1; i < vertices.size(); i++) {
+		min = glm::min(min, vertices[i]);
+		max = glm::max(max, vertices[i]);
+	}
+	float brickSize = kBrickCells * voxelSize;
+	float pad = bandVoxels * voxelSize + brickSize;
+	mLayout.origin = min - glm::vec3(pad, pad, pad);
+	mLayout.voxelSize = voxelSize;
+	mLayout.band = bandVoxels * voxelSize;
+	for (int k = 0; k < 3; k++)
+		mLayout.dims[k] = (int) ceil((max[k] - min[k] + 2 * pad) / brickSize);
+	mLayout.bricks.clear();
+
+	int brickCount = mLayout.dims[0] * mLayout.dims[1] * mLayout.dims[2];
+	mBrickTriangles.assign(brickCount, std::vector<int>());
+	mDirtyMark.assign(brickCount, 0);
+	mDirtyBricks.clear();
+	mMoved.clear();
+	mMovedMark.assign(vertices.size(), 0);
+	mRewritten.clear();
+	for (int t = 0; t < triangleCount; t++)
+		insertTriangle(t);
+	mDirtyBricks.clear();
+	mDirtyMark.assign(brickCount, 0);
+
+	std::atomic_store(&mGrid, std::shared_ptr<const Grid>());
+
+	unsigned int sum = checksum();
+	mPendingTasks = 1;
+	pool.submit([this, &pool, sum, cacheFile]() {
+		std::shared_ptr<Grid> cached(new Grid(mLayout));
+		if (!cacheFile.empty() && readCache(cacheFile, sum, *cached)) {
+			mPendingTasks = 0;
+			publish(cached);
+			return;
+		}
+
+		std::vector<int> active;
+		for (int b = 0; b < mBrickTriangles.size(); b++) {
+			if (!mBrickTriangles[b].empty())
+				active.push_back(b);
+		}
+
+		std::shared_ptr<Grid> grid(new Grid(mLayout));
+		grid->bricks.assign(mBrickTriangles.size(), std::shared_ptr<const Brick>());
+		int tasks = (active.size() + kBricksPerTask - 1) / kBricksPerTask;
+		if (tasks == 0) {
+			mPendingTasks = 0;
+			publish(grid);
+			return;
+		}
+
+		// Each task fills its own slots of grid->bricks. Whichever finishes
+		// last writes the cache and publishes the grid.
+		mPendingTasks = tasks;
+		std::shared_ptr<std::vector<int> > shared(new std::vector<int>());
+		shared->swap(active);
+		for (int first = 0; first < shared->size(); first += kBricksPerTask) {
+			pool.submit([this, grid, shared, first, sum, cacheFile]() {
+				int last = std::min((int) shared->size(), first + kBricksPerTask);
+				for (int i = first; i < last; i++)
+					grid->bricks[(*shared)[i]] = computeBrick((*shared)[i]);
+
+				if (mPendingTasks.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+					if (!cacheFile.empty() && !writeCache(cacheFile, sum, *grid))
+						fprintf(stderr, "Could not write %s\n", cacheFile.c_str());
+					publish(grid);
+				}
+			});
+		}
+	});
+}
+
+bool DistanceField::isReady() const
+{
+	return std::atomic_load(&mGrid) != 0;
+}
+
+std::shared_ptr<const DistanceField::Grid> DistanceField::getGrid() const
+{
+	return std::atomic_load(&mGrid);
+}
+
+void DistanceField::markMoved(std::vector<int> const &vertices)
+{
+	for (int i = 0; i < vertices.size(); i++) {
+		int v = vertices[i];
+		if (v >= mMovedMark.size())
+			mMovedMark.resize(v + 1, 0);
+		if (!mMovedMark[v]) {
+			mMovedMark[v] = 1;
+			mMoved.push_back(v);
+		}
+	}
+}
+
+void DistanceField::markTriangles(std::vector<int> const &triangles)
+{
+	mRewritten.insert(mRewritten.end(), triangles.begin(), triangles.end());
+}
+
+bool DistanceField::refresh(int maxBricks)
+{
+	// The build tasks read the triangle copy until the first grid is out.
+	std::shared_ptr<const Grid> current = getGrid();
+	if (!current)
+		return false;
+
+	int oldCount = mCorners.size() / 3;
+	int triangleCount = mLoader->getTriangles().size();
+	if (!mMoved.empty() || !mRewritten.empty() || triangleCount != oldCount) {
+		std::vector<std::vector<int> > const &vertexTriangles = mLoader->getVertexTriangles();
+		std::vector<int> affected;
+		for (int i = 0; i < mMoved.size(); i++) {
+			int v = mMoved[i];
+			mMovedMark[v] = 0;
+			if (v < vertexTriangles.size())
+				affected.insert(affected.end(), vertexTriangles[v].begin(), vertexTriangles[v].end());
+		}
+		mMoved.clear();
+		affected.insert(affected.end(), mRewritten.begin(), mRewritten.end());
+		mRewritten.clear();
+		for (int t = oldCount; t < triangleCount; t++)
+			affected.push_back(t);
+
+		std::sort(affected.begin(), affected.end());
+		affected.erase(std::unique(affected.begin(), affected.end()), affected.end());
+
+		// Clear the bricks around where each triangle was, then add it
+		// where it is now.
+		for (int i = 0; i < affected.size(); i++) {
+			int t = affected[i];
+			if (t < oldCount)
+				removeTriangle(t);
+			copyTriangle(t);
+			insertTriangle(t);
+		}
+	}
+
+	if (mDirtyBricks.empty())
+		return false;
+
+	std::shared_ptr<Grid> grid(new Grid(*current));
+	for (int i = 0; i < maxBricks && !mDirtyBricks.empty(); i++) {
+		int b = mDirtyBricks.back();
+		mDirtyBricks.pop_back();
+		mDirtyMark[b] = 0;
+		grid->bricks[b] = computeBrick(b);
+	}
+	publish(grid);
+
+	return !mDirtyBricks.empty();
+}
+
+int DistanceField::getBrickCount() const
+{
+	std::shared_ptr<const Grid> grid = getGrid();
+	if (!grid)
+		return 0;
+
+	int count = 0;
+	for (int b = 0; b < grid->bricks.size(); b++) {
+		if (grid->bricks[b])
+			count++;
+	}
+	return count;
+}
+
+void DistanceField::copyTriangle(int t)
+{
+	std::vector<glm::vec3> const &vertices = mLoader->getVertices();
+	std::vector<glm::vec3> const &normals = mLoader->getNormals();
+	Triangle const &tri = mLoader->getTriangles()[t];
+
+	if (3 * t + 3 > mCorners.size()) {
+		mCorners.resize(3 * t + 3);
+		mCornerNormals.resize(3 * t + 3);
+	}
+	for (int k = 0; k < 3; k++) {
+		mCorners[3 * t + k] = vertices[tri.vert[k]];
+		mCornerNormals[3 * t + k] = normals[tri.vert[k]];
+	}
+}
+
+void DistanceField::brickRange(int t, int lo[3], int hi[3]) const
+{
+	glm::vec3 min = glm::min(glm::min(mCorners[3 * t], mCorners[3 * t + 1]), mCorners[3 * t + 2]);
+	glm::vec3 max = glm::max(glm::max(mCorners[3 * t], mCorners[3 * t + 1]), mCorners[3 * t + 2]);
+	glm::vec3 band(mLayout.band, mLayout.band, mLayout.band);
+	float brickSize = kBrickCells * mLayout.voxelSize;
+
+	// A sample on a brick face belongs to both bricks, hence the extra
+	// cell on the low side.
+	float cell = 1.0f / kBrickCells;
+	glm::vec3 from = (min - band - mLayout.origin) / brickSize - glm::vec3(cell, cell, cell);
+	glm::vec3 to = (max + band - mLayout.origin) / brickSize;
+	for (int k = 0; k < 3; k++) {
+		lo[k] = std::max(0, (int) floor(from[k]));
+		hi[k] = std::min(mLayout.dims[k] - 1, (int) floor(to[k]));
+	}
+}
+
+void DistanceField::insertTriangle(int t)
+{
+	if (mLoader->getTriangles()[t].isRemoved())
+		return;
+
+	int lo[3], hi[3];
+	brickRange(t, lo, hi);
+	for (int z = lo[2]; z <= hi[2]; z++) {
+		for (int y = lo[1]; y <= hi[1]; y++) {
+			for (int x = lo[0]; x <= hi[0]; x++) {
+				int b = (z * mLayout.dims[1] + y) * mLayout.dims[0] + x;
+				mBrickTriangles[b].push_back(t);
+				markDirty(b);
+			}
+		}
+	}
+}
+
+void DistanceField::removeTriangle(int t)
+{
+	int lo[3], hi[3];
+	brickRange(t, lo, hi);
+	for (int z = lo[2]; z <= hi[2]; z++) {
+		for (int y = lo[1]; y <= hi[1]; y++) {
+			for (int x = lo[0]; x <= hi[0]; x++) {
+				int b = (z * mLayout.dims[1] + y) * mLayout.dims[0] + x;
+				std::vector<int> &list = mBrickTriangles[b];
+				list.erase(std::remove(list.begin(), list.end(), t), list.end());
+				markDirty(b);
+			}
+		}
+	}
+}
+
+void DistanceField::markDirty(int brick)
+{
+	if (!mDirtyMark[brick]) {
+		mDirtyMark[brick] = 1;
+		mDirtyBricks.push_back(brick);
+	}
+}
+
+std::shared_ptr<const DistanceField::Brick> DistanceField::computeBrick(int brick) const
+{
+	std::vector<int> const &triangles = mBrickTriangles[brick];
+	if (triangles.empty())
+		return std::shared_ptr<const Brick>();
+
+	int bx = brick % mLayout.dims[0];
+	int by = (brick / mLayout.dims[0]) % mLayout.dims[1];
+	int bz = brick / (mLayout.dims[0] * mLayout.dims[1]);
+	glm::vec3 corner = mLayout.origin + glm::vec3(bx, by, bz) * (kBrickCells * mLayout.voxelSize);
+	float band = mLayout.band;
+
+	std::shared_ptr<Brick> result(new Brick());
+	bool outsideOnly = true;
+	float *sample = result->samples;
+	for (int z = 0; z < kBrickSamples; z++) {
+		for (int y = 0; y < kBrickSamples; y++) {
+			for (int x = 0; x < kBrickSamples; x++, sample++) {
+				glm::vec3 p = corner + glm::vec3(x, y, z) * mLayout.voxelSize;
+
+				float best = band * band;
+				int bestTriangle = -1;
+				glm::vec3 bestWeights;
+				for (int i = 0; i < triangles.size(); i++) {
+					int t = triangles[i];
+					glm::vec3 w = closestBarycentric(p, mCorners[3 * t], mCorners[3 * t + 1], mCorners[3 * t + 2]);
+					glm::vec3 d = p - (w.x * mCorners[3 * t] + w.y * mCorners[3 * t + 1] + w.z * mCorners[3 * t + 2]);
+					float d2 = glm::dot(d, d);
+					if (d2 < best) {
+						best = d2;
+						bestTriangle = t;
+						bestWeights = w;
+					}
+				}
+
+				if (bestTriangle < 0) {
+					*sample = band;
+					continue;
+				}
+
+				int t = bestTriangle;
+				glm::vec3 closest = bestWeights.x * mCorners[3 * t] + bestWeights.y * mCorners[3 * t + 1] + bestWeights.z * mCorners[3 * t + 2];
+				glm::vec3 normal = bestWeights.x * mCornerNormals[3 * t] + bestWeights.y * mCornerNormals[3 * t + 1] + bestWeights.z * mCornerNormals[3 * t + 2];
+				if (glm::dot(normal, normal) < 1e-12f)
+					normal = glm::cross(mCorners[3 * t + 1] - mCorners[3 * t], mCorners[3 * t + 2] - mCorners[3 * t]);
+
+				float distance = sqrt(best);
+				*sample = glm::dot(p - closest, normal) < 0.0f ? -distance : distance;
+				if (*sample < band)
+					outsideOnly = false;
+			}
+		}
+	}
+
+	// A brick that reads as band everywhere is the same as no brick.
+	if (outsideOnly)
+		return std::shared_ptr<const Brick>();
+	return result;
+}
+
+void DistanceField::publish(std::shared_ptr<const Grid> const &grid)
+{
+	std::atomic_store(&mGrid, grid);
+}
+
+unsigned int DistanceField::checksum() const
+{
+	// FNV-1a over the triangle corners and the grid settings.
+	unsigned int hash = 2166136261u;
+	unsigned char const *bytes = (unsigned char const *) mCorners.data();
+	size_t count = mCorners.size() * sizeof(glm::vec3);
+	for (size_t i = 0; i < count; i++)
+		hash = (hash ^ bytes[i]) * 16777619u;
+
+	float settings[2] = { mLayout.voxelSize, mLayout.band };
+	bytes = (unsigned char const *) settings;
+	for (size_t i = 0; i < sizeof(settings); i++)
+		hash = (hash ^ bytes[i]) * 16777619u;
+	return hash;
+}
+
+bool DistanceField::readCache(std::string const &filename, unsigned int sum, Grid &grid) const
+{
+	FILE *file = fopen(filename.c_str(), "rb");
+	if (!file)
+		return false;
+
+	char magic[8];
+	unsigned int fileSum;
+	int dims[3], count;
+	bool ok = fread(magic, sizeof(magic), 1, file) == 1 && !memcmp(magic, kCacheMagic, sizeof(magic)) &&
+		fread(&fileSum, sizeof(fileSum), 1, file) == 1 && fileSum == sum &&
+		fread(dims, sizeof(dims), 1, file) == 1 &&
+		dims[0] == grid.dims[0] && dims[1] == grid.dims[1] && dims[2] == grid.dims[2] &&
+		fread(&count, sizeof(count), 1, file) == 1;
+
+	int brickCount = grid.dims[0] * grid.dims[1] * grid.dims[2];
+	grid.bricks.assign(brickCount, std::shared_ptr<const Brick>());
+	for (int i = 0; ok && i < count; i++) {
+		int index;
+		std::shared_ptr<Brick> brick(new Brick());
+		ok = fread(&index, sizeof(index), 1, file) == 1 && index >= 0 && index < brickCount &&
+			fread(brick->samples, sizeof(brick->samples), 1, file) == 1;
+		if (ok)
+			grid.bricks[index] = brick;
+	}
+	fclose(file);
+	return ok;
+}
+
+bool DistanceField::writeCache(std::string const &filename, unsigned int sum, Grid const &grid) const
+{
+	FILE *file = fopen(filename.c_str(), "wb");
+	if (!file)
+		return false;
+
+	int count = 0;
+	for (int b = 0; b < grid.bricks.size(); b++) {
+		if (grid.bricks[b])
+			count++;
+	}
+
+	bool ok = fwrite(kCacheMagic, sizeof(kCacheMagic), 1, file) == 1 &&
+		fwrite(&sum, sizeof(sum), 1, file) == 1 &&
+		fwrite(grid.dims, sizeof(grid.dims), 1, file) == 1 &&
+		fwrite(&count, sizeof(count), 1, file) == 1;
+	for (int b = 0; ok && b < grid.bricks.size(); b++) {
+		if (!grid.bricks[b])
+			continue;
+		ok = fwrite(&b, sizeof(b), 1, file) == 1 &&
+			fwrite(grid.bricks[b]->samples, sizeof(grid.bricks[b]->samples), 1, file) == 1;
+	}
+	return fclose(file) == 0 && ok;
+}
+
+size_t DistanceField::getMemoryBytes() const
+{
+	size_t bytes = vectorBytes(mCorners) + vectorBytes(mCornerNormals) + vectorBytes(mBrickTriangles) +
+		vectorBytes(mMoved) + vectorBytes(mMovedMark) + vectorBytes(mRewritten) + vectorBytes(mDirtyBricks) +
+		vectorBytes(mDirtyMark) + vectorBytes(mLayout.bricks);
+
+	// Bricks are shared between successive grids, so only the latest counts.
+	std::shared_ptr<const Grid> grid = getGrid();
+	if (grid) {
+		bytes += vectorBytes(grid->bricks);
+		for (int b = 0; b < grid->bricks.size(); b++) {
+			if (grid->bricks[b])
+				bytes += sizeof(Brick) + kTreeNodeOverhead;
+		}
+	}
+	return bytes;
+}
+
+size_t DistanceField::estimateBytes(OBJLoader const &loader, float voxelSize, int bandVoxels)
+{
+	std::vector<glm::vec3> const &vertices = loader.getVertices();
+	std::vector<Triangle> const &triangles = loader.getTriangles();
+	if (vertices.empty())
+		return 0;
+
+	float area = 0.0f;
+	glm::vec3 min = vertices[0], max = vertices[0];
+	for (int t = 0; t < triangles.size(); t++) {
+		Triangle const &tri = triangles[t];
+		area += 0.5f * glm::length(glm::cross(vertices[tri.vert[1]] - vertices[tri.vert[0]],
+			vertices[tri.vert[2]] - vertices[tri.vert[0]]));
+	}
+	for (int i = 1; i < vertices.size(); i++) {
+		min = glm::min(min, vertices[i]);
+		max = glm::max(max, vertices[i]);
+	}
+
+	// A surface crosses about one and a half bricks per brick face of
+	// area, and the band on either side thickens that.
+	float brickSize = kBrickCells * voxelSize;
+	float pad = bandVoxels * voxelSize + brickSize;
+	double cells = 1.0;
+	for (int k = 0; k < 3; k++)
+		cells *= ceil((max[k] - min[k] + 2 * pad) / brickSize);
+	double bricks = area / (brickSize * brickSize) * (1.5 + 2.0 * bandVoxels / kBrickCells);
+	bricks = std::min(bricks, cells);
+
+	return (size_t) (bricks * (sizeof(Brick) + kTreeNodeOverhead) +
+		cells * (sizeof(std::shared_ptr<const Brick>) + sizeof(std::vector<int>) + 1) +
+		triangles.size() * (6 * sizeof(glm::vec3) + 8 * sizeof(int)));
+}
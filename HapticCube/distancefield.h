@@ -0,0 +1,127 @@
+#ifndef DISTANCEFIELD_H
+#define DISTANCEFIELD_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include "objloader.h"
+#include "threadpool.h"
+
+	//! Narrow-band signed distance field around one mesh, in the mesh's
+	//! model space.
+	//!
+	//! Space is cut into bricks of 8 x 8 x 8 cells. Only bricks within the
+	//! band of some triangle store samples; every other point reads as the
+	//! band width outside the surface. The sign follows the interpolated
+	//! vertex normal at the closest point, so the front side is positive.
+	//!
+	//! The field is published as an immutable Grid. Queries on a Grid take
+	//! constant time and never touch triangles, so any thread, the servo
+	//! thread included, may query the grid returned by getGrid() while the
+	//! owner refreshes bricks after a deformation.
+	class DistanceField {
+	public:
+		//! (kBrickCells + 1)^3 samples, so that the eight corners of every
+		//! cell lie in the same brick.
+		static const int kBrickCells = 8;
+		static const int kBrickSamples = kBrickCells + 1;
+
+		struct Brick {
+			float samples[kBrickSamples * kBrickSamples * kBrickSamples];
+		};
+
+		struct Grid {
+			glm::vec3 origin;
+			float voxelSize;
+			float band;
+			int dims[3];	// bricks along each axis
+			std::vector<std::shared_ptr<const Brick> > bricks;	// null outside the band
+
+			//! Trilinear signed distance at p, and its gradient if gradient
+			//! is not null. Outside the band returns band with a zero
+			//! gradient.
+			float distance(glm::vec3 const &p, glm::vec3 *gradient) const;
+		};
+
+		//! Constructor
+		//!
+		DistanceField();
+
+		//! Copies the triangles of loader and computes the bricks on the pool,
+		//! returning at once. voxelSize is the cell size in model units and
+		//! bandVoxels the half-width of the band in cells. If cacheFile holds
+		//! a field of the same mesh and settings it is read instead, and a
+		//! fresh build is written back to it. isReady() turns true when the
+		//! first grid is published. loader must outlive the field, and must
+		//! not be edited during this call.
+		void buildAsync(ThreadPool &pool, OBJLoader const *loader, float voxelSize, int bandVoxels,
+			std::string const &cacheFile);
+
+		bool isReady() const;
+
+		//! Latest published grid, or null before the build is done. Any
+		//! thread.
+		std::shared_ptr<const Grid> getGrid() const;
+
+		//! Queues the bricks around the triangles of the given vertices, and
+		//! of triangles added since the last refresh, for recomputation.
+		//! Cheap; call with the mesh locked right after editing it.
+		void markMoved(std::vector<int> const &vertices);
+
+		//! Queues the bricks around the given triangles, where they were and
+		//! where they are now, for triangles rewritten or removed in place.
+		void markTriangles(std::vector<int> const &triangles);
+
+		//! Recomputes up to maxBricks queued bricks from the current mesh and
+		//! publishes a new grid. Call with the mesh locked. Returns true
+		//! while queued bricks remain.
+		bool refresh(int maxBricks);
+
+		int getBrickCount() const;
+
+		//! Heap bytes of the latest grid and of the mesh copy the bricks are
+		//! kept up to date from.
+		size_t getMemoryBytes() const;
+
+		//! Rough bytes a field of loader with these settings would take,
+		//! from the surface area the band has to cover, without building
+		//! it.
+		static size_t estimateBytes(OBJLoader const &loader, float voxelSize, int bandVoxels);
+
+	private:
+		DistanceField(const DistanceField &);
+		DistanceField &operator=(const DistanceField &);
+
+		void copyTriangle(int t);
+		void brickRange(int t, int lo[3], int hi[3]) const;
+		void insertTriangle(int t);
+		void removeTriangle(int t);
+		void markDirty(int brick);
+		std::shared_ptr<const Brick> computeBrick(int brick) const;
+		void publish(std::shared_ptr<const Grid> const &grid);
+
+		unsigned int checksum() const;
+		bool readCache(std::string const &filename, unsigned int sum, Grid &grid) const;
+		bool writeCache(std::string const &filename, unsigned int sum, Grid const &grid) const;
+
+		OBJLoader const *mLoader;
+
+		// Copy of the mesh the bricks were computed from: three corners and
+		// three corner normals per triangle.
+		std::vector<glm::vec3> mCorners;
+		std::vector<glm::vec3> mCornerNormals;
+		std::vector<std::vector<int> > mBrickTriangles;
+
+		std::vector<int> mMoved;
+		std::vector<char> mMovedMark;
+		std::vector<int> mRewritten;
+		std::vector<int> mDirtyBricks;
+		std::vector<char> mDirtyMark;
+
+		std::shared_ptr<const Grid> mGrid;
+		Grid mLayout;
+		std::atomic<int> mPendingTasks;
+	};
+
+#endif
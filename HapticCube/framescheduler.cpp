@@ -0,0 +1,93 @@
+#include <thread>
+#include "framescheduler.h"
+
+FrameScheduler::FrameScheduler() :
+mDirty(FRAME_DIRTY_ALL),
+mLastFrame(),
+mFramePeriod(1.0 / 60.0),
+mHeartbeatPeriod(1.0 / 10.0),
+mNextTask(0)
+{
+}
+
+void FrameScheduler::setTargetRate(double hz)
+{
+	if (hz > 0.0)
+		mFramePeriod = 1.0 / hz;
+}
+
+double FrameScheduler::getTargetRate() const
+{
+	return 1.0 / mFramePeriod;
+}
+
+void FrameScheduler::setHeartbeatRate(double hz)
+{
+	if (hz > 0.0)
+		mHeartbeatPeriod = 1.0 / hz;
+}
+
+void FrameScheduler::markDirty(unsigned int flags)
+{
+	mDirty.fetch_or(flags);
+}
+
+bool FrameScheduler::shouldRedraw() const
+{
+	double elapsed = std::chrono::duration<double>(Clock::now() - mLastFrame).count();
+	if (elapsed < mFramePeriod)
+		return false;
+	return mDirty.load() != 0 || elapsed >= mHeartbeatPeriod;
+}
+
+unsigned int FrameScheduler::frameDrawn()
+{
+	mLastFrame = Clock::now();
+	return mDirty.exchange(0);
+}
+
+double FrameScheduler::timeUntilNextFrame() const
+{
+	double elapsed = std::chrono::duration<double>(Clock::now() - mLastFrame).count();
+	double period = mDirty.load() != 0 ? mFramePeriod : mHeartbeatPeriod;
+	return period > elapsed ? period - elapsed : 0.0;
+}
+
+void FrameScheduler::addIdleTask(IdleTask task, void *userdata)
+{
+	Task entry;
+	entry.task = task;
+	entry.userdata = userdata;
+	mTasks.push_back(entry);
+}
+
+void FrameScheduler::runIdleTasks(double budget)
+{
+	if (mTasks.empty())
+		return;
+
+	Clock::time_point deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(budget));
+
+	// Stop after a full round in which no task had anything left to do.
+	int idleInARow = 0;
+	while (idleInARow < (int)mTasks.size() && Clock::now() < deadline) {
+		Task &entry = mTasks[mNextTask];
+		mNextTask = (mNextTask + 1) % mTasks.size();
+
+		if (entry.task(entry.userdata))
+			idleInARow = 0;
+		else
+			idleInARow++;
+	}
+}
+
+void FrameScheduler::idle(double maxSleep)
+{
+	runIdleTasks(timeUntilNextFrame());
+
+	double remaining = timeUntilNextFrame();
+	if (remaining > maxSleep)
+		remaining = maxSleep;
+	if (remaining > 0.0)
+		std::this_thread::sleep_for(std::chrono::duration<double>(remaining));
+}
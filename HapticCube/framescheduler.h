@@ -0,0 +1,76 @@
+#ifndef FRAMESCHEDULER_H
+#define FRAMESCHEDULER_H
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+//! Reasons a new graphics frame is needed.
+enum FrameDirtyFlags {
+	FRAME_DIRTY_PROXY = 1,
+	FRAME_DIRTY_TRANSFORM = 2,
+	FRAME_DIRTY_VERTICES = 4,
+	FRAME_DIRTY_VIEW = 8,
+	FRAME_DIRTY_ALL = 15
+};
+
+//! Deferrable work run by FrameScheduler between frames. Returns true while
+//! more work remains.
+typedef bool (*IdleTask)(void *userdata);
+
+	//! Decides when the GLUT thread should redraw.
+	//!
+	//! Frames are only drawn when something changed, no faster than the
+	//! target rate, plus a slow heartbeat that keeps the haptic frame fresh.
+	//! The time left between frames is given to deferred idle tasks and
+	//! then slept away instead of spinning.
+	class FrameScheduler {
+	public:
+		//! Constructor
+		//!
+		FrameScheduler();
+
+		void setTargetRate(double hz);
+		double getTargetRate() const;
+		void setHeartbeatRate(double hz);
+
+		//! Requests a redraw. Safe to call from any thread.
+		void markDirty(unsigned int flags);
+
+		//! True when a frame should be drawn now.
+		bool shouldRedraw() const;
+
+		//! Call once a frame has been drawn. Returns the flags it consumed.
+		unsigned int frameDrawn();
+
+		//! Seconds until the next frame may be drawn.
+		double timeUntilNextFrame() const;
+
+		//! Registers a task to be run from runIdleTasks.
+		void addIdleTask(IdleTask task, void *userdata);
+
+		//! Runs idle tasks round robin until they are all done or the budget
+		//! in seconds is spent.
+		void runIdleTasks(double budget);
+
+		//! Runs idle tasks for the time left before the next frame, then
+		//! sleeps for at most maxSleep seconds of what remains.
+		void idle(double maxSleep);
+
+	private:
+		typedef std::chrono::steady_clock Clock;
+
+		struct Task {
+			IdleTask task;
+			void *userdata;
+		};
+
+		std::atomic<unsigned int> mDirty;
+		Clock::time_point mLastFrame;
+		double mFramePeriod;
+		double mHeartbeatPeriod;
+		std::vector<Task> mTasks;
+		int mNextTask;
+	};
+
+#endif
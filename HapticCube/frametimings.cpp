@@ -0,0 +1,76 @@
+#include <algorithm>
+#include <cmath>
+#include "frametimings.h"
+
+FrameTimings::FrameTimings()
+{
+}
+
+void FrameTimings::reserve(int frames)
+{
+	mSeconds.reserve(frames);
+}
+
+void FrameTimings::add(double seconds)
+{
+	mSeconds.push_back(seconds);
+}
+
+void FrameTimings::clear()
+{
+	mSeconds.clear();
+}
+
+int FrameTimings::getCount() const
+{
+	return mSeconds.size();
+}
+
+double FrameTimings::getSeconds(int frame) const
+{
+	return mSeconds[frame];
+}
+
+// Nearest-rank percentile of an ascending sample.
+static double percentile(std::vector<double> const &sorted, double p)
+{
+	int rank = (int) ceil(p * sorted.size()) - 1;
+	return sorted[std::max(0, std::min(rank, (int) sorted.size() - 1))];
+}
+
+FrameTimings::Summary FrameTimings::summarize() const
+{
+	Summary summary = { 0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+	if (mSeconds.empty())
+		return summary;
+
+	std::vector<double> sorted(mSeconds);
+	std::sort(sorted.begin(), sorted.end());
+
+	double sum = 0.0;
+	for (int i = 0; i < sorted.size(); i++)
+		sum += sorted[i];
+	double mean = sum / sorted.size();
+
+	double variance = 0.0;
+	for (int i = 0; i < sorted.size(); i++)
+		variance += (sorted[i] - mean) * (sorted[i] - mean);
+	variance /= sorted.size();
+
+	summary.frames = sorted.size();
+	summary.meanMs = 1000.0 * mean;
+	summary.stddevMs = 1000.0 * sqrt(variance);
+	summary.minMs = 1000.0 * sorted.front();
+	summary.medianMs = 1000.0 * percentile(sorted, 0.5);
+	summary.p95Ms = 1000.0 * percentile(sorted, 0.95);
+	summary.p99Ms = 1000.0 * percentile(sorted, 0.99);
+	summary.maxMs = 1000.0 * sorted.back();
+	return summary;
+}
+
+void FrameTimings::print(FILE *file, const char *label) const
+{
+	Summary s = summarize();
+	fprintf(file, "%-8s frames %d  mean %.3f ms (sd %.3f)  min %.3f  median %.3f  p95 %.3f  p99 %.3f  max %.3f\n",
+		label, s.frames, s.meanMs, s.stddevMs, s.minMs, s.medianMs, s.p95Ms, s.p99Ms, s.maxMs);
+}
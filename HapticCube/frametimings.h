@@ -0,0 +1,42 @@
+#ifndef FRAMETIMINGS_H
+#define FRAMETIMINGS_H
+
+#include <cstdio>
+#include <vector>
+
+	//! Per-frame durations collected by the offscreen benchmark.
+	class FrameTimings {
+	public:
+		//! Distribution of the recorded durations, in milliseconds.
+		struct Summary {
+			int frames;
+			double meanMs;
+			double stddevMs;
+			double minMs;
+			double medianMs;
+			double p95Ms;
+			double p99Ms;
+			double maxMs;
+		};
+
+		//! Constructor
+		//!
+		FrameTimings();
+
+		void reserve(int frames);
+		void add(double seconds);
+		void clear();
+
+		int getCount() const;
+		double getSeconds(int frame) const;
+
+		Summary summarize() const;
+
+		//! Prints one summary line prefixed with label.
+		void print(FILE *file, const char *label) const;
+
+	private:
+		std::vector<double> mSeconds;
+	};
+
+#endif
@@ -0,0 +1,568 @@
+#include <algorithm>
+#include <unordered_map>
+#include "halfedgemesh.h"
+
+// Free triangles are added to the loader this many at a time, so that its
+// triangle count, on which derived structures rebuild, changes rarely.
+static const int kTriangleBlock = 4096;
+
+// Rim edges shorter than this fraction of the blade are collapsed.
+static const float kMinRimEdge = 0.2f;
+
+static float segmentDistance(glm::vec3 const &p, glm::vec3 const &a, glm::vec3 const &b)
+{
+	glm::vec3 ab = b - a;
+	float length2 = glm::dot(ab, ab);
+	float s = length2 > 0.0f ? glm::clamp(glm::dot(p - a, ab) / length2, 0.0f, 1.0f) : 0.0f;
+	return glm::distance(p, a + ab * s);
+}
+
+static long long edgeKey(int a, int b)
+{
+	return ((long long) a << 32) | (unsigned int) b;
+}
+
+HalfEdgeMesh::HalfEdgeMesh() :
+mLoader(0),
+mReady(false),
+mVertexCount(0),
+mTriangleCount(0)
+{
+}
+
+void HalfEdgeMesh::build(OBJLoader *loader)
+{
+	start(loader);
+	compute(*mBuild);
+	prepare();
+}
+
+void HalfEdgeMesh::buildAsync(ThreadPool &pool, OBJLoader *loader)
+{
+	start(loader);
+	std::shared_ptr<Build> build = mBuild;
+	pool.submit([build]() {
+		compute(*build);
+	});
+}
+
+void HalfEdgeMesh::start(OBJLoader *loader)
+{
+	mLoader = loader;
+	std::vector<Triangle> const &tris = loader->getTriangles();
+	mTriangleCount = tris.size();
+	mVertexCount = loader->getVertices().size();
+	mReady = false;
+	mPending.clear();
+
+	mBuild.reset(new Build());
+	mBuild->vertexCount = mVertexCount;
+	mBuild->corners.resize(3 * tris.size());
+	for (int t = 0; t < tris.size(); t++) {
+		for (int k = 0; k < 3; k++)
+			mBuild->corners[3 * t + k] = tris[t].vert[k];
+	}
+}
+
+void HalfEdgeMesh::compute(Build &build)
+{
+	std::vector<int> const &corners = build.corners;
+	int triangleCount = corners.size() / 3;
+
+	// Each directed edge once; one used twice makes its edge non-manifold,
+	// which is left as a boundary. A removed triangle has all its corners
+	// on one vertex, and a vertex used by no triangle is free.
+	std::unordered_map<long long, int> edges;
+	edges.reserve(corners.size());
+	build.unused.assign(build.vertexCount, 1);
+	for (int t = 0; t < triangleCount; t++) {
+		int const *vert = &corners[3 * t];
+		if (vert[0] == vert[1] && vert[1] == vert[2])
+			continue;
+		for (int k = 0; k < 3; k++) {
+			build.unused[vert[k]] = 0;
+			std::pair<std::unordered_map<long long, int>::iterator, bool> inserted =
+				edges.insert(std::make_pair(edgeKey(vert[k], vert[(k + 1) % 3]), 3 * t + k));
+			if (!inserted.second)
+				inserted.first->second = -1;
+		}
+	}
+
+	build.twin.assign(corners.size(), -1);
+	for (std::unordered_map<long long, int>::iterator it = edges.begin(); it != edges.end(); it++) {
+		int h = it->second;
+		if (h < 0)
+			continue;
+		int a = (int) (it->first >> 32), b = (int) (unsigned int) it->first;
+		std::unordered_map<long long, int>::iterator twin = edges.find(edgeKey(b, a));
+		if (twin != edges.end() && twin->second >= 0)
+			build.twin[h] = twin->second;
+	}
+
+	for (int t = triangleCount - 1; t >= 0; t--) {
+		if (corners[3 * t] == corners[3 * t + 1] && corners[3 * t + 1] == corners[3 * t + 2])
+			build.freeTriangles.push_back(t);
+	}
+	for (int v = build.vertexCount - 1; v >= 0; v--) {
+		if (build.unused[v])
+			build.freeVertices.push_back(v);
+	}
+
+	std::vector<int>().swap(build.corners);
+	build.done.store(true, std::memory_order_release);
+}
+
+bool HalfEdgeMesh::prepare()
+{
+	if (mReady)
+		return true;
+	if (!mBuild || !mBuild->done.load(std::memory_order_acquire))
+		return false;
+
+	mTwin.swap(mBuild->twin);
+	mFreeTriangles.swap(mBuild->freeTriangles);
+	mFreeVertices.swap(mBuild->freeVertices);
+	mUnused.swap(mBuild->unused);
+	mBuild.reset();
+
+	mChangedVertices.clear();
+	mChangedTriangles.clear();
+	mRim.clear();
+	mQueue.clear();
+	mQueued.assign(mTriangleCount, 0);
+	mReady = true;
+
+	// Catch up with the edits made while the build ran.
+	relink(mPending);
+	std::vector<int>().swap(mPending);
+	return true;
+}
+
+bool HalfEdgeMesh::isStale() const
+{
+	return !mLoader || mLoader->getTriangles().size() != mTriangleCount ||
+		mLoader->getVertices().size() != mVertexCount;
+}
+
+void HalfEdgeMesh::update(std::vector<int> const &triangles)
+{
+	mTriangleCount = mLoader->getTriangles().size();
+	mVertexCount = mLoader->getVertices().size();
+	if (mReady)
+		relink(triangles);
+	else
+		mPending.insert(mPending.end(), triangles.begin(), triangles.end());
+}
+
+void HalfEdgeMesh::relink(std::vector<int> const &triangles)
+{
+	mTwin.resize(3 * mTriangleCount, -1);
+	mQueued.resize(mTriangleCount, 0);
+	mUnused.resize(mVertexCount, 0);
+
+	// Unlink them all first, so that no neighbor keeps a twin whose edge
+	// has moved elsewhere in the triangle, then link them against the
+	// current corners.
+	for (int i = 0; i < triangles.size(); i++)
+		unlinkTwins(triangles[i]);
+	for (int i = 0; i < triangles.size(); i++)
+		linkTwins(triangles[i]);
+}
+
+int HalfEdgeMesh::splitEdge(int h, float s)
+{
+	std::vector<Triangle> const &tris = mLoader->getTriangles();
+	int t = h / 3, k = h % 3;
+	int a = tris[t].vert[k], b = tris[t].vert[(k + 1) % 3], c = tris[t].vert[(k + 2) % 3];
+	int g = mTwin[h];
+	int t2 = g >= 0 ? g / 3 : -1;
+	int d = g >= 0 ? tris[t2].vert[(g % 3 + 2) % 3] : -1;
+
+	glm::vec3 position = glm::mix(mLoader->getVertices()[a], mLoader->getVertices()[b], s);
+	glm::vec3 normal = glm::mix(mLoader->getNormals()[a], mLoader->getNormals()[b], s);
+	glm::vec3 color = glm::mix(mLoader->getColors()[a], mLoader->getColors()[b], s);
+	double friction = mLoader->getFriction()[a] * (1.0 - s) + mLoader->getFriction()[b] * s;
+	int m = allocateVertex(position, normal, color, friction);
+
+	// (a,b,c) becomes (a,m,c) + (m,b,c), and across the edge (b,a,d)
+	// becomes (b,m,d) + (m,a,d), keeping the winding.
+	int t1 = allocateTriangle();
+	write(t, a, m, c);
+	write(t1, m, b, c);
+	int t3 = -1;
+	if (t2 >= 0) {
+		t3 = allocateTriangle();
+		write(t2, b, m, d);
+		write(t3, m, a, d);
+	}
+
+	linkTwins(t);
+	linkTwins(t1);
+	if (t2 >= 0) {
+		linkTwins(t2);
+		linkTwins(t3);
+	}
+
+	std::vector<int> touched;
+	touched.push_back(a);
+	touched.push_back(b);
+	touched.push_back(c);
+	touched.push_back(m);
+	if (d >= 0)
+		touched.push_back(d);
+	finish(touched);
+	return m;
+}
+
+bool HalfEdgeMesh::collapseEdge(int h)
+{
+	std::vector<Triangle> const &tris = mLoader->getTriangles();
+	int t = h / 3, k = h % 3;
+	int a = tris[t].vert[k], b = tris[t].vert[(k + 1) % 3], c = tris[t].vert[(k + 2) % 3];
+	int g = mTwin[h];
+	int t2 = g >= 0 ? g / 3 : -1;
+	int d = g >= 0 ? tris[t2].vert[(g % 3 + 2) % 3] : -1;
+	if (a == b)
+		return false;
+
+	// Link condition: only the corners opposite the edge may be neighbors
+	// of both ends, and an inner edge may not join two boundaries.
+	std::set<int> const &aNeighbors = mLoader->getNeighbors(a);
+	std::set<int> const &bNeighbors = mLoader->getNeighbors(b);
+	for (std::set<int>::const_iterator n = aNeighbors.begin(); n != aNeighbors.end(); n++) {
+		if (*n != c && *n != d && bNeighbors.count(*n))
+			return false;
+	}
+	if (g >= 0 && onBoundary(a) && onBoundary(b))
+		return false;
+	std::vector<int> const &bTriangles = mLoader->getVertexTriangles()[b];
+	for (int i = 0; i < bTriangles.size(); i++) {
+		Triangle const &tri = tris[bTriangles[i]];
+		if (bTriangles[i] != t && bTriangles[i] != t2 && (tri.vert[0] == a || tri.vert[1] == a || tri.vert[2] == a))
+			return false;	// a third triangle on the edge
+	}
+
+	glm::vec3 middle = 0.5f * (mLoader->getVertices()[a] + mLoader->getVertices()[b]);
+
+	std::vector<int> touched;
+	touched.push_back(a);
+	touched.push_back(b);
+	touched.push_back(c);
+	unlinkTwins(t);
+	write(t, c, c, c);
+	mFreeTriangles.push_back(t);
+	if (t2 >= 0) {
+		touched.push_back(d);
+		unlinkTwins(t2);
+		write(t2, d, d, d);
+		mFreeTriangles.push_back(t2);
+	}
+
+	// Hand the rest of b's triangles to a.
+	std::vector<int> moved = mLoader->getVertexTriangles()[b];
+	for (int i = 0; i < moved.size(); i++) {
+		Triangle tri = mLoader->getTriangles()[moved[i]];
+		for (int j = 0; j < 3; j++) {
+			if (tri.vert[j] == b)
+				tri.vert[j] = a;
+			touched.push_back(tri.vert[j]);
+		}
+		write(moved[i], tri.vert[0], tri.vert[1], tri.vert[2]);
+	}
+	for (int i = 0; i < moved.size(); i++)
+		linkTwins(moved[i]);
+
+	mLoader->setVertex(a, middle, mLoader->getNormals()[a], mLoader->getColors()[a], mLoader->getFriction()[a]);
+	finish(touched);
+	return true;
+}
+
+void HalfEdgeMesh::removeFace(int t)
+{
+	Triangle tri = mLoader->getTriangles()[t];
+	if (tri.isRemoved())
+		return;
+
+	unlinkTwins(t);
+	write(t, tri.vert[0], tri.vert[0], tri.vert[0]);
+	mFreeTriangles.push_back(t);
+
+	std::vector<int> touched(tri.vert, tri.vert + 3);
+	finish(touched);
+}
+
+int HalfEdgeMesh::cut(glm::vec3 const &from, glm::vec3 const &to, float radius, int seed, int maxSplits)
+{
+	if (!mReady || radius <= 0.0f)
+		return 0;
+
+	// Flood outwards over the twins from the faces around the seeds, for as
+	// long as faces could still reach the blade.
+	mQueue.clear();
+	std::vector<int> seeds(mRim);
+	if (seed >= 0 && seed < mLoader->getVertices().size())
+		seeds.push_back(seed);
+	for (int i = 0; i < seeds.size(); i++) {
+		std::vector<int> const &incident = mLoader->getVertexTriangles()[seeds[i]];
+		for (int k = 0; k < incident.size(); k++)
+			enqueue(incident[k], false);
+	}
+
+	int splits = 0;
+	std::vector<int> doomed;
+	for (int i = 0; i < mQueue.size(); i++) {
+		int t = mQueue[i];
+		Triangle tri = mLoader->getTriangles()[t];
+		if (tri.isRemoved())
+			continue;
+
+		std::vector<glm::vec3> const &vertices = mLoader->getVertices();
+		glm::vec3 p[3] = { vertices[tri.vert[0]], vertices[tri.vert[1]], vertices[tri.vert[2]] };
+		int longest = 0;
+		float longestLength = 0.0f;
+		for (int k = 0; k < 3; k++) {
+			float length = glm::distance(p[k], p[(k + 1) % 3]);
+			if (length > longestLength) {
+				longest = k;
+				longestLength = length;
+			}
+		}
+		float distance = segmentDistance((p[0] + p[1] + p[2]) / 3.0f, from, to);
+		if (distance > radius + longestLength)
+			continue;
+
+		// Split down to the blade's resolution first, and look at the
+		// pieces again.
+		if (longestLength > radius && splits < maxSplits) {
+			int m = splitEdge(3 * t + longest, 0.5f);
+			splits++;
+			std::vector<int> const &incident = mLoader->getVertexTriangles()[m];
+			for (int k = 0; k < incident.size(); k++)
+				enqueue(incident[k], true);
+			continue;
+		}
+
+		if (distance < radius)
+			doomed.push_back(t);
+		for (int k = 0; k < 3; k++) {
+			if (mTwin[3 * t + k] >= 0)
+				enqueue(mTwin[3 * t + k] / 3, false);
+		}
+	}
+	for (int i = 0; i < mQueue.size(); i++)
+		mQueued[mQueue[i]] = 0;
+	mQueue.clear();
+
+	// Later splits may have reshaped a doomed face; test it again.
+	int removed = 0;
+	std::vector<int> rim;
+	for (int i = 0; i < doomed.size(); i++) {
+		Triangle tri = mLoader->getTriangles()[doomed[i]];
+		if (tri.isRemoved())
+			continue;
+		std::vector<glm::vec3> const &vertices = mLoader->getVertices();
+		glm::vec3 centroid = (vertices[tri.vert[0]] + vertices[tri.vert[1]] + vertices[tri.vert[2]]) / 3.0f;
+		if (segmentDistance(centroid, from, to) >= radius)
+			continue;
+		removeFace(doomed[i]);
+		removed++;
+		rim.insert(rim.end(), tri.vert, tri.vert + 3);
+	}
+	if (removed == 0)
+		return 0;
+
+	// Tidy the new rim: collapse the slivers the cut left along it.
+	std::sort(rim.begin(), rim.end());
+	rim.erase(std::unique(rim.begin(), rim.end()), rim.end());
+	int collapses = 0;
+	for (int i = 0; i < rim.size() && collapses < maxSplits; i++) {
+		std::vector<int> incident = mLoader->getVertexTriangles()[rim[i]];
+		for (int k = 0; k < incident.size(); k++) {
+			Triangle const &tri = mLoader->getTriangles()[incident[k]];
+			for (int j = 0; j < 3 && !tri.isRemoved(); j++) {
+				int h = 3 * incident[k] + j;
+				int a = tri.vert[j], b = tri.vert[(j + 1) % 3];
+				if (mTwin[h] >= 0 || (a != rim[i] && b != rim[i]))
+					continue;
+				std::vector<glm::vec3> const &vertices = mLoader->getVertices();
+				if (glm::distance(vertices[a], vertices[b]) < kMinRimEdge * radius && collapseEdge(h)) {
+					collapses++;
+					break;
+				}
+			}
+		}
+	}
+
+	mRim.clear();
+	for (int i = 0; i < rim.size(); i++) {
+		if (!mLoader->getVertexTriangles()[rim[i]].empty())
+			mRim.push_back(rim[i]);
+	}
+	return removed;
+}
+
+void HalfEdgeMesh::takeChanges(std::vector<int> &vertices, std::vector<int> &triangles)
+{
+	std::sort(mChangedVertices.begin(), mChangedVertices.end());
+	mChangedVertices.erase(std::unique(mChangedVertices.begin(), mChangedVertices.end()), mChangedVertices.end());
+	std::sort(mChangedTriangles.begin(), mChangedTriangles.end());
+	mChangedTriangles.erase(std::unique(mChangedTriangles.begin(), mChangedTriangles.end()), mChangedTriangles.end());
+	vertices.swap(mChangedVertices);
+	triangles.swap(mChangedTriangles);
+	mChangedVertices.clear();
+	mChangedTriangles.clear();
+}
+
+int HalfEdgeMesh::getTwin(int h) const
+{
+	return mTwin[h];
+}
+
+int HalfEdgeMesh::getFreeTriangleCount() const
+{
+	return mFreeTriangles.size();
+}
+
+int HalfEdgeMesh::getFreeVertexCount() const
+{
+	return mFreeVertices.size();
+}
+
+int HalfEdgeMesh::getOrigin(int h) const
+{
+	return mLoader->getTriangles()[h / 3].vert[h % 3];
+}
+
+bool HalfEdgeMesh::onBoundary(int v) const
+{
+	std::vector<int> const &incident = mLoader->getVertexTriangles()[v];
+	for (int i = 0; i < incident.size(); i++) {
+		for (int k = 0; k < 3; k++) {
+			int h = 3 * incident[i] + k;
+			if (mTwin[h] < 0 && (getOrigin(h) == v || getOrigin(3 * incident[i] + (k + 1) % 3) == v))
+				return true;
+		}
+	}
+	return false;
+}
+
+void HalfEdgeMesh::write(int t, int v0, int v1, int v2)
+{
+	mLoader->writeTriangle(t, v0, v1, v2);
+	mChangedTriangles.push_back(t);
+}
+
+// Points the half-edges of t and those across from them at each other.
+// Only the triangles around each edge's end are searched.
+void HalfEdgeMesh::linkTwins(int t)
+{
+	std::vector<Triangle> const &tris = mLoader->getTriangles();
+	std::vector<std::vector<int> > const &vertexTriangles = mLoader->getVertexTriangles();
+	unlinkTwins(t);
+	if (tris[t].isRemoved())
+		return;
+
+	for (int k = 0; k < 3; k++) {
+		int a = tris[t].vert[k], b = tris[t].vert[(k + 1) % 3];
+		int twin = -1, matches = 0;
+		std::vector<int> const &incident = vertexTriangles[b];
+		for (int i = 0; i < incident.size(); i++) {
+			int u = incident[i];
+			for (int j = 0; j < 3 && u != t; j++) {
+				if (tris[u].vert[j] == b && tris[u].vert[(j + 1) % 3] == a) {
+					twin = 3 * u + j;
+					matches++;
+				}
+			}
+		}
+		if (matches != 1)
+			continue;
+
+		int h = 3 * t + k;
+		int previous = mTwin[twin];
+		if (previous >= 0 && mTwin[previous] == twin)
+			mTwin[previous] = -1;
+		mTwin[h] = twin;
+		mTwin[twin] = h;
+	}
+}
+
+void HalfEdgeMesh::unlinkTwins(int t)
+{
+	for (int k = 0; k < 3; k++) {
+		int h = 3 * t + k;
+		int twin = mTwin[h];
+		if (twin >= 0 && mTwin[twin] == h)
+			mTwin[twin] = -1;
+		mTwin[h] = -1;
+	}
+}
+
+int HalfEdgeMesh::allocateTriangle()
+{
+	if (mFreeTriangles.empty()) {
+		int first = mLoader->getTriangles().size();
+		for (int i = 0; i < kTriangleBlock; i++)
+			mLoader->writeTriangle(first + i, 0, 0, 0);
+		for (int i = kTriangleBlock - 1; i >= 0; i--)
+			mFreeTriangles.push_back(first + i);
+		mTwin.resize(3 * (first + kTriangleBlock), -1);
+		mQueued.resize(first + kTriangleBlock, 0);
+		mTriangleCount = first + kTriangleBlock;
+	}
+	int t = mFreeTriangles.back();
+	mFreeTriangles.pop_back();
+	return t;
+}
+
+int HalfEdgeMesh::allocateVertex(glm::vec3 const &position, glm::vec3 const &normal, glm::vec3 const &color,
+	double friction)
+{
+	int v;
+	if (!mFreeVertices.empty()) {
+		v = mFreeVertices.back();
+		mFreeVertices.pop_back();
+		mUnused[v] = 0;
+	}
+	else {
+		v = mLoader->getVertices().size();
+		mUnused.push_back(0);
+	}
+	mLoader->setVertex(v, position, normal, color, friction);
+	mVertexCount = mLoader->getVertices().size();
+	return v;
+}
+
+// Renormals the corners of an edit and frees those it left without a
+// triangle.
+void HalfEdgeMesh::finish(std::vector<int> &touched)
+{
+	std::sort(touched.begin(), touched.end());
+	touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+	mLoader->updateNormals(touched);
+
+	std::vector<std::vector<int> > const &vertexTriangles = mLoader->getVertexTriangles();
+	for (int i = 0; i < touched.size(); i++) {
+		int v = touched[i];
+		if (vertexTriangles[v].empty() && !mUnused[v]) {
+			mUnused[v] = 1;
+			mFreeVertices.push_back(v);
+		}
+	}
+	mChangedVertices.insert(mChangedVertices.end(), touched.begin(), touched.end());
+}
+
+void HalfEdgeMesh::enqueue(int t, bool again)
+{
+	if (mQueued[t] && !again)
+		return;
+	mQueued[t] = 1;
+	mQueue.push_back(t);
+}
+
+size_t HalfEdgeMesh::getMemoryBytes() const
+{
+	return vectorBytes(mTwin) + vectorBytes(mPending) + vectorBytes(mFreeTriangles) + vectorBytes(mFreeVertices) + vectorBytes(mUnused) +
+		vectorBytes(mChangedVertices) + vectorBytes(mChangedTriangles) + vectorBytes(mRim) + vectorBytes(mQueue) +
+		vectorBytes(mQueued);
+}
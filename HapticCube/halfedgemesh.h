@@ -0,0 +1,135 @@
+#ifndef HALFEDGEMESH_H
+#define HALFEDGEMESH_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "objloader.h"
+#include "threadpool.h"
+
+	//! Edge connectivity over the triangles of an OBJLoader, for topology
+	//! edits that take time in proportion to the edit: edge split, edge
+	//! collapse, face removal, and cutting along a stylus stroke built from
+	//! them.
+	//!
+	//! Half-edges are implicit: half-edge 3t + k runs from corner k to corner
+	//! k + 1 of triangle t, so only the twin of each is stored, -1 on a
+	//! boundary. The loader stays the mesh everything else reads, and every
+	//! edit is written through to it in place. Removed triangles keep their
+	//! slot (see OBJLoader::writeTriangle) and vertices left without a
+	//! triangle stay allocated; both go on free lists that later splits take
+	//! from first, so indices held elsewhere stay valid and the loader's
+	//! arrays only grow, in blocks, when a list runs dry.
+	class HalfEdgeMesh {
+	public:
+		//! Constructor
+		//!
+		HalfEdgeMesh();
+
+		//! Builds the twins of loader, which must outlive this. Takes time
+		//! linear in the size of the mesh.
+		void build(OBJLoader *loader);
+
+		//! Copies the triangles of loader and builds the twins on the pool,
+		//! returning at once; call with loader locked. Topology edits made
+		//! meanwhile must be reported through update().
+		void buildAsync(ThreadPool &pool, OBJLoader *loader);
+
+		//! Takes over a finished buildAsync() and returns true once the mesh
+		//! can be edited. Call with the loader locked before any edit.
+		bool prepare();
+
+		//! True before build(), or once the loader's topology was changed
+		//! other than through this and update().
+		bool isStale() const;
+
+		//! Relinks the twins of triangles that were rewritten or appended
+		//! other than through this, e.g. by OBJLoader::refineRegion. Takes
+		//! time in proportion to the triangles.
+		void update(std::vector<int> const &triangles);
+
+		//! Splits the edge of half-edge h at fraction s from its origin, and
+		//! the triangle on either side. Returns the new vertex.
+		int splitEdge(int h, float s);
+
+		//! Collapses the edge of half-edge h into its midpoint, which its
+		//! origin moves to. Returns false, changing nothing, where that would
+		//! leave the mesh non-manifold.
+		bool collapseEdge(int h);
+
+		void removeFace(int t);
+
+		//! Cuts the surface along the segment from..to with a blade of the
+		//! given radius. Triangles near the blade are split until their edges
+		//! are shorter than the radius, using at most maxSplits splits, then
+		//! those whose centroid the blade passed over are removed, and short
+		//! edges left on the rim are collapsed. The flood starts from seed
+		//! and from the rim of the previous cut. Returns the number of
+		//! triangles removed.
+		int cut(glm::vec3 const &from, glm::vec3 const &to, float radius, int seed, int maxSplits);
+
+		//! Hands over the vertices and triangles edited since the last call,
+		//! sorted and distinct. Triangles appended to the loader as free
+		//! slots are not listed.
+		void takeChanges(std::vector<int> &vertices, std::vector<int> &triangles);
+
+		int getTwin(int h) const;
+		int getFreeTriangleCount() const;
+		int getFreeVertexCount() const;
+		size_t getMemoryBytes() const;
+
+	private:
+		HalfEdgeMesh(const HalfEdgeMesh &);
+		HalfEdgeMesh &operator=(const HalfEdgeMesh &);
+
+		// The input and output of one build. Shared with its task, which
+		// may outlive the mesh.
+		struct Build {
+			Build() : vertexCount(0), done(false) {}
+
+			std::vector<int> corners;	// three per triangle
+			int vertexCount;
+			std::vector<int> twin;
+			std::vector<int> freeTriangles;
+			std::vector<int> freeVertices;
+			std::vector<char> unused;
+			std::atomic<bool> done;
+		};
+
+		void start(OBJLoader *loader);
+		static void compute(Build &build);
+		void relink(std::vector<int> const &triangles);
+
+		int getOrigin(int h) const;
+		bool onBoundary(int v) const;
+		void write(int t, int v0, int v1, int v2);
+		void linkTwins(int t);
+		void unlinkTwins(int t);
+		int allocateTriangle();
+		int allocateVertex(glm::vec3 const &position, glm::vec3 const &normal, glm::vec3 const &color,
+			double friction);
+		void finish(std::vector<int> &touched);
+		void enqueue(int t, bool again);
+
+		OBJLoader *mLoader;
+		std::shared_ptr<Build> mBuild;	// until prepare() takes it over
+		std::vector<int> mPending;	// triangles updated meanwhile
+		bool mReady;
+		std::vector<int> mTwin;
+		std::vector<int> mFreeTriangles;
+		std::vector<int> mFreeVertices;
+		std::vector<char> mUnused;	// per vertex: on mFreeVertices
+
+		// Loader counts after the last edit made here.
+		int mVertexCount;
+		int mTriangleCount;
+
+		std::vector<int> mChangedVertices;
+		std::vector<int> mChangedTriangles;
+
+		std::vector<int> mRim;	// vertices left on the edge of the last cut
+		std::vector<int> mQueue;
+		std::vector<char> mQueued;
+	};
+
+#endif
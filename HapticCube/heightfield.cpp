@@ -0,0 +1,115 @@
+#include <cmath>
+#include "heightfield.h"
+#include "memoryusage.h"
+
+static const int kBlockBits = 3;
+static const int kBlockSize = 1 << kBlockBits;
+static const int kBlockMask = kBlockSize - 1;
+static const float kTwoPi = 6.28318530718f;
+
+HeightField::HeightField() :
+mSize(0),
+mBlocksPerRow(0),
+mPendingBands(-1)
+{
+}
+
+void HeightField::bakeAsync(ThreadPool &pool, int size, HeightFunction fn, void *userdata)
+{
+	mSize = size;
+	mBlocksPerRow = size >> kBlockBits;
+	mTexels.assign(size * size, 0.0f);
+	mPendingBands = mBlocksPerRow;
+
+	// One task per row of blocks, so each task writes one contiguous range.
+	for (int band = 0; band < mBlocksPerRow; band++) {
+		pool.submit([this, band, fn, userdata]() {
+			for (int y = band * kBlockSize; y < (band + 1) * kBlockSize; y++) {
+				for (int x = 0; x < mSize; x++) {
+					int block = (y >> kBlockBits) * mBlocksPerRow + (x >> kBlockBits);
+					int offset = ((y & kBlockMask) << kBlockBits) + (x & kBlockMask);
+					mTexels[block * kBlockSize * kBlockSize + offset] = fn((float) x / mSize, (float) y / mSize, userdata);
+				}
+			}
+			mPendingBands.fetch_sub(1, std::memory_order_release);
+		});
+	}
+}
+
+bool HeightField::isReady() const
+{
+	return mPendingBands.load(std::memory_order_acquire) == 0;
+}
+
+int HeightField::getSize() const
+{
+	return mSize;
+}
+
+float HeightField::texel(int x, int y) const
+{
+	x &= mSize - 1;
+	y &= mSize - 1;
+	int block = (y >> kBlockBits) * mBlocksPerRow + (x >> kBlockBits);
+	return mTexels[block * kBlockSize * kBlockSize + ((y & kBlockMask) << kBlockBits) + (x & kBlockMask)];
+}
+
+float HeightField::sample(float u, float v, float &dhdu, float &dhdv) const
+{
+	float fx = u * mSize, fy = v * mSize;
+	float x0 = floor(fx), y0 = floor(fy);
+	float tx = fx - x0, ty = fy - y0;
+	int x = (int) x0, y = (int) y0;
+
+	float h00 = texel(x, y), h10 = texel(x + 1, y);
+	float h01 = texel(x, y + 1), h11 = texel(x + 1, y + 1);
+
+	dhdu = mSize * ((h10 - h00) * (1 - ty) + (h11 - h01) * ty);
+	dhdv = mSize * ((h01 - h00) * (1 - tx) + (h11 - h10) * tx);
+	return (h00 * (1 - tx) + h10 * tx) * (1 - ty) + (h01 * (1 - tx) + h11 * tx) * ty;
+}
+
+//! Parallel ridges across u.
+float ridgeHeight(float u, float v, void *userdata)
+{
+	return sin(kTwoPi * 8 * u);
+}
+
+//! Grid of round bumps.
+float bumpHeight(float u, float v, void *userdata)
+{
+	return sin(kTwoPi * 6 * u) * sin(kTwoPi * 6 * v);
+}
+
+// Smooth value noise on a period x period lattice that wraps.
+static float latticeValue(int x, int y, int period)
+{
+	unsigned int h = (unsigned int) ((x % period + period) % period) * 73856093u ^
+		(unsigned int) ((y % period + period) % period) * 19349663u;
+	h = (h ^ (h >> 13)) * 1274126177u;
+	return ((h ^ (h >> 16)) & 0xffff) / 32767.5f - 1.0f;
+}
+
+static float valueNoise(float u, float v, int period)
+{
+	float fx = u * period, fy = v * period;
+	int x = (int) floor(fx), y = (int) floor(fy);
+	float tx = fx - x, ty = fy - y;
+	tx = tx * tx * (3 - 2 * tx);
+	ty = ty * ty * (3 - 2 * ty);
+
+	float a = latticeValue(x, y, period) * (1 - tx) + latticeValue(x + 1, y, period) * tx;
+	float b = latticeValue(x, y + 1, period) * (1 - tx) + latticeValue(x + 1, y + 1, period) * tx;
+	return a * (1 - ty) + b * ty;
+}
+
+//! Irregular grain: three octaves of tileable value noise.
+float grainHeight(float u, float v, void *userdata)
+{
+	return 0.57f * valueNoise(u, v, 8) + 0.29f * valueNoise(u, v, 16) + 0.14f * valueNoise(u, v, 32);
+}
+
+size_t HeightField::getMemoryBytes() const
+{
+	return vectorBytes(mTexels);
+}
@@ -0,0 +1,53 @@
+#ifndef HEIGHTFIELD_H
+#define HEIGHTFIELD_H
+
+#include <atomic>
+#include <vector>
+#include "threadpool.h"
+
+//! Height in [-1, 1] at (u, v) in [0, 1)^2. Must tile: the value at u = 1
+//! equals the value at u = 0, and likewise for v.
+typedef float (*HeightFunction)(float u, float v, void *userdata);
+
+	//! Periodic height map sampled at servo rate.
+	//!
+	//! Texels are stored in 8 x 8 blocks, so the four texels of a bilinear
+	//! lookup usually share a cache line or two however the contact point
+	//! moves across the map.
+	class HeightField {
+	public:
+		//! Constructor
+		//!
+		HeightField();
+
+		//! Fills a size x size map from fn on the pool and returns at once.
+		//! size must be a power of two and at least 8. isReady() turns true
+		//! when every band has been baked.
+		void bakeAsync(ThreadPool &pool, int size, HeightFunction fn, void *userdata);
+
+		bool isReady() const;
+		int getSize() const;
+		size_t getMemoryBytes() const;
+
+		//! Bilinear height at (u, v), in map periods, wrapping in both
+		//! directions, with its derivatives per period. Only call once
+		//! isReady() has returned true.
+		float sample(float u, float v, float &dhdu, float &dhdv) const;
+
+	private:
+		HeightField(const HeightField &);
+		HeightField &operator=(const HeightField &);
+
+		float texel(int x, int y) const;
+
+		int mSize;
+		int mBlocksPerRow;
+		std::vector<float> mTexels;
+		std::atomic<int> mPendingBands;
+	};
+
+float ridgeHeight(float u, float v, void *userdata);
+float bumpHeight(float u, float v, void *userdata);
+float grainHeight(float u, float v, void *userdata);
+
+#endif
@@ -0,0 +1,134 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include "memoryusage.h"
+
+MemoryUsage::MemoryUsage() :
+positions(0),
+attributes(0),
+indices(0),
+adjacency(0),
+acceleration(0),
+caches(0)
+{
+}
+
+size_t MemoryUsage::total() const
+{
+	return positions + attributes + indices + adjacency + acceleration + caches;
+}
+
+MemoryUsage &MemoryUsage::operator+=(MemoryUsage const &other)
+{
+	positions += other.positions;
+	attributes += other.attributes;
+	indices += other.indices;
+	adjacency += other.adjacency;
+	acceleration += other.acceleration;
+	caches += other.caches;
+	return *this;
+}
+
+/*******************************************************************************
+ Allocator counters
+*******************************************************************************/
+
+// Each block carries its size in front, padded so that the pointer handed
+// out keeps malloc's alignment.
+static const size_t kBlockHeader = 16;
+
+static std::atomic<size_t> sLiveBytes(0);
+static std::atomic<size_t> sPeakBytes(0);
+static std::atomic<unsigned long long> sAllocations(0);
+static std::atomic<unsigned long long> sFrees(0);
+
+static void *allocate(size_t size)
+{
+	char *block = (char *) malloc(size + kBlockHeader);
+	if (!block)
+		return 0;
+	*(size_t *) block = size;
+
+	size_t live = sLiveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+	size_t peak = sPeakBytes.load(std::memory_order_relaxed);
+	while (live > peak && !sPeakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+		;
+	sAllocations.fetch_add(1, std::memory_order_relaxed);
+	return block + kBlockHeader;
+}
+
+static void release(void *p)
+{
+	if (!p)
+		return;
+	char *block = (char *) p - kBlockHeader;
+	sLiveBytes.fetch_sub(*(size_t *) block, std::memory_order_relaxed);
+	sFrees.fetch_add(1, std::memory_order_relaxed);
+	free(block);
+}
+
+AllocatorStats getAllocatorStats()
+{
+	AllocatorStats stats;
+	stats.liveBytes = sLiveBytes.load(std::memory_order_relaxed);
+	stats.peakBytes = sPeakBytes.load(std::memory_order_relaxed);
+	stats.allocations = sAllocations.load(std::memory_order_relaxed);
+	stats.frees = sFrees.load(std::memory_order_relaxed);
+	return stats;
+}
+
+void *operator new(size_t size)
+{
+	void *p = allocate(size);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void *operator new[](size_t size)
+{
+	void *p = allocate(size);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void *operator new(size_t size, std::nothrow_t const &) noexcept
+{
+	return allocate(size);
+}
+
+void *operator new[](size_t size, std::nothrow_t const &) noexcept
+{
+	return allocate(size);
+}
+
+void operator delete(void *p) noexcept
+{
+	release(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	release(p);
+}
+
+void operator delete(void *p, std::nothrow_t const &) noexcept
+{
+	release(p);
+}
+
+void operator delete[](void *p, std::nothrow_t const &) noexcept
+{
+	release(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+	release(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+	release(p);
+}
@@ -0,0 +1,70 @@
+#ifndef MEMORYUSAGE_H
+#define MEMORYUSAGE_H
+
+#include <cstddef>
+#include <map>
+#include <set>
+#include <vector>
+
+//! Heap bytes held by a mesh and what is derived from it, by purpose.
+struct MemoryUsage {
+	size_t positions;	// vertex positions and normals
+	size_t attributes;	// colors, friction, per-triangle normals and centers
+	size_t indices;	// triangle corners and index arrays
+	size_t adjacency;	// vertex neighbours and incident triangles
+	size_t acceleration;	// bounding volumes, distance fields, point shells
+	size_t caches;	// compact copies, texture maps, queues and scratch
+
+	MemoryUsage();
+
+	size_t total() const;
+	MemoryUsage &operator+=(MemoryUsage const &other);
+};
+
+//! Per-element overhead of a node-based container: the tree links of a
+//! node and the allocator's block header.
+const size_t kTreeNodeOverhead = 4 * sizeof(void *) + 16;
+
+template <typename T>
+size_t vectorBytes(std::vector<T> const &v)
+{
+	return v.capacity() * sizeof(T);
+}
+
+template <typename T>
+size_t vectorBytes(std::vector<std::vector<T> > const &v)
+{
+	size_t bytes = v.capacity() * sizeof(std::vector<T>);
+	for (size_t i = 0; i < v.size(); i++)
+		bytes += v[i].capacity() * sizeof(T);
+	return bytes;
+}
+
+template <typename T>
+size_t setBytes(std::set<T> const &s)
+{
+	return s.size() * (sizeof(T) + kTreeNodeOverhead);
+}
+
+template <typename K, typename T>
+size_t mapBytes(std::map<K, std::set<T> > const &m)
+{
+	size_t bytes = m.size() * (sizeof(std::pair<const K, std::set<T> >) + kTreeNodeOverhead);
+	for (typename std::map<K, std::set<T> >::const_iterator it = m.begin(); it != m.end(); ++it)
+		bytes += setBytes(it->second);
+	return bytes;
+}
+
+//! Counters kept by the global operator new and delete, which
+//! memoryusage.cpp replaces. They cover every allocation the process makes
+//! through new, including those of the standard containers.
+struct AllocatorStats {
+	size_t liveBytes;
+	size_t peakBytes;
+	unsigned long long allocations;	// since startup
+	unsigned long long frees;
+};
+
+AllocatorStats getAllocatorStats();
+
+#endif
@@ -0,0 +1,289 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include "meshbvh.h"
+
+static const int kLeafSize = 4;
+
+static glm::vec3 minVec(glm::vec3 const &a, glm::vec3 const &b)
+{
+	return glm::vec3(a.x < b.x ? a.x : b.x, a.y < b.y ? a.y : b.y, a.z < b.z ? a.z : b.z);
+}
+
+static glm::vec3 maxVec(glm::vec3 const &a, glm::vec3 const &b)
+{
+	return glm::vec3(a.x > b.x ? a.x : b.x, a.y > b.y ? a.y : b.y, a.z > b.z ? a.z : b.z);
+}
+
+// Row-vector affine transform, p' = p * M, as used by hduMatrix.
+struct Affine {
+	float m[4][3];
+
+	explicit Affine(hduMatrix const &matrix)
+	{
+		for (int i = 0; i < 4; i++)
+			for (int j = 0; j < 3; j++)
+				m[i][j] = (float) matrix[i][j];
+	}
+
+	glm::vec3 apply(glm::vec3 const &p) const
+	{
+		return glm::vec3(p.x*m[0][0] + p.y*m[1][0] + p.z*m[2][0] + m[3][0],
+			p.x*m[0][1] + p.y*m[1][1] + p.z*m[2][1] + m[3][1],
+			p.x*m[0][2] + p.y*m[1][2] + p.z*m[2][2] + m[3][2]);
+	}
+
+	//! Box enclosing the transformed box [min, max].
+	void applyBox(glm::vec3 const &min, glm::vec3 const &max, glm::vec3 &outMin, glm::vec3 &outMax) const
+	{
+		glm::vec3 center = apply((min + max) * 0.5f);
+		glm::vec3 half = (max - min) * 0.5f;
+		glm::vec3 extent(fabs(m[0][0])*half.x + fabs(m[1][0])*half.y + fabs(m[2][0])*half.z,
+			fabs(m[0][1])*half.x + fabs(m[1][1])*half.y + fabs(m[2][1])*half.z,
+			fabs(m[0][2])*half.x + fabs(m[1][2])*half.y + fabs(m[2][2])*half.z);
+		outMin = center - extent;
+		outMax = center + extent;
+	}
+};
+
+static bool boxesOverlap(glm::vec3 const &aMin, glm::vec3 const &aMax, glm::vec3 const &bMin, glm::vec3 const &bMax)
+{
+	return aMin.x <= bMax.x && bMin.x <= aMax.x &&
+		aMin.y <= bMax.y && bMin.y <= aMax.y &&
+		aMin.z <= bMax.z && bMin.z <= aMax.z;
+}
+
+static bool separatedOnAxis(glm::vec3 const a[3], glm::vec3 const b[3], glm::vec3 const &axis)
+{
+	if (glm::dot(axis, axis) < 1e-20f)
+		return false;	// degenerate axis, parallel edges
+
+	float a0 = glm::dot(a[0], axis), a1 = glm::dot(a[1], axis), a2 = glm::dot(a[2], axis);
+	float b0 = glm::dot(b[0], axis), b1 = glm::dot(b[1], axis), b2 = glm::dot(b[2], axis);
+	float aMin = glm::min(a0, glm::min(a1, a2)), aMax = glm::max(a0, glm::max(a1, a2));
+	float bMin = glm::min(b0, glm::min(b1, b2)), bMax = glm::max(b0, glm::max(b1, b2));
+	return aMax < bMin || bMax < aMin;
+}
+
+// Separating axis test: two triangles are disjoint exactly when one of the
+// face normals, the nine edge-edge cross products or, for coplanar
+// triangles, the in-plane edge normals separates them.
+static bool trianglesIntersect(glm::vec3 const a[3], glm::vec3 const b[3])
+{
+	glm::vec3 ea[3] = { a[1] - a[0], a[2] - a[1], a[0] - a[2] };
+	glm::vec3 eb[3] = { b[1] - b[0], b[2] - b[1], b[0] - b[2] };
+	glm::vec3 na = glm::cross(ea[0], ea[1]);
+	glm::vec3 nb = glm::cross(eb[0], eb[1]);
+
+	if (separatedOnAxis(a, b, na) || separatedOnAxis(a, b, nb))
+		return false;
+
+	for (int i = 0; i < 3; i++) {
+		for (int j = 0; j < 3; j++) {
+			if (separatedOnAxis(a, b, glm::cross(ea[i], eb[j])))
+				return false;
+		}
+	}
+
+	for (int i = 0; i < 3; i++) {
+		if (separatedOnAxis(a, b, glm::cross(na, ea[i])) || separatedOnAxis(a, b, glm::cross(nb, eb[i])))
+			return false;
+	}
+	return true;
+}
+
+MeshBVH::MeshBVH() :
+mLoader(0),
+mVersion(0),
+mTriangleCount(0)
+{
+}
+
+void MeshBVH::build(OBJLoader const *loader)
+{
+	mLoader = loader;
+	mVersion = loader->getVersion();
+	mNodes.clear();
+	mTriangles.clear();
+
+	std::vector<Triangle> const &tris = loader->getTriangles();
+	std::vector<glm::vec3> const &vertices = loader->getVertices();
+	mTriangleCount = tris.size();
+	if (tris.empty())
+		return;
+
+	std::vector<glm::vec3> centroids(tris.size());
+	mTriangles.resize(tris.size());
+	for (int t = 0; t < tris.size(); t++) {
+		centroids[t] = (vertices[tris[t].vert[0]] + vertices[tris[t].vert[1]] + vertices[tris[t].vert[2]]) / 3.0f;
+		mTriangles[t] = t;
+	}
+
+	mNodes.reserve(2 * tris.size() / kLeafSize + 1);
+	mNodes.push_back(Node());
+	buildNode(0, 0, tris.size(), centroids);
+	refit();
+}
+
+// Splits the triangles at the median centroid along the longest axis of
+// their centroid bounds. Children are always stored after their parent, so
+// refit() can run over the nodes in reverse.
+void MeshBVH::buildNode(int index, int begin, int end, std::vector<glm::vec3> const &centroids)
+{
+	if (end - begin <= kLeafSize) {
+		mNodes[index].first = begin;
+		mNodes[index].count = end - begin;
+		return;
+	}
+
+	glm::vec3 lo(FLT_MAX, FLT_MAX, FLT_MAX), hi(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (int i = begin; i < end; i++) {
+		lo = minVec(lo, centroids[mTriangles[i]]);
+		hi = maxVec(hi, centroids[mTriangles[i]]);
+	}
+	glm::vec3 size = hi - lo;
+	int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+
+	struct ByAxis {
+		std::vector<glm::vec3> const *centroids;
+		int axis;
+		bool operator()(int a, int b) const { return (*centroids)[a][axis] < (*centroids)[b][axis]; }
+	} byAxis = { &centroids, axis };
+	int middle = (begin + end) / 2;
+	std::nth_element(mTriangles.begin() + begin, mTriangles.begin() + middle, mTriangles.begin() + end, byAxis);
+
+	int first = mNodes.size();
+	mNodes.push_back(Node());
+	mNodes.push_back(Node());
+	mNodes[index].first = first;
+	mNodes[index].count = 0;
+
+	buildNode(first, begin, middle, centroids);
+	buildNode(first + 1, middle, end, centroids);
+}
+
+void MeshBVH::fitLeaf(Node &node) const
+{
+	std::vector<Triangle> const &tris = mLoader->getTriangles();
+	std::vector<glm::vec3> const &vertices = mLoader->getVertices();
+
+	node.min = glm::vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+	node.max = glm::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (int i = node.first; i < node.first + node.count; i++) {
+		Triangle const &tri = tris[mTriangles[i]];
+		for (int k = 0; k < 3; k++) {
+			node.min = minVec(node.min, vertices[tri.vert[k]]);
+			node.max = maxVec(node.max, vertices[tri.vert[k]]);
+		}
+	}
+}
+
+void MeshBVH::refit()
+{
+	for (int i = mNodes.size() - 1; i >= 0; i--) {
+		Node &node = mNodes[i];
+		if (node.count > 0) {
+			fitLeaf(node);
+		}
+		else {
+			node.min = minVec(mNodes[node.first].min, mNodes[node.first + 1].min);
+			node.max = maxVec(mNodes[node.first].max, mNodes[node.first + 1].max);
+		}
+	}
+}
+
+bool MeshBVH::sync()
+{
+	if (!mLoader || mLoader->getVersion() == mVersion)
+		return false;
+
+	if (mLoader->getTriangles().size() != mTriangleCount) {
+		build(mLoader);
+	}
+	else {
+		refit();
+		mVersion = mLoader->getVersion();
+	}
+	return true;
+}
+
+bool MeshBVH::isEmpty() const
+{
+	return mNodes.empty();
+}
+
+void MeshBVH::getWorldBounds(hduMatrix const &world, glm::vec3 &min, glm::vec3 &max) const
+{
+	if (mNodes.empty()) {
+		min = glm::vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+		max = glm::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		return;
+	}
+	Affine(world).applyBox(mNodes[0].min, mNodes[0].max, min, max);
+}
+
+bool MeshBVH::intersects(MeshBVH const &other, hduMatrix const &toOther) const
+{
+	if (mNodes.empty() || other.mNodes.empty())
+		return false;
+
+	Affine transform(toOther);
+	std::vector<Triangle> const &tris = mLoader->getTriangles();
+	std::vector<glm::vec3> const &vertices = mLoader->getVertices();
+	std::vector<Triangle> const &otherTris = other.mLoader->getTriangles();
+	std::vector<glm::vec3> const &otherVertices = other.mLoader->getVertices();
+
+	std::vector<std::pair<int, int> > stack;
+	stack.push_back(std::make_pair(0, 0));
+
+	while (!stack.empty()) {
+		int aIndex = stack.back().first, bIndex = stack.back().second;
+		Node const &a = mNodes[aIndex];
+		Node const &b = other.mNodes[bIndex];
+		stack.pop_back();
+
+		glm::vec3 aMin, aMax;
+		transform.applyBox(a.min, a.max, aMin, aMax);
+		if (!boxesOverlap(aMin, aMax, b.min, b.max))
+			continue;
+
+		if (a.count > 0 && b.count > 0) {
+			for (int i = a.first; i < a.first + a.count; i++) {
+				Triangle const &ta = tris[mTriangles[i]];
+				if (ta.isRemoved())
+					continue;
+				glm::vec3 pa[3] = { transform.apply(vertices[ta.vert[0]]),
+					transform.apply(vertices[ta.vert[1]]),
+					transform.apply(vertices[ta.vert[2]]) };
+
+				for (int j = b.first; j < b.first + b.count; j++) {
+					Triangle const &tb = otherTris[other.mTriangles[j]];
+					if (tb.isRemoved())
+						continue;
+					glm::vec3 pb[3] = { otherVertices[tb.vert[0]], otherVertices[tb.vert[1]], otherVertices[tb.vert[2]] };
+					if (trianglesIntersect(pa, pb))
+						return true;
+				}
+			}
+			continue;
+		}
+
+		// Descend into the larger of the two boxes, or the one that is not a leaf.
+		glm::vec3 aSize = aMax - aMin, bSize = b.max - b.min;
+		bool splitA = b.count > 0 || (a.count == 0 && glm::dot(aSize, aSize) >= glm::dot(bSize, bSize));
+		if (splitA) {
+			stack.push_back(std::make_pair(a.first, bIndex));
+			stack.push_back(std::make_pair(a.first + 1, bIndex));
+		}
+		else {
+			stack.push_back(std::make_pair(aIndex, b.first));
+			stack.push_back(std::make_pair(aIndex, b.first + 1));
+		}
+	}
+	return false;
+}
+
+size_t MeshBVH::getMemoryBytes() const
+{
+	return vectorBytes(mNodes) + vectorBytes(mTriangles);
+}
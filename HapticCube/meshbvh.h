@@ -0,0 +1,56 @@
+#ifndef MESHBVH_H
+#define MESHBVH_H
+
+#include <vector>
+#include <HDU/hduMatrix.h>
+#include "objloader.h"
+
+	//! Axis-aligned bounding volume hierarchy over the triangles of one
+	//! mesh, in the mesh's model space.
+	//!
+	//! The hierarchy follows the mesh through sync(): moved vertices only
+	//! refit the boxes, while refinement, which adds triangles, rebuilds it.
+	class MeshBVH {
+	public:
+		//! Constructor
+		//!
+		MeshBVH();
+
+		//! Builds the hierarchy over loader, which must outlive it.
+		void build(OBJLoader const *loader);
+
+		//! Refits or rebuilds if the mesh changed since the last call.
+		//! Returns true if anything was updated.
+		bool sync();
+
+		bool isEmpty() const;
+
+		//! Bounds of the whole mesh once placed by world.
+		void getWorldBounds(hduMatrix const &world, glm::vec3 &min, glm::vec3 &max) const;
+
+		//! True if this mesh, mapped into other's model space by toOther,
+		//! intersects other. Touching counts as intersecting.
+		bool intersects(MeshBVH const &other, hduMatrix const &toOther) const;
+
+		size_t getMemoryBytes() const;
+
+	private:
+		struct Node {
+			glm::vec3 min;
+			glm::vec3 max;
+			int first;	// children are first and first + 1, or the first triangle of a leaf
+			int count;	// triangles in a leaf, 0 for an inner node
+		};
+
+		void buildNode(int index, int begin, int end, std::vector<glm::vec3> const &centroids);
+		void refit();
+		void fitLeaf(Node &node) const;
+
+		OBJLoader const *mLoader;
+		unsigned int mVersion;
+		int mTriangleCount;
+		std::vector<Node> mNodes;
+		std::vector<int> mTriangles;
+	};
+
+#endif
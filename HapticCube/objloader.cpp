@@ -5,8 +5,22 @@
 #include <cmath>
 #include <string>         // std::string
 #include <cstddef>         // std::size_t
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <mutex>
 #include "objloader.h"
 
+// Parsed meshes by file name. The cache keeps a reference to every asset, so
+// an instance whose data is referenced only once has already made it private.
+struct MeshAsset {
+	std::shared_ptr<MeshTopology> topology;
+	std::shared_ptr<MeshGeometry> geometry;
+};
+
+static std::mutex gMeshCacheMutex;
+static std::map<std::string, std::shared_future<MeshAsset> > gMeshCache;
+
 
 void OBJLoader:: computeNormals(std::vector<glm::vec3> const &vertices, std::vector<int> const &indices, std::vector<glm::vec3> &normals){
 		
@@ -36,11 +50,9 @@ void OBJLoader:: computeNormals(std::vector<glm::vec3> const &vertices, std::vec
 
 
 OBJLoader::OBJLoader() :
-mVertices(0),
-mNormals(0),
-mColors(0),
-vIndices(0),
-mFriction(0)
+mTopology(new MeshTopology()),
+mGeometry(new MeshGeometry()),
+mVersion(0)
 {
 	std::cout << "Called OBJFileReader constructor" << std::endl;
 }
@@ -52,6 +64,86 @@ OBJLoader::~OBJLoader()
 
 bool OBJLoader::load(const char *filename)
 {
+	std::shared_future<MeshAsset> asset;
+	std::promise<MeshAsset> parsed;
+	bool parse = false;
+	{
+		std::lock_guard<std::mutex> lock(gMeshCacheMutex);
+		std::map<std::string, std::shared_future<MeshAsset> >::iterator it = gMeshCache.find(filename);
+		if (it == gMeshCache.end()) {
+			asset = parsed.get_future().share();
+			gMeshCache[filename] = asset;
+			parse = true;
+		}
+		else {
+			asset = it->second;
+		}
+	}
+
+	// The first request parses; concurrent requests for the same file
+	// wait here for its result instead of reading the file again.
+	if (parse) {
+		mTopology.reset(new MeshTopology());
+		mGeometry.reset(new MeshGeometry());
+
+		MeshAsset result;
+		if (parseFile(filename)) {
+			result.topology = mTopology;
+			result.geometry = mGeometry;
+		}
+		else {
+			std::lock_guard<std::mutex> lock(gMeshCacheMutex);
+			gMeshCache.erase(filename);
+		}
+		parsed.set_value(result);
+	}
+
+	MeshAsset const &result = asset.get();
+	if (!result.topology)
+		return false;
+
+	mTopology = result.topology;
+	mGeometry = result.geometry;
+	mFileName = filename;
+	mVersion++;
+	mDirtyNormals.clear();
+	mDirtyMark.clear();
+	return true;
+}
+
+bool OBJLoader::save(const char *filename) const
+{
+	MeshTopology const &topology = *mTopology;
+	MeshGeometry const &geometry = *mGeometry;
+
+	std::ofstream OBJFile(filename);
+	if (!OBJFile.is_open()) {
+		std::cerr << "Could not create " << filename << std::endl;
+		return false;
+	}
+
+	// Plain "v" and "f" lines, which is all parseFile reads back.
+	OBJFile.precision(9);
+	for (int i = 0; i < geometry.vertices.size(); i++) {
+		glm::vec3 v = geometry.vertices[i] / topology.sourceScale + topology.sourceCenter;
+		OBJFile << "v " << v.x << " " << v.y << " " << v.z << "\n";
+	}
+	for (int t = 0; t < topology.tris.size(); t++) {
+		Triangle const &tri = topology.tris[t];
+		if (tri.isRemoved())
+			continue;
+		OBJFile << "f " << tri.vert[0] + 1 << " " << tri.vert[1] + 1 << " " << tri.vert[2] + 1 << "\n";
+	}
+
+	OBJFile.close();
+	return !OBJFile.fail();
+}
+
+bool OBJLoader::parseFile(const char *filename)
+{
+	MeshTopology &topology = *mTopology;
+	MeshGeometry &geometry = *mGeometry;
+
 	// Open OBJ file
 	std::ifstream OBJFile(filename);
 	if (!OBJFile.is_open()) {
@@ -74,27 +166,27 @@ bool OBJLoader::load(const char *filename)
 					vertexLine >> vertex.x;
 					vertexLine >> vertex.y;
 					vertexLine >> vertex.z;
-				    mVertices.push_back(vertex);
+				    geometry.vertices.push_back(vertex);
 					//printf("Vertex is: %f %f %f\n", vertex.x, vertex.y, vertex.z);
 					vertex = glm::normalize(vertex);
 					vertex.x = abs(vertex.x); //Red
 					vertex.y = abs(vertex.y); //Green
 					vertex.z = abs(vertex.z); //Blue
-					mColors.push_back(vertex);
+					topology.colors.push_back(vertex);
 					
 					double fric = 0.1;
 					
 					if (vertex.x > vertex.y && vertex.x > vertex.z) fric= 0.9;
 					if (vertex.y > vertex.x && vertex.y > vertex.z) fric= 0.4;
 					
-					mFriction.push_back(fric);
+					topology.friction.push_back(fric);
 				}
 				else if(line.find('n') != -1) {
 					std::istringstream textureLine(line.substr(3));
 					textureLine >> normal.x;
 					textureLine >> normal.y;
 					textureLine >> normal.z;
-				    mNormals.push_back(normal);
+				    geometry.normals.push_back(normal);
 				}
 			}
 
@@ -107,12 +199,12 @@ bool OBJLoader::load(const char *filename)
 				char slash;
 				for (int n = 0; n < 3; n++){
 					 faceLine >> val;
-					 vIndices.push_back(val- 1);
-					 nIndices.push_back(val- 1);
+					 topology.vIndices.push_back(val- 1);
+					 topology.nIndices.push_back(val- 1);
 					 tIndices[n] = (val- 1);
 				}
 
-				tris.push_back(Triangle(tIndices[0], tIndices[1], tIndices[2]));  
+				topology.tris.push_back(Triangle(tIndices[0], tIndices[1], tIndices[2]));  
 
 				
 			}
@@ -124,16 +216,16 @@ bool OBJLoader::load(const char *filename)
 
 	
 	// Compute normals
-	computeNormals(mVertices, vIndices, mNormals);
+	computeNormals(geometry.vertices, topology.vIndices, geometry.normals);
 
-	unitize(mVertices);
+	unitize(geometry.vertices, topology.sourceCenter, topology.sourceScale);
 
 	generate();
 
 	return true;
 }
 
-void OBJLoader:: unitize(std::vector<glm::vec3> &vertices) {
+void OBJLoader:: unitize(std::vector<glm::vec3> &vertices, glm::vec3 &center, float &scale) {
 	float min_x = vertices[0].x, max_x = vertices[0].x,
 	min_y = vertices[0].y, max_y = vertices[0].y,
 	min_z = vertices[0].z, max_z = vertices[0].z;
@@ -173,7 +265,8 @@ void OBJLoader:: unitize(std::vector<glm::vec3> &vertices) {
 
 	//printf("%f, %f, %f\n", width, height, depth);
 
-	float scale = 2 / glm::max(glm::max(width, height), depth);
+	center = glm::vec3(center_x, center_y, center_z);
+	scale = 2 / glm::max(glm::max(width, height), depth);
 
 	for(int i = 0; i < vertices.size(); i++)
 	{
@@ -183,81 +276,445 @@ void OBJLoader:: unitize(std::vector<glm::vec3> &vertices) {
 }
 
 
+std::string const &OBJLoader::getFileName() const
+{
+	return mFileName;
+}
+
 std::vector<glm::vec3> const &OBJLoader::getVertices() const
 {
-	return mVertices;
+	return mGeometry->vertices;
 }
 
 std::vector<glm::vec3> const &OBJLoader::getNormals() const
 {
-	return mNormals;
+	return mGeometry->normals;
+}
+
+MeshTopology &OBJLoader::editTopology()
+{
+	mVersion++;
+	if(mTopology.use_count() > 1)
+		mTopology.reset(new MeshTopology(*mTopology));
+	return *mTopology;
+}
+
+MeshGeometry &OBJLoader::editGeometry()
+{
+	mVersion++;
+	if(mGeometry.use_count() > 1)
+		mGeometry.reset(new MeshGeometry(*mGeometry));
+	return *mGeometry;
+}
+
+bool OBJLoader::hasSharedGeometry() const
+{
+	return mGeometry.use_count() > 1;
+}
+
+unsigned int OBJLoader::getVersion() const
+{
+	return mVersion;
 }
 
 void OBJLoader::deformPoint(int pointIndex, vec3 newPoint)
 {
-	mVertices[pointIndex] = newPoint;
+	MeshGeometry &geometry = editGeometry();
+	geometry.vertices[pointIndex] = newPoint;
+
+	if(pointIndex >= mDirtyMark.size())
+		mDirtyMark.resize(geometry.vertices.size(), 0);
+	if(!mDirtyMark[pointIndex]){
+		mDirtyMark[pointIndex] = 1;
+		mDirtyNormals.push_back(pointIndex);
+	}
+}
+
+bool OBJLoader::rebuildNormals(int maxVertices)
+{
+	if(mDirtyNormals.empty())
+		return false;
+
+	// A moved vertex changes the face normals of its incident triangles,
+	// which every neighbor shares.
+	std::vector<int> touched;
+	for(int i = 0; i < maxVertices && !mDirtyNormals.empty(); i++){
+		int v = mDirtyNormals.back();
+		mDirtyNormals.pop_back();
+		mDirtyMark[v] = 0;
+
+		std::set<int> const &neighbors = getNeighbors(v);
+		touched.push_back(v);
+		touched.insert(touched.end(), neighbors.begin(), neighbors.end());
+	}
+	std::sort(touched.begin(), touched.end());
+	touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+	updateNormals(touched);
+
+	return !mDirtyNormals.empty();
+}
+
+bool OBJLoader::hasDirtyNormals() const
+{
+	return !mDirtyNormals.empty();
 }
 
 std::vector<glm::vec3> const &OBJLoader::getColors() const
 {
-        return mColors;
+        return mTopology->colors;
 }
 
 std::vector<int> const &OBJLoader::getVertexIndices() const
 {
-	return vIndices;
+	return mTopology->vIndices;
+}
+
+std::vector<int> const &OBJLoader::getNormalIndices() const
+{
+	return mTopology->nIndices;
 }
 
 std::vector<Triangle> const &OBJLoader::getTriangles() const
 {
-	return tris;
+	return mTopology->tris;
 }
 
 std::vector<double> const &OBJLoader::getFriction() const
 {
-	return mFriction;
+	return mTopology->friction;
+}
+
+std::map<int, set<int>> const &OBJLoader::getAdjacency() const
+{
+	return mTopology->net;
+}
+
+std::set<int> const &OBJLoader::getNeighbors(int v) const
+{
+	static const std::set<int> none;
+	std::map<int, set<int>>::const_iterator it = mTopology->net.find(v);
+	return it != mTopology->net.end() ? it->second : none;
 }
 
 void OBJLoader::generate(){
-	for(int i = 0; i < tris.size(); i++) {
-		Triangle &tri = tris[i];
+	MeshTopology &topology = editTopology();
+	std::vector<glm::vec3> const &vertices = getVertices();
+	float totalLength = 0.0f;
+	topology.vertexTriangles.assign(vertices.size(), std::vector<int>());
+
+	for(int i = 0; i < topology.tris.size(); i++) {
+		Triangle &tri = topology.tris[i];
 		link(tri.vert[0], tri.vert[1]);
 		link(tri.vert[1], tri.vert[2]);
 		link(tri.vert[2], tri.vert[0]);
+
+		for(int k = 0; k < 3; k++){
+			topology.vertexTriangles[tri.vert[k]].push_back(i);
+			totalLength += glm::length(vertices[tri.vert[(k + 1) % 3]] - vertices[tri.vert[k]]);
+		}
 	}
+
+	if(!topology.tris.empty())
+		topology.restEdgeLength = totalLength / (3 * topology.tris.size());
 }
 
 void OBJLoader::link(int a, int b){
-	net[a].insert(b);
+	editTopology().net[a].insert(b);
+}
+
+void OBJLoader::unlink(int a, int b){
+	editTopology().net[a].erase(b);
+}
+
+std::vector<std::vector<int> > const &OBJLoader::getVertexTriangles() const
+{
+	return mTopology->vertexTriangles;
+}
+
+float OBJLoader::getRestEdgeLength() const
+{
+	return mTopology->restEdgeLength;
+}
+
+void OBJLoader::updateNormals(std::vector<int> const &vertices)
+{
+	MeshTopology const &topology = *mTopology;
+	MeshGeometry &geometry = editGeometry();
+
+	for(int i = 0; i < vertices.size(); i++){
+		int v = vertices[i];
+		glm::vec3 normal(0.0f, 0.0f, 0.0f);
+		if(topology.vertexTriangles[v].empty())
+			continue;	// unused since its triangles were removed
+
+		for(int k = 0; k < topology.vertexTriangles[v].size(); k++){
+			Triangle const &tri = topology.tris[topology.vertexTriangles[v][k]];
+			glm::vec3 p1 = geometry.vertices[tri.vert[0]];
+			glm::vec3 p2 = geometry.vertices[tri.vert[1]];
+			glm::vec3 p3 = geometry.vertices[tri.vert[2]];
+			normal += glm::normalize(glm::cross((p2 - p1), (p3 - p1)));
+		}
+		geometry.normals[v] = glm::normalize(normal);
+	}
+}
+
+void OBJLoader::setTriangle(int t, int v0, int v1, int v2)
+{
+	MeshTopology &topology = editTopology();
+	topology.tris[t].vert[0] = topology.vIndices[3*t] = topology.nIndices[3*t] = v0;
+	topology.tris[t].vert[1] = topology.vIndices[3*t + 1] = topology.nIndices[3*t + 1] = v1;
+	topology.tris[t].vert[2] = topology.vIndices[3*t + 2] = topology.nIndices[3*t + 2] = v2;
+}
+
+void OBJLoader::setVertex(int v, glm::vec3 const &position, glm::vec3 const &normal,
+	glm::vec3 const &color, double friction)
+{
+	MeshTopology &topology = editTopology();
+	MeshGeometry &geometry = editGeometry();
+	if(v == geometry.vertices.size()){
+		geometry.vertices.push_back(position);
+		geometry.normals.push_back(normal);
+		topology.colors.push_back(color);
+		topology.friction.push_back(friction);
+		topology.vertexTriangles.push_back(std::vector<int>());
+		return;
+	}
+	geometry.vertices[v] = position;
+	geometry.normals[v] = normal;
+	topology.colors[v] = color;
+	topology.friction[v] = friction;
+}
+
+void OBJLoader::writeTriangle(int t, int v0, int v1, int v2)
+{
+	MeshTopology &topology = editTopology();
+	if(t == topology.tris.size()){
+		topology.tris.push_back(Triangle(v0, v0, v0));
+		for(int k = 0; k < 3; k++){
+			topology.vIndices.push_back(v0);
+			topology.nIndices.push_back(v0);
+		}
+	}
+
+	// Detach the old corners first, so that an edge only disappears from
+	// the adjacency once no triangle uses it.
+	Triangle old = topology.tris[t];
+	if(!old.isRemoved()){
+		for(int k = 0; k < 3; k++)
+			removeVertexTriangle(old.vert[k], t);
+		for(int k = 0; k < 3; k++){
+			int a = old.vert[k], b = old.vert[(k + 1) % 3];
+			if(!sharesTriangle(a, b)){
+				unlink(a, b);
+				unlink(b, a);
+			}
+		}
+	}
+
+	setTriangle(t, v0, v1, v2);
+	if(topology.tris[t].isRemoved())
+		return;
+	for(int k = 0; k < 3; k++){
+		int a = topology.tris[t].vert[k], b = topology.tris[t].vert[(k + 1) % 3];
+		topology.vertexTriangles[a].push_back(t);
+		link(a, b);
+		link(b, a);
+	}
+}
+
+bool OBJLoader::sharesTriangle(int a, int b) const
+{
+	MeshTopology const &topology = *mTopology;
+	std::vector<int> const &incident = topology.vertexTriangles[a];
+	for(int k = 0; k < incident.size(); k++){
+		Triangle const &tri = topology.tris[incident[k]];
+		if(tri.vert[0] == b || tri.vert[1] == b || tri.vert[2] == b)
+			return true;
+	}
+	return false;
+}
+
+void OBJLoader::replaceVertexTriangle(int v, int from, int to)
+{
+	MeshTopology &topology = editTopology();
+	std::vector<int> &incident = topology.vertexTriangles[v];
+	for(int k = 0; k < incident.size(); k++){
+		if(incident[k] == from){
+			incident[k] = to;
+			return;
+		}
+	}
+}
+
+void OBJLoader::removeVertexTriangle(int v, int t)
+{
+	MeshTopology &topology = editTopology();
+	std::vector<int> &incident = topology.vertexTriangles[v];
+	incident.erase(std::remove(incident.begin(), incident.end(), t), incident.end());
+}
+
+int OBJLoader::refineRegion(std::vector<int> const &region, float maxStretch, float maxAngle,
+	int maxTriangles, std::vector<int> &newVertices)
+{
+	MeshTopology const &shared = *mTopology;
+	MeshGeometry const &current = *mGeometry;
+	float maxLength = maxStretch * shared.restEdgeLength;
+	float minLength = 0.25f * shared.restEdgeLength;
+	float minCos = cos(maxAngle);
+
+	// Collect the triangles that sit entirely inside the region and exceed
+	// one of the thresholds. Only incident triangles of region vertices are
+	// visited, so the cost follows the size of the edited area.
+	std::vector<int> candidates;
+	for(int i = 0; i < region.size() && candidates.size() < maxTriangles; i++){
+		std::vector<int> const &incident = shared.vertexTriangles[region[i]];
+		for(int k = 0; k < incident.size() && candidates.size() < maxTriangles; k++){
+			int t = incident[k];
+			Triangle const &tri = shared.tris[t];
+			if(tri.vert[0] != region[i])
+				continue;	// visit each triangle once, from its first corner
+			if(!std::binary_search(region.begin(), region.end(), tri.vert[1]) ||
+				!std::binary_search(region.begin(), region.end(), tri.vert[2]))
+				continue;
+
+			glm::vec3 p[3] = { current.vertices[tri.vert[0]], current.vertices[tri.vert[1]], current.vertices[tri.vert[2]] };
+			float longest = glm::max(glm::max(glm::length(p[1] - p[0]), glm::length(p[2] - p[1])), glm::length(p[0] - p[2]));
+			if(longest < minLength)
+				continue;
+
+			bool refine = longest > maxLength;
+			glm::vec3 faceNormal = glm::normalize(glm::cross(p[1] - p[0], p[2] - p[0]));
+			for(int c = 0; c < 3 && !refine; c++)
+				refine = glm::dot(faceNormal, current.normals[tri.vert[c]]) < minCos;
+
+			if(refine)
+				candidates.push_back(t);
+		}
+	}
+
+	if(candidates.empty())
+		return 0;
+
+	// Splitting edits the mesh, so this instance stops sharing it here.
+	MeshTopology &topology = editTopology();
+	MeshGeometry &geometry = editGeometry();
+
+	int firstNew = geometry.vertices.size();
+
+	// Centroid split: (v0,v1,v2) becomes (v0,v1,c), (v1,v2,c), (v2,v0,c).
+	// Remember which sub-triangle owns each original directed edge.
+	std::map<std::pair<int, int>, int> outerEdges;
+	for(int i = 0; i < candidates.size(); i++){
+		int t = candidates[i];
+		int v[3] = { topology.tris[t].vert[0], topology.tris[t].vert[1], topology.tris[t].vert[2] };
+		int c = geometry.vertices.size();
+
+		geometry.vertices.push_back((geometry.vertices[v[0]] + geometry.vertices[v[1]] + geometry.vertices[v[2]]) / 3.0f);
+		topology.colors.push_back((topology.colors[v[0]] + topology.colors[v[1]] + topology.colors[v[2]]) / 3.0f);
+		geometry.normals.push_back(glm::normalize(geometry.normals[v[0]] + geometry.normals[v[1]] + geometry.normals[v[2]]));
+		topology.friction.push_back((topology.friction[v[0]] + topology.friction[v[1]] + topology.friction[v[2]]) / 3.0);
+		topology.vertexTriangles.push_back(std::vector<int>());
+
+		int sub[3] = { t, (int)topology.tris.size(), (int)topology.tris.size() + 1 };
+		topology.tris.push_back(Triangle(v[1], v[2], c));
+		topology.tris.push_back(Triangle(v[2], v[0], c));
+		for(int k = 0; k < 6; k++){
+			topology.vIndices.push_back(0);
+			topology.nIndices.push_back(0);
+		}
+
+		for(int k = 0; k < 3; k++){
+			int a = v[k], b = v[(k + 1) % 3];
+			setTriangle(sub[k], a, b, c);
+			outerEdges[std::make_pair(a, b)] = sub[k];
+
+			link(a, c);
+			link(c, a);
+			topology.vertexTriangles[c].push_back(sub[k]);
+		}
+
+		// v0 keeps t; v1 and v2 move from t to the new sub-triangles.
+		replaceVertexTriangle(v[1], t, sub[1]);
+		topology.vertexTriangles[v[1]].push_back(sub[0]);
+		replaceVertexTriangle(v[2], t, sub[2]);
+		topology.vertexTriangles[v[2]].push_back(sub[1]);
+		topology.vertexTriangles[v[0]].push_back(sub[2]);
+
+		newVertices.push_back(c);
+	}
+
+	// Flip each original edge shared by two split triangles so that the two
+	// centroids become connected, as in sqrt(3) subdivision.
+	for(std::map<std::pair<int, int>, int>::iterator it = outerEdges.begin(); it != outerEdges.end(); it++){
+		int v0 = it->first.first, v1 = it->first.second;
+		if(v0 > v1)
+			continue;
+		std::map<std::pair<int, int>, int>::iterator twin = outerEdges.find(std::make_pair(v1, v0));
+		if(twin == outerEdges.end())
+			continue;
+
+		int t1 = it->second, t2 = twin->second;
+		int c1 = topology.tris[t1].vert[2], c2 = topology.tris[t2].vert[2];
+
+		// (v0,v1,c1) + (v1,v0,c2)  ->  (c1,v0,c2) + (c2,v1,c1)
+		setTriangle(t1, c1, v0, c2);
+		setTriangle(t2, c2, v1, c1);
+		removeVertexTriangle(v0, t2);
+		removeVertexTriangle(v1, t1);
+		topology.vertexTriangles[c1].push_back(t2);
+		topology.vertexTriangles[c2].push_back(t1);
+
+		unlink(v0, v1);
+		unlink(v1, v0);
+		link(c1, c2);
+		link(c2, c1);
+	}
+
+	if(newVertices.size() > 0){
+		std::vector<int> touched;
+		for(int c = firstNew; c < geometry.vertices.size(); c++){
+			std::set<int> const &neighbors = getNeighbors(c);
+			touched.push_back(c);
+			touched.insert(touched.end(), neighbors.begin(), neighbors.end());
+		}
+		std::sort(touched.begin(), touched.end());
+		touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+		updateNormals(touched);
+	}
+
+	return geometry.vertices.size() - firstNew;
 }
 
 /******************************************************************************************************************/
+#if !defined(OBJLOADER_NO_GL)
 void OBJLoader::drawColorObj(){
 
+	MeshTopology const &topology = *mTopology;
+	MeshGeometry const &geometry = *mGeometry;
+
 	vec3 vertex_one, vertex_two, vertex_three;
 	vec3 norm_one, norm_two, norm_three;
 	vec3 color_one, color_two, color_three;
-	computeNormals(mVertices, vIndices, mNormals);
 	glPushAttrib(GL_CURRENT_BIT | GL_ENABLE_BIT | GL_LIGHTING_BIT);
     glPushMatrix();
 	
 	glBegin(GL_TRIANGLES);
 
-	for (int i = 0; i < tris.size(); i++){
+	for (int i = 0; i < topology.tris.size(); i++){
 		
-	     Triangle &tri = tris[i];
+	     Triangle const &tri = topology.tris[i];
 		 
-		 vertex_one = mVertices[tri.vert[0]];
-		 vertex_two = mVertices[tri.vert[1]];
-		 vertex_three = mVertices[tri.vert[2]];
+		 vertex_one = geometry.vertices[tri.vert[0]];
+		 vertex_two = geometry.vertices[tri.vert[1]];
+		 vertex_three = geometry.vertices[tri.vert[2]];
 
-		 norm_one = mNormals[tri.vert[0]];
-		 norm_two = mNormals[tri.vert[1]];
-		 norm_three = mNormals[tri.vert[2]];
+		 norm_one = geometry.normals[tri.vert[0]];
+		 norm_two = geometry.normals[tri.vert[1]];
+		 norm_three = geometry.normals[tri.vert[2]];
 
-		 color_one = mColors[tri.vert[0]];
-		 color_two = mColors[tri.vert[1]];
-		 color_three = mColors[tri.vert[2]];
+		 color_one = topology.colors[tri.vert[0]];
+		 color_two = topology.colors[tri.vert[1]];
+		 color_three = topology.colors[tri.vert[2]];
 
 		 glNormal3f(norm_one.x, norm_one.y, norm_one.z);
 		 glColor3f(color_one.x, color_one.y, color_one.z);
@@ -282,4 +739,53 @@ void OBJLoader::drawColorObj(){
 	glPopAttrib();
 
 }
-/******************************************************************************************************************/
\ No newline at end of file
+#endif
+/******************************************************************************************************************/
+static void addTopologyUsage(MeshTopology const &topology, MemoryUsage &usage)
+{
+	// Of a Triangle, only the corners are indices.
+	size_t corners = topology.tris.capacity() * sizeof(int) * 3;
+	usage.attributes += vectorBytes(topology.colors) + vectorBytes(topology.friction) +
+		vectorBytes(topology.tris) - corners;
+	usage.indices += vectorBytes(topology.vIndices) + vectorBytes(topology.nIndices) + corners;
+	usage.adjacency += mapBytes(topology.net) + vectorBytes(topology.vertexTriangles);
+}
+
+static void addGeometryUsage(MeshGeometry const &geometry, MemoryUsage &usage)
+{
+	usage.positions += vectorBytes(geometry.vertices) + vectorBytes(geometry.normals);
+}
+
+void OBJLoader::addMemoryUsage(MemoryUsage &usage, std::set<const void *> &counted) const
+{
+	if (counted.insert(mTopology.get()).second)
+		addTopologyUsage(*mTopology, usage);
+	if (counted.insert(mGeometry.get()).second)
+		addGeometryUsage(*mGeometry, usage);
+	usage.caches += vectorBytes(mDirtyNormals) + vectorBytes(mDirtyMark);
+}
+
+void OBJLoader::addCacheMemoryUsage(MemoryUsage &usage, std::set<const void *> &counted)
+{
+	std::lock_guard<std::mutex> lock(gMeshCacheMutex);
+	for (std::map<std::string, std::shared_future<MeshAsset> >::const_iterator it = gMeshCache.begin();
+		it != gMeshCache.end(); ++it) {
+		// Loads still parsing are counted once they finish.
+		if (it->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			continue;
+
+		MemoryUsage copy;
+		MeshAsset const &asset = it->second.get();
+		if (asset.topology && counted.insert(asset.topology.get()).second)
+			addTopologyUsage(*asset.topology, copy);
+		if (asset.geometry && counted.insert(asset.geometry.get()).second)
+			addGeometryUsage(*asset.geometry, copy);
+		usage.caches += copy.total();
+	}
+}
+
+void OBJLoader::evict(std::string const &filename)
+{
+	std::lock_guard<std::mutex> lock(gMeshCacheMutex);
+	gMeshCache.erase(filename);
+}
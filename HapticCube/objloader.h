@@ -1,15 +1,22 @@
 #ifndef OBJLOADER_H
 #define OBJLOADER_H
+// Tools that only process meshes define OBJLOADER_NO_GL to build without
+// GLUT; drawColorObj is then left out.
+#if !defined(OBJLOADER_NO_GL)
 #if defined(WIN32) || defined(linux)
 #include <GL/glut.h>
 #elif defined(__APPLE__)
 #include <GLUT/glut.h>
 #endif
+#endif
 
 #include <map>
+#include <memory>
 #include <set>
+#include <string>
 #include <vector>
 #include <glm/glm.hpp>
+#include "memoryusage.h"
 using namespace glm;
 using namespace std;
 
@@ -23,7 +30,41 @@ struct Triangle{
     vec3 normal;  // triangle normal
 	vec3 center;
 	int id;
+
+    // A removed triangle keeps its slot, with all three corners on one
+    // vertex; see OBJLoader::writeTriangle.
+    bool isRemoved() const { return vert[0] == vert[1] && vert[1] == vert[2]; }
 };
+
+	//! Connectivity and per-vertex attributes that deformation never moves.
+	//! Shared by every OBJLoader that loaded the same file.
+	struct MeshTopology {
+		MeshTopology() : restEdgeLength(0.0f), sourceCenter(0.0f), sourceScale(1.0f) {}
+
+		std::vector<glm::vec3> colors;
+		std::vector<double> friction;
+		std::vector<int> vIndices;
+		std::vector<int> nIndices;
+		std::vector<Triangle> tris;
+		std::map<int, set<int>> net;
+		std::vector<std::vector<int> > vertexTriangles;
+		float restEdgeLength;
+
+		// Undone by OBJLoader::save: model = (file - sourceCenter) * sourceScale.
+		glm::vec3 sourceCenter;
+		float sourceScale;
+	};
+
+	//! Positions and normals. Shared until an instance is deformed.
+	struct MeshGeometry {
+		std::vector<glm::vec3> vertices;
+		std::vector<glm::vec3> normals;
+	};
+
+	//! Handle to a mesh asset. Copies are cheap: topology and geometry are
+	//! reference counted, and each load() of a file already loaded by another
+	//! instance reuses the parsed data. The first edit through deformPoint or
+	//! refineRegion gives the instance private copies of what it changes.
 	class OBJLoader {
 	public:
 		//! Constructor
@@ -34,8 +75,19 @@ struct Triangle{
 		//!
 		~OBJLoader();
 
+		//! Loads filename, or shares the data of an earlier load of the
+		//! same file. Safe to call from several threads at once.
 		bool load(const char *filename);
 
+		//! Writes the positions and the triangles that are not removed to
+		//! filename as OBJ. The unitizing of load() is undone, so that the
+		//! result lines up with the file it came from; normals are left for
+		//! the reader to recompute.
+		bool save(const char *filename) const;
+
+		//! Name passed to the last successful load().
+		std::string const &getFileName() const;
+
 		std::vector<glm::vec3> const &getVertices() const;
 		std::vector<glm::vec3> const &getNormals() const;
 		std::vector<glm::vec3> const &getColors() const;
@@ -43,7 +95,18 @@ struct Triangle{
 		std::vector<int> const &getNormalIndices() const;
 		std::vector<Triangle> const &getTriangles() const;
 		std::vector<double> const &OBJLoader::getFriction() const;
-		std::map<int, set<int>> net;
+		std::map<int, set<int>> const &getAdjacency() const;
+
+		//! Vertices connected to v by an edge.
+		std::set<int> const &getNeighbors(int v) const;
+
+		//! True while this instance still uses the positions of the shared
+		//! asset, i.e. has not been deformed since it was loaded.
+		bool hasSharedGeometry() const;
+
+		//! Changes whenever positions or topology are edited, so derived data
+		//! such as bounding volumes can tell when to update.
+		unsigned int getVersion() const;
 
 		void OBJLoader::Step(int n, int vertice, vec3 direction, float radius);
 		void OBJLoader::deformPoint(int pointIndex, vec3 newPoint);
@@ -52,22 +115,89 @@ struct Triangle{
 			std::vector<int> const &indices,
 			std::vector<glm::vec3> &normals);
 		
+#if !defined(OBJLOADER_NO_GL)
 		void drawColorObj();
+#endif
 		void generate();
 		void link(int a, int b);
+		void unlink(int a, int b);
+
+		//! Recomputes the normals of the given vertices from their incident
+		//! triangles only.
+		void updateNormals(std::vector<int> const &vertices);
+
+		//! Rebuilds the normals around up to maxVertices of the vertices
+		//! moved by deformPoint since the last call. Returns true while
+		//! moved vertices remain.
+		bool rebuildNormals(int maxVertices);
+		bool hasDirtyNormals() const;
+
+		//! One local sqrt(3) refinement step over the triangles whose corners
+		//! all lie in region (sorted). A triangle is split at its centroid
+		//! when an edge is stretched past maxStretch times the rest edge
+		//! length, or when its face normal deviates from a corner normal by
+		//! more than maxAngle radians. Edges shared by two split triangles
+		//! are then flipped. At most maxTriangles are split per call.
+		//! Returns the number of vertices appended to newVertices.
+		//!
+		//! The vertex and triangle arrays may be reallocated, so no other
+		//! thread may hold references into them or read them meanwhile.
+		int refineRegion(std::vector<int> const &region, float maxStretch, float maxAngle,
+			int maxTriangles, std::vector<int> &newVertices);
+
+		//! Writes the attributes of vertex v, or appends a vertex when v is
+		//! the vertex count. Adjacency comes from the triangles.
+		void setVertex(int v, glm::vec3 const &position, glm::vec3 const &normal,
+			glm::vec3 const &color, double friction);
+
+		//! Rewrites the corners of triangle t, or appends a triangle when t
+		//! is the triangle count, keeping incident triangles and adjacency in
+		//! step. A triangle with all three corners on one vertex is removed:
+		//! it keeps its slot, so other triangle indices stay valid, but has
+		//! no area and belongs to no vertex. Normals are left to
+		//! updateNormals().
+		void writeTriangle(int t, int v0, int v1, int v2);
+
+		std::vector<std::vector<int> > const &getVertexTriangles() const;
+		float getRestEdgeLength() const;
+
+		//! Adds the heap bytes of this mesh to usage. Data shared with an
+		//! instance already in counted is skipped, so that summing a scene
+		//! counts every asset once.
+		void addMemoryUsage(MemoryUsage &usage, std::set<const void *> &counted) const;
+
+		//! Adds the parsed assets the cache keeps that are not in counted,
+		//! i.e. the load-time copies of meshes deformed since.
+		static void addCacheMemoryUsage(MemoryUsage &usage, std::set<const void *> &counted);
+
+		//! Drops the cache's reference to filename, so that its data goes
+		//! with the last instance using it. A later load() parses it again.
+		static void evict(std::string const &filename);
 		
-		void unitize(std::vector<glm::vec3> &vertices);
+		//! Centers vertices on the origin and scales them to fit a cube of
+		//! side 2. Returns the center removed and the scale applied.
+		void unitize(std::vector<glm::vec3> &vertices, glm::vec3 &center, float &scale);
 		
 	private:
-		std::vector<glm::vec3> mVertices;
-		std::vector<glm::vec3> mNormals;
-		std::vector<glm::vec3> mColors;
-		std::vector<double> mFriction;
-		
-		std::vector<int> vIndices;
-		std::vector<int> nIndices;
-		std::vector<Triangle> tris;
-		
+		std::shared_ptr<MeshTopology> mTopology;
+		std::shared_ptr<MeshGeometry> mGeometry;
+		unsigned int mVersion;
+		std::string mFileName;
+
+		//! Copy-on-write access. Clones the data first if another instance
+		//! or the asset cache still refers to it.
+		MeshTopology &editTopology();
+		MeshGeometry &editGeometry();
+
+		bool parseFile(const char *filename);
+
+		void setTriangle(int t, int v0, int v1, int v2);
+		void replaceVertexTriangle(int v, int from, int to);
+		void removeVertexTriangle(int v, int t);
+		bool sharesTriangle(int a, int b) const;
+
+		std::vector<int> mDirtyNormals;
+		std::vector<char> mDirtyMark;
 	};
 
 #endif
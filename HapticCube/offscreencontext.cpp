@@ -0,0 +1,178 @@
+#include <cstdio>
+#include <vector>
+#include "offscreencontext.h"
+
+#if defined(linux)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+OffscreenContext::OffscreenContext() :
+mWidth(0),
+mHeight(0),
+mDisplay(0),
+mSurface(0),
+mContext(0),
+mWindow(0)
+{
+}
+
+OffscreenContext::~OffscreenContext()
+{
+	release();
+}
+
+#if defined(linux)
+
+static EGLDisplay openDisplay()
+{
+	EGLint major, minor;
+
+	EGLDisplay display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if (display != EGL_NO_DISPLAY && eglInitialize(display, &major, &minor))
+		return display;
+
+	// Headless machines have no native display; Mesa's surfaceless
+	// platform still supports pbuffers.
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (!getPlatformDisplay)
+		return EGL_NO_DISPLAY;
+
+	display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, 0);
+	if (display != EGL_NO_DISPLAY && eglInitialize(display, &major, &minor))
+		return display;
+
+	return EGL_NO_DISPLAY;
+}
+
+bool OffscreenContext::create(int width, int height)
+{
+	static const EGLint configAttribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8,
+		EGL_GREEN_SIZE, 8,
+		EGL_BLUE_SIZE, 8,
+		EGL_ALPHA_SIZE, 8,
+		EGL_DEPTH_SIZE, 24,
+		EGL_NONE
+	};
+
+	release();
+
+	EGLDisplay display = openDisplay();
+	if (display == EGL_NO_DISPLAY) {
+		fprintf(stderr, "Could not open an EGL display\n");
+		return false;
+	}
+	mDisplay = display;
+
+	// The scene is drawn with fixed-function GL, so ask for desktop GL
+	// rather than GLES.
+	EGLConfig config;
+	EGLint numConfigs = 0;
+	if (!eglBindAPI(EGL_OPENGL_API) ||
+		!eglChooseConfig(display, configAttribs, &config, 1, &numConfigs) || numConfigs < 1) {
+		fprintf(stderr, "No EGL config for desktop GL pbuffers\n");
+		release();
+		return false;
+	}
+
+	const EGLint surfaceAttribs[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+	mSurface = eglCreatePbufferSurface(display, config, surfaceAttribs);
+	mContext = eglCreateContext(display, config, EGL_NO_CONTEXT, 0);
+	if (mSurface == EGL_NO_SURFACE || mContext == EGL_NO_CONTEXT ||
+		!eglMakeCurrent(display, mSurface, mSurface, mContext)) {
+		fprintf(stderr, "Could not create the EGL pbuffer context (0x%x)\n", eglGetError());
+		release();
+		return false;
+	}
+
+	mWidth = width;
+	mHeight = height;
+	return true;
+}
+
+void OffscreenContext::release()
+{
+	if (!mDisplay)
+		return;
+
+	eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (mContext)
+		eglDestroyContext(mDisplay, mContext);
+	if (mSurface)
+		eglDestroySurface(mDisplay, mSurface);
+	eglTerminate(mDisplay);
+
+	mDisplay = mSurface = mContext = 0;
+	mWidth = mHeight = 0;
+}
+
+#else
+
+bool OffscreenContext::create(int width, int height)
+{
+	static int argc = 1;
+	static char *argv[] = { (char *) "offscreen", 0 };
+
+	release();
+
+	// Without EGL, render into the back buffer of a window that is never
+	// shown. Reading it back relies on the driver keeping the pixels of a
+	// hidden window, which desktop drivers do.
+	glutInit(&argc, argv);
+	glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
+	glutInitWindowSize(width, height);
+	mWindow = glutCreateWindow("Offscreen");
+	glutHideWindow();
+
+	mWidth = width;
+	mHeight = height;
+	return mWindow != 0;
+}
+
+void OffscreenContext::release()
+{
+	if (mWindow)
+		glutDestroyWindow(mWindow);
+
+	mWindow = 0;
+	mWidth = mHeight = 0;
+}
+
+#endif
+
+int OffscreenContext::getWidth() const
+{
+	return mWidth;
+}
+
+int OffscreenContext::getHeight() const
+{
+	return mHeight;
+}
+
+bool OffscreenContext::writePPM(const char *filename) const
+{
+	// Nothing to read back before create() succeeds.
+	if (mWidth <= 0 || mHeight <= 0)
+		return false;
+
+	std::vector<unsigned char> pixels(3 * mWidth * mHeight);
+
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, mWidth, mHeight, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+
+	FILE *file = fopen(filename, "wb");
+	if (!file)
+		return false;
+
+	// GL rows run bottom to top, PPM rows top to bottom.
+	fprintf(file, "P6\n%d %d\n255\n", mWidth, mHeight);
+	for (int y = mHeight - 1; y >= 0; y--)
+		fwrite(&pixels[3 * mWidth * y], 1, 3 * mWidth, file);
+
+	return fclose(file) == 0;
+}
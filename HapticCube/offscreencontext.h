@@ -0,0 +1,53 @@
+#ifndef OFFSCREENCONTEXT_H
+#define OFFSCREENCONTEXT_H
+#if defined(WIN32) || defined(linux)
+#include <GL/glut.h>
+#elif defined(__APPLE__)
+#include <GLUT/glut.h>
+#endif
+
+	//! GL context that renders without a visible window.
+	//!
+	//! On Linux this is an EGL pbuffer, which Mesa's software rasterizer
+	//! provides without an X server or GPU. Elsewhere it falls back to a
+	//! hidden GLUT window.
+	//!
+	//! Only the Windows projects are shipped, so the EGL path has no build
+	//! file yet; a Linux build has to compile the sources and link libEGL
+	//! itself.
+	class OffscreenContext {
+	public:
+		//! Constructor
+		//!
+		OffscreenContext();
+
+		//! Destructor
+		//!
+		~OffscreenContext();
+
+		//! Creates a width x height RGBA surface with a depth buffer and makes
+		//! its compatibility-profile context current on the calling thread.
+		bool create(int width, int height);
+		void release();
+
+		int getWidth() const;
+		int getHeight() const;
+
+		//! Writes the current color buffer as a binary PPM. Returns false
+		//! without a surface.
+		bool writePPM(const char *filename) const;
+
+	private:
+		OffscreenContext(const OffscreenContext &);
+		OffscreenContext &operator=(const OffscreenContext &);
+
+		int mWidth;
+		int mHeight;
+
+		void *mDisplay;
+		void *mSurface;
+		void *mContext;
+		int mWindow;
+	};
+
+#endif
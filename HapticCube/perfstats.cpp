@@ -0,0 +1,98 @@
+#include <cstring>
+#include "perfstats.h"
+
+PerfStats::PerfStats() :
+mGraphicsFrames(0), mGraphicsTime(0),
+mHapticFrames(0), mHapticTime(0),
+mServoTicks(0), mServoTime(0), mServoWorstTick(0), mServoWorstInterval(0),
+mCollisionCallbacks(0),
+mDeformSolves(0), mDeformTime(0), mDeformVertices(0),
+mForceErrors(0),
+mLastSample(Clock::now())
+{
+	memset(&mSnapshot, 0, sizeof(mSnapshot));
+}
+
+PerfStats::Counter PerfStats::toNanoseconds(double seconds)
+{
+	return seconds > 0.0 ? Counter(seconds * 1e9) : 0;
+}
+
+void PerfStats::updateMax(std::atomic<Counter> &value, Counter candidate)
+{
+	Counter current = value.load(std::memory_order_relaxed);
+	while (candidate > current && !value.compare_exchange_weak(current, candidate, std::memory_order_relaxed))
+		;
+}
+
+void PerfStats::addGraphicsFrame(double seconds)
+{
+	mGraphicsFrames.fetch_add(1, std::memory_order_relaxed);
+	mGraphicsTime.fetch_add(toNanoseconds(seconds), std::memory_order_relaxed);
+}
+
+void PerfStats::addHapticFrame(double seconds)
+{
+	mHapticFrames.fetch_add(1, std::memory_order_relaxed);
+	mHapticTime.fetch_add(toNanoseconds(seconds), std::memory_order_relaxed);
+}
+
+void PerfStats::addServoTick(double duration, double interval)
+{
+	Counter tick = toNanoseconds(duration);
+	mServoTicks.fetch_add(1, std::memory_order_relaxed);
+	mServoTime.fetch_add(tick, std::memory_order_relaxed);
+	updateMax(mServoWorstTick, tick);
+	updateMax(mServoWorstInterval, toNanoseconds(interval));
+}
+
+void PerfStats::addCollisionCallback()
+{
+	mCollisionCallbacks.fetch_add(1, std::memory_order_relaxed);
+}
+
+void PerfStats::addDeformSolve(int vertices, double seconds)
+{
+	mDeformSolves.fetch_add(1, std::memory_order_relaxed);
+	mDeformTime.fetch_add(toNanoseconds(seconds), std::memory_order_relaxed);
+	mDeformVertices.fetch_add(vertices, std::memory_order_relaxed);
+}
+
+void PerfStats::addForceError()
+{
+	mForceErrors.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool PerfStats::sample(double window)
+{
+	Clock::time_point now = Clock::now();
+	double elapsed = std::chrono::duration<double>(now - mLastSample).count();
+	if (elapsed < window)
+		return false;
+	mLastSample = now;
+
+	Counter graphicsFrames = mGraphicsFrames.exchange(0), graphicsTime = mGraphicsTime.exchange(0);
+	Counter hapticFrames = mHapticFrames.exchange(0), hapticTime = mHapticTime.exchange(0);
+	Counter servoTicks = mServoTicks.exchange(0), servoTime = mServoTime.exchange(0);
+	Counter collisions = mCollisionCallbacks.exchange(0);
+	Counter solves = mDeformSolves.exchange(0), solveTime = mDeformTime.exchange(0), vertices = mDeformVertices.exchange(0);
+
+	mSnapshot.graphicsFrameRate = graphicsFrames / elapsed;
+	mSnapshot.graphicsFrameMs = graphicsFrames ? graphicsTime * 1e-6 / graphicsFrames : 0.0;
+	mSnapshot.hapticFrameMs = hapticFrames ? hapticTime * 1e-6 / hapticFrames : 0.0;
+	mSnapshot.servoRate = servoTicks / elapsed;
+	mSnapshot.servoTickMs = servoTicks ? servoTime * 1e-6 / servoTicks : 0.0;
+	mSnapshot.servoWorstTickMs = mServoWorstTick.exchange(0) * 1e-6;
+	mSnapshot.servoWorstIntervalMs = mServoWorstInterval.exchange(0) * 1e-6;
+	mSnapshot.collisionRate = collisions / elapsed;
+	mSnapshot.deformRate = solves / elapsed;
+	mSnapshot.deformSolveMs = solves ? solveTime * 1e-6 / solves : 0.0;
+	mSnapshot.verticesPerSolve = solves ? double(vertices) / solves : 0.0;
+	mSnapshot.forceErrors = (int) mForceErrors.exchange(0);
+	return true;
+}
+
+PerfStats::Snapshot const &PerfStats::getSnapshot() const
+{
+	return mSnapshot;
+}
@@ -0,0 +1,65 @@
+#ifndef PERFSTATS_H
+#define PERFSTATS_H
+
+#include <atomic>
+#include <chrono>
+
+	//! Lock-free timing counters shared by the graphics, collision, servo
+	//! and deformation threads.
+	//!
+	//! Writers only do relaxed atomic adds, so it is safe to record from the
+	//! servo loop. The GLUT thread calls sample() to turn the totals into
+	//! per-second figures for display.
+	class PerfStats {
+	public:
+		//! Figures derived from the counters over the last sample window.
+		struct Snapshot {
+			double graphicsFrameMs;
+			double graphicsFrameRate;
+			double hapticFrameMs;
+			double servoRate;
+			double servoTickMs;
+			double servoWorstTickMs;
+			double servoWorstIntervalMs;
+			double collisionRate;
+			double deformRate;
+			double deformSolveMs;
+			double verticesPerSolve;
+			int forceErrors;	// servo force errors that cut the force output
+		};
+
+		//! Constructor
+		//!
+		PerfStats();
+
+		void addGraphicsFrame(double seconds);
+		void addHapticFrame(double seconds);
+		void addServoTick(double duration, double interval);
+		void addCollisionCallback();
+		void addDeformSolve(int vertices, double seconds);
+		void addForceError();
+
+		//! Updates the snapshot once the window has elapsed. Returns true if
+		//! the snapshot changed.
+		bool sample(double window);
+		Snapshot const &getSnapshot() const;
+
+	private:
+		typedef std::chrono::steady_clock Clock;
+		typedef unsigned long long Counter;
+
+		static Counter toNanoseconds(double seconds);
+		static void updateMax(std::atomic<Counter> &value, Counter candidate);
+
+		std::atomic<Counter> mGraphicsFrames, mGraphicsTime;
+		std::atomic<Counter> mHapticFrames, mHapticTime;
+		std::atomic<Counter> mServoTicks, mServoTime, mServoWorstTick, mServoWorstInterval;
+		std::atomic<Counter> mCollisionCallbacks;
+		std::atomic<Counter> mDeformSolves, mDeformTime, mDeformVertices;
+		std::atomic<Counter> mForceErrors;
+
+		Clock::time_point mLastSample;
+		Snapshot mSnapshot;
+	};
+
+#endif
@@ -0,0 +1,101 @@
+#include <chrono>
+#include "periodicworker.h"
+
+#if defined(WIN32)
+#include <windows.h>
+#include <mmsystem.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
+PeriodicWorker::PeriodicWorker() :
+mRunning(false),
+mRateHz(200.0),
+mLastJobTime(0.0),
+mJob(0),
+mUserData(0)
+{
+}
+
+PeriodicWorker::~PeriodicWorker()
+{
+	stop();
+}
+
+void PeriodicWorker::start(double rateHz, PeriodicJob job, void *userdata)
+{
+	if (mRunning)
+		return;
+
+	mJob = job;
+	mUserData = userdata;
+	setRate(rateHz);
+
+#if defined(WIN32)
+	// The default 15.6 ms timer resolution would cap us well below 100 Hz.
+	timeBeginPeriod(1);
+#endif
+
+	mRunning = true;
+	mThread = std::thread(&PeriodicWorker::run, this);
+}
+
+void PeriodicWorker::stop()
+{
+	if (!mRunning)
+		return;
+
+	mRunning = false;
+	if (mThread.joinable())
+		mThread.join();
+
+#if defined(WIN32)
+	timeEndPeriod(1);
+#endif
+}
+
+bool PeriodicWorker::isRunning() const
+{
+	return mRunning;
+}
+
+void PeriodicWorker::setRate(double rateHz)
+{
+	if (rateHz > 0.0)
+		mRateHz = rateHz;
+}
+
+double PeriodicWorker::getRate() const
+{
+	return mRateHz;
+}
+
+double PeriodicWorker::getLastJobTime() const
+{
+	return mLastJobTime;
+}
+
+void PeriodicWorker::run()
+{
+	typedef std::chrono::steady_clock Clock;
+
+	Clock::time_point last = Clock::now();
+	Clock::time_point next = last;
+
+	while (mRunning) {
+		Clock::time_point start = Clock::now();
+		double dt = std::chrono::duration<double>(start - last).count();
+		last = start;
+
+		mJob(dt, mUserData);
+
+		Clock::time_point end = Clock::now();
+		mLastJobTime = std::chrono::duration<double>(end - start).count();
+
+		// Schedule against the ideal timeline, but never try to catch up on
+		// ticks we already missed.
+		next += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / mRateHz));
+		if (next < end)
+			next = end;
+		std::this_thread::sleep_until(next);
+	}
+}
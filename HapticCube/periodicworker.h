@@ -0,0 +1,49 @@
+#ifndef PERIODICWORKER_H
+#define PERIODICWORKER_H
+
+#include <atomic>
+#include <thread>
+
+//! Job run by a PeriodicWorker. dt is the time in seconds since the job
+//! last ran.
+typedef void (*PeriodicJob)(double dt, void *userdata);
+
+	//! Runs a job on a dedicated thread at a fixed rate.
+	//!
+	//! Used to keep work that is too expensive for the 1 kHz servo loop,
+	//! such as mesh deformation, off the servo thread.
+	class PeriodicWorker {
+	public:
+		//! Constructor
+		//!
+		PeriodicWorker();
+
+		//! Destructor
+		//!
+		~PeriodicWorker();
+
+		void start(double rateHz, PeriodicJob job, void *userdata);
+		void stop();
+		bool isRunning() const;
+
+		void setRate(double rateHz);
+		double getRate() const;
+
+		//! Duration of the most recent job in seconds.
+		double getLastJobTime() const;
+
+	private:
+		PeriodicWorker(const PeriodicWorker &);
+		PeriodicWorker &operator=(const PeriodicWorker &);
+
+		void run();
+
+		std::thread mThread;
+		std::atomic<bool> mRunning;
+		std::atomic<double> mRateHz;
+		std::atomic<double> mLastJobTime;
+		PeriodicJob mJob;
+		void *mUserData;
+	};
+
+#endif
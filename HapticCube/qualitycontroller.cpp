@@ -0,0 +1,54 @@
+#include <cmath>
+#include "qualitycontroller.h"
+
+QualityController::QualityController(int levels, int recoverWindows, double recoverLoad) :
+mLevels(levels),
+mRecoverWindows(recoverWindows),
+mRecoverLoad(recoverLoad),
+mLevel(0),
+mCalmWindows(0)
+{
+}
+
+int QualityController::update(double load)
+{
+	int level = mLevel.load();
+	if (load > 1.0) {
+		mCalmWindows = 0;
+		if (level + 1 >= mLevels)
+			return 0;
+		mLevel.store(level + 1);
+		return 1;
+	}
+
+	if (load >= mRecoverLoad) {
+		mCalmWindows = 0;
+		return 0;
+	}
+	if (level == 0 || ++mCalmWindows < mRecoverWindows)
+		return 0;
+	mCalmWindows = 0;
+	mLevel.store(level - 1);
+	return -1;
+}
+
+void QualityController::reset()
+{
+	mLevel.store(0);
+	mCalmWindows = 0;
+}
+
+int QualityController::getLevel() const
+{
+	return mLevel.load();
+}
+
+int QualityController::getLevelCount() const
+{
+	return mLevels;
+}
+
+double QualityController::getScale(double step) const
+{
+	return pow(step, mLevel.load());
+}
@@ -0,0 +1,43 @@
+#ifndef QUALITYCONTROLLER_H
+#define QUALITYCONTROLLER_H
+
+#include <atomic>
+
+	//! Steps quality down when a loop overruns its budget and back up once
+	//! it has had headroom for a while.
+	//!
+	//! The caller measures the load of one window: the worst of its timings
+	//! over their budgets, so above 1 is an overrun. An overrun drops one
+	//! level at once. Only after recoverWindows windows in a row below
+	//! recoverLoad is a level given back, so quality does not oscillate
+	//! around the budget. Level 0 is full quality.
+	//!
+	//! update() belongs to one thread; getLevel() may be called from any.
+	class QualityController {
+	public:
+		//! Constructor
+		//!
+		QualityController(int levels, int recoverWindows, double recoverLoad);
+
+		//! Feeds the load of one window. Returns +1 if quality was degraded,
+		//! -1 if it was restored, 0 otherwise.
+		int update(double load);
+
+		//! Back to full quality.
+		void reset();
+
+		int getLevel() const;
+		int getLevelCount() const;
+
+		//! step raised to the level: 1 at full quality, smaller below.
+		double getScale(double step) const;
+
+	private:
+		int mLevels;
+		int mRecoverWindows;
+		double mRecoverLoad;
+		std::atomic<int> mLevel;
+		int mCalmWindows;
+	};
+
+#endif
@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <atomic>
+#include "scenegraph.h"
+
+SceneGraph::SceneGraph() :
+mDirty(false),
+mVersion(0),
+mSnapshot(new Snapshot())
+{
+}
+
+int SceneGraph::addNode(int parent, hduMatrix const &local)
+{
+	Node node;
+	node.parent = parent;
+	node.local = local;
+	node.dirty = true;
+
+	int index = mNodes.size();
+	mNodes.push_back(node);
+	if (parent >= 0)
+		mNodes[parent].children.push_back(index);
+
+	mDirty = true;
+	return index;
+}
+
+int SceneGraph::getNodeCount() const
+{
+	return mNodes.size();
+}
+
+bool SceneGraph::setParent(int node, int parent)
+{
+	for (int ancestor = parent; ancestor >= 0; ancestor = mNodes[ancestor].parent) {
+		if (ancestor == node)
+			return false;
+	}
+
+	int oldParent = mNodes[node].parent;
+	if (oldParent >= 0) {
+		std::vector<int> &siblings = mNodes[oldParent].children;
+		siblings.erase(std::remove(siblings.begin(), siblings.end(), node), siblings.end());
+	}
+	if (parent >= 0)
+		mNodes[parent].children.push_back(node);
+
+	mNodes[node].parent = parent;
+	mNodes[node].dirty = true;
+	mDirty = true;
+	return true;
+}
+
+int SceneGraph::getParent(int node) const
+{
+	return mNodes[node].parent;
+}
+
+void SceneGraph::setLocal(int node, hduMatrix const &local)
+{
+	mNodes[node].local = local;
+	mNodes[node].dirty = true;
+	mDirty = true;
+}
+
+hduMatrix const &SceneGraph::getLocal(int node) const
+{
+	return mNodes[node].local;
+}
+
+void SceneGraph::setWorld(int node, hduMatrix const &world)
+{
+	// Matrices compose row-vector style: world = local * parentWorld.
+	int parent = mNodes[node].parent;
+	if (parent < 0)
+		setLocal(node, world);
+	else
+		setLocal(node, world * mNodes[parent].inverseWorld);
+}
+
+bool SceneGraph::update()
+{
+	if (!mDirty)
+		return false;
+
+	for (int i = 0; i < mNodes.size(); i++) {
+		if (mNodes[i].parent < 0)
+			updateNode(i, false);
+	}
+	mDirty = false;
+
+	std::shared_ptr<Snapshot> snapshot(new Snapshot());
+	snapshot->world.resize(mNodes.size());
+	snapshot->inverseWorld.resize(mNodes.size());
+	for (int i = 0; i < mNodes.size(); i++) {
+		snapshot->world[i] = mNodes[i].world;
+		snapshot->inverseWorld[i] = mNodes[i].inverseWorld;
+	}
+	snapshot->version = ++mVersion;
+
+	std::atomic_store(&mSnapshot, std::shared_ptr<const Snapshot>(snapshot));
+	return true;
+}
+
+void SceneGraph::updateNode(int node, bool parentChanged)
+{
+	Node &n = mNodes[node];
+	bool changed = parentChanged || n.dirty;
+
+	if (changed) {
+		n.world = n.parent < 0 ? n.local : n.local * mNodes[n.parent].world;
+		n.inverseWorld = n.world.getInverse();
+		n.dirty = false;
+	}
+
+	for (int i = 0; i < n.children.size(); i++)
+		updateNode(n.children[i], changed);
+}
+
+hduMatrix const &SceneGraph::getWorld(int node) const
+{
+	return mNodes[node].world;
+}
+
+hduMatrix const &SceneGraph::getInverseWorld(int node) const
+{
+	return mNodes[node].inverseWorld;
+}
+
+std::shared_ptr<const SceneGraph::Snapshot> SceneGraph::getSnapshot() const
+{
+	return std::atomic_load(&mSnapshot);
+}
@@ -0,0 +1,76 @@
+#ifndef SCENEGRAPH_H
+#define SCENEGRAPH_H
+
+#include <memory>
+#include <vector>
+#include <HDU/hduMatrix.h>
+
+	//! Hierarchy of object transforms with cached world matrices.
+	//!
+	//! Each node stores a local transform relative to its parent. update()
+	//! recomputes the world and inverse-world matrices of nodes whose local
+	//! transform or ancestry changed, so inversion happens once per edit
+	//! rather than on every query. The results are then published as an
+	//! immutable Snapshot that other threads can hold without locking the
+	//! graph. The graph itself belongs to the thread that edits it.
+	class SceneGraph {
+	public:
+		//! World and inverse-world matrix of every node as of one update().
+		//! Never modified once published.
+		struct Snapshot {
+			std::vector<hduMatrix> world;
+			std::vector<hduMatrix> inverseWorld;
+			unsigned int version;
+		};
+
+		//! Constructor
+		//!
+		SceneGraph();
+
+		//! Adds a node under parent, or as a root when parent is -1, and
+		//! returns its index.
+		int addNode(int parent, hduMatrix const &local);
+		int getNodeCount() const;
+
+		//! Moves node under parent, keeping its local transform. Fails if
+		//! parent lies below node.
+		bool setParent(int node, int parent);
+		int getParent(int node) const;
+
+		void setLocal(int node, hduMatrix const &local);
+		hduMatrix const &getLocal(int node) const;
+
+		//! Sets the local transform that puts node at world, relative to its
+		//! parent's matrices as of the last update().
+		void setWorld(int node, hduMatrix const &world);
+
+		//! Recomputes changed nodes and their descendants and publishes a new
+		//! snapshot. Returns false, without publishing, if nothing changed.
+		bool update();
+
+		//! Cached matrices as of the last update(). Owner thread only.
+		hduMatrix const &getWorld(int node) const;
+		hduMatrix const &getInverseWorld(int node) const;
+
+		//! Latest published snapshot. Safe to call from any thread.
+		std::shared_ptr<const Snapshot> getSnapshot() const;
+
+	private:
+		struct Node {
+			int parent;
+			std::vector<int> children;
+			hduMatrix local;
+			hduMatrix world;
+			hduMatrix inverseWorld;
+			bool dirty;
+		};
+
+		void updateNode(int node, bool parentChanged);
+
+		std::vector<Node> mNodes;
+		bool mDirty;
+		unsigned int mVersion;
+		std::shared_ptr<const Snapshot> mSnapshot;
+	};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <atomic>
+
+//! Single-writer sequence lock for small, trivially copyable values.
+//!
+//! The writer never blocks and readers never take a lock, which makes it
+//! safe to read from the servo thread. A reader that races a write simply
+//! retries the copy.
+template <typename T>
+class SeqLock {
+public:
+	SeqLock() : mSequence(0), mValue() {}
+
+	//! Publishes a new value. Only one thread may write.
+	void write(const T &value)
+	{
+		unsigned int seq = mSequence.load(std::memory_order_relaxed);
+		mSequence.store(seq + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		mValue = value;
+		mSequence.store(seq + 2, std::memory_order_release);
+	}
+
+	//! Returns a consistent copy of the last published value.
+	T read() const
+	{
+		T value;
+		unsigned int before, after;
+		do {
+			before = mSequence.load(std::memory_order_acquire);
+			value = mValue;
+			std::atomic_thread_fence(std::memory_order_acquire);
+			after = mSequence.load(std::memory_order_relaxed);
+		} while ((before & 1) || before != after);
+		return value;
+	}
+
+private:
+	SeqLock(const SeqLock &);
+	SeqLock &operator=(const SeqLock &);
+
+	std::atomic<unsigned int> mSequence;
+	T mValue;
+};
+
+#endif
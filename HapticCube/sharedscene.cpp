@@ -0,0 +1,348 @@
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include "sharedscene.h"
+
+#if defined(WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char kSharedSceneMagic[8] = "TVOSHM1";
+
+static size_t roundUp16(size_t bytes)
+{
+	return (bytes + 15) & ~(size_t) 15;
+}
+
+// Shared memory names are global on both platforms; POSIX wants a leading
+// slash.
+static std::string segmentName(const char *name)
+{
+#if defined(WIN32)
+	return std::string("Local\\") + name;
+#else
+	return name[0] == '/' ? std::string(name) : std::string("/") + name;
+#endif
+}
+
+/*******************************************************************************
+ SharedSceneWriter
+*******************************************************************************/
+
+SharedSceneWriter::SharedSceneWriter() :
+mMapping(0),
+mHeader(0),
+mRing(0),
+mPosition(0),
+mFrameStart(0),
+mFrame(0)
+{
+}
+
+SharedSceneWriter::~SharedSceneWriter()
+{
+	close();
+}
+
+bool SharedSceneWriter::create(const char *name, size_t ringBytes)
+{
+	close();
+	ringBytes = roundUp16(ringBytes);
+	size_t headerBytes = roundUp16(sizeof(SharedSceneHeader));
+	size_t totalBytes = headerBytes + ringBytes;
+	mName = segmentName(name);
+
+	void *memory = 0;
+#if defined(WIN32)
+	HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+		(DWORD) ((unsigned long long) totalBytes >> 32), (DWORD) totalBytes, mName.c_str());
+	if (!mapping) {
+		fprintf(stderr, "Could not create shared memory %s (error %lu)\n", mName.c_str(), GetLastError());
+		return false;
+	}
+	memory = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, totalBytes);
+	if (!memory) {
+		fprintf(stderr, "Could not map shared memory %s (error %lu)\n", mName.c_str(), GetLastError());
+		CloseHandle(mapping);
+		return false;
+	}
+	mMapping = mapping;
+#else
+	int fd = shm_open(mName.c_str(), O_CREAT | O_RDWR, 0600);
+	if (fd < 0) {
+		perror(("Could not create shared memory " + mName).c_str());
+		return false;
+	}
+	if (ftruncate(fd, (off_t) totalBytes) != 0 ||
+		(memory = mmap(0, totalBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		perror(("Could not map shared memory " + mName).c_str());
+		::close(fd);
+		shm_unlink(mName.c_str());
+		return false;
+	}
+	::close(fd);
+	mMapping = (void *) totalBytes;	// munmap needs the length
+#endif
+
+	mHeader = new (memory) SharedSceneHeader;
+	memset(mHeader->magic, 0, sizeof(mHeader->magic));
+	mHeader->version = kSharedSceneVersion;
+	mHeader->headerBytes = (unsigned int) headerBytes;
+	mHeader->ringBytes = ringBytes;
+	mHeader->reserved.store(0, std::memory_order_relaxed);
+	mHeader->published.store(0, std::memory_order_relaxed);
+	mHeader->lastFrame.store(0, std::memory_order_relaxed);
+	mRing = (unsigned char *) memory + headerBytes;
+	mPosition = 0;
+	mFrameStart = 0;
+
+	// Readers check the magic first, so it goes in last.
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(mHeader->magic, kSharedSceneMagic, sizeof(kSharedSceneMagic));
+	return true;
+}
+
+void SharedSceneWriter::close()
+{
+	if (!mHeader)
+		return;
+
+#if defined(WIN32)
+	UnmapViewOfFile(mHeader);
+	CloseHandle((HANDLE) mMapping);
+#else
+	munmap(mHeader, (size_t) mMapping);
+	shm_unlink(mName.c_str());
+#endif
+	mMapping = 0;
+	mHeader = 0;
+	mRing = 0;
+}
+
+bool SharedSceneWriter::isOpen() const
+{
+	return mHeader != 0;
+}
+
+void SharedSceneWriter::beginFrame(unsigned long long frame, int objectCount, int deviceCount)
+{
+	mFrameStart = mPosition;
+	mFrame = frame;
+
+	SharedFrame record;
+	record.objectCount = objectCount;
+	record.deviceCount = deviceCount;
+	append(SHARED_FRAME, &record, sizeof(record), 0, 0);
+}
+
+void SharedSceneWriter::writeMatrix(SharedRecordType type, int index, double const matrix[16])
+{
+	SharedMatrix record;
+	record.index = index;
+	record.reserved = 0;
+	memcpy(record.matrix, matrix, sizeof(record.matrix));
+	append(type, &record, sizeof(record), 0, 0);
+}
+
+void SharedSceneWriter::writeSpan(SharedRecordType type, int object, int first, int count, int total,
+	void const *elements, size_t elementBytes)
+{
+	size_t maxRecord = mHeader->ringBytes / 16;
+	int chunk = (int) ((maxRecord - sizeof(SharedRecord) - sizeof(SharedSpan)) / elementBytes);
+	if (chunk < 1)
+		return;
+
+	unsigned char const *bytes = (unsigned char const *) elements;
+	for (int done = 0; done < count; done += chunk) {
+		SharedSpan span;
+		span.object = object;
+		span.first = first + done;
+		span.count = count - done < chunk ? count - done : chunk;
+		span.total = total;
+		append(type, &span, sizeof(span), bytes + done * elementBytes, span.count * elementBytes);
+	}
+}
+
+void SharedSceneWriter::endFrame()
+{
+	mHeader->published.store(mPosition, std::memory_order_release);
+	mHeader->lastFrame.store(mFrameStart, std::memory_order_release);
+}
+
+unsigned long long SharedSceneWriter::getBytesWritten() const
+{
+	return mPosition;
+}
+
+void SharedSceneWriter::append(unsigned int type, void const *head, size_t headBytes, void const *body, size_t bodyBytes)
+{
+	unsigned long long ringBytes = mHeader->ringBytes;
+	size_t bytes = roundUp16(sizeof(SharedRecord) + headBytes + bodyBytes);
+
+	// Records never wrap: pad out the end of the ring instead. Every
+	// record is a multiple of 16 bytes, so there is always room for the
+	// padding record's header.
+	size_t offset = (size_t) (mPosition % ringBytes);
+	if (ringBytes - offset < bytes) {
+		size_t rest = (size_t) (ringBytes - offset);
+		append(SHARED_PADDING, 0, 0, 0, rest - sizeof(SharedRecord));
+		offset = 0;
+	}
+
+	// Claim the bytes before overwriting them; readers check the claim
+	// after copying.
+	mHeader->reserved.store(mPosition + bytes, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	SharedRecord record;
+	record.type = type;
+	record.bytes = (unsigned int) (headBytes + bodyBytes);
+	record.frame = mFrame;
+	unsigned char *out = mRing + offset;
+	memcpy(out, &record, sizeof(record));
+	if (headBytes)
+		memcpy(out + sizeof(record), head, headBytes);
+	if (body)
+		memcpy(out + sizeof(record) + headBytes, body, bodyBytes);
+	mPosition += bytes;
+}
+
+/*******************************************************************************
+ SharedSceneReader
+*******************************************************************************/
+
+SharedSceneReader::SharedSceneReader() :
+mMapping(0),
+mMappedBytes(0),
+mHeader(0),
+mRing(0),
+mPosition(0)
+{
+}
+
+SharedSceneReader::~SharedSceneReader()
+{
+	close();
+}
+
+bool SharedSceneReader::open(const char *name)
+{
+	close();
+	std::string segment = segmentName(name);
+
+	void const *memory = 0;
+#if defined(WIN32)
+	HANDLE mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, segment.c_str());
+	if (!mapping) {
+		fprintf(stderr, "No shared scene %s (error %lu)\n", segment.c_str(), GetLastError());
+		return false;
+	}
+	memory = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!memory) {
+		fprintf(stderr, "Could not map shared scene %s (error %lu)\n", segment.c_str(), GetLastError());
+		CloseHandle(mapping);
+		return false;
+	}
+	MEMORY_BASIC_INFORMATION info;
+	VirtualQuery(memory, &info, sizeof(info));
+	mMapping = mapping;
+	mMappedBytes = info.RegionSize;
+#else
+	int fd = shm_open(segment.c_str(), O_RDONLY, 0);
+	if (fd < 0) {
+		perror(("No shared scene " + segment).c_str());
+		return false;
+	}
+	struct stat status;
+	if (fstat(fd, &status) != 0 ||
+		(memory = mmap(0, (size_t) status.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		perror(("Could not map shared scene " + segment).c_str());
+		::close(fd);
+		return false;
+	}
+	::close(fd);
+	mMappedBytes = (size_t) status.st_size;
+#endif
+
+	mHeader = (SharedSceneHeader const *) memory;
+	bool valid = mMappedBytes >= sizeof(SharedSceneHeader) &&
+		memcmp(mHeader->magic, kSharedSceneMagic, sizeof(kSharedSceneMagic)) == 0;
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (!valid || mHeader->version != kSharedSceneVersion ||
+		mHeader->headerBytes + mHeader->ringBytes > mMappedBytes) {
+		fprintf(stderr, "Shared scene %s has an unknown layout\n", segment.c_str());
+		close();
+		return false;
+	}
+
+	mRing = (unsigned char const *) memory + mHeader->headerBytes;
+	mPosition = mHeader->lastFrame.load(std::memory_order_acquire);
+	return true;
+}
+
+void SharedSceneReader::close()
+{
+	if (!mHeader)
+		return;
+
+#if defined(WIN32)
+	UnmapViewOfFile(mHeader);
+	CloseHandle((HANDLE) mMapping);
+#else
+	munmap((void *) mHeader, mMappedBytes);
+#endif
+	mMapping = 0;
+	mHeader = 0;
+	mRing = 0;
+}
+
+bool SharedSceneReader::isOpen() const
+{
+	return mHeader != 0;
+}
+
+SharedSceneReader::Result SharedSceneReader::next(SharedRecord &record, std::vector<unsigned char> &payload)
+{
+	if (!mHeader)
+		return READ_NONE;
+
+	unsigned long long ringBytes = mHeader->ringBytes;
+	for (;;) {
+		unsigned long long published = mHeader->published.load(std::memory_order_acquire);
+		if (mPosition >= published)
+			return READ_NONE;
+
+		size_t offset = (size_t) (mPosition % ringBytes);
+		bool intact = published - mPosition <= ringBytes;
+		if (intact) {
+			memcpy(&record, mRing + offset, sizeof(record));
+
+			// A torn header can hold any size; only copy what fits.
+			intact = record.bytes <= ringBytes - offset - sizeof(record);
+			if (intact) {
+				payload.resize(record.bytes);
+				if (record.bytes)
+					memcpy(&payload[0], mRing + offset + sizeof(record), record.bytes);
+			}
+
+			// Still ours if the writer has not claimed anything a whole ring
+			// past where the record starts.
+			std::atomic_thread_fence(std::memory_order_acquire);
+			intact = intact && mHeader->reserved.load(std::memory_order_relaxed) <= mPosition + ringBytes;
+		}
+
+		if (!intact) {
+			mPosition = mHeader->lastFrame.load(std::memory_order_acquire);
+			return READ_SKIPPED;
+		}
+
+		mPosition += roundUp16(sizeof(record) + record.bytes);
+		if (record.type != SHARED_PADDING)
+			return READ_RECORD;
+	}
+}
@@ -0,0 +1,149 @@
+#ifndef SHAREDSCENE_H
+#define SHAREDSCENE_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+//! Layout of the shared scene segment. Bump on any change to the structs
+//! below; readers refuse other versions.
+const unsigned int kSharedSceneVersion = 1;
+
+enum SharedRecordType {
+	SHARED_FRAME = 1,	// SharedFrame; starts a frame
+	SHARED_TRANSFORM,	// SharedMatrix, world transform of an object
+	SHARED_PROXY,	// SharedMatrix, proxy transform of a device
+	SHARED_VERTICES,	// SharedSpan, then 3 floats per vertex
+	SHARED_TRIANGLES,	// SharedSpan, then 3 indices per triangle
+	SHARED_PADDING	// fills the end of the ring before a wrap
+};
+
+//! Start of the segment. The atomics are lock-free on every platform we
+//! build for, so they work across processes.
+struct SharedSceneHeader {
+	char magic[8];	// "TVOSHM1"
+	unsigned int version;
+	unsigned int headerBytes;
+	unsigned long long ringBytes;
+	std::atomic<unsigned long long> reserved;	// end of the record being written
+	std::atomic<unsigned long long> published;	// end of the last complete frame
+	std::atomic<unsigned long long> lastFrame;	// start of the last complete frame
+};
+
+//! Every record starts with this and is padded to a multiple of 16 bytes.
+struct SharedRecord {
+	unsigned int type;
+	unsigned int bytes;	// payload bytes, without padding
+	unsigned long long frame;
+};
+
+struct SharedFrame {
+	int objectCount;
+	int deviceCount;
+};
+
+struct SharedMatrix {
+	int index;
+	int reserved;
+	double matrix[16];	// column-major, as OpenGL
+};
+
+//! Elements [first, first + count) of an object's vertex or triangle array,
+//! which now has total elements.
+struct SharedSpan {
+	int object;
+	int first;
+	int count;
+	int total;
+};
+
+	//! Producer side of a shared scene segment.
+	//!
+	//! Records are appended to a byte ring in named shared memory and become
+	//! visible to readers a frame at a time. The writer never looks at the
+	//! readers, so any number of them cost it nothing; a reader that falls a
+	//! whole ring behind skips ahead to the latest frame.
+	class SharedSceneWriter {
+	public:
+		//! Constructor
+		//!
+		SharedSceneWriter();
+
+		//! Destructor. Removes the segment.
+		//!
+		~SharedSceneWriter();
+
+		//! Creates the segment name with a ring of ringBytes, rounded up to
+		//! a multiple of 16. Returns false and prints why on failure.
+		bool create(const char *name, size_t ringBytes);
+		void close();
+		bool isOpen() const;
+
+		void beginFrame(unsigned long long frame, int objectCount, int deviceCount);
+		void writeMatrix(SharedRecordType type, int index, double const matrix[16]);
+
+		//! Writes count elements of elementBytes each, split into records
+		//! of at most a sixteenth of the ring.
+		void writeSpan(SharedRecordType type, int object, int first, int count, int total,
+			void const *elements, size_t elementBytes);
+
+		//! Makes the records since beginFrame() visible to readers.
+		void endFrame();
+
+		//! Bytes written since create(), padding included.
+		unsigned long long getBytesWritten() const;
+
+	private:
+		SharedSceneWriter(const SharedSceneWriter &);
+		SharedSceneWriter &operator=(const SharedSceneWriter &);
+
+		void append(unsigned int type, void const *head, size_t headBytes, void const *body, size_t bodyBytes);
+
+		std::string mName;
+		void *mMapping;	// platform handle, if any
+		SharedSceneHeader *mHeader;
+		unsigned char *mRing;
+		unsigned long long mPosition;
+		unsigned long long mFrameStart;
+		unsigned long long mFrame;
+	};
+
+	//! Consumer side of a shared scene segment. Never waits for the writer:
+	//! each record is copied out and then checked against the writer's
+	//! reservation, like a SeqLock read that gives up instead of retrying.
+	class SharedSceneReader {
+	public:
+		enum Result {
+			READ_NONE,	// nothing new yet
+			READ_RECORD,	// record and payload filled in
+			READ_SKIPPED	// fell behind; continuing from the latest frame
+		};
+
+		//! Constructor
+		//!
+		SharedSceneReader();
+
+		//! Destructor
+		//!
+		~SharedSceneReader();
+
+		//! Maps an existing segment and starts at its latest frame. Returns
+		//! false and prints why if it is missing or has another layout.
+		bool open(const char *name);
+		void close();
+		bool isOpen() const;
+
+		Result next(SharedRecord &record, std::vector<unsigned char> &payload);
+
+	private:
+		SharedSceneReader(const SharedSceneReader &);
+		SharedSceneReader &operator=(const SharedSceneReader &);
+
+		void *mMapping;
+		size_t mMappedBytes;
+		SharedSceneHeader const *mHeader;
+		unsigned char const *mRing;
+		unsigned long long mPosition;
+	};
+
+#endif
@@ -0,0 +1,151 @@
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <unordered_map>
+#include "smoothing.h"
+
+// Taubin's lambda and mu for a pass-band of about 0.1.
+static const float kLambda = 0.5f;
+static const float kMu = -0.53f;
+
+// Smaller moves are not written back.
+static const float kMinMove2 = 1e-14f;
+
+SmoothingBrush::SmoothingBrush() :
+mRegionCount(0),
+mPass(0)
+{
+}
+
+void SmoothingBrush::gather(OBJLoader const &loader, int root, float radius)
+{
+	mVertices.clear();
+	mWeights.clear();
+	mNeighborStart.clear();
+	mNeighbors.clear();
+	mRegionCount = 0;
+	mPass = 0;
+	if (root < 0 || root >= loader.getVertices().size() || radius <= 0.0f) {
+		load(loader);
+		return;
+	}
+
+	// Dijkstra over edge lengths from root, stopping at radius.
+	std::vector<glm::vec3> const &vertices = loader.getVertices();
+	std::unordered_map<int, int> local;
+	std::vector<float> distances;
+	typedef std::pair<float, int> Entry;
+	std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > queue;
+	std::unordered_map<int, float> best;
+	queue.push(Entry(0.0f, root));
+	best[root] = 0.0f;
+	while (!queue.empty()) {
+		Entry entry = queue.top();
+		queue.pop();
+		int v = entry.second;
+		if (entry.first > best[v] || local.count(v))
+			continue;
+		local[v] = mVertices.size();
+		mVertices.push_back(v);
+		distances.push_back(entry.first);
+
+		std::set<int> const &neighbors = loader.getNeighbors(v);
+		for (std::set<int>::const_iterator n = neighbors.begin(); n != neighbors.end(); n++) {
+			float d = entry.first + glm::distance(vertices[v], vertices[*n]);
+			if (d > radius || local.count(*n))
+				continue;
+			std::unordered_map<int, float>::iterator found = best.find(*n);
+			if (found == best.end() || d < found->second) {
+				best[*n] = d;
+				queue.push(Entry(d, *n));
+			}
+		}
+	}
+	mRegionCount = mVertices.size();
+
+	// Smooth falloff to zero at the rim.
+	for (int i = 0; i < mRegionCount; i++) {
+		float t = distances[i] / radius;
+		float w = 1.0f - t * t;
+		mWeights.push_back(w * w);
+	}
+
+	// Neighbor lists, adding the ring outside the disc as fixed vertices.
+	for (int i = 0; i < mRegionCount; i++) {
+		mNeighborStart.push_back(mNeighbors.size());
+		std::set<int> const &neighbors = loader.getNeighbors(mVertices[i]);
+		for (std::set<int>::const_iterator n = neighbors.begin(); n != neighbors.end(); n++) {
+			std::unordered_map<int, int>::iterator found = local.find(*n);
+			int index;
+			if (found == local.end()) {
+				index = mVertices.size();
+				local[*n] = index;
+				mVertices.push_back(*n);
+			} else {
+				index = found->second;
+			}
+			mNeighbors.push_back(index);
+		}
+	}
+	mNeighborStart.push_back(mNeighbors.size());
+
+	load(loader);
+}
+
+void SmoothingBrush::load(OBJLoader const &loader)
+{
+	std::vector<glm::vec3> const &vertices = loader.getVertices();
+	mLoaded.resize(mVertices.size());
+	for (int i = 0; i < mVertices.size(); i++)
+		mLoaded[i] = vertices[mVertices[i]];
+	mPositions = mLoaded;
+	mScratch.resize(mRegionCount);
+}
+
+void SmoothingBrush::iterate(Mode mode, float strength, int iterations)
+{
+	for (int pass = 0; pass < iterations; pass++, mPass++) {
+		float factor = strength * ((mode == TAUBIN && (mPass & 1)) ? kMu : kLambda);
+
+		// Every new position comes from the old ones only.
+		for (int i = 0; i < mRegionCount; i++) {
+			int start = mNeighborStart[i], end = mNeighborStart[i + 1];
+			if (start == end) {
+				mScratch[i] = mPositions[i];
+				continue;
+			}
+			glm::vec3 sum(0.0f, 0.0f, 0.0f);
+			for (int k = start; k < end; k++)
+				sum += mPositions[mNeighbors[k]];
+			glm::vec3 laplacian = sum / (float) (end - start) - mPositions[i];
+			mScratch[i] = mPositions[i] + laplacian * (factor * mWeights[i]);
+		}
+		std::copy(mScratch.begin(), mScratch.end(), mPositions.begin());
+	}
+}
+
+void SmoothingBrush::apply(OBJLoader &loader, std::vector<int> &moved)
+{
+	for (int i = 0; i < mRegionCount; i++) {
+		glm::vec3 delta = mPositions[i] - mLoaded[i];
+		if (glm::dot(delta, delta) < kMinMove2)
+			continue;
+
+		// Read through the loader each time: the first deformPoint on a
+		// shared mesh swaps in a private copy of its vertices.
+		int v = mVertices[i];
+		loader.deformPoint(v, loader.getVertices()[v] + delta);
+		moved.push_back(v);
+	}
+	mLoaded = mPositions;
+}
+
+bool SmoothingBrush::isEmpty() const
+{
+	return mRegionCount == 0;
+}
+
+int SmoothingBrush::getVertexCount() const
+{
+	return mRegionCount;
+}
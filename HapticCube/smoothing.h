@@ -0,0 +1,66 @@
+#ifndef SMOOTHING_H
+#define SMOOTHING_H
+
+#include <vector>
+#include "objloader.h"
+
+	//! Smoothing brush over a geodesic disc of a mesh.
+	//!
+	//! gather() copies the disc, the ring of vertices around it and a flat
+	//! neighbor list out of the mesh adjacency. iterate() smooths that copy
+	//! Jacobi-style without touching the mesh, so it may run with the mesh
+	//! unlocked, and apply() adds the change to the mesh. The ring around the
+	//! disc stays put, and weights fall off towards it, so a stroke blends
+	//! into the surface around it.
+	class SmoothingBrush {
+	public:
+		enum Mode {
+			LAPLACIAN,	// umbrella operator; shrinks as it smooths
+			TAUBIN	// alternating shrink and inflate steps (Taubin 1995)
+		};
+
+		//! Constructor
+		//!
+		SmoothingBrush();
+
+		//! Gathers the vertices within radius of root, measured along mesh
+		//! edges. Call with the mesh locked.
+		void gather(OBJLoader const &loader, int root, float radius);
+
+		//! Re-reads the positions of the gathered vertices. Call with the
+		//! mesh locked.
+		void load(OBJLoader const &loader);
+
+		//! Runs iterations smoothing steps on the copy; strength in (0, 1]
+		//! scales each step.
+		void iterate(Mode mode, float strength, int iterations);
+
+		//! Adds the change since the last gather() or load() to the mesh,
+		//! which may have moved in between, and appends the vertices it
+		//! moved to moved. Call with the mesh locked.
+		void apply(OBJLoader &loader, std::vector<int> &moved);
+
+		bool isEmpty() const;
+
+		//! Vertices of the disc, without the ring around it.
+		int getVertexCount() const;
+
+	private:
+		SmoothingBrush(const SmoothingBrush &);
+		SmoothingBrush &operator=(const SmoothingBrush &);
+
+		// Local vertex i is mesh vertex mVertices[i]. The first
+		// mRegionCount are the disc; the rest are the ring around it.
+		std::vector<int> mVertices;
+		int mRegionCount;
+		std::vector<float> mWeights;	// per disc vertex
+		std::vector<int> mNeighborStart;	// disc vertex i: mNeighbors[start[i]..start[i+1])
+		std::vector<int> mNeighbors;	// local indices
+
+		std::vector<glm::vec3> mLoaded;
+		std::vector<glm::vec3> mPositions;
+		std::vector<glm::vec3> mScratch;
+		unsigned int mPass;
+	};
+
+#endif
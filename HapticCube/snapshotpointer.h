@@ -0,0 +1,138 @@
+#ifndef SNAPSHOTPOINTER_H
+#define SNAPSHOTPOINTER_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+//! Grace periods for readers of SnapshotPointers that take no locks
+//! (quiescent-state-based reclamation).
+//!
+//! Each reading thread has a slot and calls quiescent() at points where it
+//! holds no snapshot, such as the start of each of its jobs. A snapshot
+//! replaced at epoch e is freed once every slot in use has reported e or
+//! later. Reporting is one load and one store, which makes it safe to call
+//! from the servo thread.
+class QuiescentDomain {
+public:
+	static const int kMaxReaders = 16;
+
+	QuiescentDomain() : mEpoch(1)
+	{
+		for (int i = 0; i < kMaxReaders; i++)
+			mReaders[i].store(0, std::memory_order_relaxed);
+	}
+
+	//! Takes a reader slot, or returns -1 when all are in use. Until its
+	//! first quiescent() the reader counts as holding the snapshots current
+	//! now.
+	int addReader()
+	{
+		unsigned int epoch = mEpoch.load(std::memory_order_acquire);
+		if (epoch == 0)
+			epoch = ~0u;
+		for (int i = 0; i < kMaxReaders; i++) {
+			unsigned int idle = 0;
+			if (mReaders[i].compare_exchange_strong(idle, epoch))
+				return i;
+		}
+		return -1;
+	}
+
+	//! Gives the slot back. The reader must hold no snapshot.
+	void removeReader(int reader)
+	{
+		if (reader >= 0)
+			mReaders[reader].store(0, std::memory_order_release);
+	}
+
+	//! Reports that the reader holds no snapshot.
+	void quiescent(int reader)
+	{
+		if (reader < 0)
+			return;
+		unsigned int epoch = mEpoch.load(std::memory_order_acquire);
+		mReaders[reader].store(epoch != 0 ? epoch : ~0u, std::memory_order_release);
+	}
+
+	//! Starts a new epoch after a snapshot was replaced, and returns it.
+	unsigned int advance()
+	{
+		return mEpoch.fetch_add(1) + 1;
+	}
+
+	//! True once every reader has been quiescent since epoch began.
+	bool hasPassed(unsigned int epoch) const
+	{
+		for (int i = 0; i < kMaxReaders; i++) {
+			unsigned int seen = mReaders[i].load(std::memory_order_acquire);
+			if (seen != 0 && (int) (seen - epoch) < 0)
+				return false;
+		}
+		return true;
+	}
+
+private:
+	QuiescentDomain(const QuiescentDomain &);
+	QuiescentDomain &operator=(const QuiescentDomain &);
+
+	std::atomic<unsigned int> mEpoch;	// compared modulo 2^32
+	// Epoch last reported by each reader; 0 marks a free slot, so a
+	// reader that sees the epoch wrap to 0 reports the one before it.
+	std::atomic<unsigned int> mReaders[kMaxReaders];
+};
+
+//! Immutable value published by one thread to readers in a QuiescentDomain.
+//!
+//! read() is a single acquire load, so readers never wait and never touch a
+//! reference count. Replaced values are kept by the writer until the domain
+//! says no reader can still hold them, and are freed on the writer's thread.
+template <typename T>
+class SnapshotPointer {
+public:
+	explicit SnapshotPointer(QuiescentDomain &domain) : mDomain(domain), mPointer(0) {}
+
+	//! Replaces the current value, and frees the replaced values no reader
+	//! can still hold. Only one thread may publish.
+	void publish(std::shared_ptr<const T> const &value)
+	{
+		mPointer.store(value.get(), std::memory_order_release);
+		if (mCurrent) {
+			Retired retired;
+			retired.value = mCurrent;
+			retired.epoch = mDomain.advance();
+			mRetired.push_back(retired);
+		}
+		mCurrent = value;
+
+		int kept = 0;
+		for (int i = 0; i < mRetired.size(); i++) {
+			if (!mDomain.hasPassed(mRetired[i].epoch))
+				mRetired[kept++] = mRetired[i];
+		}
+		mRetired.resize(kept);
+	}
+
+	//! The current value, on the publishing thread.
+	std::shared_ptr<const T> const &get() const { return mCurrent; }
+
+	//! The current value, on a reader. Valid until the reader's next
+	//! QuiescentDomain::quiescent().
+	const T *read() const { return mPointer.load(std::memory_order_acquire); }
+
+private:
+	SnapshotPointer(const SnapshotPointer &);
+	SnapshotPointer &operator=(const SnapshotPointer &);
+
+	struct Retired {
+		std::shared_ptr<const T> value;
+		unsigned int epoch;
+	};
+
+	QuiescentDomain &mDomain;
+	std::atomic<const T *> mPointer;
+	std::shared_ptr<const T> mCurrent;
+	std::vector<Retired> mRetired;
+};
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+
+//! Wait-free single-producer, single-consumer ring of trivially copyable
+//! values.
+//!
+//! push() and pop() each touch one slot and one index, never block and
+//! never allocate, which makes the consumer side safe to drain from the
+//! servo thread. Capacity must be a power of two; one slot is kept free to
+//! tell a full ring from an empty one.
+template <typename T, unsigned int Capacity>
+class SpscQueue {
+public:
+	SpscQueue() : mHead(0), mTail(0) {}
+
+	//! Appends value. Returns false, dropping it, when the ring is full.
+	//! Only one thread may push.
+	bool push(const T &value)
+	{
+		unsigned int tail = mTail.load(std::memory_order_relaxed);
+		unsigned int next = (tail + 1) & (Capacity - 1);
+		if (next == mHead.load(std::memory_order_acquire))
+			return false;
+		mSlots[tail] = value;
+		mTail.store(next, std::memory_order_release);
+		return true;
+	}
+
+	//! Takes the oldest value. Returns false when the ring is empty. Only
+	//! one thread may pop.
+	bool pop(T &value)
+	{
+		unsigned int head = mHead.load(std::memory_order_relaxed);
+		if (head == mTail.load(std::memory_order_acquire))
+			return false;
+		value = mSlots[head];
+		mHead.store((head + 1) & (Capacity - 1), std::memory_order_release);
+		return true;
+	}
+
+private:
+	SpscQueue(const SpscQueue &);
+	SpscQueue &operator=(const SpscQueue &);
+
+	static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+	// Padding keeps the producer and consumer indices off one cache line.
+	std::atomic<unsigned int> mHead;
+	char mPad[64];
+	std::atomic<unsigned int> mTail;
+	T mSlots[Capacity];
+};
+
+#endif
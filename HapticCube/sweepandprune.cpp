@@ -0,0 +1,56 @@
+#include "sweepandprune.h"
+
+SweepAndPrune::SweepAndPrune()
+{
+}
+
+void SweepAndPrune::update(std::vector<Box> const &boxes)
+{
+	mBoxes = boxes;
+	mPairs.clear();
+
+	if (mOrder.size() != mBoxes.size()) {
+		mOrder.resize(mBoxes.size());
+		for (int i = 0; i < mOrder.size(); i++)
+			mOrder[i] = i;
+	}
+
+	// Insertion sort keeps last frame's order as the starting point.
+	for (int i = 1; i < mOrder.size(); i++) {
+		int index = mOrder[i];
+		float key = mBoxes[index].min.x;
+		int j = i - 1;
+		while (j >= 0 && mBoxes[mOrder[j]].min.x > key) {
+			mOrder[j + 1] = mOrder[j];
+			j--;
+		}
+		mOrder[j + 1] = index;
+	}
+
+	for (int i = 0; i < mOrder.size(); i++) {
+		Box const &a = mBoxes[mOrder[i]];
+		if (a.min.x > a.max.x)
+			continue;
+
+		for (int j = i + 1; j < mOrder.size(); j++) {
+			Box const &b = mBoxes[mOrder[j]];
+			if (b.min.x > a.max.x)
+				break;
+			if (b.min.x > b.max.x)
+				continue;
+
+			if (a.min.y <= b.max.y && b.min.y <= a.max.y &&
+				a.min.z <= b.max.z && b.min.z <= a.max.z) {
+				int first = mOrder[i], second = mOrder[j];
+				if (first > second)
+					std::swap(first, second);
+				mPairs.push_back(std::make_pair(first, second));
+			}
+		}
+	}
+}
+
+std::vector<std::pair<int, int> > const &SweepAndPrune::getPairs() const
+{
+	return mPairs;
+}
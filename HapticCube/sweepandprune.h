@@ -0,0 +1,38 @@
+#ifndef SWEEPANDPRUNE_H
+#define SWEEPANDPRUNE_H
+
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+
+	//! Broad phase that finds overlapping pairs among world-space boxes.
+	//!
+	//! Boxes are kept sorted by their lower x bound between calls. Objects
+	//! move little from one frame to the next, so the insertion sort that
+	//! restores the order runs in close to linear time, and the sweep only
+	//! compares boxes whose x intervals overlap.
+	class SweepAndPrune {
+	public:
+		struct Box {
+			glm::vec3 min;
+			glm::vec3 max;
+		};
+
+		//! Constructor
+		//!
+		SweepAndPrune();
+
+		//! Replaces the boxes, where box i belongs to object i, and collects
+		//! the overlapping pairs. An empty box (min > max) overlaps nothing.
+		void update(std::vector<Box> const &boxes);
+
+		//! Overlapping pairs from the last update, each with first < second.
+		std::vector<std::pair<int, int> > const &getPairs() const;
+
+	private:
+		std::vector<Box> mBoxes;
+		std::vector<int> mOrder;
+		std::vector<std::pair<int, int> > mPairs;
+	};
+
+#endif
@@ -0,0 +1,108 @@
+#include <algorithm>
+#include <atomic>
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(int numThreads) :
+mActive(0),
+mStopping(false)
+{
+	if (numThreads <= 0)
+		numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+	for (int i = 0; i < numThreads; i++)
+		mThreads.push_back(std::thread(&ThreadPool::run, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStopping = true;
+	}
+	mTaskReady.notify_all();
+
+	for (int i = 0; i < mThreads.size(); i++)
+		mThreads[i].join();
+}
+
+void ThreadPool::submit(std::function<void()> const &task)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mTasks.push_back(task);
+	}
+	mTaskReady.notify_one();
+}
+
+void ThreadPool::wait()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	while (!mTasks.empty() || mActive > 0)
+		mAllDone.wait(lock);
+}
+
+void ThreadPool::parallelFor(int begin, int end, std::function<void(int)> const &body)
+{
+	if (end <= begin)
+		return;
+
+	// A few chunks per thread keeps the load balanced without paying the
+	// queue cost for every index.
+	int count = end - begin;
+	int chunks = std::min(count, (int)mThreads.size() * 4);
+	int chunkSize = (count + chunks - 1) / chunks;
+
+	std::mutex doneMutex;
+	std::condition_variable doneSignal;
+	int remaining = 0;
+
+	for (int start = begin; start < end; start += chunkSize) {
+		int stop = std::min(end, start + chunkSize);
+		{
+			std::lock_guard<std::mutex> lock(doneMutex);
+			remaining++;
+		}
+		submit([&, start, stop]() {
+			for (int i = start; i < stop; i++)
+				body(i);
+
+			std::lock_guard<std::mutex> lock(doneMutex);
+			if (--remaining == 0)
+				doneSignal.notify_one();
+		});
+	}
+
+	std::unique_lock<std::mutex> lock(doneMutex);
+	while (remaining > 0)
+		doneSignal.wait(lock);
+}
+
+int ThreadPool::getNumThreads() const
+{
+	return mThreads.size();
+}
+
+void ThreadPool::run()
+{
+	for (;;) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			while (mTasks.empty() && !mStopping)
+				mTaskReady.wait(lock);
+			if (mTasks.empty())
+				return;
+
+			task = mTasks.front();
+			mTasks.pop_front();
+			mActive++;
+		}
+
+		task();
+
+		std::lock_guard<std::mutex> lock(mMutex);
+		mActive--;
+		if (mTasks.empty() && mActive == 0)
+			mAllDone.notify_all();
+	}
+}
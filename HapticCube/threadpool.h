@@ -0,0 +1,49 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+	//! Fixed set of worker threads consuming a FIFO of tasks.
+	class ThreadPool {
+	public:
+		//! Constructor. numThreads <= 0 uses one thread per hardware core.
+		//!
+		explicit ThreadPool(int numThreads = 0);
+
+		//! Destructor. Finishes queued tasks, then joins the workers.
+		//!
+		~ThreadPool();
+
+		void submit(std::function<void()> const &task);
+
+		//! Blocks until every submitted task has finished.
+		void wait();
+
+		//! Runs body(i) for i in [begin, end) split into chunks across the
+		//! pool, and returns once all of them are done. Must not be called
+		//! from inside a pool task.
+		void parallelFor(int begin, int end, std::function<void(int)> const &body);
+
+		int getNumThreads() const;
+
+	private:
+		ThreadPool(const ThreadPool &);
+		ThreadPool &operator=(const ThreadPool &);
+
+		void run();
+
+		std::vector<std::thread> mThreads;
+		std::deque<std::function<void()> > mTasks;
+		std::mutex mMutex;
+		std::condition_variable mTaskReady;
+		std::condition_variable mAllDone;
+		int mActive;
+		bool mStopping;
+	};
+
+#endif
@@ -0,0 +1,319 @@
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+#include "toolcontact.h"
+
+// Thinning passes grow the spacing by this much until the points fit.
+static const float kSpacingGrowth = 1.2f;
+
+static glm::vec3 transformPoint(double const m[16], glm::vec3 const &p)
+{
+	return glm::vec3(
+		(float) (m[0] * p.x + m[4] * p.y + m[8] * p.z + m[12]),
+		(float) (m[1] * p.x + m[5] * p.y + m[9] * p.z + m[13]),
+		(float) (m[2] * p.x + m[6] * p.y + m[10] * p.z + m[14]));
+}
+
+static glm::vec3 transformDirection(double const m[16], glm::vec3 const &d)
+{
+	return glm::vec3(
+		(float) (m[0] * d.x + m[4] * d.y + m[8] * d.z),
+		(float) (m[1] * d.x + m[5] * d.y + m[9] * d.z),
+		(float) (m[2] * d.x + m[6] * d.y + m[10] * d.z));
+}
+
+static double matrixScale(double const m[16])
+{
+	return sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+}
+
+/*******************************************************************************
+ PointShell
+*******************************************************************************/
+
+PointShell::PointShell() :
+mCenter(0, 0, 0),
+mRadius(0.0f)
+{
+}
+
+void PointShell::build(OBJLoader const &loader, int maxPoints, int clusterPoints)
+{
+	mPoints.clear();
+	mClusters.clear();
+	mCenter = glm::vec3(0, 0, 0);
+	mRadius = 0.0f;
+
+	std::vector<glm::vec3> const &vertices = loader.getVertices();
+	std::vector<glm::vec3> const &normals = loader.getNormals();
+	std::vector<Triangle> const &triangles = loader.getTriangles();
+	if (triangles.empty() || maxPoints < 1)
+		return;
+
+	float area = 0.0f;
+	for (int t = 0; t < triangles.size(); t++) {
+		glm::vec3 a = vertices[triangles[t].vert[0]], b = vertices[triangles[t].vert[1]], c = vertices[triangles[t].vert[2]];
+		area += 0.5f * glm::length(glm::cross(b - a, c - a));
+	}
+	if (area <= 0.0f)
+		return;
+
+	// Each point stands for about spacing^2 of surface. Sample every
+	// triangle more densely than that, at the centroids of a regular split
+	// into n^2 parts, then thin the samples to one per grid cell.
+	float spacing = sqrt(area / maxPoints);
+	std::vector<Point> samples;
+	for (int t = 0; t < triangles.size(); t++) {
+		Triangle const &tri = triangles[t];
+		glm::vec3 a = vertices[tri.vert[0]], b = vertices[tri.vert[1]], c = vertices[tri.vert[2]];
+		glm::vec3 na = normals[tri.vert[0]], nb = normals[tri.vert[1]], nc = normals[tri.vert[2]];
+		glm::vec3 face = glm::cross(b - a, c - a);
+		float longest = glm::max(glm::length(b - a), glm::max(glm::length(c - b), glm::length(a - c)));
+		int n = glm::max(1, (int) ceil(2.0f * longest / spacing));
+
+		for (int i = 0; i < n; i++) {
+			for (int j = 0; i + j < n; j++) {
+				for (int flip = 0; flip < 2; flip++) {
+					if (flip && i + j == n - 1)
+						continue;
+					float offset = flip ? 2.0f / 3.0f : 1.0f / 3.0f;
+					float u = (i + offset) / n, v = (j + offset) / n, w = 1.0f - u - v;
+
+					Point point;
+					point.position = a * w + b * u + c * v;
+					point.normal = na * w + nb * u + nc * v;
+					if (glm::dot(point.normal, point.normal) < 1e-12f)
+						point.normal = face;
+					if (glm::dot(point.normal, point.normal) < 1e-12f)
+						continue;
+					point.normal = glm::normalize(point.normal);
+					samples.push_back(point);
+				}
+			}
+		}
+	}
+
+	glm::vec3 min = samples[0].position, max = samples[0].position;
+	for (int i = 1; i < samples.size(); i++) {
+		min = glm::min(min, samples[i].position);
+		max = glm::max(max, samples[i].position);
+	}
+
+	for (;;) {
+		std::unordered_map<long long, int> cells;
+		mPoints.clear();
+		for (int i = 0; i < samples.size(); i++) {
+			glm::vec3 g = (samples[i].position - min) / spacing;
+			long long key = ((long long) g.z << 42) | ((long long) g.y << 21) | (long long) g.x;
+			if (cells.insert(std::make_pair(key, (int) mPoints.size())).second)
+				mPoints.push_back(samples[i]);
+		}
+		if (mPoints.size() <= maxPoints)
+			break;
+		spacing *= kSpacingGrowth;
+	}
+
+	mCenter = (min + max) * 0.5f;
+	for (int i = 0; i < mPoints.size(); i++)
+		mRadius = glm::max(mRadius, glm::distance(mPoints[i].position, mCenter));
+
+	split(0, mPoints.size(), glm::max(1, clusterPoints));
+}
+
+// Median split along the longest side until the pieces are small enough.
+void PointShell::split(int first, int count, int clusterPoints)
+{
+	glm::vec3 min = mPoints[first].position, max = mPoints[first].position;
+	for (int i = first + 1; i < first + count; i++) {
+		min = glm::min(min, mPoints[i].position);
+		max = glm::max(max, mPoints[i].position);
+	}
+
+	if (count <= clusterPoints) {
+		Cluster cluster;
+		cluster.center = (min + max) * 0.5f;
+		cluster.radius = 0.0f;
+		cluster.first = first;
+		cluster.count = count;
+		for (int i = first; i < first + count; i++)
+			cluster.radius = glm::max(cluster.radius, glm::distance(mPoints[i].position, cluster.center));
+		mClusters.push_back(cluster);
+		return;
+	}
+
+	glm::vec3 extent = max - min;
+	int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+	int half = count / 2;
+	std::nth_element(mPoints.begin() + first, mPoints.begin() + first + half, mPoints.begin() + first + count,
+		[axis](Point const &a, Point const &b) { return a.position[axis] < b.position[axis]; });
+	split(first, half, clusterPoints);
+	split(first + half, count - half, clusterPoints);
+}
+
+bool PointShell::isEmpty() const
+{
+	return mPoints.empty();
+}
+
+std::vector<PointShell::Point> const &PointShell::getPoints() const
+{
+	return mPoints;
+}
+
+std::vector<PointShell::Cluster> const &PointShell::getClusters() const
+{
+	return mClusters;
+}
+
+glm::vec3 PointShell::getCenter() const
+{
+	return mCenter;
+}
+
+float PointShell::getRadius() const
+{
+	return mRadius;
+}
+
+size_t PointShell::getMemoryBytes() const
+{
+	return vectorBytes(mPoints) + vectorBytes(mClusters);
+}
+
+/*******************************************************************************
+ ToolContactScene
+*******************************************************************************/
+
+void ToolContactScene::addObject(int id, std::shared_ptr<const DistanceField::Grid> const &grid, double const modelToWorld[16],
+	double const worldToModel[16])
+{
+	Object object;
+	object.id = id;
+	object.voxmap = grid;
+	for (int k = 0; k < 16; k++) {
+		object.modelToWorld[k] = modelToWorld[k];
+		object.worldToModel[k] = worldToModel[k];
+	}
+	object.scale = matrixScale(modelToWorld);
+
+	float size = DistanceField::kBrickCells * grid->voxelSize;
+	glm::vec3 extent((float) grid->dims[0], (float) grid->dims[1], (float) grid->dims[2]);
+	extent *= size;
+	object.center = transformPoint(modelToWorld, grid->origin + extent * 0.5f);
+	object.radius = (float) (0.5 * glm::length(extent) * object.scale);
+	objects.push_back(object);
+}
+
+/*******************************************************************************
+ ToolContact
+*******************************************************************************/
+
+ToolContact::ToolContact() :
+mShell(0),
+mNextCluster(0)
+{
+}
+
+void ToolContact::setShell(const PointShell *shell)
+{
+	mShell = shell;
+	ClusterContact none;
+	none.force = glm::vec3(0, 0, 0);
+	none.torque = glm::vec3(0, 0, 0);
+	none.contacts = 0;
+	mClusterContacts.assign(shell ? shell->getClusters().size() : 0, none);
+	mNextCluster = 0;
+}
+
+const PointShell *ToolContact::getShell() const
+{
+	return mShell;
+}
+
+void ToolContact::evaluate(ToolContactScene const &scene, double const toolToWorld[16], int budget, Result &result)
+{
+	result.force = glm::vec3(0, 0, 0);
+	result.torque = glm::vec3(0, 0, 0);
+	result.contacts = 0;
+	result.queries = 0;
+	if (!mShell || mShell->isEmpty())
+		return;
+
+	std::vector<PointShell::Point> const &points = mShell->getPoints();
+	std::vector<PointShell::Cluster> const &clusters = mShell->getClusters();
+	float toolScale = (float) matrixScale(toolToWorld);
+	glm::vec3 origin((float) toolToWorld[12], (float) toolToWorld[13], (float) toolToWorld[14]);
+
+	// Objects the tool could reach at all. Sphere tests cost no queries.
+	glm::vec3 shellCenter = transformPoint(toolToWorld, mShell->getCenter());
+	float shellRadius = mShell->getRadius() * toolScale;
+	mCandidates.clear();
+	for (int o = 0; o < scene.objects.size(); o++) {
+		ToolContactScene::Object const &object = scene.objects[o];
+		if (glm::distance(shellCenter, object.center) < object.radius + shellRadius)
+			mCandidates.push_back(o);
+	}
+
+	int queries = 0;
+	int visited = 0;
+	for (; visited < clusters.size(); visited++) {
+		int c = (mNextCluster + visited) % clusters.size();
+		PointShell::Cluster const &cluster = clusters[c];
+
+		// Stop before a cluster that could overrun the budget, but always
+		// make progress.
+		int worstCase = (int) mCandidates.size() * (1 + cluster.count);
+		if (visited > 0 && queries + worstCase > budget)
+			break;
+
+		ClusterContact &contact = mClusterContacts[c];
+		contact.force = glm::vec3(0, 0, 0);
+		contact.torque = glm::vec3(0, 0, 0);
+		contact.contacts = 0;
+
+		glm::vec3 center = transformPoint(toolToWorld, cluster.center);
+		float radius = cluster.radius * toolScale;
+		for (int i = 0; i < mCandidates.size(); i++) {
+			ToolContactScene::Object const &object = scene.objects[mCandidates[i]];
+			if (glm::distance(center, object.center) > object.radius + radius)
+				continue;
+
+			// Coarse test: distance grows no faster than the distance moved,
+			// so no point of the cluster is inside if its center is further
+			// than its radius from the surface.
+			queries++;
+			if (object.voxmap->distance(transformPoint(object.worldToModel, center), 0) * object.scale > radius)
+				continue;
+
+			for (int p = cluster.first; p < cluster.first + cluster.count; p++) {
+				glm::vec3 world = transformPoint(toolToWorld, points[p].position);
+				glm::vec3 gradient;
+				float depth = -object.voxmap->distance(transformPoint(object.worldToModel, world), &gradient);
+				queries++;
+
+				// Past the band the gradient is zero and there is no normal.
+				if (depth <= 0.0f || glm::dot(gradient, gradient) < 0.25f)
+					continue;
+
+				// Only surfaces facing the tool push on it, so that the tool
+				// is never pulled through to the back of a thin shell.
+				glm::vec3 normal = glm::normalize(transformDirection(object.modelToWorld, gradient));
+				if (glm::dot(transformDirection(toolToWorld, points[p].normal), normal) > 0.0f)
+					continue;
+
+				glm::vec3 force = normal * (float) (depth * object.scale);
+				contact.force += force;
+				contact.torque += glm::cross(world - origin, force);
+				contact.contacts++;
+			}
+		}
+	}
+	mNextCluster = (mNextCluster + visited) % clusters.size();
+
+	for (int c = 0; c < mClusterContacts.size(); c++) {
+		result.force += mClusterContacts[c].force;
+		result.torque += mClusterContacts[c].torque;
+		result.contacts += mClusterContacts[c].contacts;
+	}
+	result.queries = queries;
+}
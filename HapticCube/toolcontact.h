@@ -0,0 +1,125 @@
+#ifndef TOOLCONTACT_H
+#define TOOLCONTACT_H
+
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+#include "distancefield.h"
+#include "objloader.h"
+
+	//! Points spread evenly over the surface of a rigid tool mesh, for
+	//! voxmap-pointshell contact (McNeely et al., "Six Degree-of-Freedom
+	//! Haptic Rendering Using Voxel Sampling", SIGGRAPH 1999).
+	//!
+	//! The points are grouped into small spatial clusters, each with a
+	//! bounding sphere, so that a whole cluster can be ruled out with one
+	//! query. Immutable once built.
+	class PointShell {
+	public:
+		struct Point {
+			glm::vec3 position;
+			glm::vec3 normal;	// outward
+		};
+
+		struct Cluster {
+			glm::vec3 center;
+			float radius;
+			int first;	// into getPoints()
+			int count;
+		};
+
+		//! Constructor
+		//!
+		PointShell();
+
+		//! Samples the surface of loader with at most maxPoints points, in
+		//! clusters of at most clusterPoints, in the mesh's model space.
+		void build(OBJLoader const &loader, int maxPoints, int clusterPoints);
+
+		bool isEmpty() const;
+		std::vector<Point> const &getPoints() const;
+		std::vector<Cluster> const &getClusters() const;
+
+		//! Bounding sphere of all the points.
+		glm::vec3 getCenter() const;
+		float getRadius() const;
+		size_t getMemoryBytes() const;
+
+	private:
+		void split(int first, int count, int clusterPoints);
+
+		std::vector<Point> mPoints;
+		std::vector<Cluster> mClusters;
+		glm::vec3 mCenter;
+		float mRadius;
+	};
+
+//! The scene as the servo thread sees it: every object's voxmap and world
+//! placement. Matrices are column-major, as OpenGL, and are assumed to scale
+//! uniformly. Immutable once published.
+struct ToolContactScene {
+	struct Object {
+		int id;	// the caller's
+		std::shared_ptr<const DistanceField::Grid> voxmap;
+		double modelToWorld[16];
+		double worldToModel[16];
+		double scale;	// world units per model unit
+		glm::vec3 center;	// bounding sphere of the voxmap, world space
+		float radius;
+	};
+	std::vector<Object> objects;
+
+	//! Adds object id, whose voxmap is grid, placed by modelToWorld.
+	void addObject(int id, std::shared_ptr<const DistanceField::Grid> const &grid, double const modelToWorld[16],
+		double const worldToModel[16]);
+};
+
+	//! Servo-rate contact between a point shell and the voxmaps of a scene.
+	//!
+	//! The voxmaps are the objects' narrow-band distance fields: bricks are
+	//! the coarse level and their samples the fine one, so every query takes
+	//! constant time whatever the triangle count. Each evaluate() spends at
+	//! most a fixed number of queries. Clusters it does not get to keep the
+	//! contribution they had when last visited, and the next call starts
+	//! where this one stopped.
+	//!
+	//! Belongs to one thread; the shell and scene may be shared.
+	class ToolContact {
+	public:
+		//! Penetration of the tool, in world units: force is the sum over
+		//! penetrating points of depth times the surface normal, and torque
+		//! the moment of those about the tool's origin.
+		struct Result {
+			glm::vec3 force;
+			glm::vec3 torque;
+			int contacts;
+			int queries;
+		};
+
+		//! Constructor
+		//!
+		ToolContact();
+
+		//! The shell must outlive its use; the servo keeps it alive
+		//! through a SnapshotPointer.
+		void setShell(const PointShell *shell);
+		const PointShell *getShell() const;
+
+		//! Evaluates the tool placed at toolToWorld against scene, spending
+		//! no more than budget voxmap queries.
+		void evaluate(ToolContactScene const &scene, double const toolToWorld[16], int budget, Result &result);
+
+	private:
+		struct ClusterContact {
+			glm::vec3 force;
+			glm::vec3 torque;
+			int contacts;
+		};
+
+		const PointShell *mShell;
+		std::vector<ClusterContact> mClusterContacts;
+		std::vector<int> mCandidates;
+		int mNextCluster;
+	};
+
+#endif
@@ -0,0 +1,136 @@
+#include "trace.h"
+
+#if defined(TVO_TRACE)
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+namespace {
+
+const int kTraceBufferSize = 1 << 16;
+
+enum TraceEventType { TRACE_EVENT_ZONE, TRACE_EVENT_COUNTER };
+
+struct TraceEvent {
+	const char *name;
+	unsigned long long begin;
+	unsigned long long end;
+	double value;
+	int type;
+};
+
+// Written only by its owning thread. count is published with release order
+// so the exporter sees complete events.
+struct TraceBuffer {
+	TraceBuffer(int id) : threadId(id), threadName(0), count(0), events(kTraceBufferSize) {}
+
+	int threadId;
+	const char *threadName;
+	std::atomic<unsigned long long> count;
+	std::vector<TraceEvent> events;
+};
+
+std::mutex gTraceBuffersMutex;
+std::vector<TraceBuffer *> gTraceBuffers;
+const std::chrono::steady_clock::time_point gTraceEpoch = std::chrono::steady_clock::now();
+
+unsigned long long traceNow()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - gTraceEpoch).count();
+}
+
+// Only the first event on a thread registers its buffer under the lock.
+TraceBuffer *threadBuffer()
+{
+	static thread_local TraceBuffer *buffer = 0;
+	if (!buffer) {
+		std::lock_guard<std::mutex> lock(gTraceBuffersMutex);
+		buffer = new TraceBuffer((int)gTraceBuffers.size() + 1);
+		gTraceBuffers.push_back(buffer);
+	}
+	return buffer;
+}
+
+void record(const char *name, unsigned long long begin, unsigned long long end, double value, int type)
+{
+	TraceBuffer *buffer = threadBuffer();
+	unsigned long long index = buffer->count.load(std::memory_order_relaxed);
+
+	TraceEvent &event = buffer->events[index % kTraceBufferSize];
+	event.name = name;
+	event.begin = begin;
+	event.end = end;
+	event.value = value;
+	event.type = type;
+
+	buffer->count.store(index + 1, std::memory_order_release);
+}
+
+}
+
+TraceZone::TraceZone(const char *name) :
+mName(name),
+mBegin(traceNow())
+{
+}
+
+TraceZone::~TraceZone()
+{
+	record(mName, mBegin, traceNow(), 0.0, TRACE_EVENT_ZONE);
+}
+
+void traceSetThreadName(const char *name)
+{
+	threadBuffer()->threadName = name;
+}
+
+void traceCounter(const char *name, double value)
+{
+	unsigned long long now = traceNow();
+	record(name, now, now, value, TRACE_EVENT_COUNTER);
+}
+
+bool traceWriteJson(const char *filename)
+{
+	FILE *file = fopen(filename, "w");
+	if (!file) {
+		fprintf(stderr, "Could not open %s\n", filename);
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(gTraceBuffersMutex);
+
+	fprintf(file, "{\"traceEvents\":[\n");
+	bool first = true;
+	for (int b = 0; b < gTraceBuffers.size(); b++) {
+		TraceBuffer *buffer = gTraceBuffers[b];
+
+		if (buffer->threadName) {
+			fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+				first ? "" : ",\n", buffer->threadId, buffer->threadName);
+			first = false;
+		}
+
+		// Once a buffer has wrapped only its newest kTraceBufferSize events remain.
+		unsigned long long count = buffer->count.load(std::memory_order_acquire);
+		unsigned long long begin = count > kTraceBufferSize ? count - kTraceBufferSize : 0;
+		for (unsigned long long i = begin; i < count; i++) {
+			const TraceEvent &event = buffer->events[i % kTraceBufferSize];
+			if (event.type == TRACE_EVENT_ZONE) {
+				fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+					first ? "" : ",\n", event.name, buffer->threadId, event.begin * 1e-3, (event.end - event.begin) * 1e-3);
+			} else {
+				fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"args\":{\"value\":%g}}",
+					first ? "" : ",\n", event.name, buffer->threadId, event.begin * 1e-3, event.value);
+			}
+			first = false;
+		}
+	}
+	fprintf(file, "\n]}\n");
+	fclose(file);
+	return true;
+}
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Timeline tracing for the GLUT client, HL collision, HD servo and
+// deformation threads. Define TVO_TRACE in the project's preprocessor
+// definitions to enable it; otherwise every macro below compiles to nothing.
+//
+// Each thread appends to its own fixed-size ring buffer, so recording never
+// takes a lock after the thread's first event. traceWriteJson exports all
+// buffers in the Chrome trace event format, which chrome://tracing and
+// Perfetto both open.
+
+#include <mutex>
+
+#if defined(TVO_TRACE)
+
+	//! Records a complete event covering the lifetime of the object.
+	class TraceZone {
+	public:
+		explicit TraceZone(const char *name);
+		~TraceZone();
+
+	private:
+		const char *mName;
+		unsigned long long mBegin;
+	};
+
+void traceSetThreadName(const char *name);
+void traceCounter(const char *name, double value);
+bool traceWriteJson(const char *filename);
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+
+//! Times the enclosing scope. name must be a string literal.
+#define TRACE_ZONE(name) TraceZone TRACE_CONCAT(traceZone, __LINE__)(name)
+#define TRACE_COUNTER(name, value) traceCounter(name, value)
+#define TRACE_THREAD_NAME(name) traceSetThreadName(name)
+#define TRACE_WRITE(filename) traceWriteJson(filename)
+
+//! Locks mutex m for the enclosing scope and records how long the wait took.
+#define TRACE_LOCK_GUARD(var, m) \
+	std::unique_lock<std::mutex> var(m, std::defer_lock); \
+	{ TRACE_ZONE("wait " #m); var.lock(); }
+
+#else
+
+#define TRACE_ZONE(name) ((void)0)
+#define TRACE_COUNTER(name, value) ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+#define TRACE_WRITE(filename) ((void)0)
+#define TRACE_LOCK_GUARD(var, m) std::lock_guard<std::mutex> var(m)
+
+#endif
+
+#endif
@@ -0,0 +1,391 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#if defined(WIN32)
+#include <direct.h>
+#endif
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../HapticCube/deformation.h"
+#include "../HapticCube/memoryusage.h"
+#include "../HapticCube/objloader.h"
+#include "../HapticCube/threadpool.h"
+
+using namespace std;
+
+/* Offline counterpart of the stylus edits in TangibleVirtualObject.  Loads
+   each input mesh with OBJLoader, replays a script of anchored drags on it
+   with the same ring falloff and DeformationBatch solve the deformation
+   worker uses, and writes the result to the output directory under the
+   same relative path, so that files of one name in different folders do
+   not overwrite each other.  Built with OBJLOADER_NO_GL, so it needs neither GLUT nor
+   OpenHaptics.
+
+   Files are processed on a thread pool, one mesh per task.  A file is only
+   started once the meshes in flight fit in "--memory-budget <MB>" with its
+   own estimate, so that a long list runs in bounded memory whatever the
+   number of cores. */
+
+/* One scripted drag:
+     drag <x> <y> <z> <dx> <dy> <dz> [slices [ticks]]
+   grabs the vertex nearest to (x, y, z) and pulls it by (dx, dy, dz) for
+   ticks servo ticks, over a region slices rings wide.  Coordinates are in
+   the unitized model space of OBJLoader, as in the application; results
+   are written back in the units and placement of their source.  Drags are
+   applied in order, each starting from the result of the previous one. */
+struct Drag
+{
+	vec3 anchor;
+	vec3 offset;
+	int slices;
+	int ticks;
+};
+
+/* Admits work while the bytes reserved by it stay within a limit.  A
+   reservation larger than the whole limit is still admitted once nothing
+   else is in flight, so that every file runs eventually. */
+class MemoryBudget
+{
+public:
+	explicit MemoryBudget(size_t limit) : mLimit(limit), mReserved(0) {}
+
+	void acquire(size_t bytes)
+	{
+		unique_lock<mutex> lock(mMutex);
+		while (mReserved > 0 && mReserved + bytes > mLimit)
+			mReleased.wait(lock);
+		mReserved += bytes;
+	}
+
+	void release(size_t bytes)
+	{
+		{
+			lock_guard<mutex> lock(mMutex);
+			mReserved -= bytes;
+		}
+		mReleased.notify_all();
+	}
+
+private:
+	mutex mMutex;
+	condition_variable mReleased;
+	size_t mLimit;
+	size_t mReserved;
+};
+
+struct BatchResult
+{
+	int vertices;
+	int triangles;
+	size_t meshBytes;
+	double seconds;
+	bool ok;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+// Servo ticks per solve, as at the deformation worker's default 200 Hz.
+const double kTicksPerSolve = 5.0;
+const int kDefaultSlices = 8;
+const int kDefaultTicks = 1000;
+const int kMaxSlices = 12;
+
+// Heap bytes per byte of OBJ text, measured on the bundled meshes with
+// adjacency and a private copy of the deformed positions.
+const size_t kBytesPerFileByte = 12;
+
+bool readScript(const char *filename, vector<Drag> &drags);
+bool readList(const char *filename, vector<string> &files);
+size_t estimateBytes(string const &filename);
+string outputPath(string const &directory, string const &filename);
+bool makeDirectories(string const &path);
+int findNearestPoint(vec3 const &point, vector<vec3> const &vertices);
+BatchResult processFile(string const &input, string const &output, vector<Drag> const &drags);
+void printUsage();
+
+/*******************************************************************************
+ meshbatch [options] <file.obj>...   applies the edit script to each file
+
+ --script <file>         drags to apply (default none: the meshes are only
+                         rewritten)
+ --list <file>           reads further input files, one per line
+ --out <directory>       where results are written (default "."), each under
+                         the path of its input with any drive, leading
+                         separator, "." and ".." left out
+ --jobs <n>              worker threads (default one per core)
+ --memory-budget <MB>    bound on the meshes in flight (default 1024)
+*******************************************************************************/
+int main(int argc, char *argv[])
+{
+	const char *scriptFile = 0;
+	string outDir = ".";
+	int jobs = 0;
+	int budgetMB = 1024;
+	vector<string> inputs;
+
+	for (int i = 1; i < argc; i++){
+		bool hasValue = i + 1 < argc;
+		if (!strcmp(argv[i], "--script") && hasValue)
+			scriptFile = argv[++i];
+		else if (!strcmp(argv[i], "--list") && hasValue){
+			if (!readList(argv[++i], inputs))
+				return 1;
+		}
+		else if (!strcmp(argv[i], "--out") && hasValue)
+			outDir = argv[++i];
+		else if (!strcmp(argv[i], "--jobs") && hasValue)
+			jobs = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--memory-budget") && hasValue)
+			budgetMB = atoi(argv[++i]);
+		else if (argv[i][0] == '-'){
+			printUsage();
+			return 1;
+		}
+		else
+			inputs.push_back(argv[i]);
+	}
+	if (inputs.empty() || budgetMB <= 0){
+		printUsage();
+		return 1;
+	}
+
+	vector<Drag> drags;
+	if (scriptFile && !readScript(scriptFile, drags))
+		return 1;
+
+	// Inputs that map to one output, such as "a/../m.obj" and "m.obj",
+	// would overwrite each other, possibly at the same time.
+	vector<string> outputs(inputs.size());
+	map<string, int> written;
+	for (int i = 0; i < inputs.size(); i++){
+		outputs[i] = outputPath(outDir, inputs[i]);
+		if (!written.insert(make_pair(outputs[i], i)).second){
+			fprintf(stderr, "%s and %s would both be written to %s\n", inputs[written[outputs[i]]].c_str(),
+				inputs[i].c_str(), outputs[i].c_str());
+			return 1;
+		}
+	}
+
+	ThreadPool pool(jobs);
+	MemoryBudget budget((size_t) budgetMB << 20);
+	vector<BatchResult> results(inputs.size());
+	mutex printMutex;
+	printf("%d files, %d drags each, %d threads, %d MB budget\n", (int) inputs.size(), (int) drags.size(),
+		pool.getNumThreads(), budgetMB);
+
+	Clock::time_point start = Clock::now();
+	for (int i = 0; i < inputs.size(); i++){
+		// Blocks here, rather than queueing every file at once, until the
+		// meshes in flight leave room for this one.
+		size_t reserved = estimateBytes(inputs[i]);
+		budget.acquire(reserved);
+
+		pool.submit([&, i, reserved]() {
+			BatchResult &result = results[i];
+			result = processFile(inputs[i], outputs[i], drags);
+			budget.release(reserved);
+
+			lock_guard<mutex> lock(printMutex);
+			if (result.ok)
+				printf("%s: %d vertices, %d triangles, %.1f MB, %.2f s\n", inputs[i].c_str(), result.vertices,
+					result.triangles, result.meshBytes / 1048576.0, result.seconds);
+			else
+				fprintf(stderr, "%s: failed\n", inputs[i].c_str());
+		});
+	}
+	pool.wait();
+
+	int failed = 0;
+	for (int i = 0; i < results.size(); i++){
+		if (!results[i].ok)
+			failed++;
+	}
+	AllocatorStats heap = getAllocatorStats();
+	printf("%d of %d files written in %.1f s, peak heap %.1f MB\n", (int) inputs.size() - failed, (int) inputs.size(),
+		std::chrono::duration<double>(Clock::now() - start).count(), heap.peakBytes / 1048576.0);
+	return failed ? 1 : 0;
+}
+
+/*******************************************************************************
+ Loads input, applies drags in order and saves to output.  The loader's
+ asset cache is cleared of the file straight away, so the mesh is freed
+ when the task ends instead of staying for the rest of the batch.
+*******************************************************************************/
+BatchResult processFile(string const &input, string const &output, vector<Drag> const &drags)
+{
+	BatchResult result;
+	result.vertices = 0;
+	result.triangles = 0;
+	result.meshBytes = 0;
+	result.ok = false;
+	Clock::time_point start = Clock::now();
+
+	OBJLoader loader;
+	bool loaded = loader.load(input.c_str());
+	OBJLoader::evict(input);
+	if (!loaded || loader.getVertices().empty()){
+		result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		return result;
+	}
+
+	DeformationBatch batch;
+	for (int d = 0; d < drags.size(); d++){
+		Drag const &drag = drags[d];
+		DeformationSession session;
+		session.begin(&loader, findNearestPoint(drag.anchor, loader.getVertices()), drag.slices);
+		session.setNumSlices(drag.slices);
+		session.setTarget(loader.getVertices()[session.getRootIndex()] + drag.offset);
+
+		// Stepped as the worker would, since the region follows its root
+		// and one closed-form solve over all ticks would overshoot.
+		vector<DeformationSession *> sessions(1, &session);
+		for (double ticks = drag.ticks; ticks > 0.0; ticks -= kTicksPerSolve)
+			batch.solve(sessions, (std::min)(ticks, kTicksPerSolve));
+		batch.invalidate();
+	}
+
+	MemoryUsage usage;
+	set<const void *> counted;
+	loader.addMemoryUsage(usage, counted);
+	result.meshBytes = usage.total();
+	result.vertices = loader.getVertices().size();
+	result.triangles = loader.getTriangles().size();
+	result.ok = makeDirectories(output) && loader.save(output.c_str());
+	result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	return result;
+}
+
+bool readScript(const char *filename, vector<Drag> &drags)
+{
+	ifstream file(filename);
+	if (!file.is_open()){
+		fprintf(stderr, "Could not open script %s\n", filename);
+		return false;
+	}
+
+	string line;
+	for (int number = 1; getline(file, line); number++){
+		istringstream words(line);
+		string command;
+		if (!(words >> command) || command[0] == '#')
+			continue;
+
+		Drag drag;
+		drag.slices = kDefaultSlices;
+		drag.ticks = kDefaultTicks;
+		if (command != "drag" ||
+			!(words >> drag.anchor.x >> drag.anchor.y >> drag.anchor.z >> drag.offset.x >> drag.offset.y >> drag.offset.z)){
+			fprintf(stderr, "%s:%d: expected \"drag x y z dx dy dz [slices [ticks]]\"\n", filename, number);
+			return false;
+		}
+		if (words >> drag.slices)
+			words >> drag.ticks;
+		if (drag.slices < 1 || drag.slices > kMaxSlices || drag.ticks < 0){
+			fprintf(stderr, "%s:%d: slices must be 1 to %d and ticks not negative\n", filename, number, kMaxSlices);
+			return false;
+		}
+		drags.push_back(drag);
+	}
+	return true;
+}
+
+bool readList(const char *filename, vector<string> &files)
+{
+	ifstream file(filename);
+	if (!file.is_open()){
+		fprintf(stderr, "Could not open list %s\n", filename);
+		return false;
+	}
+
+	string line;
+	while (getline(file, line)){
+		size_t end = line.find_last_not_of(" \t\r");
+		if (end != string::npos)
+			files.push_back(line.substr(0, end + 1));
+	}
+	return true;
+}
+
+size_t estimateBytes(string const &filename)
+{
+	ifstream file(filename.c_str(), ios::binary | ios::ate);
+	streamoff size = file.is_open() ? (streamoff) file.tellg() : 0;
+	return (size_t) (std::max)(size, (streamoff) 0) * kBytesPerFileByte;
+}
+
+string outputPath(string const &directory, string const &filename)
+{
+	string path = directory;
+	if (!path.empty() && path[path.size() - 1] != '/' && path[path.size() - 1] != '\\')
+		path += '/';
+
+	size_t begin = filename.size() > 1 && filename[1] == ':' ? 2 : 0;	// drive letter
+	while (begin < filename.size()){
+		size_t end = filename.find_first_of("/\\", begin);
+		if (end == string::npos)
+			end = filename.size();
+		string part = filename.substr(begin, end - begin);
+		if (!part.empty() && part != "." && part != ".."){
+			path += part;
+			if (end < filename.size())
+				path += '/';
+		}
+		begin = end + 1;
+	}
+	return path;
+}
+
+/*******************************************************************************
+ Creates the directories leading up to the file at path, as needed.  Tasks
+ may race to create the same one, which is fine: it only has to exist.
+*******************************************************************************/
+bool makeDirectories(string const &path)
+{
+	for (size_t slash = path.find_first_of("/\\", 1); slash != string::npos; slash = path.find_first_of("/\\", slash + 1)){
+		string directory = path.substr(0, slash);
+		if (directory.empty() || directory[directory.size() - 1] == ':')
+			continue;
+#if defined(WIN32)
+		_mkdir(directory.c_str());
+#else
+		mkdir(directory.c_str(), 0777);
+#endif
+	}
+
+	size_t slash = path.find_last_of("/\\");
+	if (slash == string::npos)
+		return true;
+	struct stat info;
+	if (stat(path.substr(0, slash).c_str(), &info) == 0 && (info.st_mode & S_IFDIR))
+		return true;
+	fprintf(stderr, "Could not create the directory of %s\n", path.c_str());
+	return false;
+}
+
+int findNearestPoint(vec3 const &point, vector<vec3> const &vertices)
+{
+	int closest = 0;
+	float minDistance = -1.0f;
+	for (int i = 0; i < vertices.size(); i++){
+		float distance = glm::distance(vertices[i], point);
+		if (minDistance < 0.0f || distance < minDistance){
+			minDistance = distance;
+			closest = i;
+		}
+	}
+	return closest;
+}
+
+void printUsage()
+{
+	fprintf(stderr, "usage: meshbatch [--script <file>] [--list <file>] [--out <directory>] [--jobs <n>]\n"
+		"                 [--memory-budget <MB>] <file.obj>...\n");
+}
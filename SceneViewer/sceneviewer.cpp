@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "../HapticCube/sharedscene.h"
+
+using namespace std;
+
+/* Sample consumer of the scene that TangibleVirtualObject publishes with
+   "--share <name>".  Maps the segment read-only and keeps a copy of every
+   object's transform, vertices and triangles and of every proxy, printing a
+   summary once a second.  The producer never knows it is there, so any
+   number of these can run at once. */
+
+struct ViewerObject
+{
+	double world[16];
+	vector<float> positions;	// three per vertex
+	vector<unsigned int> indices;	// three per triangle
+};
+
+struct ViewerScene
+{
+	unsigned long long frame;
+	vector<ViewerObject> objects;
+	vector<SharedMatrix> proxies;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+void applyRecord(ViewerScene &scene, SharedRecord const &record, vector<unsigned char> const &payload);
+void applySpan(vector<float> &elements, SharedSpan const &span, unsigned char const *data, int elementCount);
+void applySpan(vector<unsigned int> &elements, SharedSpan const &span, unsigned char const *data, int elementCount);
+ViewerObject &getObject(ViewerScene &scene, int index);
+void printSummary(ViewerScene const &scene, int records, unsigned long long bytes, int skips, double seconds);
+
+/*******************************************************************************
+ sceneviewer [name]    follows the shared scene name (default
+                       TangibleVirtualObject) until interrupted
+*******************************************************************************/
+int main(int argc, char *argv[])
+{
+	const char *name = argc > 1 ? argv[1] : "TangibleVirtualObject";
+
+	SharedSceneReader reader;
+	if (!reader.open(name))
+		return 1;
+
+	ViewerScene scene;
+	scene.frame = 0;
+
+	SharedRecord record;
+	vector<unsigned char> payload;
+	int records = 0, skips = 0;
+	unsigned long long bytes = 0;
+	Clock::time_point lastSummary = Clock::now();
+
+	for (;;){
+		SharedSceneReader::Result result;
+		while ((result = reader.next(record, payload)) != SharedSceneReader::READ_NONE){
+			if (result == SharedSceneReader::READ_SKIPPED){
+				skips++;
+				continue;
+			}
+			applyRecord(scene, record, payload);
+			records++;
+			bytes += sizeof(record) + payload.size();
+		}
+
+		double seconds = std::chrono::duration<double>(Clock::now() - lastSummary).count();
+		if (seconds >= 1.0){
+			printSummary(scene, records, bytes, skips, seconds);
+			records = skips = 0;
+			bytes = 0;
+			lastSummary = Clock::now();
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ Applies one record to the local copy.  Records are checked against their
+ declared sizes, since a newer producer may append fields.
+*******************************************************************************/
+void applyRecord(ViewerScene &scene, SharedRecord const &record, vector<unsigned char> const &payload){
+	scene.frame = record.frame;
+	unsigned char const *data = payload.empty() ? 0 : &payload[0];
+
+	switch (record.type){
+	case SHARED_FRAME:
+		if (payload.size() >= sizeof(SharedFrame)){
+			SharedFrame frame;
+			memcpy(&frame, data, sizeof(frame));
+			if (frame.objectCount >= 0 && frame.objectCount > (int) scene.objects.size())
+				scene.objects.resize(frame.objectCount);
+			if (frame.deviceCount >= 0 && frame.deviceCount > (int) scene.proxies.size())
+				scene.proxies.resize(frame.deviceCount);
+		}
+		break;
+	case SHARED_TRANSFORM:
+	case SHARED_PROXY:
+		if (payload.size() >= sizeof(SharedMatrix)){
+			SharedMatrix matrix;
+			memcpy(&matrix, data, sizeof(matrix));
+			if (matrix.index < 0)
+				break;
+			if (record.type == SHARED_TRANSFORM){
+				memcpy(getObject(scene, matrix.index).world, matrix.matrix, sizeof(matrix.matrix));
+			}else{
+				if (matrix.index >= (int) scene.proxies.size())
+					scene.proxies.resize(matrix.index + 1);
+				scene.proxies[matrix.index] = matrix;
+			}
+		}
+		break;
+	case SHARED_VERTICES:
+	case SHARED_TRIANGLES:
+		if (payload.size() >= sizeof(SharedSpan)){
+			SharedSpan span;
+			memcpy(&span, data, sizeof(span));
+			if (span.object < 0 || span.first < 0 || span.count < 0 || span.first + span.count > span.total ||
+				payload.size() < sizeof(SharedSpan) + 12 * (size_t) span.count)
+				break;
+			ViewerObject &object = getObject(scene, span.object);
+			if (record.type == SHARED_VERTICES)
+				applySpan(object.positions, span, data + sizeof(span), 3);
+			else
+				applySpan(object.indices, span, data + sizeof(span), 3);
+		}
+		break;
+	}
+}
+
+void applySpan(vector<float> &elements, SharedSpan const &span, unsigned char const *data, int elementCount){
+	elements.resize((size_t) span.total * elementCount);
+	if (span.count > 0)
+		memcpy(&elements[(size_t) span.first * elementCount], data, (size_t) span.count * elementCount * sizeof(float));
+}
+
+void applySpan(vector<unsigned int> &elements, SharedSpan const &span, unsigned char const *data, int elementCount){
+	elements.resize((size_t) span.total * elementCount);
+	if (span.count > 0)
+		memcpy(&elements[(size_t) span.first * elementCount], data, (size_t) span.count * elementCount * sizeof(unsigned int));
+}
+
+ViewerObject &getObject(ViewerScene &scene, int index){
+	if (index >= (int) scene.objects.size())
+		scene.objects.resize(index + 1);
+	return scene.objects[index];
+}
+
+/*******************************************************************************
+ One line for the stream and one per object and proxy.
+*******************************************************************************/
+void printSummary(ViewerScene const &scene, int records, unsigned long long bytes, int skips, double seconds){
+	printf("frame %llu: %.0f records/s, %.1f KB/s, %d skips\n",
+		scene.frame, records / seconds, bytes / 1024.0 / seconds, skips);
+
+	for (int i = 0; i < scene.objects.size(); i++){
+		ViewerObject const &object = scene.objects[i];
+		float min[3] = { 0, 0, 0 }, max[3] = { 0, 0, 0 };
+		for (size_t v = 0; v + 2 < object.positions.size(); v += 3){
+			for (int k = 0; k < 3; k++){
+				float x = object.positions[v + k];
+				if (v == 0 || x < min[k]) min[k] = x;
+				if (v == 0 || x > max[k]) max[k] = x;
+			}
+		}
+		printf("  object %d: %d vertices, %d triangles, at (%.3f %.3f %.3f), model bounds (%.3f %.3f %.3f)-(%.3f %.3f %.3f)\n",
+			i, (int) object.positions.size() / 3, (int) object.indices.size() / 3,
+			object.world[12], object.world[13], object.world[14], min[0], min[1], min[2], max[0], max[1], max[2]);
+	}
+	for (int i = 0; i < scene.proxies.size(); i++){
+		printf("  proxy %d: (%.3f %.3f %.3f)\n", i,
+			scene.proxies[i].matrix[12], scene.proxies[i].matrix[13], scene.proxies[i].matrix[14]);
+	}
+	fflush(stdout);
+}